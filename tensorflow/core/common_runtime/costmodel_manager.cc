@@ -14,6 +14,8 @@ limitations under the License.
 ==============================================================================*/
 
 #include "tensorflow/core/common_runtime/costmodel_manager.h"
+
+#include "absl/memory/memory.h"
 #include "tensorflow/core/lib/gtl/map_util.h"
 
 namespace tensorflow {
@@ -66,4 +68,41 @@ Status CostModelManager::AddToCostGraphDef(const Graph* graph,
   return Status::OK();
 }
 
+void CostModelManager::RecordTimeEstimates(const Graph* graph) {
+  mutex_lock l(mu_);
+  auto it = cost_models_.find(graph);
+  if (it == cost_models_.end()) {
+    return;
+  }
+  const CostModel* cost_model = it->second;
+  for (const Node* n : graph->op_nodes()) {
+    if (cost_model->TotalCount(n) > 0) {
+      time_estimates_[n->name()] = cost_model->TimeEstimate(n);
+    }
+  }
+}
+
+std::unique_ptr<CostModel> CostModelManager::NewCostModelFromTimeEstimates(
+    const Graph& graph) {
+  mutex_lock l(mu_);
+  if (time_estimates_.empty()) {
+    return nullptr;
+  }
+  auto cost_model = absl::make_unique<CostModel>(false);
+  cost_model->InitFromGraph(graph);
+  bool found = false;
+  for (const Node* n : graph.op_nodes()) {
+    auto estimate = time_estimates_.find(n->name());
+    if (estimate != time_estimates_.end()) {
+      cost_model->RecordCount(n, 1);
+      cost_model->RecordTime(n, estimate->second);
+      found = true;
+    }
+  }
+  if (!found) {
+    return nullptr;
+  }
+  return cost_model;
+}
+
 }  // namespace tensorflow
@@ -16,6 +16,7 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_COMMON_RUNTIME_COSTMODEL_MANAGER_H_
 #define TENSORFLOW_CORE_COMMON_RUNTIME_COSTMODEL_MANAGER_H_
 
+#include <memory>
 #include <unordered_map>
 
 #include "tensorflow/core/framework/cost_graph.pb.h"
@@ -45,9 +46,19 @@ class CostModelManager {
 
   Status AddToCostGraphDef(const Graph* graph, CostGraphDef* cost_graph);
 
+  // Remembers the time estimates of the executed nodes of `graph` by node
+  // name, so that they outlive the graph's cost model.
+  void RecordTimeEstimates(const Graph* graph);
+
+  // Returns a new cost model of `graph` holding the remembered time estimates
+  // of its nodes, or nullptr if none of its nodes has one. This lets graphs
+  // rebuilt from the same nodes start from earlier measurements.
+  std::unique_ptr<CostModel> NewCostModelFromTimeEstimates(const Graph& graph);
+
  private:
   mutex mu_;
   CostModelMap cost_models_ TF_GUARDED_BY(mu_);
+  std::unordered_map<string, Microseconds> time_estimates_ TF_GUARDED_BY(mu_);
 };
 
 }  // namespace tensorflow
@@ -49,6 +49,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/costmodel.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/graph_partition.h"
 #include "tensorflow/core/graph/subgraph.h"
@@ -790,6 +791,7 @@ Status DirectSession::RunInternal(
     for (const auto& item : executors_and_keys->items) {
       TF_RETURN_IF_ERROR(
           cost_model_manager_.AddToCostGraphDef(item.graph.get(), cost_graph));
+      cost_model_manager_.RecordTimeEstimates(item.graph.get());
     }
   }
 
@@ -1412,6 +1414,15 @@ Status DirectSession::CreateExecutors(
                                          device->name(),
                                          partition_graph.get()));
 
+    // Executors rebuilt for the same nodes, e.g. for another signature, start
+    // from the cost estimates measured by the earlier executors.
+    std::unique_ptr<CostModel> seed_cost_model;
+    if (options_.config.graph_options().build_cost_model() > 0) {
+      seed_cost_model =
+          cost_model_manager_.NewCostModelFromTimeEstimates(*partition_graph);
+      params.cost_model = seed_cost_model.get();
+    }
+
     item->executor = nullptr;
     item->device = device;
     auto executor_type = options_.config.experimental().executor_type();
@@ -800,6 +800,32 @@ TEST_F(DirectSessionMinusAXTest, UseRunHandlerPool) {
   EXPECT_FLOAT_EQ(5.0, mat(0, 0));
 }
 
+TEST_F(DirectSessionMinusAXTest, RebuiltExecutorsStartFromCostModel) {
+  Initialize({3, 2, -1, 0});
+  SessionOptions options = DefaultSessionOptions();
+  options.config.mutable_graph_options()->set_build_cost_model(1);
+  std::unique_ptr<Session> session(NewSession(options));
+  ASSERT_TRUE(session != nullptr);
+  TF_ASSERT_OK(session->Create(def_));
+  std::vector<std::pair<string, Tensor>> inputs;
+  std::vector<Tensor> outputs;
+  RunOptions run_options;
+  RunMetadata run_metadata;
+
+  // Measures the nodes that compute y.
+  TF_ASSERT_OK(session->Run(run_options, inputs, {y_ + ":0"}, {}, &outputs,
+                            &run_metadata));
+  EXPECT_GT(run_metadata.cost_graph().node_size(), 0);
+
+  // Fetching z needs new executors for the same nodes, which are seeded with
+  // the measurements of the first run.
+  TF_ASSERT_OK(session->Run(run_options, inputs, {z_ + ":0"}, {}, &outputs,
+                            &run_metadata));
+  ASSERT_EQ(1, outputs.size());
+  ASSERT_TRUE(outputs[0].IsInitialized());
+  EXPECT_FLOAT_EQ(-5.0, outputs[0].matrix<float>()(0, 0));
+}
+
 TEST(DirectSessionTest, KeepsStateAcrossRunsOfSession) {
   GraphDef def;
   Graph g(OpRegistry::Global());
@@ -25,10 +25,12 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/executor_factory.h"
 #include "tensorflow/core/common_runtime/graph_view.h"
 #include "tensorflow/core/common_runtime/immutable_executor_state.h"
+#include "tensorflow/core/common_runtime/ordered_propagator_state.h"
 #include "tensorflow/core/common_runtime/pending_counts.h"
 #include "tensorflow/core/common_runtime/propagator_state.h"
 #include "tensorflow/core/common_runtime/renamed_device.h"
 #include "tensorflow/core/common_runtime/simple_propagator_state.h"
+#include "tensorflow/core/common_runtime/step_arena.h"
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/allocator.h"
 #include "tensorflow/core/framework/cancellation.h"
@@ -43,6 +45,8 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor_reference.h"
 #include "tensorflow/core/framework/types.h"
 #include "tensorflow/core/framework/types.pb.h"
+#include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/costmodel.h"
 #include "tensorflow/core/graph/edgeset.h"
 #include "tensorflow/core/graph/graph.h"
 #include "tensorflow/core/graph/graph_node_util.h"
@@ -56,6 +60,7 @@ limitations under the License.
 #include "tensorflow/core/lib/hash/hash.h"
 #include "tensorflow/core/platform/context.h"
 #include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/macros.h"
@@ -69,6 +74,7 @@ limitations under the License.
 #include "tensorflow/core/profiler/lib/scoped_annotation.h"
 #include "tensorflow/core/profiler/lib/traceme_encode.h"
 #include "tensorflow/core/protobuf/error_codes.pb.h"
+#include "tensorflow/core/util/env_var.h"
 #include "tensorflow/core/util/tensor_slice_reader_cache.h"
 
 namespace tensorflow {
@@ -132,13 +138,41 @@ struct KernelTimer {
 typedef gtl::InlinedVector<TensorValue, 4> TensorValueVec;
 typedef gtl::InlinedVector<AllocatorAttributes, 4> AllocatorAttributeVec;
 
+// Returns true if an executor with the given params should serve the
+// allocations of its kernels from a per-step arena when it runs them inline.
+// The TF_EXECUTOR_USE_STEP_ARENA environment variable enables it for all
+// executors.
+bool UseStepArena(const LocalExecutorParams& params) {
+  static const bool use_step_arena_from_env = [] {
+    bool value;
+    Status s = ReadBoolFromEnvVar("TF_EXECUTOR_USE_STEP_ARENA", false, &value);
+    if (!s.ok()) LOG(ERROR) << s;
+    return value;
+  }();
+  return (params.use_step_arena || use_step_arena_from_env) &&
+         params.device->device_type() == DEVICE_CPU;
+}
+
 class ExecutorImpl : public Executor {
  public:
   explicit ExecutorImpl(const LocalExecutorParams& p) : immutable_state_(p) {}
 
   Status Initialize(const Graph& graph) {
     TF_RETURN_IF_ERROR(immutable_state_.Initialize(graph));
-    kernel_stats_.Initialize(immutable_state_.graph_view());
+    kernel_stats_.Initialize(immutable_state_.graph_view(), graph,
+                             immutable_state_.params().cost_model);
+    if (!immutable_state_.static_schedule().empty() &&
+        UseStepArena(immutable_state_.params())) {
+      std::vector<ArenaBuffer> lifetimes;
+      std::vector<bool> escapes;
+      ComputeStepArenaLifetimes(immutable_state_.static_schedule(),
+                                immutable_state_.graph_view().num_nodes(),
+                                &lifetimes, &escapes);
+      step_arena_planner_ = absl::make_unique<StepArenaPlanner>(
+          std::move(lifetimes), std::move(escapes),
+          immutable_state_.params().device->GetAllocator(
+              AllocatorAttributes()));
+    }
     return Status::OK();
   }
 
@@ -153,7 +187,11 @@ class ExecutorImpl : public Executor {
    public:
     KernelStats() = default;
 
-    void Initialize(const GraphView& gview) {
+    // If `cost_model` is not null, its time estimates for the nodes of
+    // `graph` replace the initial cost estimates of the kernels.
+    void Initialize(const GraphView& gview, const Graph& graph,
+                    const CostModel* cost_model) {
+      gview_ = &gview;
       is_expensive_ = absl::make_unique<std::atomic<bool>[]>(gview.num_nodes());
       cost_estimates_ =
           absl::make_unique<std::atomic_uint_fast64_t[]>(gview.num_nodes());
@@ -164,6 +202,42 @@ class ExecutorImpl : public Executor {
           cost_estimates_[i] = kInitialCostEstimateCycles;
         }
       }
+      if (cost_model != nullptr) {
+        const uint64 cycles_per_micro = std::max<uint64>(
+            1, static_cast<uint64>(
+                   profile_utils::CpuUtils::GetCycleCounterFrequency()) /
+                   EnvTime::kSecondsToMicros);
+        for (const Node* n : graph.op_nodes()) {
+          if (gview.node(n->id()) && cost_model->TotalCount(n) > 0) {
+            cost_estimates_[n->id()] =
+                cost_model->TimeEstimate(n).value() * cycles_per_micro;
+          }
+        }
+      }
+
+      // A post order visits the destinations of a node's out edges before the
+      // node itself, except along the back edges of loops, which are ignored
+      // by the critical paths.
+      std::vector<Node*> post_order;
+      GetPostOrder(graph, &post_order);
+      std::vector<int32> post_order_index(graph.num_node_ids(), -1);
+      for (const Node* n : post_order) {
+        if (!gview.node(n->id())) continue;
+        post_order_index[n->id()] = static_cast<int32>(post_order_.size());
+        PostOrderNode node;
+        node.id = n->id();
+        for (const Node* out : n->out_nodes()) {
+          if (post_order_index[out->id()] != -1) {
+            node.successors.push_back(out->id());
+          }
+        }
+        post_order_.push_back(std::move(node));
+      }
+      critical_path_cycles_ =
+          absl::make_unique<std::atomic<uint64>[]>(gview.num_nodes());
+      has_expensive_successor_ =
+          absl::make_unique<std::atomic<bool>[]>(gview.num_nodes());
+      RefreshCriticalPaths();
     }
 
     // Returns true iff the given node is considered "expensive". The
@@ -175,15 +249,48 @@ class ExecutorImpl : public Executor {
               kOpIsExpensiveThresholdCycles);
     }
 
+    // Returns true iff the kernel of the given node may be expensive, i.e.
+    // its cost estimate decides whether it is expensive.
+    bool MayBeExpensive(const NodeItem& node) const {
+      return is_expensive_[node.node_id].load(std::memory_order_relaxed);
+    }
+
+    // Returns true iff a successor of the given node was considered
+    // "expensive" as of the last refresh of the critical paths.
+    bool HasExpensiveSuccessor(const NodeItem& node) const {
+      return has_expensive_successor_[node.node_id].load(
+          std::memory_order_relaxed);
+    }
+
+    // Returns the estimated cost of the most expensive path from the given
+    // node to the end of the graph, as of the last refresh of the critical
+    // paths.
+    uint64 CriticalPathCycles(const NodeItem& node) const {
+      return critical_path_cycles_[node.node_id].load(
+          std::memory_order_relaxed);
+    }
+
+    // Called at the start of each step. Periodically recomputes the critical
+    // paths and the expensive successors from the current cost estimates.
+    // Returns true if the step should
+    // measure the execution time of inexpensive kernels as well, so that a
+    // kernel whose cost grows becomes expensive again.
+    bool StartStep() {
+      const uint64 step = num_steps_.fetch_add(1, std::memory_order_relaxed);
+      if (step > 0 && step % kCriticalPathRefreshPeriod == 0) {
+        RefreshCriticalPaths();
+      }
+      return step % kInexpensiveKernelSamplingPeriod == 0;
+    }
+
     // Updates the dynamic cost estimate, which is used to determine whether the
     // given node is expensive. The new cost estimate is a weighted average of
     // the old cost estimate and the latest cost.
     //
-    // NOTE: We currently only expect updates to the cost estimate when
-    // `is_expensive_[node.node_id]` is true (or at least, it *was* true, when
-    // we started to execute the kernel. As a result, we expect that a kernel
-    // can only ever transition from "expensive" to "inexpensive", but not vice
-    // versa.
+    // NOTE: The cost of a kernel is measured on every execution while it is
+    // expensive, and only on sampled steps while it is inexpensive, so a
+    // kernel can transition from "inexpensive" to "expensive", but it does so
+    // more slowly than in the other direction.
     void UpdateCostEstimate(const NodeItem& node, uint64 elapsed_cycles) {
       // N.B. Updates to `cost_estimate` are atomic but unlocked.  Simultaneous
       // updates may result in one or more updates being ignored.  This does not
@@ -194,25 +301,72 @@ class ExecutorImpl : public Executor {
                                 kCostDecay +
                             (elapsed_cycles / kCostDecay);
       cost_estimate.store(new_estimate, std::memory_order_relaxed);
-      if (new_estimate < kOpIsExpensiveThresholdCycles) {
-        is_expensive_[node.node_id].store(false, std::memory_order_relaxed);
-      }
     }
 
    private:
+    // Recomputes the cost of the most expensive path from each node to the
+    // end of the graph, and whether each node has an expensive successor.
+    // Concurrent steps skip the refresh if one is already running, and keep
+    // reading the previous values meanwhile.
+    void RefreshCriticalPaths() {
+      if (!refresh_mu_.try_lock()) return;
+      for (const PostOrderNode& node : post_order_) {
+        const NodeItem& item = *gview_->node(node.id);
+        bool has_expensive_successor = false;
+        for (const EdgeInfo& e : item.output_edges()) {
+          has_expensive_successor |= IsExpensive(*gview_->node(e.dst_id));
+        }
+        for (const ControlEdgeInfo& e : item.output_control_edges()) {
+          has_expensive_successor |= IsExpensive(*gview_->node(e.dst_id));
+        }
+        has_expensive_successor_[node.id].store(has_expensive_successor,
+                                                std::memory_order_relaxed);
+
+        uint64 max_out_cycles = 0;
+        for (int32 successor : node.successors) {
+          max_out_cycles = std::max(
+              max_out_cycles,
+              critical_path_cycles_[successor].load(std::memory_order_relaxed));
+        }
+        critical_path_cycles_[node.id].store(
+            cost_estimates_[node.id].load(std::memory_order_relaxed) +
+                max_out_cycles,
+            std::memory_order_relaxed);
+      }
+      refresh_mu_.unlock();
+    }
+
     // Initial time (in CPU cycles) we expect an operation to take.  Used to
     // determine whether an operation should be place in a threadpool.
     // Operations start out "expensive".
     static constexpr uint64 kInitialCostEstimateCycles = 100 * 1000 * 1000;
     static constexpr uint64 kOpIsExpensiveThresholdCycles = 5000;
     static constexpr uint64 kCostDecay = 10;
+    // One in this many steps measures the cost of inexpensive kernels.
+    static constexpr uint64 kInexpensiveKernelSamplingPeriod = 16;
+    // The critical paths are recomputed once every this many steps.
+    static constexpr uint64 kCriticalPathRefreshPeriod = 64;
 
+    const GraphView* gview_ = nullptr;
     std::unique_ptr<std::atomic<bool>[]> is_expensive_;
     std::unique_ptr<std::atomic_uint_fast64_t[]> cost_estimates_;
+    struct PostOrderNode {
+      int32 id;
+      // The destinations of the node's out edges, except back edges.
+      std::vector<int32> successors;
+    };
+    // The nodes of the graph in post order.
+    std::vector<PostOrderNode> post_order_;
+    std::unique_ptr<std::atomic<uint64>[]> critical_path_cycles_;
+    std::unique_ptr<std::atomic<bool>[]> has_expensive_successor_;
+    mutex refresh_mu_;
+    std::atomic<uint64> num_steps_{0};
   };
 
   ImmutableExecutorState immutable_state_;
   KernelStats kernel_stats_;
+  // Not null if the steps that run in the static schedule use a step arena.
+  std::unique_ptr<StepArenaPlanner> step_arena_planner_;
 
   TF_DISALLOW_COPY_AND_ASSIGN(ExecutorImpl);
 };
@@ -271,7 +425,8 @@ class ExecutorState {
  public:
   ExecutorState(const Executor::Args& args,
                 const ImmutableExecutorState& immutable_state_,
-                ExecutorImpl::KernelStats* kernel_stats_);
+                ExecutorImpl::KernelStats* kernel_stats_,
+                StepArenaPlanner* step_arena_planner = nullptr);
   ~ExecutorState();
 
   void RunAsync(Executor::DoneCallback done);
@@ -356,6 +511,11 @@ class ExecutorState {
   CallFrameInterface* call_frame_;
   const ImmutableExecutorState& immutable_state_;
   ExecutorImpl::KernelStats* const kernel_stats_;
+  // If true, this step measures the cost of inexpensive kernels too.
+  const bool sample_inexpensive_kernels_;
+  StepArenaPlanner* const step_arena_planner_;
+  // If not null, serves the allocations of the kernels of this step.
+  StepArena* step_arena_ = nullptr;
   CancellationManager* cancellation_manager_;
   // If not null, use this device to schedule intra-op operation
   std::unique_ptr<DeviceBase> user_device_;
@@ -383,7 +543,8 @@ class ExecutorState {
 template <class PropagatorStateType>
 ExecutorState<PropagatorStateType>::ExecutorState(
     const Executor::Args& args, const ImmutableExecutorState& immutable_state,
-    ExecutorImpl::KernelStats* kernel_stats)
+    ExecutorImpl::KernelStats* kernel_stats,
+    StepArenaPlanner* step_arena_planner)
     : vlog_(VLOG_IS_ON(1)),
       log_memory_(LogMemory::IsEnabled()),
       step_id_(args.step_id),
@@ -402,6 +563,8 @@ ExecutorState<PropagatorStateType>::ExecutorState(
       call_frame_(args.call_frame),
       immutable_state_(immutable_state),
       kernel_stats_(kernel_stats),
+      sample_inexpensive_kernels_(kernel_stats->StartStep()),
+      step_arena_planner_(step_arena_planner),
       cancellation_manager_(args.cancellation_manager),
       runner_(args.runner),
       sync_on_finish_(args.sync_on_finish),
@@ -413,6 +576,9 @@ ExecutorState<PropagatorStateType>::ExecutorState(
     user_device_ = RenamedDevice::NewRenamedDevice(
         device->name(), device, false, false, args.user_intra_op_threadpool);
   }
+  if (step_arena_planner_ != nullptr) {
+    step_arena_ = step_arena_planner_->StartStep();
+  }
 }
 
 template <class PropagatorStateType>
@@ -421,6 +587,9 @@ ExecutorState<PropagatorStateType>::~ExecutorState() {
     device_context_->Unref();
   }
   delete slice_reader_cache_;
+  if (step_arena_ != nullptr) {
+    step_arena_planner_->FinishStep(step_arena_);
+  }
 }
 
 template <class PropagatorStateType>
@@ -538,7 +707,8 @@ Status ExecutorState<PropagatorStateType>::ProcessSync(
     device->Compute(op_kernel, &ctx);
   } else {
     // In the common case, avoid creating any tracing objects.
-    if (is_expensive) {
+    if (is_expensive || (sample_inexpensive_kernels_ &&
+                         kernel_stats_->MayBeExpensive(item))) {
       KernelTimer timer;
       device->Compute(op_kernel, &ctx);
       kernel_stats_->UpdateCostEstimate(item, timer.ElapsedCycles());
@@ -660,6 +830,7 @@ void ExecutorState<PropagatorStateType>::Process(TaggedNode tagged_node,
     params.device = device;
   }
   params.log_memory = log_memory_;
+  params.step_allocator = step_arena_;
   params.rendezvous = rendezvous_;
   params.collective_executor = collective_executor_;
   params.session_state = session_state_;
@@ -773,7 +944,9 @@ void ExecutorState<PropagatorStateType>::Process(TaggedNode tagged_node,
         ProcessAsync(item, params, tagged_node, first_input, stats);
         launched_asynchronously = true;
       } else {
+        if (step_arena_ != nullptr) step_arena_->BeginNode(id);
         s = ProcessSync(item, &params, &outputs, stats);
+        if (step_arena_ != nullptr) step_arena_->EndNode();
       }
     }
 
@@ -1129,9 +1302,33 @@ void ExecutorState<PropagatorStateType>::ScheduleReady(
   } else {
     const TaggedNode* curr_expensive_node = nullptr;
     if (inline_ready == nullptr) {
-      // Schedule to run all the ready ops in thread pool.
+      // Schedule to run all the ready ops in thread pool. The inexpensive ops
+      // are run from a single closure, since dispatching each of them to a
+      // thread would cost more than running it. An inexpensive op with an
+      // expensive successor gets its own closure: the closure goes on to run
+      // the successor, which would otherwise delay the rest of the batch and
+      // serialize independent expensive branches.
+      TaggedNodeSeq inexpensive_ready;
       for (auto& tagged_node : *ready) {
-        runner_([=]() { Process(tagged_node, scheduled_nsec); });
+        const NodeItem& item = *tagged_node.node_item;
+        if (tagged_node.get_is_dead() ||
+            (!kernel_stats_->IsExpensive(item) &&
+             !kernel_stats_->HasExpensiveSuccessor(item))) {
+          inexpensive_ready.push_back(tagged_node);
+        } else {
+          runner_([=]() { Process(tagged_node, scheduled_nsec); });
+        }
+      }
+      if (inexpensive_ready.size() == 1) {
+        runner_(std::bind(&ExecutorState::Process, this, inexpensive_ready[0],
+                          scheduled_nsec));
+      } else if (!inexpensive_ready.empty()) {
+        runner_([this, inexpensive_ready = std::move(inexpensive_ready),
+                 scheduled_nsec]() {
+          for (auto& tagged_node : inexpensive_ready) {
+            Process(tagged_node, scheduled_nsec);
+          }
+        });
       }
     } else {
       for (auto& tagged_node : *ready) {
@@ -1139,14 +1336,20 @@ void ExecutorState<PropagatorStateType>::ScheduleReady(
         if (tagged_node.get_is_dead() || !kernel_stats_->IsExpensive(item)) {
           // Inline this inexpensive node.
           inline_ready->push_back(tagged_node);
+        } else if (curr_expensive_node == nullptr) {
+          curr_expensive_node = &tagged_node;
         } else {
-          if (curr_expensive_node) {
-            // Dispatch to another thread since there is plenty of work to
-            // do for this thread.
-            runner_(std::bind(&ExecutorState::Process, this,
-                              *curr_expensive_node, scheduled_nsec));
+          // Dispatch to another thread since there is plenty of work to do
+          // for this thread. Keep the node on the longer critical path for
+          // this thread, where it may start without waiting for a thread.
+          const TaggedNode* dispatched_node = &tagged_node;
+          if (kernel_stats_->CriticalPathCycles(item) >
+              kernel_stats_->CriticalPathCycles(
+                  *curr_expensive_node->node_item)) {
+            std::swap(curr_expensive_node, dispatched_node);
           }
-          curr_expensive_node = &tagged_node;
+          runner_(std::bind(&ExecutorState::Process, this, *dispatched_node,
+                            scheduled_nsec));
         }
       }
     }
@@ -1301,6 +1504,14 @@ void ExecutorImpl::RunAsync(const Args& args, DoneCallback done) {
   if (immutable_state_.requires_control_flow_support()) {
     (new ExecutorState<PropagatorState>(args, immutable_state_, &kernel_stats_))
         ->RunAsync(std::move(done));
+  } else if (args.run_all_kernels_inline &&
+             !immutable_state_.static_schedule().empty()) {
+    // All kernels run sequentially on one thread, so they may as well run in
+    // a precomputed order, which saves the pending count updates and ready
+    // queue operations for each node.
+    (new ExecutorState<OrderedPropagatorState>(
+         args, immutable_state_, &kernel_stats_, step_arena_planner_.get()))
+        ->RunAsync(std::move(done));
   } else {
     (new ExecutorState<SimplePropagatorState>(args, immutable_state_,
                                               &kernel_stats_))
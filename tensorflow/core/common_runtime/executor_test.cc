@@ -32,15 +32,21 @@ limitations under the License.
 #include "tensorflow/core/common_runtime/step_stats_collector.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/rendezvous.h"
+#include "tensorflow/core/framework/shape_inference.h"
 #include "tensorflow/core/framework/step_stats.pb.h"
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/framework/versions.pb.h"
 #include "tensorflow/core/graph/algorithm.h"
+#include "tensorflow/core/graph/costmodel.h"
+#include "tensorflow/core/graph/node_builder.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
 #include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/logging.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/test.h"
 #include "tensorflow/core/platform/test_benchmark.h"
 #include "tensorflow/core/platform/tracing.h"
@@ -67,10 +73,13 @@ class ExecutorTest : public ::testing::Test {
   }
 
   // Resets executor_ with a new executor based on a graph 'gdef'.
-  void Create(std::unique_ptr<const Graph> graph) {
+  void Create(std::unique_ptr<const Graph> graph,
+              const CostModel* cost_model = nullptr) {
     const int version = graph->versions().producer();
     LocalExecutorParams params;
     params.device = device_.get();
+    params.cost_model = cost_model;
+    params.use_step_arena = use_step_arena_;
     params.create_kernel =
         [this, version](const std::shared_ptr<const NodeProperties>& props,
                         OpKernel** kernel) {
@@ -94,6 +103,7 @@ class ExecutorTest : public ::testing::Test {
     return exec_->Run(args);
   }
 
+  bool use_step_arena_ = false;
   thread::ThreadPool* thread_pool_ = nullptr;
   std::unique_ptr<Device> device_;
   Executor* exec_ = nullptr;
@@ -205,6 +215,73 @@ TEST_F(ExecutorTest, SelfAdd) {
   EXPECT_EQ(1024.0, V(out));  // b=v10=2*v9=4*v8=...=1024*a=1024.0
 }
 
+TEST_F(ExecutorTest, RunAllKernelsInline) {
+  // v0 = 1.0
+  // v1 = v0 + v0
+  // v2 = v1 + v1
+  // ... ...
+  // v10 = v9 + v9
+  //
+  // b <- v10
+  // The graph has no asynchronous kernels, so all nodes are executed by the
+  // calling thread in a static order.
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  auto v = test::graph::Constant(g.get(), V(1.0));
+  const int N = 10;
+  for (int i = 1; i <= N; ++i) {
+    v = test::graph::Add(g.get(), v, v);
+  }
+  // out <- v10
+  test::graph::Send(g.get(), v, "b", BOB, 1, ALICE);
+  Create(std::move(g));
+  Executor::Args args;
+  args.rendezvous = rendez_;
+  args.runner = [](std::function<void()> fn) { fn(); };
+  args.run_all_kernels_inline = true;
+  for (int iters = 0; iters < 2; ++iters) {
+    TF_ASSERT_OK(exec_->Run(args));
+    Rendezvous::Args rendez_args;
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), rendez_args,
+                               &out, &is_dead));
+    EXPECT_EQ(1024.0, V(out));  // b=v10=2*v9=4*v8=...=1024*v0=1024.0
+  }
+}
+
+TEST_F(ExecutorTest, RunAllKernelsInlineWithStepArena) {
+  // Same as above, but the steps after the first one allocate the outputs of
+  // the additions from a step arena. The sent tensor outlives the step, so it
+  // is cast to another type, which the cast cannot forward its input to.
+  use_step_arena_ = true;
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  auto v = test::graph::Constant(g.get(), V(1.0));
+  const int N = 10;
+  for (int i = 1; i <= N; ++i) {
+    v = test::graph::Add(g.get(), v, v);
+  }
+  v = test::graph::Cast(g.get(), v, DT_INT32);
+  test::graph::Send(g.get(), v, "b", BOB, 1, ALICE);
+  Create(std::move(g));
+  Executor::Args args;
+  args.rendezvous = rendez_;
+  args.runner = [](std::function<void()> fn) { fn(); };
+  args.run_all_kernels_inline = true;
+  std::vector<Tensor> outs;
+  for (int iters = 0; iters < 4; ++iters) {
+    TF_ASSERT_OK(exec_->Run(args));
+    Rendezvous::Args rendez_args;
+    Tensor out = VI(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), rendez_args,
+                               &out, &is_dead));
+    outs.push_back(out);
+  }
+  for (const Tensor& out : outs) {
+    EXPECT_EQ(1024, out.scalar<int32>()());
+  }
+}
+
 // Builds a graph which adds N copies of one variable "in". I.e.,
 //     a + a + a + ... + a
 // The returned graph is parenthesized ramdonly. I.e.,
@@ -255,6 +332,138 @@ TEST_F(ExecutorTest, RandomTree) {
   EXPECT_EQ(4096.0, V(out));
 }
 
+TEST_F(ExecutorTest, RandomTreeWithCostModel) {
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  BuildTree(4096, g.get());
+  // Estimate that the additions are expensive and the rest is cheap, so that
+  // both inexpensive nodes are batched and expensive nodes are dispatched.
+  CostModel cost_model(/*is_global=*/false);
+  cost_model.InitFromGraph(*g);
+  for (const Node* n : g->op_nodes()) {
+    cost_model.RecordCount(n, 1);
+    cost_model.RecordTime(n,
+                          Microseconds(n->type_string() == "Add" ? 1000 : 1));
+  }
+  Create(std::move(g), &cost_model);
+  Rendezvous::Args args;
+  TF_ASSERT_OK(
+      rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args, V(1.0), false));
+  TF_ASSERT_OK(Run(rendez_));
+  Tensor out = V(-1);
+  bool is_dead = false;
+  TF_ASSERT_OK(
+      rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out, &is_dead));
+  EXPECT_EQ(4096.0, V(out));
+}
+
+TEST_F(ExecutorTest, RandomTreeManySteps) {
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  BuildTree(64, g.get());
+  Create(std::move(g));
+  // Enough steps for the cost estimates to be sampled, and for the critical
+  // paths to be refreshed from them.
+  for (int step = 0; step < 200; ++step) {
+    Rendezvous::Args args;
+    TF_ASSERT_OK(rendez_->Send(Key(ALICE, kIncarnation, BOB, "a"), args,
+                               V(1.0), false));
+    TF_ASSERT_OK(Run(rendez_));
+    Tensor out = V(-1);
+    bool is_dead = false;
+    TF_ASSERT_OK(rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out,
+                               &is_dead));
+    EXPECT_EQ(64.0, V(out));
+  }
+}
+
+// The number of kernels that must run at the same time for any
+// ExecutorTestBarrier kernel to complete.
+constexpr int kNumParallelBranches = 4;
+
+// Forwards its input once kNumParallelBranches instances of the kernel are
+// running at the same time, or fails after a timeout.
+class ExecutorTestBarrierOp : public OpKernel {
+ public:
+  explicit ExecutorTestBarrierOp(OpKernelConstruction* ctx) : OpKernel(ctx) {}
+
+  void Compute(OpKernelContext* ctx) override {
+    mutex_lock l(*mu());
+    ++*num_arrived();
+    cv()->notify_all();
+    const uint64 deadline_micros = Env::Default()->NowMicros() + 10000000;
+    while (*num_arrived() < kNumParallelBranches) {
+      if (Env::Default()->NowMicros() >= deadline_micros) {
+        ctx->SetStatus(errors::DeadlineExceeded(
+            "Only ", *num_arrived(), " of ", kNumParallelBranches,
+            " branches ran in parallel"));
+        return;
+      }
+      WaitForMilliseconds(&l, cv(), 100);
+    }
+    ctx->set_output(0, ctx->input(0));
+  }
+
+  static void Reset() {
+    mutex_lock l(*mu());
+    *num_arrived() = 0;
+  }
+
+ private:
+  static mutex* mu() {
+    static mutex* mu = new mutex;
+    return mu;
+  }
+  static condition_variable* cv() {
+    static condition_variable* cv = new condition_variable;
+    return cv;
+  }
+  static int* num_arrived() {
+    static int* num_arrived = new int(0);
+    return num_arrived;
+  }
+};
+
+REGISTER_OP("ExecutorTestBarrier")
+    .Input("x: float")
+    .Output("y: float")
+    .SetShapeFn(shape_inference::UnchangedShape);
+REGISTER_KERNEL_BUILDER(Name("ExecutorTestBarrier").Device(DEVICE_CPU),
+                        ExecutorTestBarrierOp);
+
+TEST_F(ExecutorTest, IndependentExpensiveBranchesRunInParallel) {
+  // Each branch is an inexpensive constant followed by an expensive barrier.
+  // The constants are ready together when the step starts. If they were run
+  // from a single closure, the first barrier would run on the closure's
+  // thread before the other constants, and block them.
+  auto g = absl::make_unique<Graph>(OpRegistry::Global());
+  std::vector<Node*> outputs;
+  for (int i = 0; i < kNumParallelBranches; ++i) {
+    Node* barrier;
+    TF_ASSERT_OK(NodeBuilder(g->NewName("barrier"), "ExecutorTestBarrier")
+                     .Input(test::graph::Constant(g.get(), V(1.0)))
+                     .Finalize(g.get(), &barrier));
+    outputs.push_back(barrier);
+  }
+  Node* sum = outputs[0];
+  for (int i = 1; i < kNumParallelBranches; ++i) {
+    sum = test::graph::Add(g.get(), sum, outputs[i]);
+  }
+  test::graph::Send(g.get(), sum, "b", BOB, 1, ALICE);
+  Create(std::move(g));
+  ExecutorTestBarrierOp::Reset();
+  // Enough threads to run every branch at the same time, whatever the size of
+  // the default pool.
+  thread::ThreadPool pool(Env::Default(), "executor_test",
+                          kNumParallelBranches);
+  runner_ = [&pool](std::function<void()> fn) { pool.Schedule(fn); };
+  TF_ASSERT_OK(Run(rendez_));
+  Rendezvous::Args args;
+  Tensor out = V(-1);
+  bool is_dead = false;
+  TF_ASSERT_OK(
+      rendez_->Recv(Key(BOB, kIncarnation, ALICE, "b"), args, &out, &is_dead));
+  EXPECT_EQ(static_cast<float>(kNumParallelBranches), V(out));
+}
+
 void BuildConcurrentAddAssign(Graph* g) {
   auto one = test::graph::Constant(g, V(1.0));
   // A variable holds one float.
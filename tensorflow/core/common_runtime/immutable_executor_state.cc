@@ -257,6 +257,7 @@ Status ImmutableExecutorState::Initialize(const Graph& graph) {
   // Initialize PendingCounts only after pending_ids_[node.id] is initialized
   // for all nodes.
   InitializePending(&graph, cf_info);
+  BuildStaticSchedule();
   return gview_.SetAllocAttrs(&graph, params_.device);
 }
 
@@ -372,4 +373,36 @@ void ImmutableExecutorState::InitializePending(const Graph* graph,
     }
   }
 }
+
+void ImmutableExecutorState::BuildStaticSchedule() {
+  if (requires_control_flow_) return;
+
+  // Visit the nodes in the order in which `SimplePropagatorState` would find
+  // them ready if each node ran to completion before the next one started.
+  std::vector<int32> pending(gview_.num_nodes());
+  for (int32 i = 0; i < gview_.num_nodes(); ++i) {
+    pending[i] = atomic_pending_counts_[i].load(std::memory_order_relaxed);
+  }
+  std::vector<const NodeItem*> schedule(root_nodes_);
+  for (size_t i = 0; i < schedule.size(); ++i) {
+    const NodeItem* item = schedule[i];
+    if (item->kernel_is_async) {
+      // An asynchronous kernel, such as a `Recv`, may wait for a node that
+      // comes later in the schedule, so the graph must be run dynamically.
+      return;
+    }
+    for (const EdgeInfo& e : item->output_edges()) {
+      if (--pending[e.dst_id] == 0) {
+        schedule.push_back(&gview_.node_ref(e.dst_id));
+      }
+    }
+    for (const ControlEdgeInfo& e : item->output_control_edges()) {
+      if (--pending[e.dst_id] == 0) {
+        schedule.push_back(&gview_.node_ref(e.dst_id));
+      }
+    }
+  }
+  static_schedule_ = std::move(schedule);
+}
+
 }  // namespace tensorflow
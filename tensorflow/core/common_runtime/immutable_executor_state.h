@@ -101,6 +101,14 @@ class ImmutableExecutorState {
 
   bool requires_control_flow_support() const { return requires_control_flow_; }
 
+  // Returns the nodes in this graph in a topological order, in which they can
+  // be executed one at a time without tracking pending counts. The vector is
+  // empty if the graph requires control flow support or has asynchronous
+  // kernels, which must be scheduled dynamically.
+  const std::vector<const NodeItem*>& static_schedule() const {
+    return static_schedule_;
+  }
+
   // Copies the pending counts for nodes in this graph to the given array.
   //
   // This method provides a more efficient way of initializing
@@ -125,6 +133,7 @@ class ImmutableExecutorState {
   static Status BuildControlFlowInfo(const Graph* graph,
                                      ControlFlowInfo* cf_info);
   void InitializePending(const Graph* graph, const ControlFlowInfo& cf_info);
+  void BuildStaticSchedule();
 
   FrameInfo* EnsureFrameInfo(const string& fname);
 
@@ -137,6 +146,9 @@ class ImmutableExecutorState {
   // Root nodes (with no in edges) that should form the initial ready queue
   std::vector<const NodeItem*> root_nodes_;
 
+  // If non-empty, a topological order of all nodes in the graph.
+  std::vector<const NodeItem*> static_schedule_;
+
   // Mapping from frame name to static information about the frame.
   // TODO(yuanbyu): We could cache it along with the graph so to avoid
   // the overhead of constructing it for each executor instance.
@@ -21,6 +21,7 @@ limitations under the License.
 
 namespace tensorflow {
 
+class CostModel;
 class Device;
 class StepStatsCollector;
 class SessionMetadata;
@@ -47,6 +48,16 @@ struct LocalExecutorParams {
                        OpKernel**)>
       create_kernel;
   std::function<void(OpKernel*)> delete_kernel;
+
+  // If true and the device is a CPU, the steps that run all kernels inline
+  // serve the allocations of the kernels from one arena per step, which is
+  // planned from the allocations of the first such step.
+  bool use_step_arena = false;
+
+  // If not null, a cost model of the graph, whose time estimates seed the
+  // executor's estimates of the cost of each kernel. It is only read while
+  // the executor is created.
+  const CostModel* cost_model = nullptr;
 };
 
 }  // end namespace tensorflow
@@ -0,0 +1,76 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/ordered_propagator_state.h"
+
+#include "tensorflow/core/common_runtime/propagator_debug_utils.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+OrderedPropagatorState::OrderedPropagatorState(
+    const ImmutableExecutorState& immutable_state, int64 step_id, bool vlog)
+    : step_id_(step_id),
+      schedule_(immutable_state.static_schedule()),
+      input_tensors_(immutable_state.get_root_frame_info().total_inputs) {
+  DCHECK(!immutable_state.requires_control_flow_support());
+  DCHECK(!schedule_.empty());
+}
+
+OrderedPropagatorState::~OrderedPropagatorState() {}
+
+void OrderedPropagatorState::ActivateRoots(
+    gtl::ArraySlice<const NodeItem*> roots, TaggedNodeSeq* ready) {
+  DCHECK_EQ(next_, 0);
+  if (!schedule_.empty()) {
+    ready->emplace_back(schedule_[next_++]);
+  }
+}
+
+void OrderedPropagatorState::PropagateOutputs(const TaggedNode& tagged_node,
+                                              EntryVector* outputs,
+                                              TaggedNodeSeq* ready) {
+  DCHECK(ready->empty());
+  DCHECK_EQ(schedule_[next_ - 1], tagged_node.node_item);
+
+  for (const EdgeInfo& e : tagged_node.node_item->output_edges()) {
+    if (e.is_last) {
+      input_tensors_[e.input_slot] = std::move((*outputs)[e.output_slot]);
+    } else {
+      input_tensors_[e.input_slot] = (*outputs)[e.output_slot];
+    }
+  }
+  // Control edges need no work, because the schedule already orders their
+  // destinations after this node.
+
+  if (next_ < schedule_.size()) {
+    ready->emplace_back(schedule_[next_++]);
+  }
+}
+
+void OrderedPropagatorState::DumpState() {
+  // Dump the nodes that have not run yet and are holding on to tensors.
+  for (size_t i = next_; i < schedule_.size(); ++i) {
+    DumpPendingNodeState(*schedule_[i], input_tensors_.data(), false);
+  }
+  // Then the active node.
+  if (next_ > 0) {
+    DumpActiveNodeState(*schedule_[next_ - 1], input_tensors_.data());
+  }
+  LOG(WARNING) << "    Step " << step_id_ << " ran " << next_ << " of "
+               << schedule_.size() << " scheduled nodes";
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,99 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_ORDERED_PROPAGATOR_STATE_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_ORDERED_PROPAGATOR_STATE_H_
+
+#include <vector>
+
+#include "tensorflow/core/common_runtime/entry.h"
+#include "tensorflow/core/common_runtime/immutable_executor_state.h"
+#include "tensorflow/core/common_runtime/simple_propagator_state.h"
+#include "tensorflow/core/framework/control_flow.h"
+#include "tensorflow/core/lib/gtl/array_slice.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// Represents the ephemeral "edge state" associated with one invocation of
+// `Executor::Run()`, for graphs that are executed one node at a time in the
+// order given by `ImmutableExecutorState::static_schedule()`.
+//
+// Because the schedule is a topological order of the graph, a node is always
+// runnable once its predecessor in the schedule has completed, and
+// `OrderedPropagatorState` does not need to count the pending inputs of each
+// node. `PropagateOutputs()` only moves the outputs of a node to the inputs of
+// its destinations, and dispatches the next node in the schedule.
+//
+// NOTE: `OrderedPropagatorState` requires that the nodes are executed
+// sequentially, i.e. the executor must run all kernels inline, and that
+// `!immutable_state.static_schedule().empty()`.
+class OrderedPropagatorState {
+ public:
+  OrderedPropagatorState(const ImmutableExecutorState& immutable_state,
+                         int64 step_id, bool vlog);
+  ~OrderedPropagatorState();
+
+  typedef SimplePropagatorState::TaggedNode TaggedNode;
+  typedef SimplePropagatorState::TaggedNodeReadyQueue TaggedNodeReadyQueue;
+  typedef SimplePropagatorState::TaggedNodeSeq TaggedNodeSeq;
+
+  // Adds a `TaggedNode` for the first node in the schedule to `*ready`. The
+  // schedule starts with `roots`.
+  void ActivateRoots(gtl::ArraySlice<const NodeItem*> roots,
+                     TaggedNodeSeq* ready);
+
+  // After processing the outputs, propagates the outputs to their dsts, and
+  // adds the next node in the schedule to `*ready`.
+  // Contents of *outputs are left in an indeterminate state after
+  // returning from this method.
+  void PropagateOutputs(const TaggedNode& tagged_node, EntryVector* outputs,
+                        TaggedNodeSeq* ready);
+
+  // Returns an array of `Entry` objects corresponding to the inputs of
+  // `tagged_node`.
+  Entry* GetInputTensors(const TaggedNode& tagged_node) {
+    return input_tensors_.data() + tagged_node.node_item->input_start;
+  }
+
+  FrameAndIter GetFrameAndIter(const TaggedNode& tagged_node) const {
+    return {0, 0};
+  }
+
+  // Provide debugging output of the state of the executor.
+  void DumpState();
+
+  // The active node is always the last node that was dispatched, so there is
+  // nothing to record.
+  void MaybeMarkStarted(const TaggedNode& tagged_node) {}
+  void MaybeMarkCompleted(const TaggedNode& tagged_node) {}
+
+ private:
+  const int64 step_id_;
+  const std::vector<const NodeItem*>& schedule_;
+
+  // The i-th node's j-th input is stored at
+  // `input_tensors[impl_->nodes[i].input_start + j]`.
+  std::vector<Entry> input_tensors_;
+
+  // The index in `schedule_` of the next node to dispatch.
+  size_t next_ = 0;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(OrderedPropagatorState);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_ORDERED_PROPAGATOR_STATE_H_
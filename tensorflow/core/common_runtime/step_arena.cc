@@ -0,0 +1,349 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/step_arena.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "absl/memory/memory.h"
+#include "tensorflow/core/framework/op.h"
+#include "tensorflow/core/framework/op_kernel.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/logging.h"
+
+namespace tensorflow {
+
+namespace {
+
+constexpr int64 kAlignment = Allocator::kAllocatorAlignment;
+
+// Each allocation from the arena is preceded by a header that holds the slot
+// of the allocation, so that the header keeps the allocation aligned.
+constexpr int64 kHeaderBytes = kAlignment;
+
+// The plan is rebuilt after a step in which more than this fraction of the
+// allocations that were meant for the arena did not fit in their slots.
+constexpr double kMaxSlotOverflowRate = 0.1;
+
+int64 AlignedAllocationBytes(size_t num_bytes) {
+  return kHeaderBytes + (num_bytes + kAlignment - 1) / kAlignment * kAlignment;
+}
+
+// Returns true if a consumer of a tensor may keep it beyond the step.
+bool ConsumerMayKeepInput(const NodeItem& consumer) {
+  if (consumer.is_transfer_node || consumer.is_any_input_ref_typed) {
+    return true;
+  }
+  const absl::string_view op = consumer.kernel->type_string_view();
+  if (op == "_Retval" || op == "_DeviceRetval") return true;
+  const OpDef* op_def = nullptr;
+  if (!OpRegistry::Global()->LookUpOpDef(consumer.kernel->type_string(),
+                                         &op_def)
+           .ok()) {
+    return true;
+  }
+  return op_def->is_stateful();
+}
+
+bool HasOutputType(const NodeItem& item, DataType dtype) {
+  for (int i = 0; i < item.num_outputs; ++i) {
+    if (item.output_type(i) == dtype) return true;
+  }
+  return false;
+}
+
+}  // namespace
+
+int64 PlanArenaOffsets(const std::vector<ArenaBuffer>& buffers,
+                       std::vector<int64>* offsets) {
+  offsets->assign(buffers.size(), 0);
+  std::vector<int> order(buffers.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&buffers](int a, int b) {
+    return buffers[a].size > buffers[b].size;
+  });
+
+  int64 arena_size = 0;
+  std::vector<int> placed;
+  std::vector<int> conflicts;
+  for (int i : order) {
+    const ArenaBuffer& buffer = buffers[i];
+    if (buffer.size == 0) break;
+    DCHECK_EQ(buffer.size % kAlignment, 0);
+
+    // Find the placed buffers that are used at the same time, by offset.
+    conflicts.clear();
+    for (int j : placed) {
+      if (buffers[j].first_use <= buffer.last_use &&
+          buffer.first_use <= buffers[j].last_use) {
+        conflicts.push_back(j);
+      }
+    }
+    std::sort(conflicts.begin(), conflicts.end(), [offsets](int a, int b) {
+      return (*offsets)[a] < (*offsets)[b];
+    });
+
+    // Take the first gap between them that is large enough.
+    int64 offset = 0;
+    for (int j : conflicts) {
+      if ((*offsets)[j] - offset >= buffer.size) break;
+      offset = std::max(offset, (*offsets)[j] + buffers[j].size);
+    }
+    (*offsets)[i] = offset;
+    arena_size = std::max(arena_size, offset + buffer.size);
+    placed.push_back(i);
+  }
+  return arena_size;
+}
+
+StepArenaPlan::StepArenaPlan(const std::vector<ArenaBuffer>& buffers)
+    : slots_(buffers.size()) {
+  std::vector<int64> offsets;
+  arena_size_ = PlanArenaOffsets(buffers, &offsets);
+
+  std::vector<int> by_offset;
+  for (int i = 0; i < buffers.size(); ++i) {
+    slots_[i].offset = offsets[i];
+    slots_[i].size = buffers[i].size;
+    if (buffers[i].size > 0) by_offset.push_back(i);
+  }
+  std::sort(by_offset.begin(), by_offset.end(), [&offsets](int a, int b) {
+    return offsets[a] < offsets[b];
+  });
+  for (int i = 0; i < by_offset.size(); ++i) {
+    Slot& slot = slots_[by_offset[i]];
+    for (int j = i + 1; j < by_offset.size(); ++j) {
+      Slot& other = slots_[by_offset[j]];
+      if (other.offset >= slot.offset + slot.size) break;
+      slot.overlapping_slots.push_back(by_offset[j]);
+      other.overlapping_slots.push_back(by_offset[i]);
+    }
+  }
+}
+
+void ComputeStepArenaLifetimes(const std::vector<const NodeItem*>& schedule,
+                               int num_nodes,
+                               std::vector<ArenaBuffer>* lifetimes,
+                               std::vector<bool>* escapes) {
+  lifetimes->assign(num_nodes, ArenaBuffer());
+  escapes->assign(num_nodes, false);
+  std::vector<int> position(num_nodes, -1);
+  std::vector<const NodeItem*> items(num_nodes, nullptr);
+  for (int i = 0; i < schedule.size(); ++i) {
+    position[schedule[i]->node_id] = i;
+    items[schedule[i]->node_id] = schedule[i];
+  }
+
+  // Consumers come after their producers in the schedule, so visiting it
+  // backwards knows whether a consumer's outputs escape before its inputs.
+  for (auto it = schedule.rbegin(); it != schedule.rend(); ++it) {
+    const NodeItem* item = *it;
+    ArenaBuffer& lifetime = (*lifetimes)[item->node_id];
+    lifetime.first_use = position[item->node_id];
+    lifetime.last_use = lifetime.first_use;
+    bool escape = false;
+    for (int i = 0; i < item->num_outputs; ++i) {
+      if (IsRefType(item->output_type(i))) escape = true;
+    }
+    for (const EdgeInfo& e : item->output_edges()) {
+      const NodeItem* consumer = items[e.dst_id];
+      if (consumer == nullptr) {
+        escape = true;
+        continue;
+      }
+      lifetime.last_use = std::max(lifetime.last_use, position[e.dst_id]);
+      // A kernel may forward its input to an output of the same type.
+      if (ConsumerMayKeepInput(*consumer) ||
+          ((*escapes)[e.dst_id] &&
+           HasOutputType(*consumer, item->output_type(e.output_slot)))) {
+        escape = true;
+      }
+    }
+    (*escapes)[item->node_id] = escape;
+  }
+}
+
+StepArena::StepArena(int num_nodes, Allocator* base_allocator)
+    : base_allocator_(base_allocator),
+      num_nodes_(num_nodes),
+      recorded_bytes_(absl::make_unique<std::atomic<int64>[]>(num_nodes)) {
+  for (int i = 0; i < num_nodes_; ++i) {
+    recorded_bytes_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+StepArena::StepArena(std::shared_ptr<const StepArenaPlan> plan,
+                     Allocator* base_allocator)
+    : StepArena(plan->num_slots(), base_allocator) {
+  plan_ = std::move(plan);
+  arena_size_ = plan_->arena_size();
+  if (arena_size_ > 0) {
+    arena_ = static_cast<char*>(
+        base_allocator_->AllocateRaw(kAlignment, arena_size_));
+    if (arena_ == nullptr) arena_size_ = 0;
+  }
+  live_allocations_ = absl::make_unique<std::atomic<int32>[]>(num_nodes_);
+  slot_used_ = absl::make_unique<std::atomic<int64>[]>(num_nodes_);
+  for (int i = 0; i < num_nodes_; ++i) {
+    live_allocations_[i].store(0, std::memory_order_relaxed);
+    slot_used_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+StepArena::~StepArena() {
+  if (arena_ != nullptr) base_allocator_->DeallocateRaw(arena_);
+}
+
+void StepArena::BeginNode(int node_id) {
+  current_slot_.store(-1, std::memory_order_relaxed);
+  current_node_.store(node_id, std::memory_order_release);
+  if (arena_ == nullptr) return;
+
+  const StepArenaPlan::Slot& slot = plan_->slot(node_id);
+  if (slot.size == 0) return;
+  // The slot may be reused only once the tensors in it, and in the slots that
+  // share its memory, are gone.
+  if (live_allocations_[node_id].load(std::memory_order_acquire) > 0) return;
+  for (int other : slot.overlapping_slots) {
+    if (live_allocations_[other].load(std::memory_order_acquire) > 0) {
+      VLOG(2) << "Memory of node " << node_id << " is still used by node "
+              << other << ", not allocating from the step arena.";
+      return;
+    }
+  }
+  slot_used_[node_id].store(0, std::memory_order_relaxed);
+  current_slot_.store(node_id, std::memory_order_release);
+}
+
+void StepArena::EndNode() {
+  current_slot_.store(-1, std::memory_order_relaxed);
+  current_node_.store(-1, std::memory_order_release);
+}
+
+std::vector<int64> StepArena::recorded_bytes() const {
+  std::vector<int64> bytes(num_nodes_);
+  for (int i = 0; i < num_nodes_; ++i) {
+    bytes[i] = recorded_bytes_[i].load(std::memory_order_relaxed);
+  }
+  return bytes;
+}
+
+void StepArena::Release() { Unref(); }
+
+void StepArena::Unref() {
+  if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+    delete this;
+  }
+}
+
+char* StepArena::AllocateFromSlot(int slot, int64 bytes) {
+  const StepArenaPlan::Slot& plan_slot = plan_->slot(slot);
+  int64 used = slot_used_[slot].load(std::memory_order_relaxed);
+  do {
+    if (used + bytes > plan_slot.size) return nullptr;
+  } while (!slot_used_[slot].compare_exchange_weak(
+      used, used + bytes, std::memory_order_relaxed));
+  return arena_ + plan_slot.offset + used;
+}
+
+void* StepArena::AllocateRaw(size_t alignment, size_t num_bytes) {
+  const int64 bytes = AlignedAllocationBytes(num_bytes);
+  const int node = current_node_.load(std::memory_order_acquire);
+  if (node >= 0) {
+    recorded_bytes_[node].fetch_add(bytes, std::memory_order_relaxed);
+    const int slot = current_slot_.load(std::memory_order_acquire);
+    if (slot >= 0) {
+      num_slot_allocations_.fetch_add(1, std::memory_order_relaxed);
+      char* header =
+          alignment <= kAlignment ? AllocateFromSlot(slot, bytes) : nullptr;
+      if (header != nullptr) {
+        *reinterpret_cast<int32*>(header) = slot;
+        live_allocations_[slot].fetch_add(1, std::memory_order_relaxed);
+        refs_.fetch_add(1, std::memory_order_relaxed);
+        return header + kHeaderBytes;
+      }
+      num_slot_overflows_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  void* ptr = base_allocator_->AllocateRaw(alignment, num_bytes);
+  if (ptr != nullptr) refs_.fetch_add(1, std::memory_order_relaxed);
+  return ptr;
+}
+
+void StepArena::DeallocateRaw(void* ptr) {
+  if (Owns(ptr)) {
+    const int32 slot =
+        *reinterpret_cast<const int32*>(static_cast<char*>(ptr) - kHeaderBytes);
+    live_allocations_[slot].fetch_sub(1, std::memory_order_release);
+  } else {
+    base_allocator_->DeallocateRaw(ptr);
+  }
+  Unref();
+}
+
+StepArenaPlanner::StepArenaPlanner(std::vector<ArenaBuffer> lifetimes,
+                                   std::vector<bool> escapes,
+                                   Allocator* base_allocator)
+    : base_allocator_(base_allocator),
+      lifetimes_(std::move(lifetimes)),
+      escapes_(std::move(escapes)) {
+  DCHECK_EQ(lifetimes_.size(), escapes_.size());
+}
+
+StepArena* StepArenaPlanner::StartStep() {
+  std::shared_ptr<const StepArenaPlan> plan;
+  {
+    mutex_lock l(mu_);
+    plan = plan_;
+  }
+  if (plan == nullptr) {
+    return new StepArena(lifetimes_.size(), base_allocator_);
+  }
+  return new StepArena(std::move(plan), base_allocator_);
+}
+
+void StepArenaPlanner::FinishStep(StepArena* arena) {
+  const bool overflowed =
+      !arena->is_recording() &&
+      arena->num_slot_overflows() >
+          kMaxSlotOverflowRate * arena->num_slot_allocations();
+  if (arena->is_recording() || overflowed) {
+    mutex_lock l(mu_);
+    // Only the first step that finishes with the current plan replaces it.
+    if (plan_ == arena->plan()) {
+      const std::vector<int64> recorded_bytes = arena->recorded_bytes();
+      std::vector<ArenaBuffer> buffers = lifetimes_;
+      for (int i = 0; i < buffers.size(); ++i) {
+        if (escapes_[i]) continue;
+        // The slots only grow, so that steps with varying shapes converge.
+        buffers[i].size = recorded_bytes[i];
+        if (plan_ != nullptr) {
+          buffers[i].size = std::max(buffers[i].size, plan_->slot(i).size);
+        }
+      }
+      if (overflowed) {
+        VLOG(1) << arena->num_slot_overflows() << " of "
+                << arena->num_slot_allocations()
+                << " allocations did not fit in the step arena, replanning.";
+      }
+      plan_ = std::make_shared<const StepArenaPlan>(buffers);
+      VLOG(1) << "Planned a step arena of " << plan_->arena_size()
+              << " bytes.";
+    }
+  }
+  arena->Release();
+}
+
+}  // namespace tensorflow
@@ -0,0 +1,221 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_H_
+#define TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_H_
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/common_runtime/graph_view.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/platform/macros.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/thread_annotations.h"
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+
+// A buffer that is used from position `first_use` to position `last_use`
+// (inclusive) of a static schedule. A buffer of size 0 is not planned.
+struct ArenaBuffer {
+  int64 size = 0;
+  int first_use = 0;
+  int last_use = 0;
+};
+
+// Assigns an offset in a single arena to each of `buffers`, such that buffers
+// whose lifetimes overlap do not overlap in the arena, and returns the size of
+// the arena. The sizes of the buffers must be multiples of
+// `Allocator::kAllocatorAlignment`, and so are the offsets.
+//
+// Like the TFLite `ArenaPlanner`, the buffers are placed from the largest to
+// the smallest, each at the lowest offset where it fits.
+int64 PlanArenaOffsets(const std::vector<ArenaBuffer>& buffers,
+                       std::vector<int64>* offsets);
+
+// Computes the lifetime of the memory of each of the `num_nodes` nodes of
+// `schedule` when they run in that order: the memory of a node is used until
+// its last consumer has run.
+//
+// Sets `(*escapes)[i]` if the outputs of node `i` may outlive the step, e.g.
+// because they are returned, sent, or consumed through a ref or by a stateful
+// op that may keep them, or forwarded to the output of a node whose outputs
+// escape. The memory of these nodes is not planned, so that they allocate from
+// the base allocator instead of keeping the whole arena alive.
+void ComputeStepArenaLifetimes(const std::vector<const NodeItem*>& schedule,
+                               int num_nodes,
+                               std::vector<ArenaBuffer>* lifetimes,
+                               std::vector<bool>* escapes);
+
+// The layout of the per-step arena of an executor. Each node of the graph owns
+// one slot of the arena, which holds all the tensors that its kernel
+// allocates, and which it may share with the slots of nodes whose tensors are
+// not used at the same time.
+class StepArenaPlan {
+ public:
+  struct Slot {
+    int64 offset = 0;
+    int64 size = 0;
+    // The slots that share some of the memory of this slot.
+    std::vector<int> overlapping_slots;
+  };
+
+  // `buffers[i]` is the memory used by the node with id `i`.
+  explicit StepArenaPlan(const std::vector<ArenaBuffer>& buffers);
+
+  int64 arena_size() const { return arena_size_; }
+  int num_slots() const { return slots_.size(); }
+  const Slot& slot(int node_id) const { return slots_[node_id]; }
+
+ private:
+  int64 arena_size_;
+  std::vector<Slot> slots_;
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArenaPlan);
+};
+
+// An allocator that serves the allocations of the kernels of one step from an
+// arena laid out by a `StepArenaPlan`. The executor calls `BeginNode()` and
+// `EndNode()` around the execution of each kernel, and the allocations in
+// between come from the slot of that node.
+//
+// An allocation falls back to the base allocator if it does not fit in the
+// rest of the slot, or if some tensor in a slot that shares memory with the
+// node's slot is still alive, e.g. because a kernel forwarded it to an output
+// that is used later, or it outlives the step.
+//
+// The allocator records the number of bytes that each node allocates. Without
+// a plan, it only forwards the allocations to the base allocator.
+//
+// `BeginNode()` and `EndNode()` must be called from one thread at a time, but
+// the kernel of the current node may allocate from several threads, without
+// locking.
+//
+// The executor calls `Release()` at the end of the step, and the object
+// deletes itself (and frees the arena) once all the memory that it served,
+// including the allocations that fell back to the base allocator, is
+// deallocated too.
+class StepArena : public Allocator {
+ public:
+  // Creates an arena that records the allocations of `num_nodes` nodes.
+  StepArena(int num_nodes, Allocator* base_allocator);
+
+  // Creates an arena laid out by `plan`.
+  StepArena(std::shared_ptr<const StepArenaPlan> plan,
+            Allocator* base_allocator);
+
+  void BeginNode(int node_id);
+  void EndNode();
+
+  // Releases the reference of the step to this arena.
+  void Release();
+
+  // Returns true if this arena records the allocations of the step instead
+  // of serving them.
+  bool is_recording() const { return plan_ == nullptr; }
+
+  // Returns the plan of this arena, or nullptr if it is recording.
+  const std::shared_ptr<const StepArenaPlan>& plan() const { return plan_; }
+
+  // Returns the number of bytes of arena that each node needs, including
+  // alignment. Must only be called after the kernels of the step have run.
+  std::vector<int64> recorded_bytes() const;
+
+  // Returns the number of allocations that were made while the slot of their
+  // node was available, and how many of them did not fit in the slot.
+  int64 num_slot_allocations() const {
+    return num_slot_allocations_.load(std::memory_order_relaxed);
+  }
+  int64 num_slot_overflows() const {
+    return num_slot_overflows_.load(std::memory_order_relaxed);
+  }
+
+  // Returns true if `ptr` was allocated from the arena.
+  bool Owns(const void* ptr) const {
+    const char* p = static_cast<const char*>(ptr);
+    return p >= arena_ && p < arena_ + arena_size_;
+  }
+
+  std::string Name() override { return "step_arena"; }
+  void* AllocateRaw(size_t alignment, size_t num_bytes) override;
+  void DeallocateRaw(void* ptr) override;
+
+ private:
+  ~StepArena() override;
+
+  void Unref();
+
+  // Reserves `bytes` in `slot`, and returns their address or nullptr if the
+  // slot is full.
+  char* AllocateFromSlot(int slot, int64 bytes);
+
+  std::shared_ptr<const StepArenaPlan> plan_;
+  Allocator* const base_allocator_;  // Not owned.
+  char* arena_ = nullptr;
+  int64 arena_size_ = 0;
+
+  // One reference for the step, and one for each live allocation.
+  std::atomic<int64> refs_{1};
+  // The number of live allocations in each slot.
+  std::unique_ptr<std::atomic<int32>[]> live_allocations_;
+  // The number of bytes reserved in each slot.
+  std::unique_ptr<std::atomic<int64>[]> slot_used_;
+
+  std::atomic<int> current_node_{-1};
+  // The slot that serves the allocations of the current node, or -1.
+  std::atomic<int> current_slot_{-1};
+
+  const int num_nodes_;
+  std::unique_ptr<std::atomic<int64>[]> recorded_bytes_;
+  std::atomic<int64> num_slot_allocations_{0};
+  std::atomic<int64> num_slot_overflows_{0};
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArena);
+};
+
+// Hands out a `StepArena` to each step of an executor. The first step records
+// how much memory each node allocates, and the steps after it use the plan
+// built from that. If too many allocations of a step do not fit in their
+// slots, e.g. because the shapes grew, the plan is rebuilt with the larger
+// sizes.
+class StepArenaPlanner {
+ public:
+  // `lifetimes` and `escapes` are computed by `ComputeStepArenaLifetimes()`.
+  StepArenaPlanner(std::vector<ArenaBuffer> lifetimes,
+                   std::vector<bool> escapes, Allocator* base_allocator);
+
+  StepArena* StartStep();
+
+  // Must be called with the arena returned by `StartStep()` once all the
+  // kernels of the step have run.
+  void FinishStep(StepArena* arena);
+
+ private:
+  Allocator* const base_allocator_;  // Not owned.
+  // The lifetime of the memory of each node, indexed by node id.
+  const std::vector<ArenaBuffer> lifetimes_;
+  // Whether the outputs of each node may outlive the step.
+  const std::vector<bool> escapes_;
+
+  mutex mu_;
+  std::shared_ptr<const StepArenaPlan> plan_ TF_GUARDED_BY(mu_);
+
+  TF_DISALLOW_COPY_AND_ASSIGN(StepArenaPlanner);
+};
+
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_COMMON_RUNTIME_STEP_ARENA_H_
@@ -0,0 +1,219 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/common_runtime/step_arena.h"
+
+#include <set>
+
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace {
+
+ArenaBuffer Buffer(int64 size, int first_use, int last_use) {
+  ArenaBuffer buffer;
+  buffer.size = size;
+  buffer.first_use = first_use;
+  buffer.last_use = last_use;
+  return buffer;
+}
+
+TEST(PlanArenaOffsetsTest, Empty) {
+  std::vector<int64> offsets;
+  EXPECT_EQ(0, PlanArenaOffsets({}, &offsets));
+  EXPECT_TRUE(offsets.empty());
+}
+
+TEST(PlanArenaOffsetsTest, OverlappingLifetimes) {
+  std::vector<int64> offsets;
+  EXPECT_EQ(448, PlanArenaOffsets({Buffer(64, 0, 2), Buffer(256, 1, 2),
+                                   Buffer(128, 2, 3)},
+                                  &offsets));
+  EXPECT_EQ(384, offsets[0]);
+  EXPECT_EQ(0, offsets[1]);
+  EXPECT_EQ(256, offsets[2]);
+}
+
+TEST(PlanArenaOffsetsTest, ReusesMemory) {
+  // A chain, in which each buffer is used by the next node only.
+  std::vector<int64> offsets;
+  EXPECT_EQ(384, PlanArenaOffsets({Buffer(128, 0, 1), Buffer(256, 1, 2),
+                                   Buffer(128, 2, 3), Buffer(0, 3, 3)},
+                                  &offsets));
+  EXPECT_EQ(256, offsets[0]);
+  EXPECT_EQ(0, offsets[1]);
+  EXPECT_EQ(256, offsets[2]);
+}
+
+TEST(PlanArenaOffsetsTest, FillsGaps) {
+  std::vector<int64> offsets;
+  EXPECT_EQ(256, PlanArenaOffsets({Buffer(128, 0, 1), Buffer(64, 0, 0),
+                                   Buffer(128, 1, 2), Buffer(64, 2, 2)},
+                                  &offsets));
+  EXPECT_EQ(0, offsets[0]);
+  EXPECT_EQ(128, offsets[1]);
+  EXPECT_EQ(128, offsets[2]);
+  EXPECT_EQ(0, offsets[3]);
+}
+
+TEST(StepArenaPlanTest, OverlappingSlots) {
+  StepArenaPlan plan(
+      {Buffer(128, 0, 1), Buffer(256, 1, 2), Buffer(128, 2, 3)});
+  EXPECT_EQ(384, plan.arena_size());
+  EXPECT_EQ(std::vector<int>({2}), plan.slot(0).overlapping_slots);
+  EXPECT_TRUE(plan.slot(1).overlapping_slots.empty());
+  EXPECT_EQ(std::vector<int>({0}), plan.slot(2).overlapping_slots);
+}
+
+TEST(StepArenaTest, Recording) {
+  StepArena* arena = new StepArena(2, cpu_allocator());
+  EXPECT_TRUE(arena->is_recording());
+  arena->BeginNode(1);
+  {
+    Tensor t(arena, DT_FLOAT, TensorShape({10}));
+    EXPECT_FALSE(arena->Owns(t.data()));
+  }
+  arena->EndNode();
+  // 40 bytes are rounded up to 64, and preceded by a 64 byte header.
+  EXPECT_EQ(std::vector<int64>({0, 128}), arena->recorded_bytes());
+  arena->Release();
+}
+
+TEST(StepArenaTest, ServesAllocationsFromSlots) {
+  auto plan = std::make_shared<const StepArenaPlan>(std::vector<ArenaBuffer>(
+      {Buffer(128, 0, 1), Buffer(256, 1, 2), Buffer(128, 2, 3)}));
+  StepArena* arena = new StepArena(plan, cpu_allocator());
+  EXPECT_FALSE(arena->is_recording());
+
+  arena->BeginNode(0);
+  Tensor t0(arena, DT_FLOAT, TensorShape({10}));
+  // The slot of node 0 has room for only one allocation of this size.
+  Tensor t0_fallback(arena, DT_FLOAT, TensorShape({10}));
+  arena->EndNode();
+  EXPECT_TRUE(arena->Owns(t0.data()));
+  EXPECT_FALSE(arena->Owns(t0_fallback.data()));
+  EXPECT_EQ(0, reinterpret_cast<uintptr_t>(t0.data()) %
+                   Allocator::kAllocatorAlignment);
+
+  arena->BeginNode(1);
+  Tensor t1(arena, DT_FLOAT, TensorShape({10}));
+  arena->EndNode();
+  EXPECT_TRUE(arena->Owns(t1.data()));
+
+  // Node 2 shares the memory of node 0, which is still in use.
+  arena->BeginNode(2);
+  Tensor t2(arena, DT_FLOAT, TensorShape({10}));
+  arena->EndNode();
+  EXPECT_FALSE(arena->Owns(t2.data()));
+
+  // Once it is free, node 2 uses the same memory.
+  const void* t0_data = t0.data();
+  t0 = Tensor();
+  arena->BeginNode(2);
+  Tensor t2_reused(arena, DT_FLOAT, TensorShape({10}));
+  arena->EndNode();
+  EXPECT_EQ(t0_data, t2_reused.data());
+
+  // The arena outlives the step while its tensors are alive.
+  arena->Release();
+  t2_reused.flat<float>().setZero();
+}
+
+TEST(StepArenaTest, ConcurrentAllocationsFromOneNode) {
+  auto plan = std::make_shared<const StepArenaPlan>(
+      std::vector<ArenaBuffer>({Buffer(128 * 64, 0, 1)}));
+  StepArena* arena = new StepArena(plan, cpu_allocator());
+  arena->BeginNode(0);
+  std::vector<Tensor> tensors(64);
+  {
+    thread::ThreadPool pool(Env::Default(), "test", 8);
+    for (int i = 0; i < tensors.size(); ++i) {
+      pool.Schedule([arena, &tensors, i]() {
+        tensors[i] = Tensor(arena, DT_FLOAT, TensorShape({10}));
+        tensors[i].flat<float>().setConstant(i);
+      });
+    }
+  }
+  arena->EndNode();
+  std::set<const void*> addresses;
+  for (int i = 0; i < tensors.size(); ++i) {
+    EXPECT_TRUE(arena->Owns(tensors[i].data()));
+    EXPECT_EQ(i, tensors[i].flat<float>()(9));
+    addresses.insert(tensors[i].data());
+  }
+  EXPECT_EQ(tensors.size(), addresses.size());
+  EXPECT_EQ(0, arena->num_slot_overflows());
+  arena->Release();
+}
+
+TEST(StepArenaPlannerTest, EscapingNodesAreNotPlanned) {
+  StepArenaPlanner planner({Buffer(0, 0, 1), Buffer(0, 1, 2)}, {false, true},
+                           cpu_allocator());
+  StepArena* arena = planner.StartStep();
+  EXPECT_TRUE(arena->is_recording());
+  for (int node : {0, 1}) {
+    arena->BeginNode(node);
+    Tensor t(arena, DT_FLOAT, TensorShape({10}));
+    arena->EndNode();
+  }
+  planner.FinishStep(arena);
+
+  arena = planner.StartStep();
+  ASSERT_FALSE(arena->is_recording());
+  EXPECT_EQ(128, arena->plan()->slot(0).size);
+  EXPECT_EQ(0, arena->plan()->slot(1).size);
+  arena->BeginNode(1);
+  Tensor escaping(arena, DT_FLOAT, TensorShape({10}));
+  arena->EndNode();
+  EXPECT_FALSE(arena->Owns(escaping.data()));
+  planner.FinishStep(arena);
+}
+
+TEST(StepArenaPlannerTest, ReplansWhenAllocationsOverflow) {
+  StepArenaPlanner planner({Buffer(0, 0, 0)}, {false}, cpu_allocator());
+  auto run_step = [&planner](int64 num_elements) {
+    StepArena* arena = planner.StartStep();
+    arena->BeginNode(0);
+    Tensor t(arena, DT_FLOAT, TensorShape({num_elements}));
+    arena->EndNode();
+    const bool owned = arena->Owns(t.data());
+    std::shared_ptr<const StepArenaPlan> plan = arena->plan();
+    planner.FinishStep(arena);
+    return std::make_pair(owned, plan);
+  };
+
+  EXPECT_EQ(nullptr, run_step(10).second);
+  auto small = run_step(10);
+  EXPECT_TRUE(small.first);
+  EXPECT_EQ(128, small.second->slot(0).size);
+
+  // The larger tensor does not fit, and the next step uses a larger slot.
+  auto overflow = run_step(100);
+  EXPECT_FALSE(overflow.first);
+  EXPECT_EQ(small.second, overflow.second);
+  auto large = run_step(100);
+  EXPECT_TRUE(large.first);
+  EXPECT_EQ(512, large.second->slot(0).size);
+
+  // Slots do not shrink.
+  EXPECT_TRUE(run_step(10).first);
+  EXPECT_EQ(large.second, run_step(10).second);
+}
+
+}  // namespace
+}  // namespace tensorflow
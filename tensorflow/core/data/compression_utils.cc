@@ -14,24 +14,192 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/data/compression_utils.h"
 
+#include <algorithm>
+
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/platform/snappy.h"
 
 namespace tensorflow {
 namespace data {
+namespace {
 
-Status CompressElement(const std::vector<Tensor>& element,
-                       CompressedElement* out) {
+// Components smaller than this are stored raw: compressing them saves too few
+// bytes to pay for the CPU time.
+constexpr int64 kMinCompressBytes = 1024;
+// Number of leading bytes of a larger component that are compressed first to
+// estimate its compressibility, so that incompressible data such as encoded
+// images is not compressed in full.
+constexpr int64 kProbeBytes = 64 << 10;
+// A codec is used only if it shrinks a component to at most this fraction of
+// its size. Otherwise the component is stored raw, which is faster to decode.
+constexpr double kMaxCompressionRatio = 0.9;
+
+// Transposes `num_values` values of `value_size` bytes each, so that the i-th
+// bytes of all values are contiguous.
+void ByteShuffle(const char* input, int64 num_values, int value_size,
+                 char* output) {
+  for (int64 i = 0; i < num_values; ++i) {
+    for (int b = 0; b < value_size; ++b) {
+      output[b * num_values + i] = input[i * value_size + b];
+    }
+  }
+}
+
+// Inverts `ByteShuffle`.
+void ByteUnshuffle(const char* input, int64 num_values, int value_size,
+                   char* output) {
+  for (int b = 0; b < value_size; ++b) {
+    for (int64 i = 0; i < num_values; ++i) {
+      output[i * value_size + b] = input[b * num_values + i];
+    }
+  }
+}
+
+// Compresses `size` bytes at `data` with `codec`, appending them to `out` and
+// setting `compressed_size` to the number of bytes appended. `value_size` is
+// the size of the values the bytes hold, for byte shuffling. Returns false and
+// leaves `out` unchanged if the codec is not available on this platform.
+bool Compress(ComponentCodec codec, const char* data, size_t size,
+              int value_size, string* out, size_t* compressed_size) {
+  const char* input = data;
+  // We use tstring for access to resize_uninitialized.
+  tstring shuffled;
+  switch (codec) {
+    case CODEC_SNAPPY:
+      break;
+    case CODEC_SHUFFLE_SNAPPY:
+      shuffled.resize_uninitialized(size);
+      ByteShuffle(data, size / value_size, value_size, shuffled.mdata());
+      input = shuffled.data();
+      break;
+    default:
+      return false;
+  }
+  const size_t offset = out->size();
+  out->resize(offset + port::Snappy_MaxCompressedLength(size));
+  if (!port::Snappy_RawCompress(input, size, &(*out)[offset],
+                                compressed_size)) {
+    out->resize(offset);
+    return false;
+  }
+  out->resize(offset + *compressed_size);
+  return true;
+}
+
+// Returns the codec to try for a component of `size` bytes at `data`, holding
+// values of `dtype`. `raw_values` is false if the bytes are a serialized
+// TensorProto.
+ComponentCodec ChooseCodec(const char* data, size_t size, DataType dtype,
+                           bool raw_values) {
+  if (size < kMinCompressBytes) {
+    return CODEC_RAW;
+  }
+  ComponentCodec codec = CODEC_SNAPPY;
+  int value_size = 1;
+  if (raw_values && (DataTypeIsFloating(dtype) || DataTypeIsComplex(dtype))) {
+    codec = CODEC_SHUFFLE_SNAPPY;
+    value_size = DataTypeSize(dtype);
+  }
+  if (size > kProbeBytes) {
+    // kProbeBytes is a multiple of every value size.
+    string probe;
+    size_t probe_size;
+    if (!Compress(codec, data, kProbeBytes, value_size, &probe, &probe_size) ||
+        probe_size > kMaxCompressionRatio * kProbeBytes) {
+      return CODEC_RAW;
+    }
+  }
+  return codec;
+}
+
+// Encodes the `size` bytes of a component at `data`, appending them to `out`
+// and recording the codec and encoded size in `metadata`. Compressed bytes are
+// written directly into `out`, and dropped again if they are not small enough.
+void EncodeComponent(const char* data, size_t size, bool raw_values,
+                     CompressedComponentMetadata* metadata, string* out) {
+  ComponentCodec codec = ChooseCodec(data, size, metadata->dtype(), raw_values);
+  if (codec != CODEC_RAW) {
+    const size_t offset = out->size();
+    size_t compressed_size;
+    int value_size =
+        codec == CODEC_SHUFFLE_SNAPPY ? DataTypeSize(metadata->dtype()) : 1;
+    if (Compress(codec, data, size, value_size, out, &compressed_size)) {
+      if (compressed_size <= kMaxCompressionRatio * size) {
+        metadata->set_codec(codec);
+        metadata->set_compressed_size_bytes(compressed_size);
+        return;
+      }
+      out->resize(offset);
+    }
+  }
+  metadata->set_codec(CODEC_RAW);
+  metadata->set_compressed_size_bytes(size);
+  out->append(data, size);
+}
+
+// Decodes the encoded bytes of a component at `data` into the `size` bytes at
+// `dest`.
+Status DecodeComponent(const CompressedComponentMetadata& metadata,
+                       const char* data, char* dest, size_t size) {
+  const size_t compressed_size = metadata.compressed_size_bytes();
+  switch (metadata.codec()) {
+    case CODEC_RAW:
+      if (compressed_size != size) {
+        return errors::Internal("Raw component has ", compressed_size,
+                                " bytes, expected ", size);
+      }
+      memcpy(dest, data, size);
+      return Status::OK();
+    case CODEC_SNAPPY:
+    case CODEC_SHUFFLE_SNAPPY: {
+      size_t uncompressed_size;
+      if (!port::Snappy_GetUncompressedLength(data, compressed_size,
+                                              &uncompressed_size)) {
+        return errors::Internal("Could not get snappy uncompressed length");
+      }
+      if (uncompressed_size != size) {
+        return errors::Internal(
+            "Uncompressed size mismatch. Snappy expects ", uncompressed_size,
+            " whereas the tensor metadata suggests ", size);
+      }
+      if (metadata.codec() == CODEC_SNAPPY) {
+        if (!port::Snappy_Uncompress(data, compressed_size, dest)) {
+          return errors::Internal("Failed to perform snappy decompression.");
+        }
+        return Status::OK();
+      }
+      // We use tstring for access to resize_uninitialized.
+      tstring shuffled;
+      shuffled.resize_uninitialized(size);
+      if (!port::Snappy_Uncompress(data, compressed_size, shuffled.mdata())) {
+        return errors::Internal("Failed to perform snappy decompression.");
+      }
+      const int value_size = DataTypeSize(metadata.dtype());
+      if (value_size <= 0 || size % value_size != 0) {
+        return errors::DataLoss("Shuffled component of ", size,
+                                " bytes is not a whole number of ",
+                                DataTypeString(metadata.dtype()), " values");
+      }
+      ByteUnshuffle(shuffled.data(), size / value_size, value_size, dest);
+      return Status::OK();
+    }
+    default:
+      return errors::Internal("Unknown component codec ", metadata.codec());
+  }
+}
+
+// Compresses `element` into a version 0 `CompressedElement`, whose data is a
+// single snappy block covering all components.
+Status CompressElementV0(const std::vector<Tensor>& element,
+                         CompressedElement* out) {
   // Step 1: Determine the total uncompressed size. This requires serializing
   // non-memcopyable tensors, which we save to use again later.
   std::vector<TensorProto> non_memcpy_components;
   int64 total_size = 0;
   for (auto& component : element) {
     if (DataTypeCanUseMemcpy(component.dtype())) {
-      // Some datatypes can be memcopied, allowing us to save two copies
-      // (AsProtoTensorContent and SerializeToArray).
-      total_size += DMAHelper::buffer(&component)->size();
+      total_size += component.tensor_data().size();
     } else {
       non_memcpy_components.emplace_back();
       component.AsProtoTensorContent(&non_memcpy_components.back());
@@ -52,9 +220,9 @@ Status CompressElement(const std::vector<Tensor>& element,
     metadata->set_dtype(component.dtype());
     component.shape().AsProto(metadata->mutable_tensor_shape());
     if (DataTypeCanUseMemcpy(component.dtype())) {
-      const TensorBuffer* buffer = DMAHelper::buffer(&component);
-      memcpy(position, buffer->data(), buffer->size());
-      metadata->set_tensor_size_bytes(buffer->size());
+      StringPiece bytes = component.tensor_data();
+      memcpy(position, bytes.data(), bytes.size());
+      metadata->set_tensor_size_bytes(bytes.size());
     } else {
       TensorProto& proto = non_memcpy_components[non_memcpy_component_index++];
       proto.SerializeToArray(position, proto.ByteSizeLong());
@@ -68,13 +236,13 @@ Status CompressElement(const std::vector<Tensor>& element,
                              out->mutable_data())) {
     return errors::Internal("Failed to compress using snappy.");
   }
-  VLOG(3) << "Compressed element from " << total_size << " bytes to "
-          << out->data().size() << " bytes";
   return Status::OK();
 }
 
-Status UncompressElement(const CompressedElement& compressed,
-                         std::vector<Tensor>* out) {
+// Uncompresses a version 0 `CompressedElement`, whose data is a single snappy
+// block covering all components.
+Status UncompressElementV0(const CompressedElement& compressed,
+                           std::vector<Tensor>* out) {
   int num_components = compressed.component_metadata_size();
   out->clear();
   out->reserve(num_components);
@@ -144,5 +312,136 @@ Status UncompressElement(const CompressedElement& compressed,
   return Status::OK();
 }
 
+}  // namespace
+
+Status CompressElement(const std::vector<Tensor>& element,
+                       CompressedElement* out) {
+  // Serialize non-memcopyable tensors up front, so that the total size of the
+  // element is known before writing it.
+  std::vector<TensorProto> non_memcpy_components;
+  int64 total_size = 0;
+  size_t max_component_size = 0;
+  for (auto& component : element) {
+    size_t component_size;
+    if (DataTypeCanUseMemcpy(component.dtype())) {
+      // Some datatypes can be memcopied, allowing us to save two copies
+      // (AsProtoTensorContent and SerializeToArray).
+      component_size = component.tensor_data().size();
+    } else {
+      non_memcpy_components.emplace_back();
+      component.AsProtoTensorContent(&non_memcpy_components.back());
+      component_size = non_memcpy_components.back().ByteSizeLong();
+    }
+    total_size += component_size;
+    max_component_size = std::max(max_component_size, component_size);
+  }
+
+  // Each component is encoded separately, with a codec chosen for its type
+  // and contents.
+  out->set_version(kCompressedElementVersion);
+  string* data = out->mutable_data();
+  // Components are compressed in place, so leave room for the worst case
+  // compressed size of the largest one.
+  data->reserve(total_size +
+                std::max(port::Snappy_MaxCompressedLength(max_component_size),
+                         max_component_size) -
+                max_component_size);
+  int non_memcpy_component_index = 0;
+  for (auto& component : element) {
+    CompressedComponentMetadata* metadata =
+        out->mutable_component_metadata()->Add();
+    metadata->set_dtype(component.dtype());
+    component.shape().AsProto(metadata->mutable_tensor_shape());
+    if (DataTypeCanUseMemcpy(component.dtype())) {
+      StringPiece bytes = component.tensor_data();
+      metadata->set_tensor_size_bytes(bytes.size());
+      EncodeComponent(bytes.data(), bytes.size(), /*raw_values=*/true,
+                      metadata, data);
+    } else {
+      TensorProto& proto = non_memcpy_components[non_memcpy_component_index++];
+      // We use tstring for access to resize_uninitialized.
+      tstring serialized;
+      serialized.resize_uninitialized(proto.ByteSizeLong());
+      proto.SerializeToArray(serialized.mdata(), serialized.size());
+      metadata->set_tensor_size_bytes(serialized.size());
+      EncodeComponent(serialized.data(), serialized.size(),
+                      /*raw_values=*/false, metadata, data);
+    }
+  }
+  VLOG(3) << "Compressed element from " << total_size << " bytes to "
+          << data->size() << " bytes";
+  return Status::OK();
+}
+
+Status ConvertCompressedElement(int32 max_version, CompressedElement* element) {
+  if (element->version() <= max_version) {
+    return Status::OK();
+  }
+  std::vector<Tensor> components;
+  TF_RETURN_IF_ERROR(UncompressElement(*element, &components));
+  CompressedElement converted;
+  TF_RETURN_IF_ERROR(CompressElementV0(components, &converted));
+  element->Swap(&converted);
+  return Status::OK();
+}
+
+Status UncompressElement(const CompressedElement& compressed,
+                         std::vector<Tensor>* out) {
+  if (compressed.version() == 0) {
+    return UncompressElementV0(compressed, out);
+  }
+  if (compressed.version() != kCompressedElementVersion) {
+    return errors::Unimplemented("Unsupported CompressedElement version ",
+                                 compressed.version());
+  }
+  int num_components = compressed.component_metadata_size();
+  out->clear();
+  out->reserve(num_components);
+  const std::string& data = compressed.data();
+  size_t offset = 0;
+  for (int i = 0; i < num_components; ++i) {
+    const CompressedComponentMetadata& metadata =
+        compressed.component_metadata(i);
+    if (metadata.compressed_size_bytes() > data.size() - offset) {
+      return errors::Internal("Component ", i, " of ",
+                              metadata.compressed_size_bytes(),
+                              " bytes exceeds the compressed element data");
+    }
+    const char* component_data = data.data() + offset;
+    offset += metadata.compressed_size_bytes();
+    if (DataTypeCanUseMemcpy(metadata.dtype())) {
+      // Decode directly into the buffer of the output tensor.
+      out->emplace_back(metadata.dtype(), metadata.tensor_shape());
+      Tensor& tensor = out->back();
+      const size_t size = tensor.tensor_data().size();
+      if (metadata.tensor_size_bytes() != size) {
+        return errors::Internal("Component ", i, " has ",
+                                metadata.tensor_size_bytes(),
+                                " bytes, but its shape requires ", size);
+      }
+      char* dest = static_cast<char*>(DMAHelper::base(&tensor));
+      TF_RETURN_IF_ERROR(
+          DecodeComponent(metadata, component_data, dest, size));
+    } else {
+      // We use tstring for access to resize_uninitialized.
+      tstring tensor_proto_str;
+      tensor_proto_str.resize_uninitialized(metadata.tensor_size_bytes());
+      TF_RETURN_IF_ERROR(DecodeComponent(metadata, component_data,
+                                         tensor_proto_str.mdata(),
+                                         tensor_proto_str.size()));
+      TensorProto tp;
+      if (!tp.ParseFromArray(tensor_proto_str.data(),
+                             tensor_proto_str.size())) {
+        return errors::Internal("Could not parse TensorProto");
+      }
+      out->emplace_back();
+      if (!out->back().FromProto(tp)) {
+        return errors::Internal("Could not parse Tensor");
+      }
+    }
+  }
+  return Status::OK();
+}
+
 }  // namespace data
 }  // namespace tensorflow
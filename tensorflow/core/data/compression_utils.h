@@ -22,14 +22,28 @@ limitations under the License.
 namespace tensorflow {
 namespace data {
 
+// The version of `CompressedElement` written by `CompressElement`. Version 0
+// elements, whose data is a single snappy block, can still be read and
+// written for readers that do not support version 1.
+constexpr int32 kCompressedElementVersion = 1;
+
 // Compresses the components of `element` into the `CompressedElement` proto.
 //
 // In addition to writing the actual compressed bytes, `Compress` fills
-// out the per-component metadata for the `CompressedElement`.
+// out the per-component metadata for the `CompressedElement`. Each component
+// is encoded with its own codec: small and incompressible components are
+// stored raw, floating point tensors are byte shuffled before compression,
+// and other components are compressed with snappy.
 Status CompressElement(const std::vector<Tensor>& element,
                        CompressedElement* out);
 
-// Uncompresses a `CompressedElement` into a vector of tensor components.
+// Re-encodes `element` in version 0 if it is newer than `max_version`, the
+// latest version that its reader supports.
+Status ConvertCompressedElement(int32 max_version, CompressedElement* element);
+
+// Uncompresses a `CompressedElement` into a vector of tensor components. The
+// components of memcopyable types are decoded directly into the buffers of the
+// output tensors.
 Status UncompressElement(const CompressedElement& compressed,
                          std::vector<Tensor>* out);
 
@@ -16,6 +16,9 @@ limitations under the License.
 
 #include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/kernels/data/dataset_test_base.h"
+#include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/random_distributions.h"
+#include "tensorflow/core/platform/snappy.h"
 #include "tensorflow/core/platform/test.h"
 
 namespace tensorflow {
@@ -35,6 +38,29 @@ TEST_P(ParameterizedCompressionUtilsTest, RoundTrip) {
       ExpectEqual(element, round_trip_element, /*compare_order=*/true));
 }
 
+// Returns a tensor of `n` floats that vary slowly, as model inputs often do.
+Tensor SmoothFloats(int64 n) {
+  Tensor t(DT_FLOAT, TensorShape({n}));
+  for (int64 i = 0; i < n; ++i) {
+    t.flat<float>()(i) = 1.0f + i / static_cast<float>(n);
+  }
+  return t;
+}
+
+// Returns a string tensor holding `n` random bytes, like an encoded image.
+Tensor RandomBytes(int64 n) {
+  random::PhiloxRandom philox(/*seed=*/42);
+  random::UniformDistribution<random::PhiloxRandom, uint32> dist;
+  std::string bytes;
+  while (bytes.size() < static_cast<size_t>(n)) {
+    auto samples = dist(&philox);
+    bytes.append(reinterpret_cast<const char*>(&samples[0]),
+                 sizeof(samples[0]) * samples.size());
+  }
+  bytes.resize(n);
+  return CreateTensor<tstring>(TensorShape{}, {bytes});
+}
+
 std::vector<std::vector<Tensor>> TestCases() {
   return {
       CreateTensors<int64>(TensorShape{1}, {{1}}),             // int64
@@ -43,11 +69,96 @@ std::vector<std::vector<Tensor>> TestCases() {
       {CreateTensor<tstring>(TensorShape{1}, {"a"}),
        CreateTensor<int64>(TensorShape{1}, {1})},  // mixed tstring/int64
       {},                                          // empty
+      {Tensor(DT_INT64, TensorShape{0})},          // zero-element tensor
+      {SmoothFloats(100000)},                      // large float
+      {RandomBytes(100000)},                       // incompressible string
+      {CreateTensor<int64>(TensorShape{4096}, std::vector<int64>(4096, 7)),
+       SmoothFloats(2048), CreateTensor<tstring>(TensorShape{1}, {"a"})},
   };
 }
 
 INSTANTIATE_TEST_SUITE_P(Instantiation, ParameterizedCompressionUtilsTest,
                          ::testing::ValuesIn(TestCases()));
 
+TEST(CompressionUtilsTest, ComponentCodecs) {
+  std::vector<Tensor> element = {
+      CreateTensor<int64>(TensorShape{1}, {1}), SmoothFloats(100000),
+      CreateTensor<int64>(TensorShape{4096}, std::vector<int64>(4096, 7)),
+      RandomBytes(100000)};
+  CompressedElement compressed;
+  TF_ASSERT_OK(CompressElement(element, &compressed));
+  ASSERT_EQ(compressed.component_metadata_size(), 4);
+  EXPECT_EQ(compressed.component_metadata(0).codec(), CODEC_RAW);
+  EXPECT_EQ(compressed.component_metadata(3).codec(), CODEC_RAW);
+  std::string unused;
+  if (port::Snappy_Compress("", 0, &unused)) {
+    EXPECT_EQ(compressed.component_metadata(1).codec(), CODEC_SHUFFLE_SNAPPY);
+    EXPECT_EQ(compressed.component_metadata(2).codec(), CODEC_SNAPPY);
+  }
+}
+
+TEST(CompressionUtilsTest, UncompressVersion0) {
+  std::string unused;
+  if (!port::Snappy_Compress("", 0, &unused)) {
+    GTEST_SKIP() << "Snappy is not available";
+  }
+  Tensor tensor = CreateTensor<int64>(TensorShape{2}, {1, 2});
+  CompressedElement compressed;
+  CompressedComponentMetadata* metadata = compressed.add_component_metadata();
+  metadata->set_dtype(DT_INT64);
+  tensor.shape().AsProto(metadata->mutable_tensor_shape());
+  metadata->set_tensor_size_bytes(tensor.tensor_data().size());
+  ASSERT_TRUE(port::Snappy_Compress(tensor.tensor_data().data(),
+                                    tensor.tensor_data().size(),
+                                    compressed.mutable_data()));
+  std::vector<Tensor> uncompressed;
+  TF_ASSERT_OK(UncompressElement(compressed, &uncompressed));
+  TF_EXPECT_OK(DatasetOpsTestBase::ExpectEqual({tensor}, uncompressed,
+                                               /*compare_order=*/true));
+}
+
+TEST(CompressionUtilsTest, ConvertToVersion0) {
+  std::string unused;
+  if (!port::Snappy_Compress("", 0, &unused)) {
+    GTEST_SKIP() << "Snappy is not available";
+  }
+  std::vector<Tensor> element = {
+      SmoothFloats(100000), CreateTensor<tstring>(TensorShape{1}, {"a"})};
+  CompressedElement compressed;
+  TF_ASSERT_OK(CompressElement(element, &compressed));
+  ASSERT_EQ(compressed.version(), kCompressedElementVersion);
+
+  CompressedElement unchanged = compressed;
+  TF_ASSERT_OK(
+      ConvertCompressedElement(kCompressedElementVersion, &unchanged));
+  EXPECT_EQ(unchanged.data(), compressed.data());
+
+  TF_ASSERT_OK(ConvertCompressedElement(/*max_version=*/0, &compressed));
+  EXPECT_EQ(compressed.version(), 0);
+  std::vector<Tensor> uncompressed;
+  TF_ASSERT_OK(UncompressElement(compressed, &uncompressed));
+  TF_EXPECT_OK(DatasetOpsTestBase::ExpectEqual(element, uncompressed,
+                                               /*compare_order=*/true));
+}
+
+TEST(CompressionUtilsTest, ShuffledComponentWithoutWholeValues) {
+  std::string unused;
+  if (!port::Snappy_Compress("", 0, &unused)) {
+    GTEST_SKIP() << "Snappy is not available";
+  }
+  // Only components with fixed size values are shuffled.
+  CompressedElement compressed;
+  compressed.set_version(kCompressedElementVersion);
+  CompressedComponentMetadata* metadata = compressed.add_component_metadata();
+  metadata->set_dtype(DT_STRING);
+  metadata->set_tensor_size_bytes(6);
+  metadata->set_codec(CODEC_SHUFFLE_SNAPPY);
+  ASSERT_TRUE(port::Snappy_Compress("abcdef", 6, compressed.mutable_data()));
+  metadata->set_compressed_size_bytes(compressed.data().size());
+  std::vector<Tensor> uncompressed;
+  EXPECT_EQ(UncompressElement(compressed, &uncompressed).code(),
+            error::DATA_LOSS);
+}
+
 }  // namespace data
 }  // namespace tensorflow
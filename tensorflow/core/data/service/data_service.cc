@@ -15,8 +15,11 @@ limitations under the License.
 
 #include "tensorflow/core/data/service/data_service.h"
 
+#include <algorithm>
+
 #include "grpcpp/create_channel.h"
 #include "grpcpp/security/credentials.h"
+#include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/data/service/credentials_factory.h"
 #include "tensorflow/core/data/service/grpc_util.h"
 #include "tensorflow/core/data/service/master.grpc.pb.h"
@@ -92,6 +95,7 @@ Status DataServiceMasterClient::GetOrCreateJob(int64 dataset_id,
                                                ProcessingMode processing_mode,
                                                const std::string& job_name,
                                                int job_name_index,
+                                               int64 num_consumers,
                                                int64* job_id) {
   TF_RETURN_IF_ERROR(EnsureInitialized());
   GetOrCreateJobRequest req;
@@ -99,6 +103,7 @@ Status DataServiceMasterClient::GetOrCreateJob(int64 dataset_id,
   req.set_processing_mode(ProcessingModeDef(processing_mode));
   req.set_job_name(job_name);
   req.set_job_name_index(job_name_index);
+  req.set_num_consumers(num_consumers);
   GetOrCreateJobResponse resp;
   grpc::ClientContext client_ctx;
   grpc::Status status = stub_->GetOrCreateJob(&client_ctx, req, &resp);
@@ -157,12 +162,14 @@ Status DataServiceMasterClient::EnsureInitialized() {
   return Status::OK();
 }
 
-Status DataServiceWorkerClient::GetElement(int64 task_id,
+Status DataServiceWorkerClient::GetElement(int64 task_id, int64 consumer_index,
                                            CompressedElement* element,
                                            bool* end_of_sequence) {
   TF_RETURN_IF_ERROR(EnsureInitialized());
   GetElementRequest req;
   req.set_task_id(task_id);
+  req.set_consumer_index(consumer_index);
+  req.set_compressed_element_version(kCompressedElementVersion);
   GetElementResponse resp;
   grpc_impl::ClientContext ctx;
   grpc::Status s = stub_->GetElement(&ctx, req, &resp);
@@ -176,6 +183,83 @@ Status DataServiceWorkerClient::GetElement(int64 task_id,
   return Status::OK();
 }
 
+DataServiceWorkerClient::ElementStream::~ElementStream() {
+  if (!finished_) {
+    ctx_.TryCancel();
+    GetElementResponse resp;
+    while (stream_->Read(&resp)) {
+    }
+    stream_->Finish();
+  }
+}
+
+Status DataServiceWorkerClient::ElementStream::GetNext(
+    CompressedElement* element, bool* end_of_sequence) {
+  if (finished_) {
+    return errors::FailedPrecondition("Element stream has already finished");
+  }
+  GetElementResponse resp;
+  if (!stream_->Read(&resp)) {
+    finished_ = true;
+    grpc::Status s = stream_->Finish();
+    if (!s.ok()) {
+      return grpc_util::WrapError("Failed to get element", s);
+    }
+    return errors::Unavailable(
+        "Element stream ended before the end of the task was reached");
+  }
+  ++next_element_index_;
+  *end_of_sequence = resp.end_of_sequence();
+  if (*end_of_sequence) {
+    return Status::OK();
+  }
+  *element = std::move(*resp.mutable_compressed_element());
+  // Credits are granted in batches of half the window, so that a credit
+  // message is not needed for every element while the window stays mostly
+  // full.
+  if (++num_consumed_ >= std::max<int64>(1, window_size_ / 2)) {
+    GetElementStreamRequest req;
+    req.set_credits(num_consumed_);
+    req.set_next_element_index(next_element_index_);
+    num_consumed_ = 0;
+    // A failed write means that the stream is broken, which the next `Read`
+    // reports.
+    stream_->Write(req);
+  }
+  return Status::OK();
+}
+
+void DataServiceWorkerClient::ElementStream::Cancel() { ctx_.TryCancel(); }
+
+Status DataServiceWorkerClient::OpenElementStream(
+    int64 task_id, int64 consumer_index, int64 window_size, int64 stream_id,
+    int64 next_element_index, std::unique_ptr<ElementStream>* stream) {
+  if (!stub_) {
+    TF_RETURN_IF_ERROR(EnsureInitialized());
+  }
+  if (window_size <= 0) {
+    return errors::InvalidArgument("Element stream window size must be ",
+                                   "positive, got ", window_size);
+  }
+  if (stream_id == 0) {
+    return errors::InvalidArgument("Element stream ids must be non-zero");
+  }
+  std::unique_ptr<ElementStream> new_stream(
+      new ElementStream(window_size, next_element_index));
+  new_stream->stream_ = stub_->GetElementStream(&new_stream->ctx_);
+  GetElementStreamRequest req;
+  req.set_task_id(task_id);
+  req.set_consumer_index(consumer_index);
+  req.set_compressed_element_version(kCompressedElementVersion);
+  req.set_credits(window_size);
+  req.set_stream_id(stream_id);
+  req.set_next_element_index(next_element_index);
+  // If the write fails, the first `GetNext` reports the error.
+  new_stream->stream_->Write(req);
+  *stream = std::move(new_stream);
+  return Status::OK();
+}
+
 Status DataServiceWorkerClient::EnsureInitialized() {
   std::shared_ptr<grpc::ChannelCredentials> credentials;
   TF_RETURN_IF_ERROR(
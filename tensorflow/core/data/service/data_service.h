@@ -85,10 +85,12 @@ class DataServiceMasterClient : public DataServiceClientBase {
 
   // Gets the job id for the job represented by the tuple
   // (job_name, job_name_index), and stores the id in *job_id. If the
-  // job doesn't exist yet, it will be created.
+  // job doesn't exist yet, it will be created. If `num_consumers` is positive,
+  // the job is shared: each of its elements is read by all `num_consumers`
+  // consumers.
   Status GetOrCreateJob(int64 dataset_id, ProcessingMode processing_mode,
                         const std::string& job_name, int job_name_index,
-                        int64* job_id);
+                        int64 num_consumers, int64* job_id);
 
   // Queries the master for the tasks associated with the specified job.
   // The tasks will be stored in *tasks, and whether the job is finished will
@@ -117,8 +119,61 @@ class DataServiceWorkerClient : public DataServiceClientBase {
   // Fetches the next element for the specified task_id. The element's
   // compressed tensors will be stored in *element. If no element is available,
   // `*end_of_sequence` will be `true`, and `element` will be left unchanged.
-  Status GetElement(int64 task_id, CompressedElement* element,
-                    bool* end_of_sequence);
+  // `consumer_index` identifies the reader of a task of a shared job, and is
+  // ignored for other tasks.
+  Status GetElement(int64 task_id, int64 consumer_index,
+                    CompressedElement* element, bool* end_of_sequence);
+
+  // A stream of the elements of a task, fetched with a single streaming RPC.
+  // The stream keeps up to `window_size` elements in flight: it grants the
+  // worker credits for elements as they are consumed, and the worker sends
+  // one element per credit. Credits also acknowledge the elements received,
+  // so that a broken stream can be reopened with the same stream id at
+  // `next_element_index()` without losing or repeating elements. Only
+  // `Cancel` may be called concurrently with other methods.
+  class ElementStream {
+   public:
+    ~ElementStream();
+
+    // Gets the next element of the stream. If the task has no more elements,
+    // `*end_of_sequence` will be `true`, and `element` will be left unchanged.
+    // After an error, the stream must not be used anymore. An Unimplemented
+    // error indicates that the worker does not support element streaming.
+    Status GetNext(CompressedElement* element, bool* end_of_sequence);
+
+    // Cancels the stream, unblocking any pending `GetNext`.
+    void Cancel();
+
+    // Returns the index in the stream of the next element to receive.
+    int64 next_element_index() const { return next_element_index_; }
+
+   private:
+    friend class DataServiceWorkerClient;
+
+    ElementStream(int64 window_size, int64 next_element_index)
+        : window_size_(window_size), next_element_index_(next_element_index) {}
+
+    const int64 window_size_;
+    int64 next_element_index_;
+    grpc::ClientContext ctx_;
+    std::unique_ptr<
+        grpc::ClientReaderWriter<GetElementStreamRequest, GetElementResponse>>
+        stream_;
+    // Number of elements consumed since credits were last granted.
+    int64 num_consumed_ = 0;
+    // Whether the RPC has completed.
+    bool finished_ = false;
+  };
+
+  // Opens a stream of the elements of `task_id`, with up to `window_size`
+  // elements in flight. `consumer_index` is as for `GetElement`. `stream_id`
+  // must be non-zero and unique to the stream. To resume a broken stream,
+  // pass its id and `next_element_index()`; otherwise pass 0. Resuming fails
+  // with DataLoss if the worker no longer has the elements to resume from.
+  Status OpenElementStream(int64 task_id, int64 consumer_index,
+                           int64 window_size, int64 stream_id,
+                           int64 next_element_index,
+                           std::unique_ptr<ElementStream>* stream);
 
  protected:
   Status EnsureInitialized() override;
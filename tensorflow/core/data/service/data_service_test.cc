@@ -15,10 +15,13 @@ limitations under the License.
 
 #include "tensorflow/core/data/service/data_service.h"
 
+#include <numeric>
+
 #include "grpcpp/create_channel.h"
 #include "grpcpp/security/credentials.h"
 #include "absl/strings/str_split.h"
 #include "tensorflow/core/data/compression_utils.h"
+#include "tensorflow/core/data/service/credentials_factory.h"
 #include "tensorflow/core/data/service/grpc_util.h"
 #include "tensorflow/core/data/service/master.grpc.pb.h"
 #include "tensorflow/core/data/service/master.pb.h"
@@ -27,8 +30,11 @@ limitations under the License.
 #include "tensorflow/core/data/service/test_util.h"
 #include "tensorflow/core/data/service/worker.grpc.pb.h"
 #include "tensorflow/core/data/service/worker.pb.h"
+#include "tensorflow/core/data/service/worker_impl.h"
 #include "tensorflow/core/kernels/data/dataset_test_base.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
+#include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/test.h"
 
@@ -37,8 +43,71 @@ namespace data {
 
 namespace {
 constexpr const char kProtocol[] = "grpc+local";
+
+// Registers `graph_def` and creates a job for it on a cluster with a single
+// worker, storing the id of the job's task in `*task_id`. The job is shared
+// if `num_consumers` is positive.
+Status CreateTask(TestCluster& cluster, const GraphDef& graph_def,
+                  int64 num_consumers, int64* task_id) {
+  DataServiceMasterClient master(cluster.MasterAddress(), kProtocol);
+  int64 dataset_id;
+  TF_RETURN_IF_ERROR(master.RegisterDataset(graph_def, &dataset_id));
+  int64 job_id;
+  if (num_consumers > 0) {
+    TF_RETURN_IF_ERROR(master.GetOrCreateJob(
+        dataset_id, ProcessingMode::PARALLEL_EPOCHS, "shared_job",
+        /*job_name_index=*/0, num_consumers, &job_id));
+  } else {
+    TF_RETURN_IF_ERROR(
+        master.CreateJob(dataset_id, ProcessingMode::PARALLEL_EPOCHS, &job_id));
+  }
+  std::vector<TaskInfo> tasks;
+  bool job_finished;
+  TF_RETURN_IF_ERROR(master.GetTasks(job_id, &tasks, &job_finished));
+  if (tasks.size() != 1) {
+    return errors::Internal("Expected 1 task, got ", tasks.size());
+  }
+  *task_id = tasks[0].id();
+  return Status::OK();
+}
+
+// Stores the single int64 component of `compressed` in `*value`.
+Status UncompressValue(const CompressedElement& compressed, int64* value) {
+  std::vector<Tensor> components;
+  TF_RETURN_IF_ERROR(UncompressElement(compressed, &components));
+  if (components.size() != 1) {
+    return errors::Internal("Expected 1 component, got ", components.size());
+  }
+  *value = components[0].scalar<int64>()();
+  return Status::OK();
+}
+
+// Gets the next element of `stream`, and stores its value in `*value`.
+Status GetNextValue(DataServiceWorkerClient::ElementStream* stream,
+                    int64* value, bool* end_of_sequence) {
+  CompressedElement compressed;
+  TF_RETURN_IF_ERROR(stream->GetNext(&compressed, end_of_sequence));
+  if (*end_of_sequence) {
+    return Status::OK();
+  }
+  return UncompressValue(compressed, value);
 }
 
+// Gets the next element of `task_id` for `consumer_index`, and stores its
+// value in `*value`.
+Status GetValue(DataServiceWorkerClient* worker, int64 task_id,
+                int64 consumer_index, int64* value, bool* end_of_sequence) {
+  CompressedElement compressed;
+  TF_RETURN_IF_ERROR(
+      worker->GetElement(task_id, consumer_index, &compressed,
+                         end_of_sequence));
+  if (*end_of_sequence) {
+    return Status::OK();
+  }
+  return UncompressValue(compressed, value);
+}
+}  // namespace
+
 TEST(DataService, ParseParallelEpochsProcessingMode) {
   ProcessingMode mode;
   TF_ASSERT_OK(ParseProcessingMode("parallel_epochs", &mode));
@@ -72,5 +141,336 @@ TEST(DataService, GetWorkers) {
   EXPECT_EQ(1, workers.size());
 }
 
+TEST(DataService, SharedJobNumConsumersMismatch) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::map_test_case(&test_case));
+  DataServiceMasterClient master(cluster.MasterAddress(), kProtocol);
+  int64 dataset_id;
+  TF_ASSERT_OK(master.RegisterDataset(test_case.graph_def, &dataset_id));
+  int64 job_id;
+  TF_ASSERT_OK(master.GetOrCreateJob(
+      dataset_id, ProcessingMode::PARALLEL_EPOCHS, "shared_job",
+      /*job_name_index=*/0, /*num_consumers=*/2, &job_id));
+  int64 same_job_id;
+  TF_ASSERT_OK(master.GetOrCreateJob(
+      dataset_id, ProcessingMode::PARALLEL_EPOCHS, "shared_job",
+      /*job_name_index=*/0, /*num_consumers=*/2, &same_job_id));
+  EXPECT_EQ(job_id, same_job_id);
+  Status s = master.GetOrCreateJob(
+      dataset_id, ProcessingMode::PARALLEL_EPOCHS, "shared_job",
+      /*job_name_index=*/0, /*num_consumers=*/3, &same_job_id);
+  EXPECT_EQ(s.code(), error::Code::FAILED_PRECONDITION);
+}
+
+TEST(DataService, ElementStreamUnknownTask) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  std::unique_ptr<DataServiceWorkerClient::ElementStream> stream;
+  TF_ASSERT_OK(worker->OpenElementStream(/*task_id=*/-1, /*consumer_index=*/0,
+                                         /*window_size=*/4, /*stream_id=*/1,
+                                         /*next_element_index=*/0, &stream));
+  CompressedElement element;
+  bool end_of_sequence;
+  Status s = stream->GetNext(&element, &end_of_sequence);
+  EXPECT_EQ(s.code(), error::Code::NOT_FOUND);
+  s = stream->GetNext(&element, &end_of_sequence);
+  EXPECT_EQ(s.code(), error::Code::FAILED_PRECONDITION);
+}
+
+TEST(DataService, ElementStreamInvalidWindowSize) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  std::unique_ptr<DataServiceWorkerClient::ElementStream> stream;
+  Status s = worker->OpenElementStream(/*task_id=*/0, /*consumer_index=*/0,
+                                       /*window_size=*/0, /*stream_id=*/1,
+                                       /*next_element_index=*/0, &stream);
+  EXPECT_EQ(s.code(), error::Code::INVALID_ARGUMENT);
+}
+
+TEST(DataService, ElementsMatchClientCompressionVersion) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(/*num_elements=*/2,
+                                                     &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(CreateTask(cluster, test_case.graph_def, /*num_consumers=*/0,
+                          &task_id));
+  std::shared_ptr<grpc::ChannelCredentials> credentials;
+  TF_ASSERT_OK(
+      CredentialsFactory::CreateClientCredentials(kProtocol, &credentials));
+  std::unique_ptr<WorkerService::Stub> stub = WorkerService::NewStub(
+      grpc::CreateChannel(cluster.WorkerAddress(0), credentials));
+
+  // A client that predates `compressed_element_version` gets version 0.
+  GetElementRequest req;
+  req.set_task_id(task_id);
+  GetElementResponse resp;
+  {
+    grpc_impl::ClientContext ctx;
+    grpc::Status s = stub->GetElement(&ctx, req, &resp);
+    ASSERT_TRUE(s.ok()) << s.error_message();
+  }
+  EXPECT_EQ(resp.compressed_element().version(), 0);
+  int64 value;
+  TF_ASSERT_OK(UncompressValue(resp.compressed_element(), &value));
+  EXPECT_EQ(value, 0);
+
+  req.set_compressed_element_version(kCompressedElementVersion);
+  {
+    grpc_impl::ClientContext ctx;
+    grpc::Status s = stub->GetElement(&ctx, req, &resp);
+    ASSERT_TRUE(s.ok()) << s.error_message();
+  }
+  EXPECT_EQ(resp.compressed_element().version(), kCompressedElementVersion);
+  TF_ASSERT_OK(UncompressValue(resp.compressed_element(), &value));
+  EXPECT_EQ(value, 1);
+}
+
+TEST(DataService, ElementStreamResumesAfterBreak) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  const int64 kNumElements = 10;
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(kNumElements, &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(CreateTask(cluster, test_case.graph_def, /*num_consumers=*/0,
+                          &task_id));
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  const int64 kStreamId = 42;
+  std::vector<int64> values;
+  std::unique_ptr<DataServiceWorkerClient::ElementStream> stream;
+  TF_ASSERT_OK(worker->OpenElementStream(task_id, /*consumer_index=*/0,
+                                         /*window_size=*/4, kStreamId,
+                                         /*next_element_index=*/0, &stream));
+  // Break the stream in the middle of its window, while the worker has sent
+  // elements which were not received.
+  for (int i = 0; i < 3; ++i) {
+    int64 value;
+    bool end_of_sequence;
+    TF_ASSERT_OK(GetNextValue(stream.get(), &value, &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    values.push_back(value);
+  }
+  const int64 next_element_index = stream->next_element_index();
+  EXPECT_EQ(next_element_index, 3);
+  stream.reset();
+
+  TF_ASSERT_OK(worker->OpenElementStream(task_id, /*consumer_index=*/0,
+                                         /*window_size=*/4, kStreamId,
+                                         next_element_index, &stream));
+  while (true) {
+    int64 value;
+    bool end_of_sequence;
+    TF_ASSERT_OK(GetNextValue(stream.get(), &value, &end_of_sequence));
+    if (end_of_sequence) {
+      break;
+    }
+    values.push_back(value);
+  }
+  std::vector<int64> expected(kNumElements);
+  std::iota(expected.begin(), expected.end(), 0);
+  EXPECT_EQ(values, expected);
+}
+
+TEST(DataService, ElementStreamResumeUnknownStream) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(10, &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(CreateTask(cluster, test_case.graph_def, /*num_consumers=*/0,
+                          &task_id));
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  std::unique_ptr<DataServiceWorkerClient::ElementStream> stream;
+  TF_ASSERT_OK(worker->OpenElementStream(task_id, /*consumer_index=*/0,
+                                         /*window_size=*/4, /*stream_id=*/7,
+                                         /*next_element_index=*/5, &stream));
+  int64 value;
+  bool end_of_sequence;
+  Status s = GetNextValue(stream.get(), &value, &end_of_sequence);
+  EXPECT_EQ(s.code(), error::Code::DATA_LOSS);
+}
+
+TEST(DataService, SharedTaskConsumersEachReadAllElements) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  const int64 kNumElements = 10;
+  const int64 kNumConsumers = 3;
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(kNumElements, &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(
+      CreateTask(cluster, test_case.graph_def, kNumConsumers, &task_id));
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  for (int64 i = 0; i < kNumElements; ++i) {
+    for (int64 consumer = 0; consumer < kNumConsumers; ++consumer) {
+      int64 value;
+      bool end_of_sequence;
+      TF_ASSERT_OK(
+          GetValue(worker.get(), task_id, consumer, &value, &end_of_sequence));
+      ASSERT_FALSE(end_of_sequence);
+      EXPECT_EQ(value, i);
+    }
+  }
+  for (int64 consumer = 0; consumer < kNumConsumers; ++consumer) {
+    int64 value;
+    bool end_of_sequence;
+    TF_ASSERT_OK(
+        GetValue(worker.get(), task_id, consumer, &value, &end_of_sequence));
+    EXPECT_TRUE(end_of_sequence);
+  }
+}
+
+TEST(DataService, SharedTaskEvictsAbandonedConsumer) {
+  TestCluster cluster(1, /*worker_consumer_timeout_ms=*/100);
+  TF_ASSERT_OK(cluster.Initialize());
+  // More elements than a shared task buffers, so that the abandoned consumer
+  // would stall the other one if it were not evicted.
+  const int64 kNumElements = 100;
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(kNumElements, &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(CreateTask(cluster, test_case.graph_def, /*num_consumers=*/2,
+                          &task_id));
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  int64 value;
+  bool end_of_sequence;
+  // Consumer 1 reads a few elements, then stops requesting elements.
+  for (int64 i = 0; i < 5; ++i) {
+    TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/1, &value,
+                          &end_of_sequence));
+    EXPECT_EQ(value, i);
+  }
+  for (int64 i = 0; i < kNumElements; ++i) {
+    TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/0, &value,
+                          &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    EXPECT_EQ(value, i);
+  }
+  TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/0, &value,
+                        &end_of_sequence));
+  EXPECT_TRUE(end_of_sequence);
+  // The evicted consumer can't read the elements it missed.
+  Status s = GetValue(worker.get(), task_id, /*consumer_index=*/1, &value,
+                      &end_of_sequence);
+  EXPECT_EQ(s.code(), error::Code::FAILED_PRECONDITION);
+}
+
+TEST(DataService, SharedTaskKeepsIdleConsumerWhileOthersProgress) {
+  TestCluster cluster(1, /*worker_consumer_timeout_ms=*/100);
+  TF_ASSERT_OK(cluster.Initialize());
+  const int64 kNumElements = 20;
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(kNumElements, &test_case));
+  int64 task_id;
+  TF_ASSERT_OK(CreateTask(cluster, test_case.graph_def, /*num_consumers=*/2,
+                          &task_id));
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  int64 value;
+  bool end_of_sequence;
+  // Consumer 0 reads every element without filling the shared buffer, so it
+  // never waits for consumer 1.
+  for (int64 i = 0; i < kNumElements; ++i) {
+    TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/0, &value,
+                          &end_of_sequence));
+    EXPECT_EQ(value, i);
+  }
+  // Consumer 1 stays idle for several timeouts, but stalls no one.
+  Env::Default()->SleepForMicroseconds(500 * 1000);
+  for (int64 i = 0; i < kNumElements; ++i) {
+    TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/1, &value,
+                          &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    EXPECT_EQ(value, i);
+  }
+  TF_ASSERT_OK(GetValue(worker.get(), task_id, /*consumer_index=*/1, &value,
+                        &end_of_sequence));
+  EXPECT_TRUE(end_of_sequence);
+}
+
+TEST(DataService, WorkerReportsFilledPrefetchBuffer) {
+  // Set before the worker starts, so that its heartbeat thread sends task
+  // updates at this interval.
+  DataServiceWorkerImpl::SetHeartbeatIntervalForTesting(100 * 1000);
+  auto reset_interval = gtl::MakeCleanup(
+      []() { DataServiceWorkerImpl::SetHeartbeatIntervalForTesting(0); });
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  const int64 kNumElements = 10;
+  test_util::GraphDefTestCase test_case;
+  TF_ASSERT_OK(test_util::compressed_range_test_case(kNumElements, &test_case));
+  DataServiceMasterClient master(cluster.MasterAddress(), kProtocol);
+  int64 dataset_id;
+  TF_ASSERT_OK(master.RegisterDataset(test_case.graph_def, &dataset_id));
+  int64 job_id;
+  TF_ASSERT_OK(
+      master.CreateJob(dataset_id, ProcessingMode::PARALLEL_EPOCHS, &job_id));
+  // Without any element requests, the worker fills the task's buffer up to
+  // its capacity, and its periodic updates report that to the master.
+  const uint64 deadline_micros = Env::Default()->NowMicros() + 10 * 1000 * 1000;
+  std::vector<TaskInfo> tasks;
+  while (true) {
+    bool job_finished;
+    TF_ASSERT_OK(master.GetTasks(job_id, &tasks, &job_finished));
+    ASSERT_EQ(tasks.size(), 1);
+    if (tasks[0].num_buffered_elements() ==
+        DataServiceWorkerImpl::kMaxBufferedElementsPerTask) {
+      break;
+    }
+    ASSERT_LE(tasks[0].num_buffered_elements(),
+              DataServiceWorkerImpl::kMaxBufferedElementsPerTask);
+    ASSERT_LT(Env::Default()->NowMicros(), deadline_micros)
+        << "The buffer of the task was never reported full";
+    Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+  // The buffered elements are served in order, followed by the rest.
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  int64 value;
+  bool end_of_sequence;
+  for (int64 i = 0; i < kNumElements; ++i) {
+    TF_ASSERT_OK(GetValue(worker.get(), tasks[0].id(), /*consumer_index=*/0,
+                          &value, &end_of_sequence));
+    ASSERT_FALSE(end_of_sequence);
+    EXPECT_EQ(value, i);
+  }
+  TF_ASSERT_OK(GetValue(worker.get(), tasks[0].id(), /*consumer_index=*/0,
+                        &value, &end_of_sequence));
+  EXPECT_TRUE(end_of_sequence);
+}
+
+TEST(DataService, ElementStreamRequiresStreamId) {
+  TestCluster cluster(1);
+  TF_ASSERT_OK(cluster.Initialize());
+  std::unique_ptr<DataServiceWorkerClient> worker;
+  TF_ASSERT_OK(CreateDataServiceWorkerClient(cluster.WorkerAddress(0),
+                                             kProtocol, &worker));
+  std::unique_ptr<DataServiceWorkerClient::ElementStream> stream;
+  Status s = worker->OpenElementStream(/*task_id=*/0, /*consumer_index=*/0,
+                                       /*window_size=*/4, /*stream_id=*/0,
+                                       /*next_element_index=*/0, &stream);
+  EXPECT_EQ(s.code(), error::Code::INVALID_ARGUMENT);
+}
+
 }  // namespace data
 }  // namespace tensorflow
@@ -17,6 +17,8 @@ limitations under the License.
 
 #include "grpcpp/server_context.h"
 #include "tensorflow/core/distributed_runtime/rpc/grpc_util.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 
 namespace tensorflow {
 namespace data {
@@ -27,14 +29,16 @@ using ::grpc::Status;
 
 GrpcWorkerImpl::GrpcWorkerImpl(ServerBuilder* server_builder,
                                const std::string& master_address,
-                               const std::string& protocol)
-    : impl_(master_address, protocol) {
+                               const std::string& protocol,
+                               int64 consumer_timeout_ms)
+    : impl_(master_address, protocol, consumer_timeout_ms) {
   server_builder->RegisterService(this);
   VLOG(1) << "Registered data service worker";
 }
 
-void GrpcWorkerImpl::Start(const std::string& worker_address) {
-  impl_.Start(worker_address);
+void GrpcWorkerImpl::Start(const std::string& worker_address,
+                           const std::string& worker_locality) {
+  impl_.Start(worker_address, worker_locality);
 }
 
 #define HANDLER(method)                                         \
@@ -47,5 +51,68 @@ HANDLER(ProcessTask);
 HANDLER(GetElement);
 #undef HANDLER
 
+Status GrpcWorkerImpl::GetElementStream(
+    ServerContext* context,
+    ::grpc::ServerReaderWriter<GetElementResponse, GetElementStreamRequest>*
+        stream) {
+  GetElementStreamRequest credit_request;
+  if (!stream->Read(&credit_request)) {
+    return Status::OK();
+  }
+  const int64 stream_id = credit_request.stream_id();
+  if (stream_id == 0) {
+    return ToGrpcStatus(tensorflow::errors::InvalidArgument(
+        "Element streams must be opened with a non-zero stream id"));
+  }
+  GetElementRequest request;
+  request.set_task_id(credit_request.task_id());
+  request.set_consumer_index(credit_request.consumer_index());
+  request.set_compressed_element_version(
+      credit_request.compressed_element_version());
+  int64 element_index = credit_request.next_element_index();
+  int64 generation;
+  tensorflow::Status s = impl_.ResumeElementStream(stream_id, request,
+                                                   element_index, &generation);
+  if (!s.ok()) {
+    return ToGrpcStatus(s);
+  }
+  auto disconnect = gtl::MakeCleanup(
+      [this, stream_id]() { impl_.DisconnectElementStream(stream_id); });
+  // Produces one element per credit, then waits for the client to grant more.
+  // The client grants credits ahead of consuming elements, so the worker
+  // normally finds new credits without waiting. Credit requests acknowledge
+  // the elements the client received, so that the worker can send again the
+  // unacknowledged elements if the stream breaks and is resumed.
+  do {
+    s = impl_.AcknowledgeStreamElements(stream_id, generation,
+                                        credit_request.next_element_index());
+    if (!s.ok()) {
+      return ToGrpcStatus(s);
+    }
+    for (int64 i = 0; i < credit_request.credits(); ++i) {
+      if (context->IsCancelled()) {
+        return Status(::grpc::StatusCode::CANCELLED,
+                      "Element stream was cancelled");
+      }
+      std::shared_ptr<const GetElementResponse> response;
+      s = impl_.GetStreamElement(stream_id, generation, element_index,
+                                 &response);
+      if (!s.ok()) {
+        return ToGrpcStatus(s);
+      }
+      if (!stream->Write(*response)) {
+        // The client has gone away. It may resume the stream from the
+        // elements it received.
+        return Status::OK();
+      }
+      ++element_index;
+      if (response->end_of_sequence()) {
+        return Status::OK();
+      }
+    }
+  } while (stream->Read(&credit_request));
+  return Status::OK();
+}
+
 }  // namespace data
 }  // namespace tensorflow
@@ -36,10 +36,12 @@ class GrpcWorkerImpl : public WorkerService::Service {
  public:
   explicit GrpcWorkerImpl(grpc::ServerBuilder* server_builder,
                           const std::string& master_address,
-                          const std::string& protocol);
+                          const std::string& protocol,
+                          int64 consumer_timeout_ms);
   ~GrpcWorkerImpl() override {}
 
-  void Start(const std::string& worker_address);
+  void Start(const std::string& worker_address,
+             const std::string& worker_locality);
 
 #define HANDLER(method)                               \
   grpc::Status method(grpc::ServerContext* context,   \
@@ -49,6 +51,11 @@ class GrpcWorkerImpl : public WorkerService::Service {
   HANDLER(GetElement);
 #undef HANDLER
 
+  grpc::Status GetElementStream(
+      grpc::ServerContext* context,
+      grpc::ServerReaderWriter<GetElementResponse, GetElementStreamRequest>*
+          stream) override;
+
  private:
   DataServiceWorkerImpl impl_;
 
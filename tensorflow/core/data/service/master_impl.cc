@@ -61,8 +61,9 @@ Status DataServiceMasterImpl::RegisterWorker(
   VLOG(3) << "Received register worker request";
   mutex_lock l(mu_);
   int64 worker_id = next_worker_id_++;
-  workers_.push_back(
-      std::make_shared<Worker>(worker_id, request->worker_address()));
+  auto worker = std::make_shared<Worker>(
+      worker_id, request->worker_address(), request->worker_locality());
+  workers_.push_back(worker);
   response->set_worker_id(worker_id);
 
   // Allocate tasks to the worker.
@@ -71,7 +72,7 @@ Status DataServiceMasterImpl::RegisterWorker(
     if (job->finished()) {
       continue;
     }
-    const Task& task = CreateTaskLocked(job.get(), request->worker_address());
+    const Task& task = CreateTaskLocked(job.get(), worker.get());
 
     TaskDef* task_def = response->add_tasks();
     *task_def->mutable_dataset() =
@@ -79,10 +80,12 @@ Status DataServiceMasterImpl::RegisterWorker(
     task_def->set_dataset_id(job->dataset_id());
     task_def->set_job_id(job->job_id());
     task_def->set_task_id(task.task_id());
+    task_def->set_num_consumers(job->num_consumers());
   }
 
   VLOG(1) << "Registered worker at address " << request->worker_address()
-          << " with id " << worker_id;
+          << " in locality \"" << request->worker_locality() << "\" with id "
+          << worker_id;
   return Status::OK();
 }
 
@@ -93,9 +96,13 @@ Status DataServiceMasterImpl::WorkerUpdate(const WorkerUpdateRequest* request,
   for (auto& update : request->updates()) {
     int64 task_id = update.task_id();
     if (!tasks_.contains(task_id)) {
-      return errors::NotFound("WorkerUpdate called for worker ", worker_id,
-                              " with unknown task id ", task_id);
+      // Workers report all of their running tasks, so one unknown task must
+      // not cause the updates of the other tasks to be dropped.
+      LOG(WARNING) << "WorkerUpdate called for worker " << worker_id
+                   << " with unknown task id " << task_id;
+      continue;
     }
+    tasks_.at(task_id).UpdateBufferStats(update);
     if (update.completed()) {
       int64 job_id = tasks_.at(task_id).job_id();
       DCHECK(jobs_.contains(job_id));
@@ -149,7 +156,8 @@ Status DataServiceMasterImpl::CreateJob(const CreateJobRequest* request,
   ProcessingMode processing_mode = ProcessingMode(request->processing_mode());
   int64 job_id;
   TF_RETURN_IF_ERROR(CreateJob(request->dataset_id(), processing_mode,
-                               absl::optional<std::string>(), &job_id));
+                               absl::optional<std::string>(),
+                               /*num_consumers=*/0, &job_id));
   response->set_job_id(job_id);
 
   VLOG(3) << "Creating job " << job_id << " for dataset "
@@ -162,6 +170,10 @@ Status DataServiceMasterImpl::GetOrCreateJob(
   VLOG(3) << "Received get or create job request for dataset id "
           << request->dataset_id() << " with name " << request->job_name()
           << " and index " << request->job_name_index();
+  if (request->num_consumers() < 0) {
+    return errors::InvalidArgument("num_consumers must be non-negative, got ",
+                                   request->num_consumers());
+  }
   NamedJobKey key(request->job_name(), request->job_name_index());
   ProcessingMode requested_processing_mode =
       ProcessingMode(request->processing_mode());
@@ -170,7 +182,8 @@ Status DataServiceMasterImpl::GetOrCreateJob(
     std::shared_ptr<Job>* job = gtl::FindOrNull(named_jobs_, key);
     if (job != nullptr) {
       TF_RETURN_IF_ERROR(ValidateMatchingJob(**job, requested_processing_mode,
-                                             request->dataset_id()));
+                                             request->dataset_id(),
+                                             request->num_consumers()));
       int64 job_id = (*job)->job_id();
       response->set_job_id(job_id);
       VLOG(3) << "Found existing job for name=" << request->job_name()
@@ -181,7 +194,8 @@ Status DataServiceMasterImpl::GetOrCreateJob(
   }
   int64 job_id;
   TF_RETURN_IF_ERROR(CreateJob(request->dataset_id(), requested_processing_mode,
-                               request->job_name(), &job_id));
+                               request->job_name(), request->num_consumers(),
+                               &job_id));
   {
     mutex_lock l(mu_);
     named_jobs_[key] = jobs_[job_id];
@@ -192,9 +206,11 @@ Status DataServiceMasterImpl::GetOrCreateJob(
   return Status::OK();
 }
 
-// Validates that the job matches the given processing_mode and dataset_id.
+// Validates that the job matches the given processing_mode, dataset_id and
+// num_consumers.
 Status DataServiceMasterImpl::ValidateMatchingJob(
-    const Job& job, ProcessingMode processing_mode, int64 dataset_id) {
+    const Job& job, ProcessingMode processing_mode, int64 dataset_id,
+    int64 num_consumers) {
   DCHECK(job.name().has_value());
   std::string job_name = job.name().value();
   if (job.processing_mode() != processing_mode) {
@@ -211,12 +227,19 @@ Status DataServiceMasterImpl::ValidateMatchingJob(
         job.dataset_id(), "> doesn't match the requested dataset id <",
         dataset_id, ">.");
   }
+  if (job.num_consumers() != num_consumers) {
+    return errors::FailedPrecondition(
+        "Found a job with name ", job_name, ", but the number of consumers <",
+        job.num_consumers(), "> doesn't match the requested number of ",
+        "consumers <", num_consumers, ">.");
+  }
   return Status::OK();
 }
 
 Status DataServiceMasterImpl::CreateJob(int64 dataset_id,
                                         ProcessingMode processing_mode,
                                         absl::optional<std::string> job_name,
+                                        int64 num_consumers,
                                         int64* out_job_id) LOCKS_EXCLUDED(mu_) {
   switch (processing_mode) {
     case ProcessingMode::PARALLEL_EPOCHS:
@@ -240,7 +263,8 @@ Status DataServiceMasterImpl::CreateJob(int64 dataset_id,
 
     int64 job_id = next_job_id_++;
     DCHECK(!jobs_.contains(job_id));
-    job = std::make_shared<Job>(job_id, dataset_id, processing_mode, job_name);
+    job = std::make_shared<Job>(job_id, dataset_id, processing_mode, job_name,
+                                num_consumers);
     jobs_[job_id] = job;
 
     // Copy workers_ so that we can iterate through the workers without holding
@@ -260,7 +284,7 @@ Status DataServiceMasterImpl::CreateJob(int64 dataset_id,
   }
 
   for (auto& worker : workers) {
-    const Task& task = CreateTask(job.get(), worker->address());
+    const Task& task = CreateTask(job.get(), worker.get());
     Status s = AllocateTaskToWorker(task, worker.get());
     if (!s.ok()) {
       LOG(WARNING) << "Failed to allocate task with id " << task.task_id()
@@ -275,17 +299,17 @@ Status DataServiceMasterImpl::CreateJob(int64 dataset_id,
 }
 
 const DataServiceMasterImpl::Task& DataServiceMasterImpl::CreateTask(
-    Job* job, const std::string& worker_address) LOCKS_EXCLUDED(mu_) {
+    Job* job, Worker* worker) LOCKS_EXCLUDED(mu_) {
   mutex_lock l(mu_);
-  return CreateTaskLocked(job, worker_address);
+  return CreateTaskLocked(job, worker);
 }
 
 const DataServiceMasterImpl::Task& DataServiceMasterImpl::CreateTaskLocked(
-    Job* job, const std::string& worker_address) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Job* job, Worker* worker) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   int64 task_id = next_task_id_++;
   DCHECK(!tasks_.contains(task_id));
   tasks_.insert({task_id, Task(task_id, job->job_id(), job->dataset_id(),
-                               worker_address)});
+                               worker->address(), worker->locality())});
   job->add_task_id(task_id);
   return tasks_.at(task_id);
 }
@@ -311,6 +335,9 @@ Status DataServiceMasterImpl::AllocateTaskToWorker(const Task& task,
     DCHECK(datasets_by_id_.contains(task.dataset_id()));
     *req.mutable_task()->mutable_dataset() =
         datasets_by_id_.at(task.dataset_id())->dataset_def();
+    DCHECK(jobs_.contains(task.job_id()));
+    req.mutable_task()->set_num_consumers(
+        jobs_.at(task.job_id())->num_consumers());
   }
   req.mutable_task()->set_task_id(task.task_id());
   ProcessTaskResponse resp;
@@ -339,6 +366,9 @@ Status DataServiceMasterImpl::GetTasks(const GetTasksRequest* request,
     TaskInfo* task_info = response->mutable_task_info()->Add();
     task_info->set_worker_address(task.worker_address());
     task_info->set_id(task.task_id());
+    task_info->set_num_buffered_elements(task.num_buffered_elements());
+    task_info->set_buffer_miss_rate(task.buffer_miss_rate());
+    task_info->set_worker_locality(task.worker_locality());
   }
   response->set_job_finished(job->finished());
   VLOG(3) << "Found " << response->task_info_size() << " tasks for job id "
@@ -354,6 +384,7 @@ Status DataServiceMasterImpl::GetWorkers(const GetWorkersRequest* request,
     WorkerInfo* info = response->add_workers();
     info->set_address(worker->address());
     info->set_id(worker->worker_id());
+    info->set_locality(worker->locality());
   }
   VLOG(3) << "Returning list of " << workers_.size()
           << " workers from GetWorkers";
@@ -66,23 +66,27 @@ class DataServiceMasterImpl {
  private:
   class Worker {
    public:
-    Worker(int64 worker_id, const std::string address)
-        : worker_id_(worker_id), address_(address) {}
+    Worker(int64 worker_id, const std::string address,
+           const std::string locality)
+        : worker_id_(worker_id), address_(address), locality_(locality) {}
 
     int64 worker_id() { return worker_id_; }
     std::string address() { return address_; }
+    std::string locality() { return locality_; }
     WorkerService::Stub* stub() { return stub_.get(); }
     void set_stub(std::unique_ptr<WorkerService::Stub> stub) {
       stub_ = std::move(stub);
     }
 
     std::string DebugString() {
-      return absl::StrCat("id: ", worker_id_, " address: ", address_);
+      return absl::StrCat("id: ", worker_id_, " address: ", address_,
+                          " locality: ", locality_);
     }
 
    private:
     const int64 worker_id_;
     const std::string address_;
+    const std::string locality_;
     std::unique_ptr<WorkerService::Stub> stub_;
   };
 
@@ -106,16 +110,20 @@ class DataServiceMasterImpl {
   class Job {
    public:
     Job(int64 job_id, int64 dataset_id, ProcessingMode processing_mode,
-        absl::optional<absl::string_view> job_name)
+        absl::optional<absl::string_view> job_name, int64 num_consumers)
         : job_id_(job_id),
           dataset_id_(dataset_id),
           processing_mode_(processing_mode),
-          job_name_(job_name) {}
+          job_name_(job_name),
+          num_consumers_(num_consumers) {}
 
     int64 job_id() const { return job_id_; }
     int64 dataset_id() const { return dataset_id_; }
     ProcessingMode processing_mode() const { return processing_mode_; }
     absl::optional<std::string> name() const { return job_name_; }
+    // The number of consumers that each read every element of the job, or 0
+    // if the job is not shared.
+    int64 num_consumers() const { return num_consumers_; }
     const std::vector<int64>& task_ids() const { return task_ids_; }
     void add_task_id(int64 task_id) { task_ids_.push_back(task_id); }
     void task_finished(int64 task_id) {
@@ -131,6 +139,7 @@ class DataServiceMasterImpl {
     const int64 dataset_id_;
     const ProcessingMode processing_mode_;
     const absl::optional<std::string> job_name_;
+    const int64 num_consumers_;
     std::vector<int64> task_ids_;
     std::vector<int64> finished_tasks_;
     bool finished_ = false;
@@ -158,22 +167,37 @@ class DataServiceMasterImpl {
   class Task {
    public:
     Task(int64 task_id, int64 job_id, int64 dataset_id,
-         const std::string& worker_address)
+         const std::string& worker_address, const std::string& worker_locality)
         : task_id_(task_id),
           job_id_(job_id),
           dataset_id_(dataset_id),
-          worker_address_(worker_address) {}
+          worker_address_(worker_address),
+          worker_locality_(worker_locality) {}
 
     int64 task_id() const { return task_id_; }
     int64 job_id() const { return job_id_; }
     int64 dataset_id() const { return dataset_id_; }
     std::string worker_address() const { return worker_address_; }
+    std::string worker_locality() const { return worker_locality_; }
+    int64 num_buffered_elements() const { return num_buffered_elements_; }
+    double buffer_miss_rate() const { return buffer_miss_rate_; }
+    // Records the buffer statistics reported by the worker for the task.
+    void UpdateBufferStats(const TaskProgress& progress) {
+      num_buffered_elements_ = progress.num_buffered_elements();
+      if (progress.num_requests() > 0) {
+        buffer_miss_rate_ = static_cast<double>(progress.num_buffer_misses()) /
+                            progress.num_requests();
+      }
+    }
 
    private:
     const int64 task_id_;
     const int64 job_id_;
     const int64 dataset_id_;
     const std::string worker_address_;
+    const std::string worker_locality_;
+    int64 num_buffered_elements_ = 0;
+    double buffer_miss_rate_ = 0.0;
   };
 
   // Registers a dataset with the given fingerprint, returning a new dataset id.
@@ -184,20 +208,22 @@ class DataServiceMasterImpl {
   // Instructs a worker to begin processing a task.
   Status AllocateTaskToWorker(const Task& task_id, Worker* worker)
       LOCKS_EXCLUDED(mu_);
-  // Creates a job and stores its job_id in `*job_id`.
+  // Creates a job and stores its job_id in `*job_id`. If `num_consumers` is
+  // positive, the job is shared by that many consumers.
   Status CreateJob(int64 dataset_id, ProcessingMode processing_mode,
-                   absl::optional<std::string> job_name, int64* out_job_id)
-      LOCKS_EXCLUDED(mu_);
-  // Creates a new task for a job, returning a reference to the task.
-  const Task& CreateTask(Job* job, const std::string& worker_address)
-      LOCKS_EXCLUDED(mu_);
+                   absl::optional<std::string> job_name, int64 num_consumers,
+                   int64* out_job_id) LOCKS_EXCLUDED(mu_);
+  // Creates a new task for a job on `worker`, returning a reference to the
+  // task.
+  const Task& CreateTask(Job* job, Worker* worker) LOCKS_EXCLUDED(mu_);
   // Same as `CreateTask`, but expects that the master lock is already held.
-  const Task& CreateTaskLocked(Job* job, const std::string& worker_address)
+  const Task& CreateTaskLocked(Job* job, Worker* worker)
       EXCLUSIVE_LOCKS_REQUIRED(mu_);
-  // Validates that an existing job matches the given processing_mode and
-  // dataset_id, returning an error status describing any difference.
+  // Validates that an existing job matches the given processing_mode,
+  // dataset_id and num_consumers, returning an error status describing any
+  // difference.
   Status ValidateMatchingJob(const Job& job, ProcessingMode processing_mode,
-                             int64 dataset_id);
+                             int64 dataset_id, int64 num_consumers);
   // Protocol to use for communicating with workers.
   const std::string protocol_;
 
@@ -98,16 +98,20 @@ Status MasterGrpcDataServer::NumWorkers(int* num_workers) {
 WorkerGrpcDataServer::WorkerGrpcDataServer(int port,
                                            const std::string& protocol,
                                            const std::string& master_address,
-                                           const std::string& worker_address)
+                                           const std::string& worker_address,
+                                           const std::string& worker_locality,
+                                           int64 consumer_timeout_ms)
     : GrpcDataServerBase(port, protocol),
       master_address_(master_address),
-      worker_address_(worker_address) {}
+      worker_address_(worker_address),
+      worker_locality_(worker_locality),
+      consumer_timeout_ms_(consumer_timeout_ms) {}
 
 WorkerGrpcDataServer::~WorkerGrpcDataServer() { delete service_; }
 
 void WorkerGrpcDataServer::AddServiceToBuilder(grpc::ServerBuilder* builder) {
-  auto service =
-      absl::make_unique<GrpcWorkerImpl>(builder, master_address_, protocol_);
+  auto service = absl::make_unique<GrpcWorkerImpl>(
+      builder, master_address_, protocol_, consumer_timeout_ms_);
   service_ = service.release();
 }
 
@@ -119,7 +123,7 @@ Status WorkerGrpcDataServer::StartServiceInternal() {
   std::string resolved_address = str_util::StringReplace(
       worker_address, kPortPlaceholder, absl::StrCat(bound_port()),
       /*replace_all=*/false);
-  service_->Start(resolved_address);
+  service_->Start(resolved_address, worker_locality_);
   return Status::OK();
 }
 
@@ -140,8 +144,29 @@ Status NewWorkerServer(int port, const std::string& protocol,
                        const std::string& master_address,
                        const std::string& worker_address,
                        std::unique_ptr<WorkerGrpcDataServer>* out_server) {
+  return NewWorkerServer(port, protocol, master_address, worker_address,
+                         /*worker_locality=*/"", out_server);
+}
+
+Status NewWorkerServer(int port, const std::string& protocol,
+                       const std::string& master_address,
+                       const std::string& worker_address,
+                       const std::string& worker_locality,
+                       std::unique_ptr<WorkerGrpcDataServer>* out_server) {
+  return NewWorkerServer(port, protocol, master_address, worker_address,
+                         worker_locality, /*consumer_timeout_ms=*/0,
+                         out_server);
+}
+
+Status NewWorkerServer(int port, const std::string& protocol,
+                       const std::string& master_address,
+                       const std::string& worker_address,
+                       const std::string& worker_locality,
+                       int64 consumer_timeout_ms,
+                       std::unique_ptr<WorkerGrpcDataServer>* out_server) {
   *out_server = absl::make_unique<WorkerGrpcDataServer>(
-      port, protocol, master_address, worker_address);
+      port, protocol, master_address, worker_address, worker_locality,
+      consumer_timeout_ms);
   return Status::OK();
 }
 
@@ -91,7 +91,9 @@ class WorkerGrpcDataServer : public GrpcDataServerBase {
  public:
   WorkerGrpcDataServer(int requested_port, const std::string& protocol,
                        const std::string& master_address,
-                       const std::string& worker_address);
+                       const std::string& worker_address,
+                       const std::string& worker_locality,
+                       int64 consumer_timeout_ms);
   ~WorkerGrpcDataServer() override;
 
  protected:
@@ -101,6 +103,8 @@ class WorkerGrpcDataServer : public GrpcDataServerBase {
  private:
   const std::string master_address_;
   const std::string worker_address_;
+  const std::string worker_locality_;
+  const int64 consumer_timeout_ms_;
   // Owned. We use a raw pointer because GrpcWorkerImpl is forward-declared.
   GrpcWorkerImpl* service_;
 };
@@ -119,6 +123,29 @@ Status NewMasterServer(int port, const std::string& protocol,
 // will report the worker address, so that the master can tell clients where to
 // read from. The address may contain the placeholder "%port%", which will be
 // replaced with the value of BoundPort().
+//
+// The worker_locality argument is optional. It labels where the worker runs,
+// e.g. its rack or zone. Clients which declare the same locality read from the
+// worker before reading from workers in other localities.
+//
+// The consumer_timeout_ms argument bounds how long a consumer of a shared job
+// may keep the job's other consumers waiting on this worker before it is
+// evicted. A non-positive value selects the default of 5 minutes.
+Status NewWorkerServer(int port, const std::string& protocol,
+                       const std::string& master_address,
+                       const std::string& worker_address,
+                       const std::string& worker_locality,
+                       int64 consumer_timeout_ms,
+                       std::unique_ptr<WorkerGrpcDataServer>* out_server);
+
+// Creates a worker with the default consumer timeout.
+Status NewWorkerServer(int port, const std::string& protocol,
+                       const std::string& master_address,
+                       const std::string& worker_address,
+                       const std::string& worker_locality,
+                       std::unique_ptr<WorkerGrpcDataServer>* out_server);
+
+// Creates a worker without a locality.
 Status NewWorkerServer(int port, const std::string& protocol,
                        const std::string& master_address,
                        const std::string& worker_address,
@@ -37,7 +37,12 @@ Status AddressFromTarget(absl::string_view target, std::string* address) {
 }
 }  // namespace
 
-TestCluster::TestCluster(int num_workers) : num_workers_(num_workers) {}
+TestCluster::TestCluster(int num_workers)
+    : TestCluster(num_workers, /*worker_consumer_timeout_ms=*/0) {}
+
+TestCluster::TestCluster(int num_workers, int64 worker_consumer_timeout_ms)
+    : num_workers_(num_workers),
+      worker_consumer_timeout_ms_(worker_consumer_timeout_ms) {}
 
 Status TestCluster::Initialize() {
   if (initialized_) {
@@ -58,8 +63,9 @@ Status TestCluster::Initialize() {
 
 Status TestCluster::AddWorker() {
   std::unique_ptr<WorkerGrpcDataServer> worker;
-  TF_RETURN_IF_ERROR(
-      NewWorkerServer(/*port=*/0, kProtocol, master_address_, &worker));
+  TF_RETURN_IF_ERROR(NewWorkerServer(
+      /*port=*/0, kProtocol, master_address_, /*worker_address=*/"",
+      /*worker_locality=*/"", worker_consumer_timeout_ms_, &worker));
   TF_RETURN_IF_ERROR(worker->Start());
   worker_addresses_.push_back(absl::StrCat("localhost:", worker->BoundPort()));
   workers_.push_back(std::move(worker));
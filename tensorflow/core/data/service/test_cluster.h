@@ -26,6 +26,9 @@ class TestCluster {
  public:
   // Creates a new test cluster with a master and `num_workers` workers.
   explicit TestCluster(int num_workers);
+  // Creates a new test cluster whose workers evict consumers of shared jobs
+  // after `worker_consumer_timeout_ms`.
+  TestCluster(int num_workers, int64 worker_consumer_timeout_ms);
 
   // Initializes the test cluster. This must be called before interacting with
   // the cluster. Initialize should be called only once.
@@ -42,6 +45,7 @@ class TestCluster {
  private:
   bool initialized_ = false;
   int num_workers_;
+  int64 worker_consumer_timeout_ms_;
   std::unique_ptr<MasterGrpcDataServer> master_;
   std::string master_address_;
   std::vector<std::unique_ptr<WorkerGrpcDataServer>> workers_;
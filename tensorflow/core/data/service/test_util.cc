@@ -15,6 +15,10 @@ limitations under the License.
 
 #include "tensorflow/core/data/service/test_util.h"
 
+#include "tensorflow/core/framework/function.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
 #include "tensorflow/core/kernels/data/dataset_test_base.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/path.h"
@@ -53,6 +57,45 @@ Status map_test_case(GraphDefTestCase* test_case) {
   return Status::OK();
 }
 
+Status compressed_range_test_case(int64 num_elements,
+                                  GraphDefTestCase* test_case) {
+  using test::function::NDef;
+  FunctionDef compress = FunctionDefHelper::Create(
+      "CompressRangeElement", {"x: int64"}, {"compressed: variant"}, {},
+      {{{"compress"},
+        "CompressElement",
+        {"x"},
+        {{"input_types", DataTypeSlice{DT_INT64}}}}},
+      {{"compressed", "compress:compressed:0"}});
+  std::vector<PartialTensorShape> scalar_shapes = {PartialTensorShape({})};
+  GraphDef graph_def = test::function::GDef(
+      {NDef("start", "Const", {},
+            {{"value", test::AsScalar<int64>(0)}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {},
+            {{"value", test::AsScalar<int64>(num_elements)},
+             {"dtype", DT_INT64}}),
+       NDef("step", "Const", {},
+            {{"value", test::AsScalar<int64>(1)}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"},
+            {{"output_types", DataTypeSlice{DT_INT64}},
+             {"output_shapes", scalar_shapes}}),
+       NDef("map", "MapDataset", {"range"},
+            {{"f", FunctionDefHelper::FunctionRef("CompressRangeElement")},
+             {"Targuments", DataTypeSlice{}},
+             {"output_types", DataTypeSlice{DT_VARIANT}},
+             {"output_shapes", scalar_shapes},
+             {"use_inter_op_parallelism", true},
+             {"preserve_cardinality", true}}),
+       NDef("dataset", "_Retval", {"map"}, {{"T", DT_VARIANT}, {"index", 0}})},
+      {compress});
+  std::vector<std::vector<Tensor>> outputs(num_elements);
+  for (int64 i = 0; i < num_elements; ++i) {
+    outputs[i] = CreateTensors<int64>(TensorShape{}, {{i}});
+  }
+  *test_case = {"CompressedRangeGraph", graph_def, outputs};
+  return Status::OK();
+}
+
 }  // namespace test_util
 }  // namespace data
 }  // namespace tensorflow
@@ -37,6 +37,13 @@ struct GraphDefTestCase {
 // dataset graph execution.
 Status map_test_case(GraphDefTestCase* test_case);
 
+// Fills in the input test_case pointer with test case data representing the
+// dataset tf.data.Dataset.range(num_elements) with each element compressed
+// into a CompressedElement, as the tf.data service serves them. `output` holds
+// the uncompressed elements.
+Status compressed_range_test_case(int64 num_elements,
+                                  GraphDefTestCase* test_case);
+
 }  // namespace test_util
 }  // namespace data
 }  // namespace tensorflow
@@ -15,10 +15,14 @@ limitations under the License.
 
 #include "tensorflow/core/data/service/worker_impl.h"
 
+#include <algorithm>
+#include <atomic>
+
 #include "grpcpp/create_channel.h"
 #include "absl/memory/memory.h"
 #include "tensorflow/c/c_api_internal.h"
 #include "tensorflow/c/tf_status_helper.h"
+#include "tensorflow/core/data/compression_utils.h"
 #include "tensorflow/core/data/dataset.pb.h"
 #include "tensorflow/core/data/service/credentials_factory.h"
 #include "tensorflow/core/data/service/grpc_util.h"
@@ -27,6 +31,7 @@ limitations under the License.
 #include "tensorflow/core/data/standalone.h"
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/io/zlib_outputbuffer.h"
 #include "tensorflow/core/lib/monitoring/gauge.h"
 #include "tensorflow/core/platform/errors.h"
@@ -36,9 +41,21 @@ limitations under the License.
 namespace tensorflow {
 namespace data {
 
-const constexpr uint64 kHeartbeatIntervalMicros = 5ull * 1000 * 1000;
+const constexpr int64 kHeartbeatIntervalMicros = 5ll * 1000 * 1000;
+// Maximum number of elements buffered for a shared task. This bounds how far
+// the consumers of a shared task can lag behind each other.
+const constexpr int64 kMaxBufferedElementsPerSharedTask = 64;
+// How long the state of an element stream is kept after its last connection
+// closes, waiting for the client to resume the stream.
+const constexpr uint64 kElementStreamTimeoutMicros = 10ull * 60 * 1000 * 1000;
+// How long a consumer of a shared task may stall the other consumers without
+// requesting elements before it is evicted, so that a consumer which died or
+// never attached does not stall the other consumers forever.
+const constexpr int64 kDefaultConsumerTimeoutMicros = 5ll * 60 * 1000 * 1000;
 
 namespace {
+std::atomic<int64> heartbeat_interval_micros(kHeartbeatIntervalMicros);
+
 auto* tf_data_service_created =
     monitoring::Gauge<bool, 0>::New("/tensorflow/data/service/created",
                                     "Whether a tf.data service server "
@@ -46,21 +63,47 @@ auto* tf_data_service_created =
 }  // namespace
 
 DataServiceWorkerImpl::DataServiceWorkerImpl(const std::string& master_address,
-                                             const std::string& protocol)
-    : master_address_(master_address), protocol_(protocol) {
+                                             const std::string& protocol,
+                                             int64 consumer_timeout_ms)
+    : master_address_(master_address),
+      protocol_(protocol),
+      consumer_timeout_micros_(consumer_timeout_ms > 0
+                                   ? consumer_timeout_ms * 1000
+                                   : kDefaultConsumerTimeoutMicros) {
   tf_data_service_created->GetCell()->Set(true);
 }
 
 DataServiceWorkerImpl::~DataServiceWorkerImpl() {
-  mutex_lock l(mu_);
-  cancelled_ = true;
-  heartbeat_cv_.notify_one();
+  std::vector<std::unique_ptr<Thread>> prefetch_threads;
+  {
+    mutex_lock l(mu_);
+    cancelled_ = true;
+    heartbeat_cv_.notify_one();
+    for (auto& entry : tasks_) {
+      Task& task = *entry.second;
+      task.element_available_cv.notify_all();
+      task.space_available_cv.notify_all();
+      // Unblocks a prefetch thread which is waiting in GetNext.
+      task.dataset->Cancel();
+      prefetch_threads.push_back(std::move(task.prefetch_thread));
+    }
+  }
+  // Joins the prefetch threads before the tasks they fill are destroyed.
+  prefetch_threads.clear();
+}
+
+void DataServiceWorkerImpl::SetHeartbeatIntervalForTesting(
+    int64 interval_micros) {
+  heartbeat_interval_micros =
+      interval_micros > 0 ? interval_micros : kHeartbeatIntervalMicros;
 }
 
-void DataServiceWorkerImpl::Start(const std::string& worker_address) {
+void DataServiceWorkerImpl::Start(const std::string& worker_address,
+                                  const std::string& worker_locality) {
   VLOG(3) << "Starting tf.data service worker at address " << worker_address;
   mutex_lock l(mu_);
   worker_address_ = worker_address;
+  worker_locality_ = worker_locality;
 
   Thread* thread = Env::Default()->StartThread(
       {}, "data-service-worker-heartbeat", [this]() { HeartbeatThread(); });
@@ -69,7 +112,7 @@ void DataServiceWorkerImpl::Start(const std::string& worker_address) {
   while (!s.ok()) {
     LOG(WARNING) << "Failed to register with master at " << master_address_
                  << ": " << s;
-    Env::Default()->SleepForMicroseconds(kHeartbeatIntervalMicros);
+    Env::Default()->SleepForMicroseconds(heartbeat_interval_micros);
     s = Register();
   }
 }
@@ -98,19 +141,71 @@ Status DataServiceWorkerImpl::ProcessTaskInternal(const TaskDef& task_def)
     return errors::AlreadyExists("A task with id ", task_def.task_id(),
                                  " already exists.");
   }
-  Task& task = tasks_[task_def.task_id()];
-  task.id = task_def.task_id();
-  task.dataset = std::move(dataset);
-  task.iterator = std::move(iterator);
+  auto task = absl::make_unique<Task>();
+  task->id = task_def.task_id();
+  task->num_consumers = task_def.num_consumers();
+  const int64 num_positions = std::max<int64>(1, task->num_consumers);
+  task->consumer_positions.assign(num_positions, 0);
+  task->consumer_last_request_micros.assign(num_positions,
+                                            Env::Default()->NowMicros());
+  task->consumer_evicted.assign(num_positions, false);
+  task->dataset = std::move(dataset);
+  task->iterator = std::move(iterator);
+  Task* task_ptr = task.get();
+  task->prefetch_thread.reset(
+      Env::Default()->StartThread({}, "data-service-worker-prefetch",
+                                  [this, task_ptr]() {
+                                    PrefetchThread(task_ptr);
+                                  }));
+  tasks_[task_def.task_id()] = std::move(task);
   VLOG(3) << "Began processing for task " << task_def.task_id();
   return Status::OK();
 }
 
+void DataServiceWorkerImpl::PrefetchThread(Task* task) {
+  while (true) {
+    standalone::Iterator* iterator;
+    {
+      mutex_lock l(mu_);
+      while (!cancelled_ && static_cast<int64>(task->buffer.size()) >=
+                                BufferCapacity(*task)) {
+        task->space_available_cv.wait(l);
+      }
+      if (cancelled_) {
+        return;
+      }
+      iterator = task->iterator.get();
+    }
+    BufferedElement element;
+    bool end_of_sequence = false;
+    element.status = iterator->GetNext(&element.components, &end_of_sequence);
+    mutex_lock l(mu_);
+    if (element.status.ok() && end_of_sequence) {
+      VLOG(3) << "Reached end_of_sequence for task " << task->id;
+      task->end_of_sequence = true;
+      // Release iterator memory.
+      task->iterator.reset();
+      task->element_available_cv.notify_all();
+      return;
+    }
+    task->buffer.push_back(std::move(element));
+    // The consumers of a shared task may all be waiting for the element.
+    task->element_available_cv.notify_all();
+  }
+}
+
+/* static */ constexpr int64 DataServiceWorkerImpl::kMaxBufferedElementsPerTask;
+
+int64 DataServiceWorkerImpl::BufferCapacity(const Task& task) {
+  return task.num_consumers > 0 ? kMaxBufferedElementsPerSharedTask
+                                : kMaxBufferedElementsPerTask;
+}
+
 Status DataServiceWorkerImpl::GetElement(const GetElementRequest* request,
                                          GetElementResponse* response) {
   VLOG(3) << "Received GetElement request for task " << request->task_id();
-  bool end_of_sequence = false;
   std::vector<tensorflow::Tensor> outputs;
+  bool shared;
   {
     mutex_lock l(mu_);
     auto it = tasks_.find(request->task_id());
@@ -118,57 +213,325 @@ Status DataServiceWorkerImpl::GetElement(const GetElementRequest* request,
       return errors::NotFound("DataServiceWorkerImpl::GetElement failed. ",
                               "Task id ", request->task_id(), " not found");
     }
-    std::unique_ptr<standalone::Iterator>& iter = it->second.iterator;
-    if (iter == nullptr) {
+    Task& task = *it->second;
+    shared = task.num_consumers > 0;
+    int64 consumer_index = 0;
+    if (shared) {
+      consumer_index = request->consumer_index();
+      if (consumer_index < 0 || consumer_index >= task.num_consumers) {
+        return errors::InvalidArgument(
+            "Consumer index ", consumer_index, " is out of range for task ",
+            task.id, " with ", task.num_consumers, " consumers");
+      }
+      if (task.consumer_evicted[consumer_index]) {
+        return errors::FailedPrecondition(
+            "Consumer ", consumer_index, " of task ", task.id,
+            " was evicted after stalling the other consumers for ",
+            consumer_timeout_micros_ / 1000000, " seconds, so it can't read ",
+            "all elements of the task anymore");
+      }
+    }
+    task.consumer_last_request_micros[consumer_index] =
+        Env::Default()->NowMicros();
+    int64& position = task.consumer_positions[consumer_index];
+    auto buffer_end = [&task]() {
+      return task.buffer_start_index + static_cast<int64>(task.buffer.size());
+    };
+    ++task.num_requests;
+    if (position == buffer_end() && !task.end_of_sequence) {
+      ++task.num_buffer_misses;
+    }
+    ++task.num_waiting_requests;
+    UpdateStalledSince(task);
+    while (!cancelled_ && position == buffer_end() && !task.end_of_sequence) {
+      task.element_available_cv.wait(l);
+    }
+    --task.num_waiting_requests;
+    UpdateStalledSince(task);
+    if (cancelled_) {
+      return errors::Cancelled("The tf.data service worker is shutting down");
+    }
+    task.consumer_last_request_micros[consumer_index] =
+        Env::Default()->NowMicros();
+    if (position == buffer_end()) {
       VLOG(3) << "Task " << request->task_id() << " is already finished";
+      DropConsumedElements(task);
       response->set_end_of_sequence(true);
       return Status::OK();
     }
-    TF_RETURN_IF_ERROR(iter->GetNext(&outputs, &end_of_sequence));
-    if (end_of_sequence) {
-      VLOG(3) << "Reached end_of_sequence for task " << request->task_id();
-      // Release iterator memory and leave a null entry as a tombstone.
-      iter.reset();
-      pending_completed_tasks_.push_back(request->task_id());
-      heartbeat_cv_.notify_one();
-    }
-  }
-
-  if (!end_of_sequence) {
-    VLOG(3) << "Producing an element for task " << request->task_id();
-    if (outputs.size() != 1) {
-      return errors::FailedPrecondition(
-          "Expected dataset to produce a single scalar variant tensor, but the "
-          "dataset produced ",
-          outputs.size(), " outputs");
-    }
-    if (outputs[0].dtype() != DT_VARIANT) {
-      return errors::FailedPrecondition(
-          "Expected dataset to produce a single scalar variant tensor, but "
-          "the dataset produced a tensor with type ",
-          DataTypeString(outputs[0].dtype()));
-    }
-    if (!TensorShapeUtils::IsScalar(outputs[0].shape())) {
-      return errors::FailedPrecondition(
-          "Expected dataset to produce a single scalar variant tensor, but "
-          "the dataset produced a tensor with shape ",
-          outputs[0].shape());
-    }
-    Variant& variant = outputs[0].scalar<Variant>()();
-    CompressedElement* compressed = variant.get<CompressedElement>();
-    if (compressed == nullptr) {
-      return errors::FailedPrecondition(
-          "Expected dataset to produce a CompressedElement variant tensor, but "
-          "it produced ",
-          variant.TypeName());
+    BufferedElement& element = task.buffer[position - task.buffer_start_index];
+    ++position;
+    Status status = element.status;
+    if (shared) {
+      // Other consumers still need the element. Copying the tensors only
+      // copies references.
+      outputs = element.components;
+    } else {
+      outputs = std::move(element.components);
     }
+    DropConsumedElements(task);
+    TF_RETURN_IF_ERROR(status);
+  }
+
+  VLOG(3) << "Producing an element for task " << request->task_id();
+  if (outputs.size() != 1) {
+    return errors::FailedPrecondition(
+        "Expected dataset to produce a single scalar variant tensor, but the "
+        "dataset produced ",
+        outputs.size(), " outputs");
+  }
+  if (outputs[0].dtype() != DT_VARIANT) {
+    return errors::FailedPrecondition(
+        "Expected dataset to produce a single scalar variant tensor, but "
+        "the dataset produced a tensor with type ",
+        DataTypeString(outputs[0].dtype()));
+  }
+  if (!TensorShapeUtils::IsScalar(outputs[0].shape())) {
+    return errors::FailedPrecondition(
+        "Expected dataset to produce a single scalar variant tensor, but "
+        "the dataset produced a tensor with shape ",
+        outputs[0].shape());
+  }
+  Variant& variant = outputs[0].scalar<Variant>()();
+  CompressedElement* compressed = variant.get<CompressedElement>();
+  if (compressed == nullptr) {
+    return errors::FailedPrecondition(
+        "Expected dataset to produce a CompressedElement variant tensor, but "
+        "it produced ",
+        variant.TypeName());
+  }
+  if (shared) {
+    *response->mutable_compressed_element() = *compressed;
+  } else {
     compressed->Swap(response->mutable_compressed_element());
   }
-  response->set_end_of_sequence(end_of_sequence);
+  TF_RETURN_IF_ERROR(
+      ConvertCompressedElement(request->compressed_element_version(),
+                               response->mutable_compressed_element()));
+  response->set_end_of_sequence(false);
+
+  return Status::OK();
+}
+
+void DataServiceWorkerImpl::DropConsumedElements(Task& task) {
+  const int64 buffer_end =
+      task.buffer_start_index + static_cast<int64>(task.buffer.size());
+  // Evicted consumers don't hold elements back. If every consumer was
+  // evicted, all elements are dropped.
+  int64 min_position = buffer_end;
+  for (size_t i = 0; i < task.consumer_positions.size(); ++i) {
+    if (!task.consumer_evicted[i]) {
+      min_position = std::min(min_position, task.consumer_positions[i]);
+    }
+  }
+  while (task.buffer_start_index < min_position) {
+    task.buffer.pop_front();
+    ++task.buffer_start_index;
+    task.space_available_cv.notify_one();
+  }
+  UpdateStalledSince(task);
+  // The buffer only becomes empty at the end of the input once every consumer
+  // has read all elements.
+  if (task.end_of_sequence && task.buffer.empty() &&
+      !task.completion_reported) {
+    task.completion_reported = true;
+    pending_completed_tasks_.push_back(task.id);
+    heartbeat_cv_.notify_one();
+  }
+}
+
+void DataServiceWorkerImpl::UpdateStalledSince(Task& task) {
+  // Requests only wait once they have read every buffered element, so a full
+  // buffer means that they wait for the consumers behind them.
+  const bool stalled =
+      task.num_consumers > 0 && task.num_waiting_requests > 0 &&
+      static_cast<int64>(task.buffer.size()) >= BufferCapacity(task);
+  if (!stalled) {
+    task.stalled_since_micros = 0;
+  } else if (task.stalled_since_micros == 0) {
+    task.stalled_since_micros = Env::Default()->NowMicros();
+  }
+}
+
+void DataServiceWorkerImpl::EvictIdleConsumers() {
+  const uint64 now_micros = Env::Default()->NowMicros();
+  for (auto& entry : tasks_) {
+    Task& task = *entry.second;
+    if (task.num_consumers == 0 || task.stalled_since_micros == 0) {
+      continue;
+    }
+    bool evicted = false;
+    for (int64 i = 0; i < task.num_consumers; ++i) {
+      // Only the consumers which hold back the oldest buffered element stall
+      // the others, and only since the stall started.
+      if (task.consumer_evicted[i] ||
+          task.consumer_positions[i] > task.buffer_start_index) {
+        continue;
+      }
+      const uint64 idle_since_micros = std::max(
+          task.consumer_last_request_micros[i], task.stalled_since_micros);
+      const int64 idle_micros =
+          static_cast<int64>(now_micros - idle_since_micros);
+      if (idle_micros < consumer_timeout_micros_) {
+        continue;
+      }
+      LOG(WARNING) << "Evicting consumer " << i << " of task " << task.id
+                   << ", which has stalled the other consumers for "
+                   << idle_micros / 1000000 << " seconds";
+      task.consumer_evicted[i] = true;
+      evicted = true;
+    }
+    if (evicted) {
+      DropConsumedElements(task);
+    }
+  }
+}
+
+Status DataServiceWorkerImpl::ResumeElementStream(
+    int64 stream_id, const GetElementRequest& request,
+    int64 next_element_index, int64* generation) {
+  std::shared_ptr<ElementStream> stream;
+  {
+    mutex_lock l(mu_);
+    auto it = element_streams_.find(stream_id);
+    if (it == element_streams_.end()) {
+      if (next_element_index != 0) {
+        return errors::DataLoss(
+            "Element stream ", stream_id, " for task ", request.task_id(),
+            " can't be resumed at element ", next_element_index,
+            ": the worker has no state for the stream. The worker may have "
+            "restarted, or the stream may have expired.");
+      }
+      ElementStreamEntry entry;
+      entry.stream = std::make_shared<ElementStream>();
+      entry.stream->request = request;
+      it = element_streams_.emplace(stream_id, std::move(entry)).first;
+    }
+    stream = it->second.stream;
+    ++it->second.num_connections;
+  }
+  auto disconnect = gtl::MakeCleanup(
+      [this, stream_id]() { DisconnectElementStream(stream_id); });
+  if (stream->request.task_id() != request.task_id() ||
+      stream->request.consumer_index() != request.consumer_index()) {
+    return errors::InvalidArgument(
+        "Element stream ", stream_id, " reads task ",
+        stream->request.task_id(), " as consumer ",
+        stream->request.consumer_index(), ", but it was resumed for task ",
+        request.task_id(), " as consumer ", request.consumer_index());
+  }
+  mutex_lock l(stream->mu);
+  const int64 end_index = stream->first_unacknowledged_index +
+                          static_cast<int64>(stream->unacknowledged.size());
+  if (next_element_index < stream->first_unacknowledged_index ||
+      next_element_index > end_index) {
+    return errors::DataLoss(
+        "Element stream ", stream_id, " for task ", request.task_id(),
+        " can't be resumed at element ", next_element_index,
+        ": the worker retains elements ", stream->first_unacknowledged_index,
+        " to ", end_index, " of the stream.");
+  }
+  while (stream->first_unacknowledged_index < next_element_index) {
+    stream->unacknowledged.pop_front();
+    ++stream->first_unacknowledged_index;
+  }
+  *generation = ++stream->generation;
+  disconnect.release();
+  return Status::OK();
+}
+
+Status DataServiceWorkerImpl::AcknowledgeStreamElements(
+    int64 stream_id, int64 generation, int64 next_element_index) {
+  std::shared_ptr<ElementStream> stream;
+  TF_RETURN_IF_ERROR(FindElementStream(stream_id, &stream));
+  mutex_lock l(stream->mu);
+  if (stream->generation != generation) {
+    return errors::Cancelled("Element stream ", stream_id,
+                             " was resumed by another connection");
+  }
+  const int64 end_index = stream->first_unacknowledged_index +
+                          static_cast<int64>(stream->unacknowledged.size());
+  if (next_element_index > end_index) {
+    return errors::InvalidArgument(
+        "Element ", next_element_index, " of stream ", stream_id,
+        " was acknowledged, but only ", end_index, " elements were sent");
+  }
+  while (stream->first_unacknowledged_index < next_element_index) {
+    stream->unacknowledged.pop_front();
+    ++stream->first_unacknowledged_index;
+  }
+  return Status::OK();
+}
 
+Status DataServiceWorkerImpl::GetStreamElement(
+    int64 stream_id, int64 generation, int64 element_index,
+    std::shared_ptr<const GetElementResponse>* response) {
+  std::shared_ptr<ElementStream> stream;
+  TF_RETURN_IF_ERROR(FindElementStream(stream_id, &stream));
+  mutex_lock l(stream->mu);
+  if (stream->generation != generation) {
+    return errors::Cancelled("Element stream ", stream_id,
+                             " was resumed by another connection");
+  }
+  const int64 end_index = stream->first_unacknowledged_index +
+                          static_cast<int64>(stream->unacknowledged.size());
+  if (element_index < stream->first_unacknowledged_index ||
+      element_index > end_index) {
+    return errors::Internal("Element ", element_index, " of stream ",
+                            stream_id, " is not available. Elements ",
+                            stream->first_unacknowledged_index, " to ",
+                            end_index, " are retained.");
+  }
+  if (element_index < end_index) {
+    // The client did not receive the element before the stream broke.
+    *response = stream->unacknowledged[element_index -
+                                       stream->first_unacknowledged_index];
+    return Status::OK();
+  }
+  auto new_response = std::make_shared<GetElementResponse>();
+  TF_RETURN_IF_ERROR(GetElement(&stream->request, new_response.get()));
+  stream->unacknowledged.push_back(new_response);
+  *response = std::move(new_response);
   return Status::OK();
 }
 
+void DataServiceWorkerImpl::DisconnectElementStream(int64 stream_id) {
+  mutex_lock l(mu_);
+  auto it = element_streams_.find(stream_id);
+  if (it == element_streams_.end()) {
+    return;
+  }
+  if (--it->second.num_connections == 0) {
+    it->second.disconnected_at_micros = Env::Default()->NowMicros();
+  }
+}
+
+Status DataServiceWorkerImpl::FindElementStream(
+    int64 stream_id, std::shared_ptr<ElementStream>* stream) {
+  mutex_lock l(mu_);
+  auto it = element_streams_.find(stream_id);
+  if (it == element_streams_.end()) {
+    return errors::NotFound("Element stream ", stream_id, " not found");
+  }
+  *stream = it->second.stream;
+  return Status::OK();
+}
+
+void DataServiceWorkerImpl::ExpireElementStreams() {
+  const uint64 now_micros = Env::Default()->NowMicros();
+  for (auto it = element_streams_.begin(); it != element_streams_.end();) {
+    const ElementStreamEntry& entry = it->second;
+    if (entry.num_connections == 0 &&
+        now_micros - entry.disconnected_at_micros >=
+            kElementStreamTimeoutMicros) {
+      VLOG(3) << "Expiring element stream " << it->first;
+      element_streams_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+}
+
 Status DataServiceWorkerImpl::EnsureMasterStubInitialized()
     EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   if (!master_stub_) {
@@ -188,6 +551,7 @@ Status DataServiceWorkerImpl::Register() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   TF_RETURN_IF_ERROR(EnsureMasterStubInitialized());
   RegisterWorkerRequest req;
   req.set_worker_address(worker_address_);
+  req.set_worker_locality(worker_locality_);
   RegisterWorkerResponse resp;
 
   grpc::ClientContext ctx;
@@ -203,43 +567,87 @@ Status DataServiceWorkerImpl::Register() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
   return Status::OK();
 }
 
-Status DataServiceWorkerImpl::SendTaskUpdate() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-  VLOG(3) << "Sending " << pending_completed_tasks_.size()
-          << " task updates to master";
-  TF_RETURN_IF_ERROR(EnsureMasterStubInitialized());
+Status DataServiceWorkerImpl::SendTaskUpdate() {
   WorkerUpdateRequest req;
-  req.set_worker_id(worker_id_);
-  for (int task_id : pending_completed_tasks_) {
-    TaskProgress* update = req.add_updates();
-    update->set_task_id(task_id);
-    update->set_completed(true);
+  MasterService::Stub* master_stub;
+  {
+    mutex_lock l(mu_);
+    TF_RETURN_IF_ERROR(EnsureMasterStubInitialized());
+    master_stub = master_stub_.get();
+    req.set_worker_id(worker_id_);
+    for (int64 task_id : pending_completed_tasks_) {
+      TaskProgress* update = req.add_updates();
+      update->set_task_id(task_id);
+      update->set_completed(true);
+    }
+    // Reports the buffer occupancy of the running tasks, so that the master
+    // can tell which tasks keep their clients waiting.
+    for (auto& entry : tasks_) {
+      Task& task = *entry.second;
+      if (task.completion_reported) {
+        continue;
+      }
+      TaskProgress* update = req.add_updates();
+      update->set_task_id(task.id);
+      update->set_num_buffered_elements(task.buffer.size());
+      update->set_buffer_capacity(BufferCapacity(task));
+      update->set_num_requests(task.num_requests);
+      update->set_num_buffer_misses(task.num_buffer_misses);
+      task.num_requests = 0;
+      task.num_buffer_misses = 0;
+    }
   }
 
+  VLOG(3) << "Sending " << req.updates_size() << " task updates to master";
   WorkerUpdateResponse resp;
   grpc::ClientContext ctx;
-  grpc::Status s = master_stub_->WorkerUpdate(&ctx, req, &resp);
+  grpc::Status s = master_stub->WorkerUpdate(&ctx, req, &resp);
   if (!s.ok()) {
     return grpc_util::WrapError("Failed to send task updates", s);
   }
-  pending_completed_tasks_.clear();
+  mutex_lock l(mu_);
+  for (const TaskProgress& update : req.updates()) {
+    if (update.completed()) {
+      pending_completed_tasks_.erase(
+          std::remove(pending_completed_tasks_.begin(),
+                      pending_completed_tasks_.end(), update.task_id()),
+          pending_completed_tasks_.end());
+    }
+  }
   VLOG(3) << "Sent " << req.updates().size() << " task updates ";
   return Status::OK();
 }
 
 void DataServiceWorkerImpl::HeartbeatThread() {
+  uint64 next_update_micros =
+      Env::Default()->NowMicros() + heartbeat_interval_micros;
   while (true) {
-    mutex_lock l(mu_);
-    while (!cancelled_ && pending_completed_tasks_.empty()) {
-      heartbeat_cv_.wait(l);
-    }
-    if (cancelled_) {
-      VLOG(3) << "Heartbeat thread shutting down";
-      return;
+    {
+      mutex_lock l(mu_);
+      // Completed tasks are reported right away. Otherwise an update with the
+      // tasks' buffer occupancy is sent every heartbeat interval. Idle
+      // consumers are checked for at least once per consumer timeout.
+      while (!cancelled_ && pending_completed_tasks_.empty() &&
+             Env::Default()->NowMicros() < next_update_micros) {
+        const int64 wait_micros = std::min<int64>(
+            static_cast<int64>(next_update_micros -
+                               Env::Default()->NowMicros()),
+            consumer_timeout_micros_);
+        heartbeat_cv_.wait_for(l, std::chrono::microseconds(wait_micros));
+        EvictIdleConsumers();
+      }
+      if (cancelled_) {
+        VLOG(3) << "Heartbeat thread shutting down";
+        return;
+      }
+      ExpireElementStreams();
     }
     Status s = SendTaskUpdate();
     if (!s.ok()) {
       LOG(WARNING) << "Failed to send task updates to master: " << s;
     }
+    next_update_micros =
+        Env::Default()->NowMicros() + heartbeat_interval_micros;
   }
 }
 
@@ -15,6 +15,9 @@ limitations under the License.
 #ifndef TENSORFLOW_CORE_DATA_SERVICE_WORKER_IMPL_H_
 #define TENSORFLOW_CORE_DATA_SERVICE_WORKER_IMPL_H_
 
+#include <deque>
+#include <memory>
+
 #include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/data/service/common.pb.h"
 #include "tensorflow/core/data/service/master.grpc.pb.h"
@@ -29,13 +32,26 @@ namespace data {
 // A TensorFlow DataService serves dataset elements over RPC.
 class DataServiceWorkerImpl {
  public:
+  // `consumer_timeout_ms` bounds how long a consumer of a shared task may
+  // stall the task's other consumers before it is evicted. A non-positive
+  // value selects the default of 5 minutes.
   explicit DataServiceWorkerImpl(const std::string& master_address,
-                                 const std::string& protocol);
+                                 const std::string& protocol,
+                                 int64 consumer_timeout_ms);
   ~DataServiceWorkerImpl();
 
   // Starts the worker. The worker needs to know its own address so that it can
-  // register with the master.
-  void Start(const std::string& worker_address);
+  // register with the master. `worker_locality` labels where the worker runs,
+  // so that clients in the same locality can prefer it. It may be empty.
+  void Start(const std::string& worker_address,
+             const std::string& worker_locality);
+
+  // Sets how often the worker sends task updates to the master. A
+  // non-positive value restores the default.
+  static void SetHeartbeatIntervalForTesting(int64 interval_micros);
+
+  // Maximum number of elements produced ahead of GetElement requests, per task.
+  static constexpr int64 kMaxBufferedElementsPerTask = 4;
 
   // See worker.proto for API documentation.
 
@@ -47,39 +63,172 @@ class DataServiceWorkerImpl {
   Status GetElement(const GetElementRequest* request,
                     GetElementResponse* response);
 
+  /// Element streams, used to implement GetElementStream.
+  // Connects to the stream `stream_id`, creating it if it doesn't exist, so
+  // that it produces the elements requested by `request` from
+  // `next_element_index` on. Elements before `next_element_index` are
+  // acknowledged. Returns DataLoss if the stream can't be resumed at
+  // `next_element_index`. Sets `*generation` to identify the connection in
+  // the calls below. Each successful call must be matched by a call to
+  // `DisconnectElementStream`.
+  Status ResumeElementStream(int64 stream_id, const GetElementRequest& request,
+                             int64 next_element_index, int64* generation);
+  // Acknowledges the elements of the stream before `next_element_index`, so
+  // that they are no longer retained.
+  Status AcknowledgeStreamElements(int64 stream_id, int64 generation,
+                                   int64 next_element_index);
+  // Gets the element at `element_index` in the stream. The index may either
+  // be that of an element which was produced but not acknowledged yet, or of
+  // the next element to produce. Returns Cancelled if another connection has
+  // since resumed the stream.
+  Status GetStreamElement(int64 stream_id, int64 generation,
+                          int64 element_index,
+                          std::shared_ptr<const GetElementResponse>* response);
+  // Disconnects from the stream. Streams without connections expire after a
+  // timeout.
+  void DisconnectElementStream(int64 stream_id);
+
  private:
   // Sets master_stub_ if it isn't already set.
   Status EnsureMasterStubInitialized();
   // Registers the worker with the master.
   Status Register();
-  // Sends task status to the master.
-  Status SendTaskUpdate();
+  // Sends task status and buffer occupancy to the master.
+  Status SendTaskUpdate() TF_LOCKS_EXCLUDED(mu_);
   // Creates an iterator to process a task.
   Status ProcessTaskInternal(const TaskDef& task);
   // A thread for updating the master with worker status.
   void HeartbeatThread();
 
+  // The result of a call to the iterator of a task, buffered until it is
+  // requested.
+  struct BufferedElement {
+    Status status;
+    std::vector<Tensor> components;
+  };
+
   typedef struct Task {
     int64 id;
     // TODO(aaudibert): Have standalone::Iterator own a reference to
     // standalone::Dataset so that we don't need to store the dataset here.
     std::unique_ptr<standalone::Dataset> dataset;
+    // Only used by the prefetch thread. Reset when the task reaches the end of
+    // its input, to release iterator memory.
     std::unique_ptr<standalone::Iterator> iterator;
+    // The number of consumers of a shared task, or 0 if the task is not
+    // shared.
+    int64 num_consumers = 0;
+    // Elements produced ahead of GetElement requests, in order. For shared
+    // tasks, elements stay buffered until every consumer has read them.
+    std::deque<BufferedElement> buffer;
+    // The index in the task's output of the first element of `buffer`.
+    int64 buffer_start_index = 0;
+    // The index of the next element to read, per consumer. Tasks that are not
+    // shared have a single position.
+    std::vector<int64> consumer_positions;
+    // When each consumer last requested an element, or when the task started
+    // if it has not requested any yet.
+    std::vector<uint64> consumer_last_request_micros;
+    // Whether each consumer was evicted for stalling the other consumers for
+    // longer than the consumer timeout. Evicted consumers no longer keep
+    // elements buffered, and their requests fail.
+    std::vector<bool> consumer_evicted;
+    // The number of GetElement requests waiting for an element to be produced.
+    int64 num_waiting_requests = 0;
+    // Since when `buffer` has been full while requests wait for an element, or
+    // 0 if it hasn't. While this lasts, the consumers which hold back the
+    // oldest buffered element keep the other consumers from progressing.
+    uint64 stalled_since_micros = 0;
+    // Whether the iterator has reached the end of its input.
+    bool end_of_sequence = false;
+    // Whether the completion of the task has been queued for the master.
+    bool completion_reported = false;
+    // Element requests, and requests that found `buffer` empty, since the last
+    // update sent to the master.
+    int64 num_requests = 0;
+    int64 num_buffer_misses = 0;
+    // Notified when an element is added to `buffer` or the end of the input is
+    // reached.
+    condition_variable element_available_cv;
+    // Notified when an element is removed from `buffer`.
+    condition_variable space_available_cv;
+    // Fills `buffer` ahead of requests.
+    std::unique_ptr<Thread> prefetch_thread;
   } Task;
 
+  // The elements of a resumable stream that have been produced but not yet
+  // acknowledged by the client.
+  struct ElementStream {
+    // The request to produce elements with. Immutable after creation.
+    GetElementRequest request;
+    // Serializes element production, so that elements are appended to
+    // `unacknowledged` in order.
+    mutex mu;
+    // Responses which the client may not have received, in order.
+    std::deque<std::shared_ptr<const GetElementResponse>> unacknowledged
+        TF_GUARDED_BY(mu);
+    // The index in the stream of the first element of `unacknowledged`.
+    int64 first_unacknowledged_index TF_GUARDED_BY(mu) = 0;
+    // Incremented each time the stream is resumed. Only the latest connection
+    // may produce elements.
+    int64 generation TF_GUARDED_BY(mu) = 0;
+  };
+
+  // Book-keeping for expiring element streams.
+  struct ElementStreamEntry {
+    std::shared_ptr<ElementStream> stream;
+    int64 num_connections = 0;
+    // When the last connection to the stream was closed.
+    uint64 disconnected_at_micros = 0;
+  };
+
+  // Returns the stream `stream_id`, or NotFound if it doesn't exist.
+  Status FindElementStream(int64 stream_id,
+                           std::shared_ptr<ElementStream>* stream)
+      TF_LOCKS_EXCLUDED(mu_);
+  // Removes the element streams that have had no connection for longer than
+  // the stream timeout.
+  void ExpireElementStreams() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Drops the buffered elements of `task` which every consumer has read, and
+  // queues the completion of the task once it has no elements left.
+  void DropConsumedElements(Task& task) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Starts or ends the stall of `task` if its buffer or waiting requests
+  // changed.
+  void UpdateStalledSince(Task& task) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+  // Evicts the consumers of shared tasks which have stalled the other
+  // consumers for longer than the consumer timeout without requesting an
+  // element. Time that a consumer spends idle while the others can still
+  // progress does not count.
+  void EvictIdleConsumers() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Produces elements of `task` into its buffer until the end of its input is
+  // reached or the worker is cancelled.
+  void PrefetchThread(Task* task);
+  // Returns the maximum number of elements to buffer for `task`.
+  static int64 BufferCapacity(const Task& task);
+
   const std::string master_address_;
   // Protocol for communicating with the master.
   const std::string protocol_;
+  // How long a consumer of a shared task may stall the other consumers
+  // before it is evicted.
+  const int64 consumer_timeout_micros_;
   // The worker's own address.
   std::string worker_address_;
+  // The locality label of the worker.
+  std::string worker_locality_;
 
   mutex mu_;
   int64 worker_id_ TF_GUARDED_BY(mu_);
   std::unique_ptr<MasterService::Stub> master_stub_ TF_GUARDED_BY(mu_);
   // Information about tasks, keyed by task ids.
-  absl::flat_hash_map<int64, Task> tasks_ TF_GUARDED_BY(mu_);
+  absl::flat_hash_map<int64, std::unique_ptr<Task>> tasks_ TF_GUARDED_BY(mu_);
   // List of completed tasks which haven't yet been communicated to the master.
   std::vector<int64> pending_completed_tasks_ TF_GUARDED_BY(mu_);
+  // Resumable element streams, keyed by stream ids.
+  absl::flat_hash_map<int64, ElementStreamEntry> element_streams_
+      TF_GUARDED_BY(mu_);
   bool cancelled_ TF_GUARDED_BY(mu_) = false;
   // Condition variable for notifying the heartbeat thread.
   condition_variable heartbeat_cv_ TF_GUARDED_BY(mu_);
@@ -130,6 +130,8 @@ Status Dataset::MakeIterator(std::unique_ptr<Iterator>* result) {
   return Status::OK();
 }
 
+void Dataset::Cancel() { cancellation_manager_.StartCancel(); }
+
 Dataset::Dataset(DatasetBase* dataset, DeviceMgr* device_mgr,
                  ProcessFunctionLibraryRuntime* pflr,
                  FunctionLibraryDefinition* flib_def, thread::ThreadPool* pool)
@@ -99,6 +99,10 @@ class Dataset {
   // Creates an iterator for this dataset.
   Status MakeIterator(std::unique_ptr<Iterator>* result);
 
+  // Cancels the iterators of this dataset. `GetNext` calls which are blocked
+  // or made afterwards return a `Cancelled` error.
+  void Cancel();
+
  private:
   Dataset(DatasetBase* dataset, DeviceMgr* device_mgr,
           ProcessFunctionLibraryRuntime* pflr,
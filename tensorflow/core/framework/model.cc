@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/framework/model.h"
 
+#include <algorithm>
+#include <cmath>
 #include <memory>
 
 #include "absl/time/clock.h"
@@ -28,6 +30,18 @@ namespace {
 // Wrapper for the square function to reduce verbosity.
 inline double Square(double x) { return x * x; }
 
+// Returns the path of node names from the output of the model to the given
+// node, e.g. "Prefetch/ParallelMapV2/TFRecord".
+string NodePath(const Node& node) {
+  std::vector<string> names({node.name()});
+  for (const Node* output = node.output(); output != nullptr;
+       output = output->output()) {
+    names.push_back(output->name());
+  }
+  std::reverse(names.begin(), names.end());
+  return str_util::Join(names, "/");
+}
+
 // The first input of InterleaveMany corresponds to the input dataset whose
 // elements are used to create the (derived) input datasets whose elements are
 // interleaved as output.
@@ -1251,6 +1265,35 @@ void Node::TotalMaximumBufferedBytesHelper(
   total_bytes->insert(std::make_pair(long_name(), result));
 }
 
+absl::flat_hash_map<string, double> Node::TunableParameterValues() const {
+  absl::flat_hash_map<string, double> values;
+  tf_shared_lock l(mu_);
+  for (const auto& pair : parameters_) {
+    if (pair.second->state->tunable) {
+      values[pair.first] = pair.second->state->value;
+    }
+  }
+  return values;
+}
+
+void Node::SetTunableParameterValue(const string& name, double value) {
+  mutex_lock l(mu_);
+  auto* parameter = gtl::FindOrNull(parameters_, name);
+  if (!parameter || !(*parameter)->state->tunable) {
+    return;
+  }
+  value = std::min(std::max(value, (*parameter)->min), (*parameter)->max);
+  (*parameter)->value = value;
+  auto& state = (*parameter)->state;
+  if (state->mu) {
+    mutex_lock state_lock(*state->mu);
+    state->value = value;
+    state->cond_var->notify_all();
+  } else {
+    state->value = value;
+  }
+}
+
 void Model::AddNode(Node::Factory factory, const string& name,
                     std::shared_ptr<Node> parent,
                     std::shared_ptr<Node>* out_node) {
@@ -1271,6 +1314,19 @@ void Model::AddNode(Node::Factory factory, const string& name,
   }
   collect_resource_usage_ =
       collect_resource_usage_ || node->has_tunable_parameters();
+  if (!warm_start_state_.empty()) {
+    auto* state = gtl::FindOrNull(warm_start_state_, NodePath(*node));
+    if (state) {
+      VLOG(2) << "Warm-starting " << node->long_name();
+      for (const auto& pair : state->parameters) {
+        node->SetTunableParameterValue(pair.first, pair.second);
+      }
+      if (state->self_processing_time > 0) {
+        node->add_processing_time(std::llround(state->self_processing_time));
+        node->record_element();
+      }
+    }
+  }
   *out_node = std::move(node);
 }
 
@@ -1292,6 +1348,11 @@ void Model::FlushMetrics() {
 
 void Model::Optimize(AutotuneAlgorithm algorithm, int64 cpu_budget,
                      int64 ram_budget) {
+  Optimize(algorithm, cpu_budget, ram_budget, OptimizationObjective());
+}
+
+void Model::Optimize(AutotuneAlgorithm algorithm, int64 cpu_budget,
+                     int64 ram_budget, const OptimizationObjective& objective) {
   switch (algorithm) {
     case AutotuneAlgorithm::HILL_CLIMB:
       OptimizeHillClimb(cpu_budget, ram_budget);
@@ -1299,6 +1360,9 @@ void Model::Optimize(AutotuneAlgorithm algorithm, int64 cpu_budget,
     case AutotuneAlgorithm::GRADIENT_DESCENT:
       OptimizeGradientDescent(cpu_budget, ram_budget);
       break;
+    case AutotuneAlgorithm::MULTI_OBJECTIVE:
+      OptimizeMultiObjective(cpu_budget, ram_budget, objective);
+      break;
   }
 }
 
@@ -1312,6 +1376,44 @@ void Model::RemoveNode(std::shared_ptr<Node> node) {
   }
 }
 
+ModelState Model::GetState() {
+  ModelState state;
+  std::deque<std::shared_ptr<Node>> queue;
+  {
+    tf_shared_lock l(mu_);
+    if (output_) queue.push_back(output_);
+  }
+  while (!queue.empty()) {
+    auto node = queue.front();
+    queue.pop_front();
+    if (!node->autotune()) {
+      continue;
+    }
+    string path = NodePath(*node);
+    // Inputs of the same transformation (e.g. interleave) may share a path, in
+    // which case the first node stands in for all of them.
+    if (!state.contains(path)) {
+      NodeState& node_state = state[path];
+      int64 num_elements = node->num_elements();
+      if (num_elements > 0) {
+        node_state.self_processing_time =
+            static_cast<double>(node->processing_time()) /
+            static_cast<double>(num_elements);
+      }
+      node_state.parameters = node->TunableParameterValues();
+    }
+    for (auto input : node->inputs()) {
+      queue.push_back(input);
+    }
+  }
+  return state;
+}
+
+void Model::SetWarmStartState(ModelState state) {
+  mutex_lock l(mu_);
+  warm_start_state_ = std::move(state);
+}
+
 absl::flat_hash_map<string, std::shared_ptr<Parameter>>
 Model::CollectTunableParameters(std::shared_ptr<Node> node) {
   absl::flat_hash_map<string, std::shared_ptr<Parameter>> parameters;
@@ -1486,6 +1588,86 @@ void Model::OptimizeHillClimb(int64 cpu_budget, int64 ram_budget) {
   }
 }
 
+void Model::OptimizeMultiObjective(int64 cpu_budget, int64 ram_budget,
+                                   const OptimizationObjective& objective) {
+  std::shared_ptr<Node> snapshot;
+  {
+    tf_shared_lock lock(mu_);
+    snapshot = output_->Snapshot(nullptr);
+  }
+  VLOG(2) << "Starting optimization of tunable parameters with MultiObjective";
+  auto parameters = CollectTunableParameters(snapshot);
+  // We add the number of model's buffered bytes because it is excluded from the
+  // memory budget, but it is included in the maximum number of buffered bytes.
+  ram_budget += TotalBufferedBytes(snapshot);
+  // Buffer size parameter will only be incremented if the output latency
+  // improvement is greater than this constant.
+  constexpr double kBufferSizeMinDelta = 1.0L;
+
+  for (auto& pair : parameters) {
+    pair.second->value = pair.second->min;
+  }
+  auto total_parallelism = [&parameters]() {
+    double parallelism = 0.0L;
+    for (auto& pair : parameters) {
+      if (pair.second->name == kParallelism) {
+        parallelism += pair.second->value;
+      }
+    }
+    return parallelism;
+  };
+  auto cost = [this, &objective, &snapshot,
+               &total_parallelism](double output_time) {
+    double excess_output_time =
+        std::max(output_time - objective.target_output_time, 0.0);
+    return objective.latency_weight * excess_output_time +
+           objective.cpu_weight * total_parallelism() +
+           objective.ram_weight * TotalMaximumBufferedBytes(snapshot);
+  };
+  double output_time = OutputTime(snapshot, /*gradients=*/nullptr);
+  double current_cost = cost(output_time);
+  while (true) {
+    double best_cost = current_cost;
+    double best_output_time = output_time;
+    Parameter* best_parameter = nullptr;
+    for (auto& pair : parameters) {
+      if (pair.second->value == pair.second->max) {
+        continue;
+      }
+      pair.second->value++;
+      double new_output_time = OutputTime(snapshot, /*gradients=*/nullptr);
+      double new_cost = cost(new_output_time);
+      bool within_budget =
+          total_parallelism() <= cpu_budget &&
+          TotalMaximumBufferedBytes(snapshot) <= ram_budget;
+      if (within_budget && new_cost < best_cost &&
+          (output_time - new_output_time > kBufferSizeMinDelta ||
+           pair.second->name != kBufferSize)) {
+        best_cost = new_cost;
+        best_output_time = new_output_time;
+        best_parameter = pair.second.get();
+      }
+      pair.second->value--;
+    }
+    if (!best_parameter) {
+      break;
+    }
+    best_parameter->value++;
+    current_cost = best_cost;
+    output_time = best_output_time;
+  }
+  VLOG(2) << "Number of tunable parameters: " << parameters.size()
+          << ", output time: " << output_time << ", cost: " << current_cost;
+  for (auto& pair : parameters) {
+    auto& parameter = pair.second;
+    VLOG(2) << "Setting tunable parameter " << pair.first << " to "
+            << parameter->value;
+    mutex_lock l(*parameter->state->mu);
+    parameter->state->value = parameter->value;
+    parameter->state->cond_var->notify_all();
+  }
+}
+
 double Model::OutputTime(std::shared_ptr<Node> node,
                          absl::flat_hash_map<string, double>* gradients) {
   // To store the input time for each node.
@@ -48,6 +48,28 @@ constexpr char kInputTimeKey[] = "input_time";
 enum class AutotuneAlgorithm {
   HILL_CLIMB = 0,
   GRADIENT_DESCENT = 1,
+  MULTI_OBJECTIVE = 2,
+};
+
+// Weights used by the `MULTI_OBJECTIVE` autotuning algorithm to trade off the
+// output latency of an input pipeline against the resources it consumes. The
+// algorithm minimizes
+//
+//   latency_weight * max(output_time - target_output_time, 0) +
+//   cpu_weight * parallelism + ram_weight * maximum_buffered_bytes
+//
+// where `output_time` is the modeled output latency (in nanoseconds),
+// `parallelism` is the total parallelism of the tunable transformations (i.e.
+// the number of cores they may keep busy) and `maximum_buffered_bytes` is the
+// worst-case memory used by their buffers.
+struct OptimizationObjective {
+  double latency_weight = 1.0;
+  double cpu_weight = 0.0;
+  double ram_weight = 0.0;
+  // Output latency (in nanoseconds) below which further improvements are not
+  // worth any resources, e.g. the step time of the model consuming the input
+  // pipeline. Zero means that there is no target.
+  double target_output_time = 0.0;
 };
 
 enum class TraversalOrder {
@@ -103,6 +125,20 @@ std::shared_ptr<Parameter> MakeParameter(const string& name,
                                          std::shared_ptr<SharedState> state,
                                          double min, double max);
 
+// Summary of a node of the model that can be used to warm-start the modeling
+// of the same input pipeline, e.g. in a different process.
+struct NodeState {
+  // Average processing time (in nanoseconds) per element produced by the node.
+  double self_processing_time = 0.0;
+  // Values of the tunable parameters of the node, keyed by parameter name.
+  absl::flat_hash_map<string, double> parameters;
+};
+
+// Node states keyed by the path of node names from the output of the model.
+// Unlike `Node::long_name()`, the path does not depend on the order in which
+// nodes are created and can be matched across processes.
+using ModelState = absl::flat_hash_map<string, NodeState>;
+
 // Abstract representation of a TensorFlow input pipeline node. It collects
 // information about inputs to this node, processing time spent executing the
 // node logic, number of elements produced by the node, various other
@@ -289,6 +325,16 @@ class Node {
     inputs_.remove(input);
   }
 
+  // Returns the values of the tunable parameters of this node (excluding its
+  // inputs), keyed by parameter name.
+  absl::flat_hash_map<string, double> TunableParameterValues() const
+      TF_LOCKS_EXCLUDED(mu_);
+
+  // Sets the value of the tunable parameter with the given name, clamped to the
+  // parameter range. Does nothing if the node has no such tunable parameter.
+  void SetTunableParameterValue(const string& name, double value)
+      TF_LOCKS_EXCLUDED(mu_);
+
   // Sets the value that determines whether autotuning is enabled for this node.
   void set_autotune(bool autotune) TF_LOCKS_EXCLUDED(mu_) {
     autotune_.store(autotune);
@@ -613,9 +659,24 @@ class Model {
   void Optimize(AutotuneAlgorithm algorithm, int64 cpu_budget, int64 ram_budget)
       TF_LOCKS_EXCLUDED(mu_);
 
+  // Same as above, with `objective` configuring the trade-off made by the
+  // `MULTI_OBJECTIVE` algorithm. Other algorithms ignore `objective`.
+  void Optimize(AutotuneAlgorithm algorithm, int64 cpu_budget, int64 ram_budget,
+                const OptimizationObjective& objective) TF_LOCKS_EXCLUDED(mu_);
+
   // Removes the given node.
   void RemoveNode(std::shared_ptr<Node> node) TF_LOCKS_EXCLUDED(mu_);
 
+  // Returns the state of the nodes of the model for which autotuning is
+  // enabled.
+  ModelState GetState() TF_LOCKS_EXCLUDED(mu_);
+
+  // Sets the state used to warm-start nodes subsequently added to the model.
+  // When a node whose path matches a node of `state` is added, its tunable
+  // parameters are initialized to the saved values and its processing time
+  // estimate is seeded with the saved per-element processing time.
+  void SetWarmStartState(ModelState state) TF_LOCKS_EXCLUDED(mu_);
+
  private:
   // Collects tunable parameters in the tree rooted in the given node, returning
   // a mapping from a (unique) node name to a tunable parameter.
@@ -647,6 +708,15 @@ class Model {
   // an element divided by CPU budget.
   void OptimizeGradientDescent(int64 cpu_budget, int64 ram_budget);
 
+  // This optimization algorithm starts by setting all tunable parameters to
+  // the minimum value. It then repeatedly increments the parameter which
+  // decreases the cost defined by `objective` the most, subject to the CPU and
+  // memory budgets. This process is repeated until no increment decreases the
+  // cost. In particular, once the output time reaches the target output time,
+  // additional parallelism or buffering only adds to the cost.
+  void OptimizeMultiObjective(int64 cpu_budget, int64 ram_budget,
+                              const OptimizationObjective& objective);
+
   // Collects the output time and if `gradients` is not `nullptr`, the output
   // time gradient w.r.t. tunable parameters of the subtree rooted in the given
   // node.
@@ -673,6 +743,9 @@ class Model {
   int64 id_counter_ TF_GUARDED_BY(mu_) = 1;
   std::shared_ptr<Node> output_ TF_GUARDED_BY(mu_);
 
+  // State used to warm-start nodes when they are added to the model.
+  ModelState warm_start_state_ TF_GUARDED_BY(mu_);
+
   // Indicates whether the modeling framework should collect resource usage
   // (e.g. CPU, memory). The logic for collecting this information assumes that
   // the collection is not repeatedly disabled and enabled. As a consequence,
@@ -772,6 +772,102 @@ TEST(SnapshotTest, Model) {
   }
 }
 
+class MultiObjectiveTest
+    : public ::testing::TestWithParam<
+          std::tuple<int64, double, double, int64>> {};
+
+TEST_P(MultiObjectiveTest, Model) {
+  const int64 cpu_budget = std::get<0>(GetParam());
+  OptimizationObjective objective;
+  objective.cpu_weight = std::get<1>(GetParam());
+  objective.target_output_time = std::get<2>(GetParam());
+  const int64 expected_parallelism = std::get<3>(GetParam());
+
+  Model model;
+  auto parallelism =
+      std::make_shared<SharedState>(kAutotune, std::make_shared<mutex>(),
+                                    std::make_shared<condition_variable>());
+  std::shared_ptr<Node> async_known_ratio;
+  model.AddNode(
+      [&parallelism](Node::Args args) {
+        return model::MakeAsyncKnownRatioNode(
+            std::move(args), /*ratio=*/1,
+            {model::MakeParameter(kParallelism, parallelism, /*min=*/1,
+                                  /*max=*/8)});
+      },
+      "async_known_ratio", /*parent=*/nullptr, &async_known_ratio);
+  std::shared_ptr<Node> source;
+  model.AddNode(
+      [](Node::Args args) { return model::MakeSourceNode(std::move(args)); },
+      "source", async_known_ratio, &source);
+  // With an infinitely fast input, the output time is `8000 / parallelism`.
+  async_known_ratio->add_processing_time(8000);
+  async_known_ratio->record_element();
+
+  model.Optimize(AutotuneAlgorithm::MULTI_OBJECTIVE, cpu_budget,
+                 /*ram_budget=*/0, objective);
+  EXPECT_EQ(parallelism->value, expected_parallelism);
+}
+
+INSTANTIATE_TEST_SUITE_P(
+    Test, MultiObjectiveTest,
+    ::testing::Values(
+        // Output time only: use all of the available parallelism.
+        std::make_tuple(64, 0.0, 0.0, 8),
+        // Output time only, limited by the CPU budget.
+        std::make_tuple(2, 0.0, 0.0, 2),
+        // Stop once a thread saves less than 1000ns of output time.
+        std::make_tuple(64, 1000.0, 0.0, 3),
+        // Stop once the output time is below the 3000ns target.
+        std::make_tuple(64, 1.0, 3000.0, 3)));
+
+TEST(WarmStartTest, Model) {
+  auto make_model = [](std::shared_ptr<SharedState> parallelism,
+                       Model* model) {
+    std::shared_ptr<Node> async_known_ratio;
+    model->AddNode(
+        [&parallelism](Node::Args args) {
+          return model::MakeAsyncKnownRatioNode(
+              std::move(args), /*ratio=*/1,
+              {model::MakeParameter(kParallelism, parallelism, /*min=*/1,
+                                    /*max=*/8)});
+        },
+        "async_known_ratio", /*parent=*/nullptr, &async_known_ratio);
+    std::shared_ptr<Node> source;
+    model->AddNode(
+        [](Node::Args args) { return model::MakeSourceNode(std::move(args)); },
+        "source", async_known_ratio, &source);
+    return async_known_ratio;
+  };
+
+  Model model;
+  auto parallelism =
+      std::make_shared<SharedState>(kAutotune, std::make_shared<mutex>(),
+                                    std::make_shared<condition_variable>());
+  std::shared_ptr<Node> node = make_model(parallelism, &model);
+  node->add_processing_time(800);
+  node->record_element();
+  node->record_element();
+  parallelism->value = 5;
+  ModelState state = model.GetState();
+  ASSERT_EQ(state.size(), 2);
+  const NodeState& node_state = state.at("async_known_ratio");
+  EXPECT_EQ(node_state.self_processing_time, 400);
+  EXPECT_EQ(node_state.parameters.at(kParallelism), 5);
+  EXPECT_TRUE(state.at("async_known_ratio/source").parameters.empty());
+
+  // A new model of the same pipeline starts from the saved state.
+  Model warm_model;
+  warm_model.SetWarmStartState(std::move(state));
+  auto warm_parallelism =
+      std::make_shared<SharedState>(kAutotune, std::make_shared<mutex>(),
+                                    std::make_shared<condition_variable>());
+  std::shared_ptr<Node> warm_node = make_model(warm_parallelism, &warm_model);
+  EXPECT_EQ(warm_parallelism->value, 5);
+  EXPECT_EQ(warm_node->processing_time(), 400);
+  EXPECT_EQ(warm_node->num_elements(), 1);
+}
+
 class ComputeWaitTimeTest
     : public ::testing::TestWithParam<std::tuple<double, double, double>> {};
 
@@ -632,6 +632,10 @@ class OpKernelContext {
     bool track_allocations = false;
     bool log_memory = false;
 
+    // If not null, serves the allocations with default attributes instead of
+    // the allocator of the device. Not owned.
+    Allocator* step_allocator = nullptr;
+
     // Array indexed by output number for this node
     const AllocatorAttributes* output_attr_array = nullptr;
 
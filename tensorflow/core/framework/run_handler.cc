@@ -398,7 +398,7 @@ void RunHandlerThreadPool::AddWorkToQueue(ThreadWorkSource* tws,
 // provide better performance due to less lock retention. The drawback is that
 // the profiler will be a bit harder to read.
 void RunHandlerThreadPool::SetThreadWorkSources(
-    int tid, int start_request_idx, uint64 version,
+    int tid, int start_request_idx, int num_preferred_requests, uint64 version,
     const Eigen::MaxSizeVector<ThreadWorkSource*>& thread_work_sources) {
   mutex_lock l(thread_data_[tid].mu);
   if (version > thread_data_[tid].new_version) {
@@ -407,6 +407,7 @@ void RunHandlerThreadPool::SetThreadWorkSources(
     // A newer version is already updated. No need to update.
     return;
   }
+  thread_data_[tid].new_num_preferred_requests = num_preferred_requests;
   thread_data_[tid].new_thread_work_sources->resize(0);
   if (use_sub_thread_pool_) {
     for (int i = 0; i < thread_work_sources.size(); ++i) {
@@ -468,11 +469,13 @@ int RunHandlerThreadPool::NumNonBlockingThreads() const {
 RunHandlerThreadPool::ThreadData::ThreadData()
     : new_version(0),
       current_index(0),
+      new_num_preferred_requests(0),
       new_thread_work_sources(
           new Eigen::MaxSizeVector<ThreadWorkSource*>(static_cast<int32>(
               ParamFromEnvWithDefault("TF_RUN_HANDLER_MAX_CONCURRENT_HANDLERS",
                                       kMaxConcurrentHandlers)))),
       current_version(0),
+      current_num_preferred_requests(0),
       current_thread_work_sources(
           new Eigen::MaxSizeVector<ThreadWorkSource*>(static_cast<int32>(
               ParamFromEnvWithDefault("TF_RUN_HANDLER_MAX_CONCURRENT_HANDLERS",
@@ -536,6 +539,8 @@ void RunHandlerThreadPool::WorkerLoop(int thread_id,
           thread_data_[thread_id].new_version) {
         thread_data_[thread_id].current_version =
             thread_data_[thread_id].new_version;
+        thread_data_[thread_id].current_num_preferred_requests =
+            thread_data_[thread_id].new_num_preferred_requests;
         thread_data_[thread_id].current_thread_work_sources.swap(
             thread_data_[thread_id].new_thread_work_sources);
       }
@@ -545,17 +550,25 @@ void RunHandlerThreadPool::WorkerLoop(int thread_id,
     if (use_sub_thread_pool_) {
       sub_thread_pool_id = thread_data_[thread_id].sub_thread_pool_id;
       int active_requests = thread_work_sources->size();
+      // The sub thread pools split the preferred requests among themselves.
+      // The other requests are only searched when none of the preferred
+      // requests has a task.
+      int preferred_requests =
+          thread_data_[thread_id].current_num_preferred_requests;
+      if (preferred_requests <= 0 || preferred_requests > active_requests) {
+        preferred_requests = active_requests;
+      }
       if (may_steal_blocking_work) {
         // Each thread will first look for tasks from requests that belongs to
         // its sub thread pool.
         int search_range_start =
-            active_requests *
+            preferred_requests *
             sub_thread_pool_start_request_percentage_[sub_thread_pool_id];
         int search_range_end =
-            active_requests *
+            preferred_requests *
             sub_thread_pool_end_request_percentage_[sub_thread_pool_id];
         search_range_end =
-            std::min(active_requests,
+            std::min(preferred_requests,
                      std::max(search_range_end, search_range_start + 1));
 
         t = FindTask(search_range_start, search_range_end, thread_id,
@@ -563,20 +576,32 @@ void RunHandlerThreadPool::WorkerLoop(int thread_id,
                      /*may_steal_blocking_work=*/true, *thread_work_sources,
                      &task_from_blocking_queue, &tws);
         if (!t.f) {
-          // Search from all requests if the thread cannot find tasks from
-          // requests that belong to its own sub thread pool.
-          t = FindTask(0, active_requests, thread_id, sub_thread_pool_id,
+          // Search from all preferred requests if the thread cannot find
+          // tasks from requests that belong to its own sub thread pool.
+          t = FindTask(0, preferred_requests, thread_id, sub_thread_pool_id,
                        kMaxBlockingInflight,
                        /*may_steal_blocking_work=*/true, *thread_work_sources,
                        &task_from_blocking_queue, &tws);
         }
+        if (!t.f && preferred_requests < active_requests) {
+          t = FindTask(preferred_requests, active_requests, thread_id,
+                       sub_thread_pool_id, kMaxBlockingInflight,
+                       /*may_steal_blocking_work=*/true, *thread_work_sources,
+                       &task_from_blocking_queue, &tws);
+        }
       } else {
         // For non-blocking threads, it will always search from all pending
-        // requests.
-        t = FindTask(0, active_requests, thread_id, sub_thread_pool_id,
+        // requests, starting with the preferred ones.
+        t = FindTask(0, preferred_requests, thread_id, sub_thread_pool_id,
                      kMaxBlockingInflight,
                      /*may_steal_blocking_work=*/false, *thread_work_sources,
                      &task_from_blocking_queue, &tws);
+        if (!t.f && preferred_requests < active_requests) {
+          t = FindTask(preferred_requests, active_requests, thread_id,
+                       sub_thread_pool_id, kMaxBlockingInflight,
+                       /*may_steal_blocking_work=*/false, *thread_work_sources,
+                       &task_from_blocking_queue, &tws);
+        }
       }
     } else {
       // TODO(chaox): Refactor the following code to share the logic with
@@ -682,6 +707,8 @@ void RunHandlerThreadPool::WaitForWork(bool is_blocking, int thread_id,
           thread_data_[thread_id].new_thread_work_sources);
       thread_data_[thread_id].current_version =
           thread_data_[thread_id].new_version;
+      thread_data_[thread_id].current_num_preferred_requests =
+          thread_data_[thread_id].new_num_preferred_requests;
     }
     Eigen::MaxSizeVector<ThreadWorkSource*>* thread_work_sources =
         thread_data_[thread_id].current_thread_work_sources.get();
@@ -694,6 +721,8 @@ void RunHandlerThreadPool::WaitForWork(bool is_blocking, int thread_id,
             thread_data_[thread_id].new_thread_work_sources);
         thread_data_[thread_id].current_version =
             thread_data_[thread_id].new_version;
+        thread_data_[thread_id].current_num_preferred_requests =
+            thread_data_[thread_id].new_num_preferred_requests;
         thread_work_sources =
             thread_data_[thread_id].current_thread_work_sources.get();
       }
@@ -739,7 +768,11 @@ class RunHandler::Impl {
 
   internal::ThreadWorkSource* tws() { return &tws_; }
 
-  int64 priority() { return options_.priority(); }
+  int64 priority() const { return options_.priority(); }
+
+  // Returns the time (in microseconds since unix epoch) by which the request
+  // should finish, or kuint64max if it has no deadline.
+  uint64 deadline_us() const { return deadline_us_; }
 
  private:
   class ThreadPoolInterfaceWrapper : public thread::ThreadPoolInterface {
@@ -757,6 +790,7 @@ class RunHandler::Impl {
 
   RunHandlerPool::Impl* pool_impl_;  // NOT OWNED.
   uint64 start_time_us_;
+  uint64 deadline_us_;
   int64 step_id_;
   std::unique_ptr<thread::ThreadPoolInterface> thread_pool_interface_;
   internal::ThreadWorkSource tws_;
@@ -836,6 +870,7 @@ class RunHandlerPool::Impl {
                         kMaxConcurrentHandlers))));
     uint64 version;
     int num_active_requests;
+    int num_preferred_requests;
     RunHandler::Impl* handler_impl;
     {
       mutex_lock l(mu_);
@@ -862,12 +897,11 @@ class RunHandlerPool::Impl {
 
       num_active_requests = sorted_active_handlers_.size() + 1;
       thread_work_sources->resize(num_active_requests);
-      int priority = options.priority();
       auto it = sorted_active_handlers_.cbegin();
       bool new_handler_inserted = false;
       for (int i = 0; i < num_active_requests; ++i) {
         if (!new_handler_inserted && (it == sorted_active_handlers_.cend() ||
-                                      priority > (*it)->priority())) {
+                                      ScheduledBefore(*handler_impl, **it))) {
           sorted_active_handlers_.insert(it, handler_impl);
           new_handler_inserted = true;
           // Point to the newly added handler.
@@ -876,9 +910,16 @@ class RunHandlerPool::Impl {
         (*thread_work_sources)[i] = (*it)->tws();
         ++it;
       }
+      const int64 top_priority = sorted_active_handlers_.front()->priority();
+      num_preferred_requests = 0;
+      for (const auto& active_handler : sorted_active_handlers_) {
+        if (active_handler->priority() != top_priority) break;
+        ++num_preferred_requests;
+      }
       version = ++version_;
     }
-    RecomputePoolStats(num_active_requests, version, *thread_work_sources);
+    RecomputePoolStats(num_active_requests, num_preferred_requests, version,
+                       *thread_work_sources);
     return WrapUnique<RunHandler>(new RunHandler(handler_impl));
   }
 
@@ -923,9 +964,31 @@ class RunHandlerPool::Impl {
     return ret;
   }
 
+  std::vector<int64> GetActiveHandlerStepIdsForTesting()
+      TF_LOCKS_EXCLUDED(mu_) {
+    mutex_lock l(mu_);
+    std::vector<int64> ret;
+    for (const auto& handler_impl : sorted_active_handlers_) {
+      ret.push_back(handler_impl->step_id());
+    }
+    return ret;
+  }
+
  private:
+  // Returns true if the request of `a` should be scheduled before the request
+  // of `b`, i.e. it has a higher priority, or the same priority and an
+  // earlier deadline.
+  static bool ScheduledBefore(const RunHandler::Impl& a,
+                              const RunHandler::Impl& b) {
+    if (a.priority() != b.priority()) return a.priority() > b.priority();
+    return a.deadline_us() < b.deadline_us();
+  }
+
+  // Threads prefer the first `num_preferred_requests` of the active requests,
+  // which have the highest priority, and only run the work of the other
+  // requests when the preferred ones have none.
   void RecomputePoolStats(
-      int num_active_requests, uint64 version,
+      int num_active_requests, int num_preferred_requests, uint64 version,
       const Eigen::MaxSizeVector<internal::ThreadWorkSource*>&
           thread_work_sources);
 
@@ -942,8 +1005,7 @@ class RunHandlerPool::Impl {
 
   std::unique_ptr<internal::RunHandlerThreadPool> run_handler_thread_pool_;
   // Thread compatible part used only by lock under RunHandlerPool.
-  // Handlers are sorted by start time.
-  // TODO(azaks): sort by the remaining latency budget.
+  // Handlers are sorted by priority, then deadline, then start time.
   // TODO(chaox): Consider other data structure for maintaining the sorted
   // active handlers if the searching overhead(currently O(n)) becomes the
   // bottleneck.
@@ -961,18 +1023,28 @@ class RunHandlerPool::Impl {
 };
 
 void RunHandlerPool::Impl::RecomputePoolStats(
-    int num_active_requests, uint64 version,
+    int num_active_requests, int num_preferred_requests, uint64 version,
     const Eigen::MaxSizeVector<internal::ThreadWorkSource*>&
         thread_work_sources) {
   if (num_active_requests == 0) return;
 
+  // The preferred requests and the remaining requests are each split among
+  // the sub thread pools, matching the search order of the worker threads.
+  const int num_sub_thread_pools =
+      sub_thread_pool_end_request_percentage_.size();
   int sub_thread_pool_id = 0;
+  int range_start = 0;
+  int range_size = num_preferred_requests;
   for (int i = 0; i < num_active_requests; ++i) {
-    while (
-        sub_thread_pool_id <
-            sub_thread_pool_end_request_percentage_.size() - 1 &&
-        i >= num_active_requests *
-                 sub_thread_pool_end_request_percentage_[sub_thread_pool_id]) {
+    if (i == num_preferred_requests) {
+      sub_thread_pool_id = 0;
+      range_start = num_preferred_requests;
+      range_size = num_active_requests - num_preferred_requests;
+    }
+    while (sub_thread_pool_id < num_sub_thread_pools - 1 &&
+           i - range_start >=
+               range_size * sub_thread_pool_end_request_percentage_
+                                [sub_thread_pool_id]) {
       sub_thread_pool_id++;
     }
     thread_work_sources[i]->SetWaiter(version,
@@ -985,22 +1057,23 @@ void RunHandlerPool::Impl::RecomputePoolStats(
   int num_non_blocking_threads = num_threads - num_blocking_threads;
 
   std::vector<int> request_idx_list = ChooseRequestsWithExponentialDistribution(
-      num_active_requests, num_blocking_threads);
+      num_preferred_requests, num_blocking_threads);
   for (int i = 0; i < num_blocking_threads; ++i) {
     VLOG(2) << "Set work for tid=" << i
             << " with start_request_idx=" << request_idx_list[i];
     run_handler_thread_pool()->SetThreadWorkSources(
-        i, request_idx_list[i], version, thread_work_sources);
+        i, request_idx_list[i], num_preferred_requests, version,
+        thread_work_sources);
   }
 
   request_idx_list = ChooseRequestsWithExponentialDistribution(
-      num_active_requests, num_non_blocking_threads);
+      num_preferred_requests, num_non_blocking_threads);
   for (int i = 0; i < num_non_blocking_threads; ++i) {
     VLOG(2) << "Set work for tid=" << (i + num_blocking_threads)
             << " with start_request_idx=" << request_idx_list[i];
     run_handler_thread_pool()->SetThreadWorkSources(
-        i + num_blocking_threads, request_idx_list[i], version,
-        thread_work_sources);
+        i + num_blocking_threads, request_idx_list[i], num_preferred_requests,
+        version, thread_work_sources);
   }
 }
 
@@ -1067,6 +1140,9 @@ void RunHandler::Impl::Reset(
     int64 step_id,
     const RunOptions::Experimental::RunHandlerPoolOptions& options) {
   start_time_us_ = tensorflow::Env::Default()->NowMicros();
+  deadline_us_ = options.deadline_in_ms() > 0
+                     ? start_time_us_ + options.deadline_in_ms() * 1000
+                     : kuint64max;
   step_id_ = step_id;
   options_ = options;
   tws_.SetTracemeId(step_id);
@@ -1092,6 +1168,10 @@ std::vector<int64> RunHandlerPool::GetActiveHandlerPrioritiesForTesting()
   return impl_->GetActiveHandlerPrioritiesForTesting();
 }
 
+std::vector<int64> RunHandlerPool::GetActiveHandlerStepIdsForTesting() const {
+  return impl_->GetActiveHandlerStepIdsForTesting();
+}
+
 RunHandler::RunHandler(Impl* impl) : impl_(impl) {}
 
 void RunHandler::ScheduleInterOpClosure(std::function<void()> fn) {
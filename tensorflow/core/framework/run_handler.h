@@ -72,6 +72,10 @@ class RunHandlerPool {
   // order of the active handler list.
   std::vector<int64> GetActiveHandlerPrioritiesForTesting() const;
 
+  // Get the step ids for active handlers. The return result is with the same
+  // order of the active handler list.
+  std::vector<int64> GetActiveHandlerStepIdsForTesting() const;
+
  private:
   class Impl;
   friend class RunHandler;
@@ -82,7 +86,13 @@ class RunHandlerPool {
 // RunHandler can be used to schedule inter/intra-op closures to run on a global
 // pool shared across all Session::Run(s). The closures are enqueued to a
 // handler specific queue, from which the work is stolen in a priority order
-// (time of the Get() call).
+// (the priority of the request, then its deadline, then the time of the Get()
+// call). The deadline counts from the Get() call that returns the handler, so
+// any time spent waiting for a free handler is not included. While requests
+// of different priorities are active, the threads only run closures of lower
+// priority requests when the highest priority requests have none ready, so a
+// new high priority request preempts lower priority work as soon as the
+// running closures finish.
 //
 // It can only be created via RunHandlerPool::Get().
 //
@@ -236,9 +246,12 @@ class RunHandlerThreadPool {
 
   // Set work queues from which the thread 'tid' can steal its work.
   // The request with start_request_idx will be attempted first. Other requests
-  // will be attempted in FIFO order based on their arrival time.
+  // will be attempted in FIFO order based on their arrival time. With sub
+  // thread pools, the first num_preferred_requests requests are searched
+  // before the others.
   void SetThreadWorkSources(
-      int tid, int start_request_idx, uint64 version,
+      int tid, int start_request_idx, int num_preferred_requests,
+      uint64 version,
       const Eigen::MaxSizeVector<ThreadWorkSource*>& thread_work_sources);
 
   PerThread* GetPerThread();
@@ -276,11 +289,13 @@ class RunHandlerThreadPool {
     condition_variable sources_not_empty;
     std::unique_ptr<Thread> thread;
     int current_index;
+    int new_num_preferred_requests TF_GUARDED_BY(mu);
     std::unique_ptr<Eigen::MaxSizeVector<ThreadWorkSource*>>
         new_thread_work_sources TF_GUARDED_BY(mu);
 
     uint64 current_version;
     // Should only be accessed by one thread.
+    int current_num_preferred_requests;
     std::unique_ptr<Eigen::MaxSizeVector<ThreadWorkSource*>>
         current_thread_work_sources;
 
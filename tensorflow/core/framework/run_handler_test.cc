@@ -113,6 +113,34 @@ TEST(RunHandlerUtilTest, PrioritySchedulingTest) {
   EXPECT_EQ(sorted_active_list[3], 1);
 }
 
+TEST(RunHandlerUtilTest, DeadlineSchedulingTest) {
+  int num_threads = 2;
+  std::unique_ptr<RunHandlerPool> pool(
+      new RunHandlerPool(num_threads, num_threads));
+
+  RunOptions::Experimental::RunHandlerPoolOptions options =
+      RunOptions::Experimental::RunHandlerPoolOptions();
+  options.set_priority(1);
+  auto handler1 = pool->Get(/*step_id=*/1, /*timeout_in_ms=*/0, options);
+  options.set_deadline_in_ms(1000 * 1000);
+  auto handler2 = pool->Get(/*step_id=*/2, /*timeout_in_ms=*/0, options);
+  options.set_deadline_in_ms(20);
+  auto handler3 = pool->Get(/*step_id=*/3, /*timeout_in_ms=*/0, options);
+  options.set_priority(0);
+  options.set_deadline_in_ms(10);
+  auto handler4 = pool->Get(/*step_id=*/4, /*timeout_in_ms=*/0, options);
+
+  // The active requests should be ordered by priorities, then deadlines.
+  // Requests without a deadline come last within their priority.
+  std::vector<int64> sorted_active_list =
+      pool->GetActiveHandlerStepIdsForTesting();
+  EXPECT_EQ(sorted_active_list.size(), 4);
+  EXPECT_EQ(sorted_active_list[0], 3);
+  EXPECT_EQ(sorted_active_list[1], 2);
+  EXPECT_EQ(sorted_active_list[2], 1);
+  EXPECT_EQ(sorted_active_list[3], 4);
+}
+
 TEST(RunHandlerThreadPool, EnqueueTask) {
   Eigen::MaxSizeVector<mutex> waiters_mu(2);
   waiters_mu.resize(2);
@@ -476,7 +504,8 @@ TEST(RunHandlerThreadPool, RoundRobinExecution) {
   }
   run_handler_thread_pool->Start();
   run_handler_thread_pool->SetThreadWorkSources(
-      /*tid=*/0, /*start_request_idx=*/0, /*version=*/1, thread_work_sources);
+      /*tid=*/0, /*start_request_idx=*/0, /*num_preferred_requests=*/3,
+      /*version=*/1, thread_work_sources);
 
   // Validate the execution should be roundrobin.
   mutex_lock l(mu);
@@ -548,9 +577,11 @@ TEST(RunHandlerThreadPool, MultipleSubThreadPool) {
   }
   run_handler_thread_pool->StartOneThreadForTesting();
   run_handler_thread_pool->SetThreadWorkSources(
-      /*tid=*/0, /*start_request_idx=*/0, /*version=*/1, thread_work_sources);
+      /*tid=*/0, /*start_request_idx=*/0, /*num_preferred_requests=*/4,
+      /*version=*/1, thread_work_sources);
   run_handler_thread_pool->SetThreadWorkSources(
-      /*tid=*/1, /*start_request_idx=*/0, /*version=*/1, thread_work_sources);
+      /*tid=*/1, /*start_request_idx=*/0, /*num_preferred_requests=*/4,
+      /*version=*/1, thread_work_sources);
 
   // Pick task from the given sub thread pool requests in a round robin fashion.
   mutex_lock l(mu);
@@ -583,6 +614,85 @@ TEST(RunHandlerThreadPool, MultipleSubThreadPool) {
   delete run_handler_thread_pool;
 }
 
+TEST(RunHandlerThreadPool, SubThreadPoolPrefersPreferredRequests) {
+  // Set up environment for 2 sub thread pools.
+  setenv("TF_RUN_HANDLER_USE_SUB_THREAD_POOL", "true", true);
+  setenv("TF_RUN_HANDLER_NUM_THREADS_IN_SUB_THREAD_POOL", "2", true);
+  setenv("TF_RUN_HANDLER_SUB_THREAD_POOL_START_REQUEST_PERCENTAGE", "0,0.5",
+         true);
+  setenv("TF_RUN_HANDLER_SUB_THREAD_POOL_END_REQUEST_PERCENTAGE", "0.5,1",
+         true);
+
+  Eigen::MaxSizeVector<mutex> waiters_mu(2);
+  waiters_mu.resize(2);
+  Eigen::MaxSizeVector<internal::Waiter> waiters(2);
+  waiters.resize(2);
+  internal::RunHandlerThreadPool* run_handler_thread_pool =
+      new internal::RunHandlerThreadPool(
+          /*num_blocking_threads=*/2, /*num_non_blocking_threads=*/0,
+          Env::Default(), ThreadOptions(), "tf_run_handler_pool", &waiters_mu,
+          &waiters);
+  Eigen::MaxSizeVector<internal::ThreadWorkSource*> thread_work_sources(4);
+  thread_work_sources.resize(4);
+  internal::ThreadWorkSource tws[4];
+  for (int i = 0; i < 4; ++i) {
+    tws[i].SetWaiter(1, &waiters[0], &waiters_mu[0]);
+    thread_work_sources[i] = &tws[i];
+  }
+
+  int result = 0;
+  mutex mu;
+  bool ok_to_execute = false;
+  bool ok_to_validate = false;
+  condition_variable function_start;
+  condition_variable function_end;
+
+  std::vector<std::function<void()>> fns;
+  for (int i = 0; i < 4; ++i) {
+    fns.push_back([&result, &mu, &function_start, &function_end, &ok_to_execute,
+                   &ok_to_validate, i] {
+      mutex_lock l(mu);
+      while (!ok_to_execute) {
+        function_start.wait(l);
+      }
+      result = i;
+      ok_to_execute = false;
+      ok_to_validate = true;
+      function_end.notify_one();
+    });
+    run_handler_thread_pool->AddWorkToQueue(&tws[i], /*is_blocking=*/true,
+                                            fns[i]);
+    run_handler_thread_pool->AddWorkToQueue(&tws[i], /*is_blocking=*/true,
+                                            fns[i]);
+  }
+  run_handler_thread_pool->StartOneThreadForTesting();
+  // Only the first 2 requests are preferred, so the first sub thread pool
+  // owns request 0 only and the second one owns request 1 only.
+  run_handler_thread_pool->SetThreadWorkSources(
+      /*tid=*/0, /*start_request_idx=*/0, /*num_preferred_requests=*/2,
+      /*version=*/1, thread_work_sources);
+  run_handler_thread_pool->SetThreadWorkSources(
+      /*tid=*/1, /*start_request_idx=*/0, /*num_preferred_requests=*/2,
+      /*version=*/1, thread_work_sources);
+
+  // The thread drains its own request, then the other preferred request, and
+  // only then the requests that are not preferred.
+  mutex_lock l(mu);
+  for (int i = 0; i < 4; ++i) {
+    for (int round = 0; round < 2; ++round) {
+      ok_to_execute = true;
+      function_start.notify_one();
+      while (!ok_to_validate) {
+        function_end.wait(l);
+      }
+      ok_to_validate = false;
+      EXPECT_EQ(result, i);
+    }
+  }
+
+  delete run_handler_thread_pool;
+}
+
 SessionOptions DefaultSessionOptions() {
   SessionOptions options;
   (*options.config.mutable_device_count())["CPU"] = 2;
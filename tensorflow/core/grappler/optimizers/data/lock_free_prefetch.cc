@@ -0,0 +1,49 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/data/lock_free_prefetch.h"
+
+#include "tensorflow/core/framework/node_def.pb.h"
+#include "tensorflow/core/grappler/clusters/cluster.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+
+namespace tensorflow {
+namespace grappler {
+
+namespace {
+constexpr char kPrefetchDataset[] = "PrefetchDataset";
+constexpr char kLockFreeBuffer[] = "lock_free_buffer";
+}  // anonymous namespace
+
+Status LockFreePrefetch::OptimizeAndCollectStats(Cluster* cluster,
+                                                 const GrapplerItem& item,
+                                                 GraphDef* output,
+                                                 OptimizationStats* stats) {
+  *output = item.graph;
+  for (NodeDef& node : *output->mutable_node()) {
+    if (node.op() != kPrefetchDataset) continue;
+    auto it = node.attr().find(kLockFreeBuffer);
+    if (it != node.attr().end() && it->second.b()) continue;
+    (*node.mutable_attr())[kLockFreeBuffer].set_b(true);
+    stats->num_changes++;
+  }
+  return Status::OK();
+}
+
+REGISTER_GRAPH_OPTIMIZER_AS(LockFreePrefetch, "lock_free_prefetch");
+
+}  // namespace grappler
+}  // namespace tensorflow
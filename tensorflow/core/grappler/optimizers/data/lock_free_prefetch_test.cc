@@ -0,0 +1,76 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+
+#include "tensorflow/core/grappler/optimizers/data/lock_free_prefetch.h"
+
+#include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/function_testlib.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/data/graph_utils.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace grappler {
+namespace {
+
+TEST(LockFreePrefetch, AllPrefetches) {
+  using test::function::NDef;
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("start", "Const", {}, {{"value", 0}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {}, {{"value", 10}, {"dtype", DT_INT64}}),
+       NDef("step", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"}, {}),
+       NDef("buffer_size", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("prefetch_1", "PrefetchDataset", {"range", "buffer_size"}, {}),
+       NDef("prefetch_2", "PrefetchDataset", {"prefetch_1", "buffer_size"},
+            {{"lock_free_buffer", false}})},
+      // FunctionLib
+      {});
+
+  LockFreePrefetch optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  for (const string& name : {"prefetch_1", "prefetch_2"}) {
+    ASSERT_TRUE(graph_utils::ContainsGraphNodeWithName(name, output));
+    int index = graph_utils::FindGraphNodeWithName(name, output);
+    EXPECT_TRUE(output.node(index).attr().at("lock_free_buffer").b());
+  }
+}
+
+TEST(LockFreePrefetch, NoPrefetch) {
+  using test::function::NDef;
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("start", "Const", {}, {{"value", 0}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {}, {{"value", 10}, {"dtype", DT_INT64}}),
+       NDef("step", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"}, {})},
+      // FunctionLib
+      {});
+
+  LockFreePrefetch optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+  int index = graph_utils::FindGraphNodeWithName("range", output);
+  ASSERT_GE(index, 0);
+  EXPECT_EQ(output.node(index).attr().count("lock_free_buffer"), 0);
+}
+
+}  // namespace
+}  // namespace grappler
+}  // namespace tensorflow
@@ -17,12 +17,14 @@ limitations under the License.
 
 #include "absl/container/flat_hash_set.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
+#include "tensorflow/core/framework/function.h"
 #include "tensorflow/core/framework/node_def.pb.h"
 #include "tensorflow/core/grappler/clusters/cluster.h"
 #include "tensorflow/core/grappler/grappler_item.h"
 #include "tensorflow/core/grappler/mutable_graph_view.h"
 #include "tensorflow/core/grappler/op_types.h"
 #include "tensorflow/core/grappler/optimizers/custom_graph_optimizer_registry.h"
+#include "tensorflow/core/grappler/optimizers/data/fusion_utils.h"
 #include "tensorflow/core/grappler/optimizers/data/graph_utils.h"
 #include "tensorflow/core/grappler/utils.h"
 #include "tensorflow/core/platform/protobuf.h"
@@ -32,6 +34,7 @@ namespace grappler {
 namespace {
 
 constexpr char kFusedOpName[] = "MapAndBatchDataset";
+constexpr char kFusedWithFilterOpName[] = "MapFilterAndBatchDataset";
 constexpr char kParallelMap[] = "ParallelMapDataset";
 constexpr char kParallelMapV2[] = "ParallelMapDatasetV2";
 
@@ -105,6 +108,56 @@ NodeDef MakeMapAndBatchNode(const NodeDef& map_node, const NodeDef& batch_node,
   return new_node;
 }
 
+// Returns whether `node` is a map without captured inputs. The function of
+// such a map can be composed with a filter predicate.
+// TODO(b/148614315): Support captured inputs.
+bool IsMapWithoutCapturedInputs(const NodeDef& node) {
+  return (node.op() == "MapDataset" && node.input_size() == 1) ||
+         (IsParallelMap(node) && node.input_size() == 2);
+}
+
+bool IsFilterWithoutCapturedInputs(const NodeDef& node) {
+  return node.op() == "FilterDataset" && node.input_size() == 1;
+}
+
+// Creates a function that returns the outputs of the map function followed by
+// the result of applying the filter predicate to them, or returns nullptr if
+// the two functions cannot be composed.
+FunctionDef* MakeMapAndPredicateFunction(
+    const NodeDef& map_node, const NodeDef& filter_node,
+    const FunctionLibraryDefinition& function_library,
+    FunctionDefLibrary* library) {
+  const FunctionDef* map_func =
+      function_library.Find(map_node.attr().at("f").func().name());
+  const FunctionDef* filter_func =
+      function_library.Find(filter_node.attr().at("predicate").func().name());
+  if (map_func == nullptr || filter_func == nullptr) return nullptr;
+  if (!fusion_utils::CanCompose(map_func->signature(),
+                                filter_func->signature())) {
+    VLOG(1) << "Can't fuse map, filter and batch because the output signature "
+               "of the map function does not match the input signature of "
+               "the filter function";
+    return nullptr;
+  }
+  return fusion_utils::FuseFunctions(
+      *map_func, *filter_func, "fused_map_and_predicate_function",
+      fusion_utils::CombineSignature, fusion_utils::ComposeInput,
+      fusion_utils::CombineOutput, fusion_utils::MergeNodes, library);
+}
+
+NodeDef MakeMapFilterAndBatchNode(const NodeDef& map_node,
+                                  const FunctionDef& fused_function,
+                                  const NodeDef& batch_node,
+                                  MutableGraphView* graph) {
+  NodeDef new_node = MakeMapAndBatchNode(map_node, batch_node, graph);
+  new_node.set_op(kFusedWithFilterOpName);
+  graph_utils::SetUniqueGraphNodeName(kFusedWithFilterOpName, graph->graph(),
+                                      &new_node);
+  (*new_node.mutable_attr())["f"].mutable_func()->set_name(
+      fused_function.signature().name());
+  return new_node;
+}
+
 }  // namespace
 
 Status MapAndBatchFusion::OptimizeAndCollectStats(Cluster* cluster,
@@ -114,6 +167,8 @@ Status MapAndBatchFusion::OptimizeAndCollectStats(Cluster* cluster,
   *output = item.graph;
   MutableGraphView graph(output);
   absl::flat_hash_set<string> nodes_to_delete;
+  FunctionLibraryDefinition function_library(OpRegistry::Global(),
+                                             item.graph.library());
   for (const NodeDef& node : item.graph.node()) {
     if (node.op() != "BatchDataset" && node.op() != "BatchDatasetV2") {
       continue;
@@ -123,6 +178,32 @@ Status MapAndBatchFusion::OptimizeAndCollectStats(Cluster* cluster,
     const NodeDef& batch_node = node;
     NodeDef* node2 = graph_utils::GetInputNode(batch_node, graph);
 
+    if (fuse_filter_ && IsFilterWithoutCapturedInputs(*node2)) {
+      // A filter between the map and the batch is fused into a single
+      // `MapFilterAndBatchDataset` whose function returns the outputs of the
+      // map followed by the predicate.
+      NodeDef* filter_node = node2;
+      NodeDef* map_node = graph_utils::GetInputNode(*filter_node, graph);
+      if (!IsMapWithoutCapturedInputs(*map_node)) continue;
+      const FunctionDef* fused_function = MakeMapAndPredicateFunction(
+          *map_node, *filter_node, function_library, output->mutable_library());
+      if (fused_function == nullptr) continue;
+
+      auto* new_node = graph.AddNode(
+          MakeMapFilterAndBatchNode(*map_node, *fused_function, batch_node,
+                                    &graph));
+      TF_RETURN_IF_ERROR(
+          graph.UpdateFanouts(batch_node.name(), new_node->name()));
+      TF_RETURN_IF_ERROR(function_library.AddFunctionDef(*fused_function));
+
+      // Mark the `Map`, `Filter` and `Batch` nodes for removal.
+      nodes_to_delete.insert(map_node->name());
+      nodes_to_delete.insert(filter_node->name());
+      nodes_to_delete.insert(batch_node.name());
+      stats->num_changes++;
+      continue;
+    }
+
     if (node2->op() != "MapDataset" && !IsParallelMap(*node2)) {
       continue;
     }
@@ -21,6 +21,9 @@ limitations under the License.
 namespace tensorflow {
 namespace grappler {
 
+// This optimizer fuses map -> batch into a single MapAndBatchDataset. If the
+// "fuse_filter" configuration is enabled, it also fuses map -> filter -> batch
+// into a single MapFilterAndBatchDataset.
 class MapAndBatchFusion : public TFDataOptimizerBase {
  public:
   MapAndBatchFusion() = default;
@@ -32,6 +35,20 @@ class MapAndBatchFusion : public TFDataOptimizerBase {
 
   Status Init(
       const tensorflow::RewriterConfig_CustomGraphOptimizer* config) override {
+    if (!config) return Status::OK();
+
+    auto it = config->parameter_map().find("fuse_filter");
+    if (it == config->parameter_map().end()) return Status::OK();
+    const string& fuse_filter_param = it->second.s();
+    if (fuse_filter_param == "true") {
+      fuse_filter_ = true;
+    } else if (fuse_filter_param == "false") {
+      fuse_filter_ = false;
+    } else {
+      return errors::InvalidArgument(
+          "Received an invalid value for parameter \"fuse_filter\": ",
+          fuse_filter_param);
+    }
     return Status::OK();
   }
 
@@ -41,6 +58,9 @@ class MapAndBatchFusion : public TFDataOptimizerBase {
 
   void Feedback(Cluster* cluster, const GrapplerItem& item,
                 const GraphDef& optimize_output, double result) override;
+
+ private:
+  bool fuse_filter_ = false;
 };
 
 }  // namespace grappler
@@ -16,7 +16,9 @@ limitations under the License.
 #include "tensorflow/core/grappler/optimizers/data/map_and_batch_fusion.h"
 
 #include "tensorflow/core/framework/attr_value_util.h"
+#include "tensorflow/core/framework/function_testlib.h"
 #include "tensorflow/core/grappler/grappler_item.h"
+#include "tensorflow/core/grappler/optimizers/data/graph_test_utils.h"
 #include "tensorflow/core/grappler/optimizers/data/graph_utils.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/platform/test.h"
@@ -361,6 +363,119 @@ TEST(MapAndBatchFusionTest, FuseParallelMapV2AndBatchNodesIntoOne) {
                                  batch_node->attr().at("output_types")));
 }
 
+TEST(MapAndBatchFusionTest, FuseMapFilterAndBatchNodesIntoOne) {
+  using test::function::NDef;
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("start", "Const", {}, {{"value", 0}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {}, {{"value", 10}, {"dtype", DT_INT64}}),
+       NDef("step", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"}, {}),
+       graph_tests_utils::MakeMapNode("map", "range"),
+       graph_tests_utils::MakeFilterNode("filter", "map"),
+       NDef("batch_size", "Const", {}, {{"value", 5}, {"dtype", DT_INT64}}),
+       NDef("batch", "BatchDataset", {"filter", "batch_size"},
+            {{"output_shapes", gtl::ArraySlice<TensorShape>{}},
+             {"output_types", gtl::ArraySlice<DataType>{}}})},
+      // FunctionLib
+      {
+          test::function::XTimesTwo(),
+          test::function::IsZero(),
+      });
+
+  MapAndBatchFusion optimizer;
+  RewriterConfig_CustomGraphOptimizer config;
+  (*config.mutable_parameter_map())["fuse_filter"].set_s("true");
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("map", output));
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("filter", output));
+  EXPECT_FALSE(graph_utils::ContainsGraphNodeWithName("batch", output));
+  ASSERT_TRUE(
+      graph_utils::ContainsNodeWithOp("MapFilterAndBatchDataset", output));
+  NodeDef fused_node = output.node(
+      graph_utils::FindGraphNodeWithOp("MapFilterAndBatchDataset", output));
+  EXPECT_EQ(fused_node.input_size(), 4);
+  EXPECT_EQ(fused_node.input(0), "range");
+  EXPECT_EQ(fused_node.input(1), "batch_size");
+
+  // The fused function returns the output of the map followed by the
+  // predicate.
+  const string& fused_function_name = fused_node.attr().at("f").func().name();
+  int fused_function_index =
+      graph_utils::FindGraphFunctionWithName(fused_function_name,
+                                             output.library());
+  ASSERT_GE(fused_function_index, 0);
+  const OpDef& signature =
+      output.library().function(fused_function_index).signature();
+  ASSERT_EQ(signature.output_arg_size(), 2);
+  EXPECT_EQ(signature.output_arg(1).type(), DT_BOOL);
+}
+
+TEST(MapAndBatchFusionTest, NoChangeForFilterWithCapturedInputs) {
+  using test::function::NDef;
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("start", "Const", {}, {{"value", 0}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {}, {{"value", 10}, {"dtype", DT_INT64}}),
+       NDef("step", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"}, {}),
+       graph_tests_utils::MakeMapNode("map", "range"),
+       NDef("captured", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("filter", "FilterDataset", {"map", "captured"},
+            {{"predicate", FunctionDefHelper::FunctionRef("IsZero")},
+             {"Targuments", gtl::ArraySlice<DataType>{DT_INT64}},
+             {"output_shapes", gtl::ArraySlice<TensorShape>{}},
+             {"output_types", gtl::ArraySlice<DataType>{}}}),
+       NDef("batch_size", "Const", {}, {{"value", 5}, {"dtype", DT_INT64}}),
+       NDef("batch", "BatchDataset", {"filter", "batch_size"},
+            {{"output_shapes", gtl::ArraySlice<TensorShape>{}},
+             {"output_types", gtl::ArraySlice<DataType>{}}})},
+      // FunctionLib
+      {
+          test::function::XTimesTwo(),
+          test::function::IsZero(),
+      });
+
+  MapAndBatchFusion optimizer;
+  RewriterConfig_CustomGraphOptimizer config;
+  (*config.mutable_parameter_map())["fuse_filter"].set_s("true");
+  TF_ASSERT_OK(optimizer.Init(&config));
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_TRUE(graph_utils::Compare(item.graph, output));
+}
+
+TEST(MapAndBatchFusionTest, NoChangeForFilterUnlessEnabled) {
+  using test::function::NDef;
+  GrapplerItem item;
+  item.graph = test::function::GDef(
+      {NDef("start", "Const", {}, {{"value", 0}, {"dtype", DT_INT64}}),
+       NDef("stop", "Const", {}, {{"value", 10}, {"dtype", DT_INT64}}),
+       NDef("step", "Const", {}, {{"value", 1}, {"dtype", DT_INT64}}),
+       NDef("range", "RangeDataset", {"start", "stop", "step"}, {}),
+       graph_tests_utils::MakeMapNode("map", "range"),
+       graph_tests_utils::MakeFilterNode("filter", "map"),
+       NDef("batch_size", "Const", {}, {{"value", 5}, {"dtype", DT_INT64}}),
+       NDef("batch", "BatchDataset", {"filter", "batch_size"},
+            {{"output_shapes", gtl::ArraySlice<TensorShape>{}},
+             {"output_types", gtl::ArraySlice<DataType>{}}})},
+      // FunctionLib
+      {
+          test::function::XTimesTwo(),
+          test::function::IsZero(),
+      });
+
+  MapAndBatchFusion optimizer;
+  GraphDef output;
+  TF_ASSERT_OK(optimizer.Optimize(nullptr, item, &output));
+
+  EXPECT_TRUE(graph_utils::Compare(item.graph, output));
+}
+
 TEST(MapAndBatchFusionTest, NoChange) {
   GrapplerItem item;
   MutableGraphView graph(&item.graph);
@@ -15,6 +15,8 @@ limitations under the License.
 
 #include "tensorflow/core/grappler/optimizers/data/map_vectorization.h"
 
+#include <deque>
+
 #include "absl/container/flat_hash_set.h"
 #include "tensorflow/core/framework/attr_value.pb.h"
 #include "tensorflow/core/framework/dataset.h"
@@ -538,7 +540,16 @@ Status MapVectorization::OptimizeAndCollectStats(Cluster* cluster,
 
   FunctionDefLibrary* library = output->mutable_library();
 
-  for (const NodeDef& node : item.graph.node()) {
+  // Vectorizing a map moves the batch in front of it, so the new batch node
+  // may itself follow a vectorizable map. New batch nodes are appended to the
+  // worklist so that a chain of maps followed by a batch is rewritten into a
+  // single batch followed by the vectorized maps. Nodes are copied because
+  // `DeleteNodes` may move nodes around in `output`.
+  std::deque<NodeDef> worklist(item.graph.node().begin(),
+                               item.graph.node().end());
+  while (!worklist.empty()) {
+    const NodeDef node = std::move(worklist.front());
+    worklist.pop_front();
     FunctionLibraryDefinition function_library(OpRegistry::Global(), *library);
     const NodeDef* map_node;
     const NodeDef* optional_prefetch_node = nullptr;
@@ -615,8 +626,19 @@ Status MapVectorization::OptimizeAndCollectStats(Cluster* cluster,
                                   : new_map_node->name()));
     }
 
+    // Capture the name before `DeleteNodes` invalidates `new_batch_node`.
+    const string new_batch_node_name = new_batch_node->name();
     TF_RETURN_IF_ERROR(graph.DeleteNodes(nodes_to_delete));
     stats->num_changes++;
+
+    // With ChooseFastestBranch, the new batch node lives in a branch function
+    // rather than in the graph, so there is nothing left to revisit.
+    if (!use_choose_fastest_) {
+      const NodeDef* revisit = graph.GetNode(new_batch_node_name);
+      if (revisit != nullptr) {
+        worklist.push_back(*revisit);
+      }
+    }
   }
   return Status::OK();
 }
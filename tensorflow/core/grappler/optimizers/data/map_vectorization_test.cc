@@ -488,6 +488,46 @@ INSTANTIATE_TEST_SUITE_P(ChainedMapAndBatchTest, ChainedMapAndBatchTest,
                                             ::testing::Bool(),
                                             ::testing::Bool()));
 
+TEST(MapVectorizationTest, VectorizeChainedMaps) {
+  // Tests that map.map.batch is rewritten to batch.map.map, with both maps
+  // vectorized.
+  GrapplerItem item;
+  MutableGraphView graph(&item.graph);
+  auto range_node = AddRangeNode(&graph);
+  auto map_fn = AddMapFn(&graph);
+  auto map_node_0 =
+      AddMapNode(&graph, range_node->name(), map_fn->signature().name());
+  auto map_node_1 =
+      AddMapNode(&graph, map_node_0->name(), map_fn->signature().name());
+  AddBatchNode(&graph, map_node_1->name(), /*v2=*/true);
+
+  GraphDef output;
+  TF_ASSERT_OK(OptimizeWithMapVectorization(item, &output,
+                                            /*use_choose_fastest=*/false));
+  TF_ASSERT_OK(TopologicalSort(&output));
+
+  std::vector<int> map_nodes =
+      graph_utils::FindAllGraphNodesWithOp(kMapOp, output);
+  std::vector<int> batch_nodes =
+      graph_utils::FindAllGraphNodesWithOp(kBatchV2Op, output);
+  ASSERT_EQ(map_nodes.size(), 2);
+  ASSERT_EQ(batch_nodes.size(), 1);
+
+  const NodeDef& batch_node = output.node(batch_nodes[0]);
+  EXPECT_EQ(batch_node.input(0), range_node->name());
+  const NodeDef& vectorized_map_0 = output.node(map_nodes[0]);
+  EXPECT_EQ(vectorized_map_0.input(0), batch_node.name());
+  const NodeDef& vectorized_map_1 = output.node(map_nodes[1]);
+  EXPECT_EQ(vectorized_map_1.input(0), vectorized_map_0.name());
+
+  for (const NodeDef* map_node : {&vectorized_map_0, &vectorized_map_1}) {
+    const FunctionDef* function =
+        GetFunction(output, map_node->attr().at(kAttrNameF).func().name());
+    ASSERT_NE(function, nullptr);
+    EXPECT_NE(function->signature().name(), map_fn->signature().name());
+  }
+}
+
 // Not all dataset types have "output_shapes" and "output_types"
 // attrs defined. Add a generic input node which may not have these attrs
 // defined.
@@ -35,7 +35,7 @@ using ConfigMap =
     std::map<string, tensorflow::RewriterConfig_CustomGraphOptimizer>;
 
 // tf.data optimizations, in the order we want to perform them.
-constexpr std::array<const char*, 15> kTFDataOptimizations = {
+constexpr std::array<const char*, 16> kTFDataOptimizations = {
     "noop_elimination",
     "shuffle_and_repeat_fusion",
     "map_fusion",
@@ -50,7 +50,8 @@ constexpr std::array<const char*, 15> kTFDataOptimizations = {
     "make_sloppy",
     "parallel_batch",
     "slack",
-    "inject_prefetch"};
+    "inject_prefetch",
+    "lock_free_prefetch"};
 
 // Parses a list of string optimizer configurations into a map from
 // optimizer name -> rewriter config for that optimizer.
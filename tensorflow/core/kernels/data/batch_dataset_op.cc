@@ -15,6 +15,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/batch_dataset_op.h"
 
 #include <algorithm>
+#include <deque>
 #include <utility>
 
 #include "tensorflow/core/framework/op_kernel.h"
@@ -42,8 +43,13 @@ namespace data {
 /* static */ constexpr const char* const BatchDatasetOp::kOutputShapes;
 
 constexpr char kInputImplEmpty[] = "input_impl_empty";
+constexpr char kNumInputElements[] = "num_input_elements";
 constexpr char kBatchDataset[] = "BatchDataset";
 
+// Maximum number of previously produced batches whose buffers are retained so
+// that they can be reused once all downstream references have been dropped.
+constexpr size_t kMaxRecycledBatches = 2;
+
 class BatchDatasetOp::Dataset : public DatasetBase {
  public:
   Dataset(OpKernelContext* ctx, int64 batch_size, bool drop_remainder,
@@ -67,6 +73,21 @@ class BatchDatasetOp::Dataset : public DatasetBase {
              {"parallel_copy", parallel_copy ? "true" : "false"}}) {
     input_->Ref();
 
+    // If every component of the input has a statically known shape, the
+    // shape of a full batch is known up front and input elements can be
+    // copied into a preallocated batch as soon as they are produced.
+    // `parallel_copy` keeps the two-pass implementation, which copies the
+    // elements of a batch concurrently.
+    preallocate_batches_ = !parallel_copy_ && reserve_size_ == batch_size_;
+    for (const auto& input_shape : input_->output_shapes()) {
+      preallocate_batches_ =
+          preallocate_batches_ && input_shape.IsFullyDefined();
+    }
+    recycle_batches_ = preallocate_batches_;
+    for (DataType dtype : input_->output_dtypes()) {
+      recycle_batches_ = recycle_batches_ && DataTypeCanUseMemcpy(dtype);
+    }
+
     // NOTE(mrry): Currently we implement "batch up to" semantics. If
     // we could tell statically that the input dataset is infinite,
     // then we could always report `batch_size` as the 0th dimension.
@@ -145,12 +166,18 @@ class BatchDatasetOp::Dataset : public DatasetBase {
         : DatasetIterator<Dataset>(params) {}
 
     Status Initialize(IteratorContext* ctx) override {
+      input_cardinality_ = dataset()->input_->Cardinality();
       return dataset()->input_->MakeIterator(ctx, this, prefix(), &input_impl_);
     }
 
     Status GetNextInternal(IteratorContext* ctx,
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
+      if (dataset()->preallocate_batches_) {
+        mutex_lock l(mu_);
+        return GetNextIntoPreallocatedBatch(ctx, out_tensors, end_of_sequence);
+      }
+
       // Each row of `batch_elements` is a tuple of tensors from the
       // input iterator.
       std::vector<std::vector<Tensor>> batch_elements;
@@ -272,6 +299,10 @@ class BatchDatasetOp::Dataset : public DatasetBase {
       } else {
         TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
       }
+      if (dataset()->preallocate_batches_) {
+        TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kNumInputElements),
+                                               num_input_elements_));
+      }
       return Status::OK();
     }
 
@@ -283,6 +314,13 @@ class BatchDatasetOp::Dataset : public DatasetBase {
       } else {
         input_impl_.reset();
       }
+      // Checkpoints written before the count was saved leave the number of
+      // remaining elements unknown.
+      num_input_elements_ = -1;
+      if (reader->Contains(full_name(kNumInputElements))) {
+        TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kNumInputElements),
+                                              &num_input_elements_));
+      }
       return Status::OK();
     }
 
@@ -291,14 +329,161 @@ class BatchDatasetOp::Dataset : public DatasetBase {
     }
 
    private:
+    // Produces the next batch by copying each input element into its slice
+    // of a preallocated batch as soon as the element is produced, so that the
+    // elements of a batch are never all materialized at the same time.
+    //
+    // If the input has a known cardinality, the final partial batch is
+    // allocated with its exact size. Otherwise, it is returned as a slice of
+    // the full-size batch, which is not recycled.
+    Status GetNextIntoPreallocatedBatch(IteratorContext* ctx,
+                                        std::vector<Tensor>* out_tensors,
+                                        bool* end_of_sequence)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!input_impl_) {
+        *end_of_sequence = true;
+        return Status::OK();
+      }
+      int64 batch_size = dataset()->batch_size_;
+      if (!dataset()->drop_remainder_ && input_cardinality_ >= 0 &&
+          num_input_elements_ >= 0) {
+        const int64 num_remaining = input_cardinality_ - num_input_elements_;
+        if (num_remaining > 0 && num_remaining < batch_size) {
+          batch_size = num_remaining;
+        }
+      }
+      std::vector<Tensor> batch;
+      TF_RETURN_IF_ERROR(AcquireBatch(ctx, batch_size, &batch));
+      const auto& input_shapes = dataset()->input_->output_shapes();
+      int64 num_batch_elements = 0;
+      *end_of_sequence = false;
+      while (num_batch_elements < batch_size) {
+        std::vector<Tensor> batch_element_tuple;
+        TF_RETURN_IF_ERROR(
+            input_impl_->GetNext(ctx, &batch_element_tuple, end_of_sequence));
+        if (*end_of_sequence) {
+          input_impl_.reset();
+          break;
+        }
+        for (size_t component_index = 0; component_index < batch.size();
+             ++component_index) {
+          Tensor& component = batch_element_tuple[component_index];
+          if (!input_shapes[component_index].IsCompatibleWith(
+                  component.shape())) {
+            return errors::InvalidArgument(
+                "Cannot batch tensors with different shapes in component ",
+                component_index, ". Expected shape ",
+                input_shapes[component_index].DebugString(), " but element ",
+                num_batch_elements, " had shape ",
+                component.shape().DebugString(), ".");
+          }
+          TF_RETURN_IF_ERROR(batch_util::CopyElementToSlice(
+              std::move(component), &batch[component_index],
+              num_batch_elements));
+        }
+        ++num_batch_elements;
+        if (num_input_elements_ >= 0) {
+          ++num_input_elements_;
+        }
+      }
+
+      if (num_batch_elements == 0 ||
+          (dataset()->drop_remainder_ &&
+           num_batch_elements < dataset()->batch_size_)) {
+        *end_of_sequence = true;
+        RecycleBatch(std::move(batch));
+        return Status::OK();
+      }
+      *end_of_sequence = false;
+
+      if (num_batch_elements < batch_size) {
+        // The input ended before the batch was full. The leading rows of the
+        // batch are returned without copying them, so the batch is not
+        // recycled.
+        out_tensors->reserve(batch.size());
+        for (const Tensor& batch_component : batch) {
+          out_tensors->push_back(batch_component.Slice(0, num_batch_elements));
+        }
+        return Status::OK();
+      }
+
+      *out_tensors = batch;
+      RecycleBatch(std::move(batch));
+      return Status::OK();
+    }
+
+    // Returns a batch of `batch_size` elements. A full-size batch reuses the
+    // buffers of a recycled batch that are no longer referenced outside of
+    // this iterator if there is one, and is allocated otherwise.
+    Status AcquireBatch(IteratorContext* ctx, int64 batch_size,
+                        std::vector<Tensor>* batch)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (batch_size == dataset()->batch_size_) {
+        for (auto it = recycled_batches_.begin();
+             it != recycled_batches_.end(); ++it) {
+          if (std::all_of(it->begin(), it->end(),
+                          [](const Tensor& t) { return t.RefCountIsOne(); })) {
+            *batch = std::move(*it);
+            recycled_batches_.erase(it);
+            return Status::OK();
+          }
+        }
+      }
+      const auto& input_shapes = dataset()->input_->output_shapes();
+      const DataTypeVector& input_dtypes = dataset()->input_->output_dtypes();
+      batch->reserve(input_shapes.size());
+      for (size_t component_index = 0; component_index < input_shapes.size();
+           ++component_index) {
+        TensorShape element_shape;
+        if (!input_shapes[component_index].AsTensorShape(&element_shape)) {
+          return errors::Internal("Expected a fully defined shape but got ",
+                                  input_shapes[component_index].DebugString(),
+                                  " for component ", component_index);
+        }
+        TensorShape batch_component_shape({batch_size});
+        batch_component_shape.AppendShape(element_shape);
+        batch->emplace_back(ctx->allocator({}), input_dtypes[component_index],
+                            batch_component_shape);
+        if (!batch->back().IsInitialized()) {
+          return errors::ResourceExhausted(
+              "Failed to allocate memory for the batch of component ",
+              component_index);
+        }
+      }
+      return Status::OK();
+    }
+
+    // Retains `batch` so that its buffers can be reused by a later call to
+    // `AcquireBatch()` once downstream consumers have released them. Only
+    // full-size batches are retained.
+    void RecycleBatch(std::vector<Tensor> batch)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!dataset()->recycle_batches_ ||
+          (!batch.empty() && batch[0].dim_size(0) != dataset()->batch_size_)) {
+        return;
+      }
+      recycled_batches_.push_back(std::move(batch));
+      if (recycled_batches_.size() > kMaxRecycledBatches) {
+        recycled_batches_.pop_front();
+      }
+    }
+
     mutex mu_;
     std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
+    std::deque<std::vector<Tensor>> recycled_batches_ TF_GUARDED_BY(mu_);
+    int64 input_cardinality_ = kUnknownCardinality;
+    // The number of elements consumed from the input, or -1 if unknown.
+    int64 num_input_elements_ TF_GUARDED_BY(mu_) = 0;
   };
 
   const int64 batch_size_;
   const int64 reserve_size_;
   const bool drop_remainder_;
   const bool parallel_copy_;
+  // Whether input elements are copied directly into a preallocated batch.
+  bool preallocate_batches_;
+  // Whether the buffers of previously produced batches are reused.
+  bool recycle_batches_;
   const DatasetBase* const input_;
   const int op_version_;
   std::vector<PartialTensorShape> output_shapes_;
@@ -289,6 +289,60 @@ TEST_F(BatchDatasetOpTest, InvalidBatchSize) {
             tensorflow::error::INVALID_ARGUMENT);
 }
 
+// Consumes each batch before producing the next one, so that the buffers of
+// earlier batches are reused for later ones.
+TEST_F(BatchDatasetOpTest, ReuseReleasedBatches) {
+  auto batch_dataset_params = BatchDatasetParams3();
+  TF_ASSERT_OK(Initialize(batch_dataset_params));
+  bool end_of_sequence = false;
+
+  // The first batch is still referenced, so the second one gets new buffers.
+  std::vector<Tensor> first;
+  TF_ASSERT_OK(
+      iterator_->GetNext(iterator_ctx_.get(), &first, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  TF_EXPECT_OK(ExpectEqual(
+      first[0], CreateTensor<int64>(TensorShape({3}), {0, 1, 2})));
+  std::vector<Tensor> second;
+  TF_ASSERT_OK(
+      iterator_->GetNext(iterator_ctx_.get(), &second, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  TF_EXPECT_OK(ExpectEqual(
+      second[0], CreateTensor<int64>(TensorShape({3}), {3, 4, 5})));
+  const void* first_data = first[0].data();
+  const void* second_data = second[0].data();
+  EXPECT_NE(first_data, second_data);
+
+  // Once it is released, its buffers are reused.
+  first.clear();
+  std::vector<Tensor> third;
+  TF_ASSERT_OK(
+      iterator_->GetNext(iterator_ctx_.get(), &third, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  TF_EXPECT_OK(ExpectEqual(
+      third[0], CreateTensor<int64>(TensorShape({3}), {6, 7, 8})));
+  EXPECT_EQ(third[0].data(), first_data);
+
+  // The final partial batch has its own buffer of the exact size.
+  second.clear();
+  third.clear();
+  std::vector<Tensor> last;
+  TF_ASSERT_OK(
+      iterator_->GetNext(iterator_ctx_.get(), &last, &end_of_sequence));
+  ASSERT_FALSE(end_of_sequence);
+  TF_EXPECT_OK(
+      ExpectEqual(last[0], CreateTensor<int64>(TensorShape({1}), {9})));
+  EXPECT_NE(last[0].data(), first_data);
+  EXPECT_NE(last[0].data(), second_data);
+  EXPECT_EQ(last[0].TotalBytes(), sizeof(int64));
+
+  std::vector<Tensor> out_tensors;
+  TF_ASSERT_OK(
+      iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence));
+  EXPECT_TRUE(end_of_sequence);
+  EXPECT_TRUE(out_tensors.empty());
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -14,12 +14,18 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/cache_dataset_ops.h"
 
+#include <atomic>
+#include <limits>
+
+#include "absl/container/flat_hash_map.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/cache_ops.h"
+#include "tensorflow/core/kernels/data/dataset_utils.h"
 #include "tensorflow/core/kernels/data/name_utils.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/errors.h"
@@ -34,6 +40,10 @@ namespace data {
 /* static */ constexpr const char* const CacheDatasetOp::kDatasetType;
 /* static */ constexpr const char* const CacheDatasetOp::kInputDataset;
 /* static */ constexpr const char* const CacheDatasetOp::kFileName;
+/* static */ constexpr const char* const CacheDatasetOp::kMemoryBudget;
+/* static */ constexpr const char* const CacheDatasetOp::kMaxShardBytes;
+/* static */ constexpr const char* const CacheDatasetOp::kNumReaderThreads;
+/* static */ constexpr const char* const CacheDatasetOp::kReadAheadWindow;
 /* static */ constexpr const char* const CacheDatasetOp::kOutputTypes;
 /* static */ constexpr const char* const CacheDatasetOp::kOutputShapes;
 
@@ -60,17 +70,22 @@ constexpr char kCacheDataset[] = "CacheDataset";
 class CacheDatasetOp::FileDatasetBase : public DatasetBase {
  public:
   FileDatasetBase(OpKernelContext* ctx, const DatasetBase* input,
-                  string filename, Env* env)
+                  string filename, Env* env, int64 max_shard_bytes,
+                  int64 num_reader_threads, int64 read_ahead_window)
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
         filename_(std::move(filename)),
         env_(env),
         num_tensors_(input->output_dtypes().size()),
         tensor_index_padding_size_(StringPaddingSize(num_tensors_)),
+        max_shard_bytes_(max_shard_bytes),
+        num_reader_threads_(num_reader_threads),
+        read_ahead_window_(read_ahead_window),
         item_index_padding_size_(StringPaddingSize(kMaxItems)),
         tensor_format_string_(strings::Printf(kKeyStrFormat,
                                               item_index_padding_size_,
-                                              tensor_index_padding_size_)) {
+                                              tensor_index_padding_size_)),
+        reader_pool_(env, filename_, num_reader_threads) {
     input_->Ref();
     DCHECK_EQ(item_index_padding_size_, 7);
   }
@@ -106,10 +121,84 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
   }
 
  protected:
+  // Adds the attrs that configure the sharding and reading of the cache file
+  // to `attrs`.
+  void AddFileCacheAttrs(DatasetGraphDefBuilder* b,
+                         std::vector<std::pair<StringPiece, AttrValue>>* attrs)
+      const {
+    AttrValue max_shard_bytes;
+    b->BuildAttrValue(max_shard_bytes_, &max_shard_bytes);
+    attrs->emplace_back(kMaxShardBytes, max_shard_bytes);
+    AttrValue num_reader_threads;
+    b->BuildAttrValue(num_reader_threads_, &num_reader_threads);
+    attrs->emplace_back(kNumReaderThreads, num_reader_threads);
+    AttrValue read_ahead_window;
+    b->BuildAttrValue(read_ahead_window_, &read_ahead_window);
+    attrs->emplace_back(kReadAheadWindow, read_ahead_window);
+  }
+
   const DatasetBase* const input_;
   const tstring filename_;
 
  private:
+  // Hands out `BundleReader`s over a completed cache to the reader threads of
+  // all the iterators of the dataset. Each reader keeps one file open per
+  // shard of the cache, so the pool bounds the number of readers instead of
+  // letting every reader thread own one.
+  class ReaderPool {
+   public:
+    ReaderPool(Env* env, const string& filename, int max_readers)
+        : env_(env), filename_(filename), max_readers_(max_readers) {}
+
+    // Sets `reader` to a reader of the cache, blocking while `max_readers`
+    // readers are in use. Returns the error of a newly created reader that
+    // fails to open the cache.
+    Status Acquire(std::unique_ptr<BundleReader>* reader)
+        TF_LOCKS_EXCLUDED(mu_) {
+      {
+        mutex_lock l(mu_);
+        while (free_readers_.empty() && num_readers_ >= max_readers_) {
+          cond_var_.wait(l);
+        }
+        if (!free_readers_.empty()) {
+          *reader = std::move(free_readers_.back());
+          free_readers_.pop_back();
+          return Status::OK();
+        }
+        num_readers_++;
+      }
+      *reader = absl::make_unique<BundleReader>(env_, filename_);
+      Status s = (*reader)->status();
+      if (!s.ok()) {
+        Release(std::move(*reader));
+      }
+      return s;
+    }
+
+    // Returns a reader obtained from `Acquire()` to the pool. Readers in an
+    // error state are destroyed rather than handed out again.
+    void Release(std::unique_ptr<BundleReader> reader) TF_LOCKS_EXCLUDED(mu_) {
+      mutex_lock l(mu_);
+      if (reader->status().ok()) {
+        free_readers_.push_back(std::move(reader));
+      } else {
+        num_readers_--;
+      }
+      cond_var_.notify_one();
+    }
+
+   private:
+    Env* const env_;
+    const string filename_;
+    const int max_readers_;
+    mutex mu_;
+    condition_variable cond_var_;
+    // Number of readers created so far, whether in use or not.
+    int num_readers_ TF_GUARDED_BY(mu_) = 0;
+    std::vector<std::unique_ptr<BundleReader>> free_readers_
+        TF_GUARDED_BY(mu_);
+  };
+
   static size_t StringPaddingSize(size_t num_tensors) {
     return strings::Printf(kPaddingSizeStrFormat, num_tensors - 1).size();
   }
@@ -199,6 +288,10 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
     // checkpoint the input pipeline. On each call to `SaveInternal` the
     // partial cache gets flushed to disk in files with prefix
     // <filename>_<shard_id> where shard_id is unique for each checkpoint.
+    // In addition, if `max_shard_bytes_` is positive, a new shard is started
+    // whenever the current one holds more than `max_shard_bytes_` of tensor
+    // data, so that a large cache is spread over several data files that can
+    // be read back concurrently.
     // When all elements have been produced, these shards get coalesced.
     class FileWriterIterator : public DatasetIterator<FileDatasetBase> {
      public:
@@ -210,24 +303,21 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
                 strings::StrCat(params.dataset->filename_, "_", shard_id_)),
             lockfile_(strings::StrCat(filename_, kLockFileSuffix)),
             lockfile_created_(false),
-            iteration_completed_(false) {}
+            iteration_completed_(false),
+            shard_bytes_(0) {}
 
       ~FileWriterIterator() override {
+        if (iteration_completed_) {
+          return;
+        }
+        // The shards that were rolled over since the last checkpoint are not
+        // referenced by any checkpoint, so they are abandoned together with
+        // the current shard.
+        for (const string& shard : uncheckpointed_shards_) {
+          DeleteShardFiles(shard);
+        }
         if (!dataset()->env_->FileExists(MetaFilename(filename_)).ok()) {
-          std::vector<string> cache_files;
-          Status s = dataset()->env_->GetMatchingPaths(
-              strings::StrCat(filename_, "*"), &cache_files);
-          if (!s.ok()) {
-            LOG(WARNING) << "Failed to get matching files on " << filename_
-                         << "* : " << s.ToString();
-          }
-          for (const string& path : cache_files) {
-            s = dataset()->env_->DeleteFile(path);
-            if (!s.ok()) {
-              LOG(WARNING) << "Failed to delete " << path << " : "
-                           << s.ToString();
-            }
-          }
+          DeleteShardFiles(filename_);
         }
       }
 
@@ -275,9 +365,14 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
           DCHECK_LT(tensor_index, dataset()->num_tensors_);
           string key = dataset()->FormatName(cur_index_, tensor_index++);
           TF_RETURN_IF_ERROR(writer_->Add(key, t));
+          shard_bytes_ += t.TotalBytes();
         }
         if (*end_of_sequence) {
           TF_RETURN_IF_ERROR(Finish());
+        } else if (dataset()->max_shard_bytes_ > 0 &&
+                   shard_bytes_ >=
+                       static_cast<size_t>(dataset()->max_shard_bytes_)) {
+          TF_RETURN_IF_ERROR(StartNewShard());
         }
         cur_index_++;
         return Status::OK();
@@ -308,19 +403,10 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
         // about flushing the current shard. This ensures that we never write
         // empty shards.
         if (lockfile_created_) {
-          // Flush the current bundle.
-          TF_RETURN_IF_ERROR(writer_->Finish());
-
-          // Note: We do not delete the lockfile here. We keep lockfiles of
-          // all shards around until the entire cache has been written to
-          // prevent concurrent iterators from corrupting any of the shards.
-
-          // Start caching to a new shard.
-          shard_id_++;
-          filename_ = strings::StrCat(dataset()->filename_, "_", shard_id_);
-          lockfile_ = strings::StrCat(filename_, kLockFileSuffix);
-          lockfile_created_ = false;
+          TF_RETURN_IF_ERROR(StartNewShard());
         }
+        // From now on, the shards written so far belong to the checkpoint.
+        uncheckpointed_shards_.clear();
         TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kShardId), shard_id_));
         return Status::OK();
@@ -363,6 +449,42 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
       }
 
      private:
+      // Flushes the current bundle and starts caching to a new shard.
+      Status StartNewShard() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        TF_RETURN_IF_ERROR(writer_->Finish());
+
+        // Note: We do not delete the lockfile here. We keep lockfiles of
+        // all shards around until the entire cache has been written to
+        // prevent concurrent iterators from corrupting any of the shards.
+
+        uncheckpointed_shards_.push_back(filename_);
+        shard_id_++;
+        filename_ = strings::StrCat(dataset()->filename_, "_", shard_id_);
+        lockfile_ = strings::StrCat(filename_, kLockFileSuffix);
+        lockfile_created_ = false;
+        shard_bytes_ = 0;
+        return Status::OK();
+      }
+
+      // Deletes the files of the shard with prefix `shard`, including its
+      // lockfile and any temporary files of an unfinished bundle.
+      void DeleteShardFiles(const string& shard) {
+        std::vector<string> cache_files;
+        Status s = dataset()->env_->GetMatchingPaths(
+            strings::StrCat(shard, ".*"), &cache_files);
+        if (!s.ok()) {
+          LOG(WARNING) << "Failed to get matching files on " << shard
+                       << ".* : " << s.ToString();
+        }
+        for (const string& path : cache_files) {
+          s = dataset()->env_->DeleteFile(path);
+          if (!s.ok()) {
+            LOG(WARNING) << "Failed to delete " << path << " : "
+                         << s.ToString();
+          }
+        }
+      }
+
       Status EnsureLockFileExists(bool* end_of_sequence)
           TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
         if (iteration_completed_) {
@@ -467,49 +589,77 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
       string lockfile_ TF_GUARDED_BY(mu_);
       bool lockfile_created_ TF_GUARDED_BY(mu_);
       bool iteration_completed_ TF_GUARDED_BY(mu_);
+      // Number of tensor bytes written to the current shard.
+      size_t shard_bytes_ TF_GUARDED_BY(mu_);
+      // Prefixes of the finished shards that were written after the last
+      // checkpoint, and are deleted if the cache is abandoned.
+      std::vector<string> uncheckpointed_shards_ TF_GUARDED_BY(mu_);
     };  // FileWriterIterator
 
+    // FileReaderIterator reads back the elements of a completed cache.
+    //
+    // If `num_reader_threads_` is zero, elements are read on the calling
+    // thread. Otherwise, elements are read ahead of the consumer by
+    // `num_reader_threads_` background threads, which read whole elements
+    // with `BundleReader`s from the dataset's `ReaderPool`. If the cache was
+    // written in shards of at most `max_shard_bytes_`, concurrent readers are
+    // typically served from different data files. At most
+    // `read_ahead_window_` elements past the next element to be returned are
+    // buffered, and elements are always returned in cache order.
     class FileReaderIterator : public DatasetIterator<FileDatasetBase> {
      public:
       explicit FileReaderIterator(const Params& params)
           : DatasetIterator<FileDatasetBase>(params),
             cur_index_(0),
-            reader_(dataset()->env_, dataset()->filename_),
-            iterator_restored_(false) {}
+            next_index_to_read_(0),
+            end_index_(std::numeric_limits<size_t>::max()),
+            generation_(0) {}
+
+      ~FileReaderIterator() override {
+        CancelThreads();
+        if (deregister_fn_) deregister_fn_();
+      }
+
+      Status Initialize(IteratorContext* ctx) override {
+        return RegisterCancellationCallback(
+            ctx->cancellation_manager(), [this]() { CancelThreads(); },
+            &deregister_fn_);
+      }
 
       Status GetNextInternal(IteratorContext* ctx,
                              std::vector<Tensor>* out_tensors,
                              bool* end_of_sequence) override {
         mutex_lock l(mu_);
         *end_of_sequence = false;
-        TF_RETURN_IF_ERROR(reader_.status());
-        if (!reader_.Valid()) {
+        if (cur_index_ >= end_index_) {
           *end_of_sequence = true;
           return Status::OK();
         }
-        out_tensors->clear();
-        out_tensors->resize(dataset()->num_tensors_);
-
-        for (size_t i = 0; i < dataset()->num_tensors_; ++i) {
-          // When the iterator is restored from the checkpoint, `reader_` is
-          // already pointing at `key` so we do not need to skip the header
-          // entry.
-          if (!iterator_restored_) {
-            reader_.Next();  // The first entry in the table is a header.
-          } else {
-            iterator_restored_ = false;
-          }
-          if (!reader_.Valid()) {
-            out_tensors->clear();
-            *end_of_sequence = true;
-            return Status::OK();
-          }
-          StringPiece key = reader_.key();
-          DCHECK_EQ(key, dataset()->FormatName(cur_index_, i));
-          TF_RETURN_IF_ERROR(reader_.ReadCurrent(&(*out_tensors)[i]));
-          TF_RETURN_IF_ERROR(reader_.status());
+        if (dataset()->num_reader_threads_ == 0) {
+          return ReadNextElementLocked(out_tensors, end_of_sequence);
+        }
+        EnsureReaderThreadsStarted(ctx);
+        while (!cancelled_ && buffer_.find(cur_index_) == buffer_.end()) {
+          RecordStop(ctx);
+          cond_var_.wait(l);
+          RecordStart(ctx);
+        }
+        if (cancelled_) {
+          return errors::Cancelled("Iterator was cancelled");
         }
+        auto it = buffer_.find(cur_index_);
+        // Errors are left in the buffer so that they are reported again by
+        // subsequent calls.
+        TF_RETURN_IF_ERROR(it->second.status);
+        if (cur_index_ >= end_index_) {
+          buffer_.erase(it);
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+        *out_tensors = std::move(it->second.element);
+        buffer_.erase(it);
         cur_index_++;
+        cond_var_.notify_all();
         return Status::OK();
       }
 
@@ -543,19 +693,152 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
             return errors::Internal("Invalid value for cur_index ", temp);
           }
         }
-        if (!reader_.Valid()) {
-          return errors::Internal("Error initializing BundleReader.");
-        }
-        reader_.Seek(dataset()->FormatName(cur_index_, 0));
-        iterator_restored_ = true;
+        // Discard elements that were read ahead of the previous position.
+        // Reads that are still in flight are dropped when they complete.
+        generation_++;
+        buffer_.clear();
+        next_index_to_read_ = cur_index_;
+        end_index_ = std::numeric_limits<size_t>::max();
+        cond_var_.notify_all();
         return Status::OK();
       }
 
      private:
+      struct BufferElement {
+        Status status;
+        std::vector<Tensor> element;
+      };
+
+      // Reads the element at `cur_index_` on the calling thread.
+      Status ReadNextElementLocked(std::vector<Tensor>* out_tensors,
+                                   bool* end_of_sequence)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (!reader_) {
+          reader_ = absl::make_unique<BundleReader>(dataset()->env_,
+                                                    dataset()->filename_);
+        }
+        TF_RETURN_IF_ERROR(ReadElement(reader_.get(), cur_index_, out_tensors,
+                                       end_of_sequence));
+        if (*end_of_sequence) {
+          end_index_ = cur_index_;
+          return Status::OK();
+        }
+        cur_index_++;
+        return Status::OK();
+      }
+
+      void CancelThreads() TF_LOCKS_EXCLUDED(mu_) {
+        mutex_lock l(mu_);
+        cancelled_ = true;
+        cond_var_.notify_all();
+      }
+
+      void EnsureReaderThreadsStarted(IteratorContext* ctx)
+          TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+        if (!reader_threads_.empty()) {
+          return;
+        }
+        std::shared_ptr<IteratorContext> new_ctx =
+            std::make_shared<IteratorContext>(*ctx);
+        reader_threads_.reserve(dataset()->num_reader_threads_);
+        for (int i = 0; i < dataset()->num_reader_threads_; ++i) {
+          reader_threads_.push_back(
+              ctx->StartThread(strings::StrCat("tf_data_cache_reader_", i),
+                               [this, new_ctx]() { ReaderThread(new_ctx); }));
+        }
+      }
+
+      // Reads elements of the cache into `buffer_` until cancelled.
+      //
+      // It owns the iterator context passed to it.
+      void ReaderThread(const std::shared_ptr<IteratorContext>& ctx) {
+        RecordStart(ctx.get());
+        auto cleanup = gtl::MakeCleanup([this, ctx] { RecordStop(ctx.get()); });
+        while (true) {
+          size_t index;
+          int64 generation;
+          {
+            mutex_lock l(mu_);
+            while (!cancelled_ &&
+                   (next_index_to_read_ >= end_index_ ||
+                    next_index_to_read_ >=
+                        cur_index_ + static_cast<size_t>(
+                                         dataset()->read_ahead_window_))) {
+              RecordStop(ctx.get());
+              cond_var_.wait(l);
+              RecordStart(ctx.get());
+            }
+            if (cancelled_) {
+              return;
+            }
+            index = next_index_to_read_++;
+            generation = generation_;
+          }
+          BufferElement result;
+          bool end_of_sequence = false;
+          std::unique_ptr<BundleReader> reader;
+          result.status = dataset()->reader_pool_.Acquire(&reader);
+          if (result.status.ok()) {
+            result.status = ReadElement(reader.get(), index, &result.element,
+                                        &end_of_sequence);
+            dataset()->reader_pool_.Release(std::move(reader));
+          }
+          mutex_lock l(mu_);
+          if (generation != generation_) {
+            continue;
+          }
+          if (result.status.ok() && end_of_sequence) {
+            end_index_ = std::min(end_index_, index);
+          }
+          buffer_[index] = std::move(result);
+          cond_var_.notify_all();
+        }
+      }
+
+      // Reads the tensors of the element at `index` from `reader`. Sets
+      // `end_of_sequence` if the cache holds no element at `index`.
+      Status ReadElement(BundleReader* reader, size_t index,
+                         std::vector<Tensor>* element,
+                         bool* end_of_sequence) const {
+        TF_RETURN_IF_ERROR(reader->status());
+        reader->Seek(dataset()->FormatName(index, 0));
+        element->resize(dataset()->num_tensors_);
+        for (size_t i = 0; i < dataset()->num_tensors_; ++i) {
+          if (!reader->Valid() ||
+              reader->key() != dataset()->FormatName(index, i)) {
+            if (i == 0) {
+              element->clear();
+              *end_of_sequence = true;
+              return Status::OK();
+            }
+            return errors::DataLoss("Cache ", dataset()->filename_,
+                                    " is missing tensor ", i, " of element ",
+                                    index);
+          }
+          TF_RETURN_IF_ERROR(reader->ReadCurrent(&(*element)[i]));
+          reader->Next();
+        }
+        return reader->status();
+      }
+
       mutex mu_;
+      condition_variable cond_var_;
+      // Index of the next element to be returned by `GetNextInternal()`.
       size_t cur_index_ TF_GUARDED_BY(mu_);
-      BundleReader reader_ TF_GUARDED_BY(mu_);
-      bool iterator_restored_ TF_GUARDED_BY(mu_);
+      // Index of the next element to be read by a reader thread.
+      size_t next_index_to_read_ TF_GUARDED_BY(mu_);
+      // Number of elements in the cache, once known.
+      size_t end_index_ TF_GUARDED_BY(mu_);
+      // Incremented on restore so that stale reads can be discarded.
+      int64 generation_ TF_GUARDED_BY(mu_);
+      // Elements read ahead of `cur_index_`, keyed by their index.
+      absl::flat_hash_map<size_t, BufferElement> buffer_ TF_GUARDED_BY(mu_);
+      bool cancelled_ TF_GUARDED_BY(mu_) = false;
+      // Method for deregistering the cancellation callback.
+      std::function<void()> deregister_fn_;
+      std::vector<std::unique_ptr<Thread>> reader_threads_ TF_GUARDED_BY(mu_);
+      // Reads the cache on the calling thread if there are no reader threads.
+      std::unique_ptr<BundleReader> reader_ TF_GUARDED_BY(mu_);
     };  // FileReaderIterator
 
     Status InitializeIterator(IteratorContext* ctx)
@@ -593,8 +876,18 @@ class CacheDatasetOp::FileDatasetBase : public DatasetBase {
   const size_t num_tensors_;
   const size_t tensor_index_padding_size_;
   static constexpr size_t kMaxItems = 10000000;  // 10 million
+  // Size above which the writer starts a new cache shard, or zero if shards
+  // are only started at checkpoints.
+  const int64 max_shard_bytes_;
+  // Number of threads reading a completed cache concurrently, or zero if the
+  // cache is read on the calling thread.
+  const int64 num_reader_threads_;
+  // Maximum number of elements read ahead of the consumer by the reader
+  // threads.
+  const int64 read_ahead_window_;
   const size_t item_index_padding_size_;
   const string tensor_format_string_;
+  mutable ReaderPool reader_pool_;
 };  // FileDatasetBase
 
 class CacheDatasetOp::FileDataset : public CacheDatasetOp::FileDatasetBase {
@@ -609,7 +902,10 @@ class CacheDatasetOp::FileDataset : public CacheDatasetOp::FileDatasetBase {
     TF_RETURN_IF_ERROR(b->AddInputDataset(ctx, input_, &input_graph));
     Node* filename = nullptr;
     TF_RETURN_IF_ERROR(b->AddScalar(filename_, &filename));
-    TF_RETURN_IF_ERROR(b->AddDataset(this, {input_graph, filename}, output));
+    std::vector<std::pair<StringPiece, AttrValue>> attrs;
+    AddFileCacheAttrs(b, &attrs);
+    TF_RETURN_IF_ERROR(
+        b->AddDataset(this, {input_graph, filename}, attrs, output));
     return Status::OK();
   }
 };
@@ -617,9 +913,11 @@ class CacheDatasetOp::FileDataset : public CacheDatasetOp::FileDatasetBase {
 class CacheDatasetOp::FileDatasetV2 : public CacheDatasetOp::FileDatasetBase {
  public:
   explicit FileDatasetV2(OpKernelContext* ctx, const DatasetBase* input,
-                         string filename, Env* env,
+                         string filename, Env* env, int64 max_shard_bytes,
+                         int64 num_reader_threads, int64 read_ahead_window,
                          const Tensor& resource_handle)
-      : FileDatasetBase(ctx, input, filename, env),
+      : FileDatasetBase(ctx, input, filename, env, max_shard_bytes,
+                        num_reader_threads, read_ahead_window),
         resource_handle_(resource_handle) {}
 
  protected:
@@ -632,8 +930,11 @@ class CacheDatasetOp::FileDatasetV2 : public CacheDatasetOp::FileDatasetBase {
     TF_RETURN_IF_ERROR(b->AddScalar(filename_, &filename_node));
     Node* resource_handle_node = nullptr;
     TF_RETURN_IF_ERROR(b->AddTensor(resource_handle_, &resource_handle_node));
+    std::vector<std::pair<StringPiece, AttrValue>> attrs;
+    AddFileCacheAttrs(b, &attrs);
     TF_RETURN_IF_ERROR(b->AddDataset(
-        this, {input_node, filename_node, resource_handle_node}, output));
+        this, {input_node, filename_node, resource_handle_node}, attrs,
+        output));
     return Status::OK();
   }
 
@@ -642,26 +943,125 @@ class CacheDatasetOp::FileDatasetV2 : public CacheDatasetOp::FileDatasetBase {
 };
 
 namespace {
-template <typename T, typename FullNameFn>
-Status SaveCache(IteratorStateWriter* writer, T* cache, FullNameFn full_name) {
-  size_t cache_size = cache->size();
-  TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kCacheSize), cache_size));
-  for (size_t i = 0; i < cache_size; i++) {
-    auto& element = cache->at(i);
-    TF_RETURN_IF_ERROR(writer->WriteScalar(
-        full_name(strings::StrCat(kCache, "[", i, "]", kSizeSuffix)),
-        element.size()));
-    for (size_t j = 0; j < element.size(); ++j) {
-      TF_RETURN_IF_ERROR(writer->WriteTensor(
-          full_name(strings::StrCat(kCache, "[", i, "][", j, "]")),
-          element[j]));
+// Accumulates the elements of a memory cache. Elements are held in memory
+// until they use up `memory_budget` bytes, and all later elements are spilled
+// to a `CacheSpillFile`. A negative budget holds all elements in memory.
+class MemoryCacheBuilder {
+ public:
+  MemoryCacheBuilder(Env* env, int64 memory_budget,
+                     const DataTypeVector& dtypes)
+      : env_(env), memory_budget_(memory_budget), dtypes_(dtypes) {}
+
+  // Adds `element` to the cache and sets `spilled` to whether it was written
+  // to the spill file.
+  Status Add(const std::vector<Tensor>& element, bool* spilled) {
+    if (!spill_file_) {
+      size_t element_bytes = 0;
+      for (const Tensor& t : element) {
+        element_bytes += t.TotalBytes();
+      }
+      if (memory_budget_ < 0 || memory_bytes_ + element_bytes <=
+                                    static_cast<size_t>(memory_budget_)) {
+        elements_.push_back(element);
+        memory_bytes_ += element_bytes;
+        *spilled = false;
+        return Status::OK();
+      }
+      VLOG(2) << "Memory cache exceeded its budget of " << memory_budget_
+              << " bytes after " << elements_.size()
+              << " elements; spilling the remaining elements to disk.";
+      std::unique_ptr<CacheSpillFile> spill_file;
+      TF_RETURN_IF_ERROR(CacheSpillFile::Create(env_, dtypes_, &spill_file));
+      spill_file_ = std::move(spill_file);
+    }
+    *spilled = true;
+    return spill_file_->Append(element);
+  }
+
+  // Returns the total number of elements added to the cache.
+  size_t size() const {
+    return elements_.size() + (spill_file_ ? spill_file_->size() : 0);
+  }
+
+  // Returns the elements held in memory.
+  const std::vector<std::vector<Tensor>>& elements() const {
+    return elements_;
+  }
+
+  // Returns the file holding the spilled elements, or nullptr.
+  std::shared_ptr<const CacheSpillFile> spill_file() const {
+    return spill_file_;
+  }
+
+  // Flushes the spilled elements so that they can be read back.
+  Status Flush() { return spill_file_ ? spill_file_->Flush() : Status::OK(); }
+
+  // Moves the accumulated elements into `cache` and marks it as completed.
+  Status CompleteCache(MemoryCache* cache) {
+    if (spill_file_) {
+      TF_RETURN_IF_ERROR(spill_file_->Finish());
     }
+    cache->Complete(std::move(elements_), std::move(spill_file_));
+    elements_.clear();
+    spill_file_.reset();
+    memory_bytes_ = 0;
+    return Status::OK();
+  }
+
+ private:
+  Env* const env_;
+  const int64 memory_budget_;
+  const DataTypeVector dtypes_;
+  std::vector<std::vector<Tensor>> elements_;
+  size_t memory_bytes_ = 0;
+  std::shared_ptr<CacheSpillFile> spill_file_;
+};
+
+template <typename FullNameFn>
+Status SaveElement(IteratorStateWriter* writer, size_t index,
+                   const std::vector<Tensor>& element, FullNameFn full_name) {
+  TF_RETURN_IF_ERROR(writer->WriteScalar(
+      full_name(strings::StrCat(kCache, "[", index, "]", kSizeSuffix)),
+      element.size()));
+  for (size_t j = 0; j < element.size(); ++j) {
+    TF_RETURN_IF_ERROR(writer->WriteTensor(
+        full_name(strings::StrCat(kCache, "[", index, "][", j, "]")),
+        element[j]));
   }
   return Status::OK();
 }
 
+// Saves the in-memory elements of `cache`, followed by the elements of
+// `spill_file` if it is not null. The spilled elements are read back from the
+// file and saved like the in-memory ones, so that the checkpoint does not
+// depend on the spill file, which is local to this process.
 template <typename T, typename FullNameFn>
-Status RestoreCache(IteratorContext* ctx, IteratorStateReader* reader, T* cache,
+Status SaveCache(IteratorStateWriter* writer, T* cache,
+                 const CacheSpillFile* spill_file, FullNameFn full_name) {
+  size_t memory_size = cache->size();
+  size_t spill_size = spill_file ? spill_file->size() : 0;
+  TF_RETURN_IF_ERROR(
+      writer->WriteScalar(full_name(kCacheSize), memory_size + spill_size));
+  for (size_t i = 0; i < memory_size; i++) {
+    TF_RETURN_IF_ERROR(SaveElement(writer, i, cache->at(i), full_name));
+  }
+  if (spill_size > 0) {
+    std::unique_ptr<snapshot_util::Reader> spill_reader;
+    TF_RETURN_IF_ERROR(spill_file->NewReader(/*index=*/0, &spill_reader));
+    for (size_t i = 0; i < spill_size; i++) {
+      std::vector<Tensor> element;
+      TF_RETURN_IF_ERROR(spill_reader->ReadTensors(&element));
+      TF_RETURN_IF_ERROR(
+          SaveElement(writer, memory_size + i, element, full_name));
+    }
+  }
+  return Status::OK();
+}
+
+// Restores the elements saved by `SaveCache` into `cache`, which spills them
+// again if they exceed its memory budget.
+template <typename FullNameFn>
+Status RestoreCache(IteratorStateReader* reader, MemoryCacheBuilder* cache,
                     FullNameFn full_name) {
   size_t cache_size;
   {
@@ -685,7 +1085,8 @@ Status RestoreCache(IteratorContext* ctx, IteratorStateReader* reader, T* cache,
           full_name(strings::StrCat(kCache, "[", i, "][", j, "]")),
           &element.back()));
     }
-    cache->emplace_back(std::move(element));
+    bool spilled;
+    TF_RETURN_IF_ERROR(cache->Add(element, &spilled));
   }
   return Status::OK();
 }
@@ -695,10 +1096,13 @@ Status RestoreCache(IteratorContext* ctx, IteratorStateReader* reader, T* cache,
 class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
  public:
   explicit MemoryDatasetBase(OpKernelContext* ctx, const DatasetBase* input,
-                             std::shared_ptr<MemoryCache> cache)
+                             std::shared_ptr<MemoryCache> cache,
+                             int64 memory_budget)
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
-        cache_(std::move(cache)) {
+        cache_(std::move(cache)),
+        env_(ctx->env()),
+        memory_budget_(memory_budget) {
     input_->Ref();
   }
 
@@ -764,8 +1168,9 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex_lock l(mu_);
       if (cache_->IsCompleted()) {
         TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kCacheCompleted), ""));
-        TF_RETURN_IF_ERROR(SaveCache(
-            writer, cache_, [this](const string& s) { return full_name(s); }));
+        TF_RETURN_IF_ERROR(
+            SaveCache(writer, cache_, cache_->spill_file().get(),
+                      [this](const string& s) { return full_name(s); }));
       }
       return SaveInput(ctx, writer, iterator_);
     }
@@ -776,25 +1181,33 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       iterator_.reset();
       cache_->Reset();
       if (reader->Contains(full_name(kCacheCompleted))) {
-        std::vector<std::vector<Tensor>> temp_cache;
+        MemoryCacheBuilder temp_cache(dataset()->env_,
+                                      dataset()->memory_budget_,
+                                      dataset()->output_dtypes());
         TF_RETURN_IF_ERROR(
-            RestoreCache(ctx, reader, &temp_cache,
+            RestoreCache(reader, &temp_cache,
                          [this](const string& s) { return full_name(s); }));
-        cache_->Complete(std::move(temp_cache));
+        TF_RETURN_IF_ERROR(temp_cache.CompleteCache(cache_));
       }
       TF_RETURN_IF_ERROR(InitializeIterator(ctx));
       return RestoreInput(ctx, reader, iterator_);
     }
 
    private:
+    // MemoryWriterIterator passes through and caches items from the input
+    // dataset. If the dataset has a memory budget, the items that do not fit
+    // within it are spilled to a local scratch file.
     class MemoryWriterIterator : public DatasetIterator<MemoryDatasetBase> {
      public:
       explicit MemoryWriterIterator(const Params& params, MemoryCache* cache)
-          : DatasetIterator<MemoryDatasetBase>(params), cache_(cache) {}
+          : DatasetIterator<MemoryDatasetBase>(params),
+            cache_(cache),
+            temp_cache_(params.dataset->env_, params.dataset->memory_budget_,
+                        params.dataset->output_dtypes()) {}
 
       ~MemoryWriterIterator() override {
         mutex_lock l(mu_);
-        if (!temp_cache_.empty() && !cache_->IsCompleted()) {
+        if (temp_cache_.size() > 0 && !cache_->IsCompleted()) {
           LOG(WARNING)
               << "The calling iterator did not fully read the dataset being "
                  "cached. In order to avoid unexpected truncation of the "
@@ -820,16 +1233,19 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         if (*end_of_sequence) {
           if (!cache_->IsCompleted()) {
             VLOG(2) << "Finalizing the cache because EOF has been reached.";
-            cache_->Complete(std::move(temp_cache_));
+            TF_RETURN_IF_ERROR(temp_cache_.CompleteCache(cache_));
           }
           return Status::OK();
         }
-        RecordBufferEnqueue(ctx, *out_tensors);
-        temp_cache_.emplace_back(*out_tensors);
+        bool spilled;
+        TF_RETURN_IF_ERROR(temp_cache_.Add(*out_tensors, &spilled));
+        if (!spilled) {
+          RecordBufferEnqueue(ctx, *out_tensors);
+        }
         if (temp_cache_.size() == dataset()->input_->Cardinality()) {
           VLOG(2) << "Finalizing the cache because its size matches the "
                      "expected input cardinality.";
-          cache_->Complete(std::move(temp_cache_));
+          TF_RETURN_IF_ERROR(temp_cache_.CompleteCache(cache_));
         }
         return Status::OK();
       }
@@ -845,8 +1261,10 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
                           IteratorStateWriter* writer) override {
         mutex_lock l(mu_);
         if (!cache_->IsCompleted()) {
+          TF_RETURN_IF_ERROR(temp_cache_.Flush());
           TF_RETURN_IF_ERROR(
-              SaveCache(writer, &temp_cache_,
+              SaveCache(writer, &temp_cache_.elements(),
+                        temp_cache_.spill_file().get(),
                         [this](const string& s) { return full_name(s); }));
         }
         return SaveInput(ctx, writer, input_impl_);
@@ -857,7 +1275,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
         mutex_lock l(mu_);
         if (!reader->Contains(full_name(kCacheCompleted))) {
           TF_RETURN_IF_ERROR(
-              RestoreCache(ctx, reader, &temp_cache_,
+              RestoreCache(reader, &temp_cache_,
                            [this](const string& s) { return full_name(s); }));
         }
         return RestoreInput(ctx, reader, input_impl_);
@@ -867,7 +1285,7 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex mu_;
       std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_);
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
-      std::vector<std::vector<Tensor>> temp_cache_ TF_GUARDED_BY(mu_);
+      MemoryCacheBuilder temp_cache_ TF_GUARDED_BY(mu_);
     };  // MemoryWriterIterator
 
     class MemoryReaderIterator : public DatasetIterator<MemoryDatasetBase> {
@@ -901,10 +1319,22 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
           index_++;
           *end_of_sequence = false;
           return Status::OK();
-        } else {
-          *end_of_sequence = true;
+        }
+        if (!spill_file_) {
+          spill_file_ = cache_->spill_file();
+        }
+        if (spill_file_ && index_ < cache_->size() + spill_file_->size()) {
+          if (!spill_reader_) {
+            TF_RETURN_IF_ERROR(spill_file_->NewReader(index_ - cache_->size(),
+                                                      &spill_reader_));
+          }
+          TF_RETURN_IF_ERROR(spill_reader_->ReadTensors(out_tensors));
+          index_++;
+          *end_of_sequence = false;
           return Status::OK();
         }
+        *end_of_sequence = true;
+        return Status::OK();
       }
 
      protected:
@@ -929,6 +1359,8 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
           TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kIndex), &temp));
           index_ = static_cast<size_t>(temp);
         }
+        spill_reader_.reset();
+        spill_file_.reset();
         return Status::OK();
       }
 
@@ -936,6 +1368,13 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
       mutex mu_;
       MemoryCache* const cache_ TF_GUARDED_BY(mu_);  // not owned.
       size_t index_ TF_GUARDED_BY(mu_);
+      // The file holding the elements that were spilled from memory, if any.
+      // Holding it keeps the file alive while this iterator reads from it,
+      // even if the cache is reset in the meantime.
+      std::shared_ptr<const CacheSpillFile> spill_file_ TF_GUARDED_BY(mu_);
+      // Reads the elements of `spill_file_`. Created when the first spilled
+      // element is read.
+      std::unique_ptr<snapshot_util::Reader> spill_reader_ TF_GUARDED_BY(mu_);
     };  // MemoryReaderIterator
 
     Status InitializeIterator(IteratorContext* ctx)
@@ -962,6 +1401,10 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
 
   const DatasetBase* const input_;
   const std::shared_ptr<MemoryCache> cache_;
+  Env* const env_;
+  // Maximum number of bytes of the cache held in memory. Negative values
+  // mean that the cache is not bounded.
+  const int64 memory_budget_;
 };  // MemoryDatasetBase
 
 // This version of memory dataset has an exclusive ownership of the memory cache
@@ -970,8 +1413,9 @@ class CacheDatasetOp::MemoryDatasetBase : public DatasetBase {
 class CacheDatasetOp::MemoryDataset : public CacheDatasetOp::MemoryDatasetBase {
  public:
   MemoryDataset(OpKernelContext* ctx, const DatasetBase* input,
-                MemoryCacheManager* manager, ResourceHandle&& resource_handle)
-      : MemoryDatasetBase(ctx, input, manager->get()),
+                MemoryCacheManager* manager, ResourceHandle&& resource_handle,
+                int64 memory_budget)
+      : MemoryDatasetBase(ctx, input, manager->get(), memory_budget),
         manager_(manager),
         resource_handle_(std::move(resource_handle)),
         resource_mgr_(ctx->resource_manager()) {}
@@ -993,8 +1437,11 @@ class CacheDatasetOp::MemoryDataset : public CacheDatasetOp::MemoryDatasetBase {
     TF_RETURN_IF_ERROR(b->AddInputDataset(ctx, input_, &input_node));
     Node* filename_node = nullptr;
     TF_RETURN_IF_ERROR(b->AddScalar(tstring(""), &filename_node));
-    TF_RETURN_IF_ERROR(
-        b->AddDataset(this, {input_node, filename_node}, output));
+    AttrValue memory_budget;
+    b->BuildAttrValue(memory_budget_, &memory_budget);
+    TF_RETURN_IF_ERROR(b->AddDataset(this, {input_node, filename_node},
+                                     {{kMemoryBudget, memory_budget}},
+                                     output));
     return Status::OK();
   }
 
@@ -1012,8 +1459,8 @@ class CacheDatasetOp::MemoryDatasetV2
  public:
   MemoryDatasetV2(OpKernelContext* ctx, const DatasetBase* input,
                   MemoryCacheManager* manager, ResourceHandle&& resource_handle,
-                  bool owns_resource)
-      : MemoryDatasetBase(ctx, input, manager->get()),
+                  bool owns_resource, int64 memory_budget)
+      : MemoryDatasetBase(ctx, input, manager->get(), memory_budget),
         manager_(manager),
         owns_resource_(owns_resource),
         resource_handle_(std::move(resource_handle)),
@@ -1042,8 +1489,11 @@ class CacheDatasetOp::MemoryDatasetV2
     Tensor handle(DT_RESOURCE, TensorShape({}));
     handle.scalar<ResourceHandle>()() = resource_handle_;
     TF_RETURN_IF_ERROR(b->AddTensor(handle, &resource_handle_node));
+    AttrValue memory_budget;
+    b->BuildAttrValue(memory_budget_, &memory_budget);
     TF_RETURN_IF_ERROR(b->AddDataset(
-        this, {input_node, filename_node, resource_handle_node}, output));
+        this, {input_node, filename_node, resource_handle_node},
+        {{kMemoryBudget, memory_budget}}, output));
     return Status::OK();
   }
 
@@ -1056,7 +1506,28 @@ class CacheDatasetOp::MemoryDatasetV2
 
 CacheDatasetOp::CacheDatasetOp(OpKernelConstruction* ctx)
     : UnaryDatasetOpKernel(ctx),
-      op_version_(ctx->def().op() == kCacheDataset ? 1 : 2) {}
+      op_version_(ctx->def().op() == kCacheDataset ? 1 : 2) {
+  if (ctx->HasAttr(kMemoryBudget)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kMemoryBudget, &memory_budget_));
+  }
+  if (ctx->HasAttr(kMaxShardBytes)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kMaxShardBytes, &max_shard_bytes_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kNumReaderThreads, &num_reader_threads_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kReadAheadWindow, &read_ahead_window_));
+  }
+  OP_REQUIRES(ctx, max_shard_bytes_ >= 0,
+              errors::InvalidArgument("`", kMaxShardBytes,
+                                      "` must be non-negative but is ",
+                                      max_shard_bytes_, "."));
+  OP_REQUIRES(ctx, num_reader_threads_ >= 0,
+              errors::InvalidArgument("`", kNumReaderThreads,
+                                      "` must be non-negative but is ",
+                                      num_reader_threads_, "."));
+  OP_REQUIRES(ctx, read_ahead_window_ > 0,
+              errors::InvalidArgument("`", kReadAheadWindow,
+                                      "` must be positive but is ",
+                                      read_ahead_window_, "."));
+}
 
 void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
                                  DatasetBase** output) {
@@ -1089,7 +1560,7 @@ void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
       }
       // Ownership of manager is transferred onto `MemoryDatasetV2`.
       *output = new MemoryDatasetV2(ctx, input, manager, std::move(handle),
-                                    owns_resource);
+                                    owns_resource, memory_budget_);
     } else {
       MemoryCacheManager* manager;
       OP_REQUIRES_OK(
@@ -1101,14 +1572,18 @@ void CacheDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
       auto handle =
           MakeResourceHandle<MemoryCacheManager>(ctx, container, name);
       // Ownership of manager is transferred onto `MemoryDataset`.
-      *output = new MemoryDataset(ctx, input, manager, std::move(handle));
+      *output = new MemoryDataset(ctx, input, manager, std::move(handle),
+                                  memory_budget_);
     }
   } else {
     if (op_version_ == 2) {
-      *output =
-          new FileDatasetV2(ctx, input, filename, ctx->env(), ctx->input(2));
+      *output = new FileDatasetV2(ctx, input, filename, ctx->env(),
+                                  max_shard_bytes_, num_reader_threads_,
+                                  read_ahead_window_, ctx->input(2));
     } else {
-      *output = new FileDataset(ctx, input, filename, ctx->env());
+      *output = new FileDataset(ctx, input, filename, ctx->env(),
+                                max_shard_bytes_, num_reader_threads_,
+                                read_ahead_window_);
     }
   }
 }
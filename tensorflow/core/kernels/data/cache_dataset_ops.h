@@ -28,6 +28,10 @@ class CacheDatasetOp : public UnaryDatasetOpKernel {
   static constexpr const char* const kDatasetType = "Cache";
   static constexpr const char* const kInputDataset = "input_dataset";
   static constexpr const char* const kFileName = "filename";
+  static constexpr const char* const kMemoryBudget = "memory_budget";
+  static constexpr const char* const kMaxShardBytes = "max_shard_bytes";
+  static constexpr const char* const kNumReaderThreads = "num_reader_threads";
+  static constexpr const char* const kReadAheadWindow = "read_ahead_window";
   static constexpr const char* const kOutputTypes = "output_types";
   static constexpr const char* const kOutputShapes = "output_shapes";
 
@@ -44,6 +48,10 @@ class CacheDatasetOp : public UnaryDatasetOpKernel {
   class MemoryDatasetV2;
 
   const int op_version_;
+  int64 memory_budget_ = -1;
+  int64 max_shard_bytes_ = 0;
+  int64 num_reader_threads_ = 0;
+  int64 read_ahead_window_ = 16;
 };
 
 }  // namespace data
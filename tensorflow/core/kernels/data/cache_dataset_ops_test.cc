@@ -11,6 +11,8 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/cache_dataset_ops.h"
 
+#include <numeric>
+
 #include "tensorflow/core/kernels/data/dataset_test_base.h"
 #include "tensorflow/core/kernels/data/dataset_utils.h"
 #include "tensorflow/core/platform/path.h"
@@ -27,12 +29,18 @@ class CacheDatasetParams : public DatasetParams {
  public:
   template <typename T>
   CacheDatasetParams(T input_dataset_params, string filename,
-                     DataTypeVector output_dtypes,
+                     int64 memory_budget, DataTypeVector output_dtypes,
                      std::vector<PartialTensorShape> output_shapes,
-                     string node_name)
+                     string node_name, int64 max_shard_bytes = 0,
+                     int64 num_reader_threads = 0,
+                     int64 read_ahead_window = 16)
       : DatasetParams(std::move(output_dtypes), std::move(output_shapes),
                       std::move(node_name)),
-        filename_(filename) {
+        filename_(filename),
+        memory_budget_(memory_budget),
+        max_shard_bytes_(max_shard_bytes),
+        num_reader_threads_(num_reader_threads),
+        read_ahead_window_(read_ahead_window) {
     input_dataset_params_.push_back(absl::make_unique<T>(input_dataset_params));
     iterator_prefix_ =
         name_utils::IteratorPrefix(input_dataset_params.dataset_type(),
@@ -51,7 +59,11 @@ class CacheDatasetParams : public DatasetParams {
   }
 
   Status GetAttributes(AttributeVector* attr_vector) const override {
-    *attr_vector = {{CacheDatasetOp::kOutputTypes, output_dtypes_},
+    *attr_vector = {{CacheDatasetOp::kMemoryBudget, memory_budget_},
+                    {CacheDatasetOp::kMaxShardBytes, max_shard_bytes_},
+                    {CacheDatasetOp::kNumReaderThreads, num_reader_threads_},
+                    {CacheDatasetOp::kReadAheadWindow, read_ahead_window_},
+                    {CacheDatasetOp::kOutputTypes, output_dtypes_},
                     {CacheDatasetOp::kOutputShapes, output_shapes_}};
     return Status::OK();
   }
@@ -62,6 +74,10 @@ class CacheDatasetParams : public DatasetParams {
 
  private:
   string filename_;
+  int64 memory_budget_;
+  int64 max_shard_bytes_;
+  int64 num_reader_threads_;
+  int64 read_ahead_window_;
 };
 
 class CacheDatasetOpTest : public DatasetOpsTestBase {
@@ -104,6 +120,7 @@ CacheDatasetParams CacheDatasetParams1() {
   return CacheDatasetParams(
       std::move(tensor_slice_dataset_params),
       /*filename=*/io::JoinPath(testing::TmpDir(), "cache_data"),
+      /*memory_budget=*/-1,
       /*output_dtypes=*/{DT_INT64},
       /*output_shapes=*/{PartialTensorShape({3, 1})}, kNodeName);
 }
@@ -116,6 +133,7 @@ CacheDatasetParams CacheDatasetParams2() {
   return CacheDatasetParams(
       std::move(tensor_slice_dataset_params),
       /*filename=*/io::JoinPath(testing::TmpDir(), "cache_data"),
+      /*memory_budget=*/-1,
       /*output_dtypes=*/{DT_INT64},
       /*output_shapes=*/{PartialTensorShape({})}, kNodeName);
 }
@@ -128,6 +146,7 @@ CacheDatasetParams CacheDatasetParams3() {
       /*node_name=*/"tensor_slice");
   return CacheDatasetParams(std::move(tensor_slice_dataset_params),
                             /*filename=*/"",
+                            /*memory_budget=*/-1,
                             /*output_dtypes=*/{DT_INT64},
                             /*output_shapes=*/{PartialTensorShape({3, 1})},
                             kNodeName);
@@ -140,11 +159,76 @@ CacheDatasetParams CacheDatasetParams4() {
       /*node_name=*/"tensor_slice");
   return CacheDatasetParams(std::move(tensor_slice_dataset_params),
                             /*filename=*/"",
+                            /*memory_budget=*/-1,
                             /*output_dtypes=*/{DT_INT64},
                             /*output_shapes=*/{PartialTensorShape({})},
                             kNodeName);
 }
 
+// Test case 5: cache data in file with more elements than are read ahead by
+// 4 reader threads.
+CacheDatasetParams CacheDatasetParams5() {
+  std::vector<int64> values(100);
+  std::iota(values.begin(), values.end(), 0);
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<int64>(TensorShape{100}, values)},
+      /*node_name=*/"tensor_slice");
+  return CacheDatasetParams(
+      std::move(tensor_slice_dataset_params),
+      /*filename=*/io::JoinPath(testing::TmpDir(), "cache_data"),
+      /*memory_budget=*/-1,
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})}, kNodeName,
+      /*max_shard_bytes=*/0,
+      /*num_reader_threads=*/4,
+      /*read_ahead_window=*/16);
+}
+
+std::vector<Tensor> CacheDatasetParams5Outputs() {
+  std::vector<Tensor> outputs;
+  outputs.reserve(100);
+  for (int64 i = 0; i < 100; ++i) {
+    outputs.push_back(CreateTensor<int64>(TensorShape({}), {i}));
+  }
+  return outputs;
+}
+
+// Test case 6: cache data in memory with a budget that only fits the first
+// two elements, so that the remaining elements are spilled to disk.
+CacheDatasetParams CacheDatasetParams6() {
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<int64>(TensorShape{6, 1},
+                                          {0, 1, 2, 3, 4, 5})},
+      /*node_name=*/"tensor_slice");
+  return CacheDatasetParams(std::move(tensor_slice_dataset_params),
+                            /*filename=*/"",
+                            /*memory_budget=*/16,
+                            /*output_dtypes=*/{DT_INT64},
+                            /*output_shapes=*/{PartialTensorShape({1})},
+                            kNodeName);
+}
+
+// Test case 7: cache 100 elements of 8 bytes in a file whose shards are
+// rolled over every `kShardBytes`, and read it back with 4 reader threads.
+constexpr int64 kShardBytes = 64;
+
+CacheDatasetParams CacheDatasetParams7() {
+  std::vector<int64> values(100);
+  std::iota(values.begin(), values.end(), 0);
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<int64>(TensorShape{100}, values)},
+      /*node_name=*/"tensor_slice");
+  return CacheDatasetParams(
+      std::move(tensor_slice_dataset_params),
+      /*filename=*/io::JoinPath(testing::TmpDir(), "sharded_cache_data"),
+      /*memory_budget=*/-1,
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({})}, kNodeName,
+      /*max_shard_bytes=*/kShardBytes,
+      /*num_reader_threads=*/4,
+      /*read_ahead_window=*/16);
+}
+
 std::vector<GetNextTestCase<CacheDatasetParams>> GetNextTestCases() {
   return {{/*dataset_params=*/CacheDatasetParams1(),
            /*expected_outputs=*/
@@ -157,7 +241,13 @@ std::vector<GetNextTestCase<CacheDatasetParams>> GetNextTestCases() {
            CreateTensors<int64>(TensorShape({3, 1}),
                                 {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}})},
           {/*dataset_params=*/CacheDatasetParams4(),
-           /*expected_outputs=*/{}}};
+           /*expected_outputs=*/{}},
+          {/*dataset_params=*/CacheDatasetParams5(),
+           /*expected_outputs=*/CacheDatasetParams5Outputs()},
+          {/*dataset_params=*/CacheDatasetParams6(),
+           /*expected_outputs=*/
+           CreateTensors<int64>(TensorShape({1}),
+                                {{0}, {1}, {2}, {3}, {4}, {5}})}};
 }
 
 class ParameterizedGetNextTest : public CacheDatasetOpTest,
@@ -298,7 +388,12 @@ IteratorSaveAndRestoreTestCases() {
                                 {{0, 1, 2}, {3, 4, 5}, {6, 7, 8}})},
           {/*dataset_params=*/CacheDatasetParams4(),
            /*breakpoints=*/{0, 2, 4, 11},
-           /*expected_outputs=*/{}}};
+           /*expected_outputs=*/{}},
+          {/*dataset_params=*/CacheDatasetParams6(),
+           /*breakpoints=*/{0, 1, 3, 11},
+           /*expected_outputs=*/
+           CreateTensors<int64>(TensorShape({1}),
+                                {{0}, {1}, {2}, {3}, {4}, {5}})}};
 }
 
 class ParameterizedIteratorSaveAndRestoreTest
@@ -365,6 +460,220 @@ INSTANTIATE_TEST_CASE_P(CacheDatasetOpTest,
                         ParameterizedIteratorSaveAndRestoreTest,
                         ::testing::ValuesIn(IteratorSaveAndRestoreTestCases()));
 
+// Reads up to `num_elements` elements from `iterator`, or all of its remaining
+// elements if `num_elements` is negative, and appends them to `outputs`.
+Status ReadElements(IteratorContext* ctx, IteratorBase* iterator,
+                    int num_elements, std::vector<Tensor>* outputs) {
+  bool end_of_sequence = false;
+  for (int i = 0; !end_of_sequence && (num_elements < 0 || i < num_elements);
+       ++i) {
+    std::vector<Tensor> next;
+    TF_RETURN_IF_ERROR(iterator->GetNext(ctx, &next, &end_of_sequence));
+    outputs->insert(outputs->end(), next.begin(), next.end());
+  }
+  return Status::OK();
+}
+
+TEST_F(CacheDatasetOpTest, RestoreWhileSpillingIntoFreshCache) {
+  auto dataset_params = CacheDatasetParams6();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  // The first two elements fit in memory and the next two are spilled.
+  std::vector<Tensor> out_tensors;
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), iterator_.get(),
+                            /*num_elements=*/4, &out_tensors));
+  std::unique_ptr<SerializationContext> serialization_ctx;
+  TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+  VariantTensorDataWriter writer;
+  TF_ASSERT_OK(iterator_->Save(serialization_ctx.get(), &writer));
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+
+  // Destroying the writer discards the partial cache and deletes its spill
+  // file, so the checkpoint must hold the spilled elements itself. Restore it
+  // into a new dataset, which uses a fresh cache resource.
+  iterator_.reset();
+  std::unique_ptr<TestDataset> fresh_dataset;
+  TF_ASSERT_OK(MakeDataset(dataset_params, &fresh_dataset));
+  VariantTensorDataReader reader(data);
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(RestoreIterator(iterator_ctx_.get(), &reader,
+                               dataset_params.iterator_prefix(),
+                               *fresh_dataset->dataset(), &iterator));
+  out_tensors.clear();
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), iterator.get(),
+                            /*num_elements=*/-1, &out_tensors));
+  TF_EXPECT_OK(ExpectEqual(out_tensors,
+                           CreateTensors<int64>(TensorShape({1}), {{4}, {5}}),
+                           /*compare_order=*/true));
+
+  // The restored cache holds every element.
+  TF_ASSERT_OK(fresh_dataset->dataset()->MakeIterator(
+      iterator_ctx_.get(), /*parent=*/nullptr,
+      dataset_params.iterator_prefix(), &iterator));
+  out_tensors.clear();
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), iterator.get(),
+                            /*num_elements=*/-1, &out_tensors));
+  TF_EXPECT_OK(ExpectEqual(
+      out_tensors,
+      CreateTensors<int64>(TensorShape({1}), {{0}, {1}, {2}, {3}, {4}, {5}}),
+      /*compare_order=*/true));
+}
+
+TEST_F(CacheDatasetOpTest, ReaderOutlivesCacheReset) {
+  auto dataset_params = CacheDatasetParams6();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  std::vector<Tensor> out_tensors;
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), iterator_.get(),
+                            /*num_elements=*/-1, &out_tensors));
+  std::unique_ptr<IteratorBase> cache_reader;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &cache_reader));
+  out_tensors.clear();
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), cache_reader.get(),
+                            /*num_elements=*/3, &out_tensors));
+
+  // Restoring another iterator resets the cache and replaces its spill file,
+  // but the reader keeps reading from the file it started with.
+  std::unique_ptr<SerializationContext> serialization_ctx;
+  TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+  VariantTensorDataWriter writer;
+  TF_ASSERT_OK(iterator_->Save(serialization_ctx.get(), &writer));
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+  VariantTensorDataReader reader(data);
+  TF_ASSERT_OK(RestoreIterator(iterator_ctx_.get(), &reader,
+                               dataset_params.iterator_prefix(), *dataset_,
+                               &iterator_));
+  TF_ASSERT_OK(ReadElements(iterator_ctx_.get(), cache_reader.get(),
+                            /*num_elements=*/-1, &out_tensors));
+  TF_EXPECT_OK(ExpectEqual(
+      out_tensors,
+      CreateTensors<int64>(TensorShape({1}), {{0}, {1}, {2}, {3}, {4}, {5}}),
+      /*compare_order=*/true));
+}
+
+class ShardedCacheDatasetOpTest : public CacheDatasetOpTest {
+ protected:
+  // Returns the files of the cache whose names match `pattern`.
+  std::vector<string> CacheFiles(const string& pattern) {
+    std::vector<string> files;
+    TF_CHECK_OK(device_->env()->GetMatchingPaths(
+        strings::StrCat(cache_filename_, pattern), &files));
+    return files;
+  }
+};
+
+TEST_F(ShardedCacheDatasetOpTest, RollsOverShards) {
+  auto dataset_params = CacheDatasetParams7();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  while (!end_of_sequence) {
+    TF_ASSERT_OK(iterator_->GetNext(iterator_ctx_.get(), &out_tensors,
+                                    &end_of_sequence));
+  }
+  // Each shard holds 8 elements, and the merged cache keeps one data file per
+  // shard.
+  EXPECT_EQ(CacheFiles(".data-*").size(), 13);
+  EXPECT_TRUE(CacheFiles("_*").empty());
+}
+
+TEST_F(ShardedCacheDatasetOpTest, ParallelReadsReturnCacheOrder) {
+  auto dataset_params = CacheDatasetParams7();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  while (!end_of_sequence) {
+    TF_ASSERT_OK(iterator_->GetNext(iterator_ctx_.get(), &out_tensors,
+                                    &end_of_sequence));
+  }
+
+  // Two readers of the same cache share the readers of the dataset, and each
+  // of them returns the elements in cache order.
+  std::unique_ptr<IteratorBase> first;
+  std::unique_ptr<IteratorBase> second;
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &first));
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &second));
+  for (int64 i = 0; i < 100; ++i) {
+    for (IteratorBase* iterator : {first.get(), second.get()}) {
+      out_tensors.clear();
+      TF_ASSERT_OK(iterator->GetNext(iterator_ctx_.get(), &out_tensors,
+                                     &end_of_sequence));
+      ASSERT_FALSE(end_of_sequence);
+      TF_EXPECT_OK(ExpectEqual(out_tensors[0],
+                               CreateTensor<int64>(TensorShape({}), {i})));
+    }
+  }
+  for (IteratorBase* iterator : {first.get(), second.get()}) {
+    out_tensors.clear();
+    TF_ASSERT_OK(iterator->GetNext(iterator_ctx_.get(), &out_tensors,
+                                   &end_of_sequence));
+    EXPECT_TRUE(end_of_sequence);
+  }
+}
+
+TEST_F(ShardedCacheDatasetOpTest, ReaderThreadsReportCorruptCache) {
+  auto dataset_params = CacheDatasetParams7();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  while (!end_of_sequence) {
+    TF_ASSERT_OK(iterator_->GetNext(iterator_ctx_.get(), &out_tensors,
+                                    &end_of_sequence));
+  }
+
+  // Readers that fail to open the cache return their error instead of being
+  // handed out by the reader pool.
+  TF_ASSERT_OK(WriteStringToFile(device_->env(),
+                                 strings::StrCat(cache_filename_, ".index"),
+                                 "not a tensor bundle index"));
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator_));
+  for (int i = 0; i < 2; ++i) {
+    out_tensors.clear();
+    EXPECT_FALSE(
+        iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence)
+            .ok());
+  }
+}
+
+TEST_F(ShardedCacheDatasetOpTest, AbandonedWriteDeletesAllShards) {
+  auto dataset_params = CacheDatasetParams7();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  for (int i = 0; i < 20; ++i) {
+    TF_ASSERT_OK(iterator_->GetNext(iterator_ctx_.get(), &out_tensors,
+                                    &end_of_sequence));
+  }
+  // Shards 0 and 1 have been rolled over, and shard 2 is being written.
+  EXPECT_EQ(CacheFiles("_*.lockfile").size(), 3);
+
+  iterator_.reset();
+  EXPECT_TRUE(CacheFiles("*").empty());
+
+  // A new iterator writes the whole cache from scratch.
+  TF_ASSERT_OK(dataset_->MakeIterator(iterator_ctx_.get(), /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator_));
+  out_tensors.clear();
+  end_of_sequence = false;
+  while (!end_of_sequence) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+  }
+  TF_EXPECT_OK(ExpectEqual(out_tensors, CacheDatasetParams5Outputs(),
+                           /*compare_order=*/true));
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
@@ -19,6 +19,7 @@ limitations under the License.
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/dataset_utils.h"
+#include "tensorflow/core/lib/io/compression.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/random_distributions.h"
@@ -28,15 +29,98 @@ namespace data {
 namespace {
 
 constexpr char kMemoryCache[] = "MemoryCache";
+// Version of the snapshot record format used for spill files.
+constexpr int kSpillFileVersion = 1;
 
 }  // namespace
 
 string MemoryCacheManager::DebugString() const { return kMemoryCache; }
 
+Status CacheSpillFile::Create(Env* env, const DataTypeVector& dtypes,
+                              std::unique_ptr<CacheSpillFile>* out) {
+  string filename;
+  if (!env->LocalTempFilename(&filename)) {
+    return errors::Unavailable(
+        "Failed to create a local scratch file for the memory cache.");
+  }
+  std::unique_ptr<snapshot_util::Writer> writer;
+  TF_RETURN_IF_ERROR(snapshot_util::Writer::Create(
+      env, filename, io::compression::kNone, kSpillFileVersion, dtypes,
+      &writer));
+  out->reset(
+      new CacheSpillFile(env, std::move(filename), dtypes, std::move(writer)));
+  return Status::OK();
+}
+
+CacheSpillFile::CacheSpillFile(Env* env, string filename,
+                               const DataTypeVector& dtypes,
+                               std::unique_ptr<snapshot_util::Writer> writer)
+    : env_(env),
+      filename_(std::move(filename)),
+      dtypes_(dtypes),
+      writer_(std::move(writer)) {}
+
+CacheSpillFile::~CacheSpillFile() {
+  writer_.reset();
+  Status s = env_->DeleteFile(filename_);
+  if (!s.ok()) {
+    LOG(WARNING) << "Failed to delete memory cache spill file " << filename_
+                 << ": " << s.ToString();
+  }
+  const string index_filename = snapshot_util::IndexFileName(filename_);
+  if (env_->FileExists(index_filename).ok()) {
+    s = env_->DeleteFile(index_filename);
+    if (!s.ok()) {
+      LOG(WARNING) << "Failed to delete memory cache spill index file "
+                   << index_filename << ": " << s.ToString();
+    }
+  }
+}
+
+Status CacheSpillFile::Append(const std::vector<Tensor>& element) {
+  if (!writer_) {
+    return errors::FailedPrecondition("Spill file ", filename_,
+                                      " is closed for writing.");
+  }
+  TF_RETURN_IF_ERROR(writer_->WriteTensors(element));
+  size_++;
+  return Status::OK();
+}
+
+Status CacheSpillFile::Flush() {
+  if (!writer_) {
+    return Status::OK();
+  }
+  return writer_->Sync();
+}
+
+Status CacheSpillFile::Finish() {
+  if (!writer_) {
+    return Status::OK();
+  }
+  Status s = writer_->Close();
+  writer_.reset();
+  return s;
+}
+
+Status CacheSpillFile::NewReader(
+    int64 index, std::unique_ptr<snapshot_util::Reader>* reader) const {
+  TF_RETURN_IF_ERROR(snapshot_util::Reader::Create(
+      env_, filename_, io::compression::kNone, kSpillFileVersion, dtypes_,
+      reader));
+  return (*reader)->SkipRecords(index);
+}
+
 void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache) {
+  Complete(std::move(cache), /*spill_file=*/nullptr);
+}
+
+void MemoryCache::Complete(std::vector<std::vector<Tensor>>&& cache,
+                           std::shared_ptr<const CacheSpillFile> spill_file) {
   mutex_lock l(mu_);
   if (!completed_) {
     cache_ = std::move(cache);
+    spill_file_ = std::move(spill_file);
     completed_ = true;
   }
 }
@@ -50,6 +134,7 @@ void MemoryCache::Reset() {
   mutex_lock l(mu_);
   completed_ = false;
   cache_.clear();
+  spill_file_.reset();
 }
 
 const std::vector<Tensor>& MemoryCache::at(int64 index) {
@@ -63,6 +148,11 @@ size_t MemoryCache::size() {
   return cache_.size();
 }
 
+std::shared_ptr<const CacheSpillFile> MemoryCache::spill_file() {
+  tf_shared_lock l(mu_);
+  return spill_file_;
+}
+
 AnonymousMemoryCacheHandleOp::AnonymousMemoryCacheHandleOp(
     OpKernelConstruction* ctx)
     : AnonymousResourceOp<MemoryCacheManager>(ctx) {}
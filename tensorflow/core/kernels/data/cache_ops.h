@@ -18,15 +18,61 @@ limitations under the License.
 
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/kernels/data/dataset_utils.h"
+#include "tensorflow/core/kernels/data/experimental/snapshot_util.h"
 
 namespace tensorflow {
 namespace data {
 
+// A local scratch file holding the dataset elements that did not fit within
+// the memory budget of a `MemoryCache`.
+//
+// Elements are appended and read back in order using the snapshot record
+// format. The file is deleted when this object is destroyed.
+class CacheSpillFile {
+ public:
+  // Creates an empty spill file in a local temporary directory.
+  static Status Create(Env* env, const DataTypeVector& dtypes,
+                       std::unique_ptr<CacheSpillFile>* out);
+
+  ~CacheSpillFile();
+
+  // Appends `element` to the file.
+  Status Append(const std::vector<Tensor>& element);
+
+  // Flushes the appended elements so that they can be read back.
+  Status Flush();
+
+  // Closes the file for writing. No elements can be appended afterwards.
+  Status Finish();
+
+  // Creates a reader positioned at the `index`-th element of the file.
+  Status NewReader(int64 index,
+                   std::unique_ptr<snapshot_util::Reader>* reader) const;
+
+  // Returns the number of elements in the file.
+  size_t size() const { return size_; }
+
+ private:
+  CacheSpillFile(Env* env, string filename, const DataTypeVector& dtypes,
+                 std::unique_ptr<snapshot_util::Writer> writer);
+
+  Env* const env_;
+  const string filename_;
+  const DataTypeVector dtypes_;
+  std::unique_ptr<snapshot_util::Writer> writer_;
+  size_t size_ = 0;
+};
+
 // A thread-safe data structure for caching dataset elements.
 //
 // The expected use is that a single `MemoryWriterIterator` populates the
 // cache with dataset elements. Once all elements are cached, the cache can
 // be used by one or more `MemoryReaderIterator`s.
+//
+// If the cache was populated under a memory budget, the elements that did not
+// fit in memory follow the in-memory ones in a `CacheSpillFile`. The file is
+// shared with the readers of the cache, so it is deleted only after the cache
+// is reset and the last reader is done with it.
 class MemoryCache {
  public:
   MemoryCache() = default;
@@ -34,23 +80,33 @@ class MemoryCache {
   // Marks the cache as completed.
   void Complete(std::vector<std::vector<Tensor>>&& cache);
 
+  // Marks the cache as completed. The elements of `spill_file` follow the
+  // elements of `cache`.
+  void Complete(std::vector<std::vector<Tensor>>&& cache,
+                std::shared_ptr<const CacheSpillFile> spill_file);
+
   // Returns whether the cache is completed.
   bool IsCompleted();
 
   // Resets the cache.
   void Reset();
 
-  // Returns the element at the given index.
+  // Returns the in-memory element at the given index.
   const std::vector<Tensor>& at(int64 index);
 
-  // Returns the size of the cache.
+  // Returns the number of elements held in memory.
   size_t size();
 
+  // Returns the file holding the elements that follow the in-memory ones, or
+  // nullptr if all elements are held in memory.
+  std::shared_ptr<const CacheSpillFile> spill_file();
+
  private:
   mutex mu_;
   // Determines whether all elements of the dataset have been cached.
   bool completed_ TF_GUARDED_BY(mu_) = false;
   std::vector<std::vector<Tensor>> cache_ TF_GUARDED_BY(mu_);
+  std::shared_ptr<const CacheSpillFile> spill_file_ TF_GUARDED_BY(mu_);
 };
 
 // A resource wrapping a shared instance of a memory cache.
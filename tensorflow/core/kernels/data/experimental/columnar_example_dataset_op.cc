@@ -0,0 +1,354 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/columnar_example_dataset_op.h"
+
+#include "tensorflow/core/framework/partial_tensor_shape.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/experimental/columnar_util.h"
+#include "tensorflow/core/kernels/data/name_utils.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kDatasetType;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kFileNames;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kSparseKeys;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kDenseKeys;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kSparseTypes;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kDenseTypes;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kDenseShapes;
+/* static */ constexpr const char* const ColumnarExampleDatasetOp::kOutputTypes;
+/* static */ constexpr const char* const
+    ColumnarExampleDatasetOp::kOutputShapes;
+
+constexpr char kCurrentFileIndex[] = "current_file_index";
+constexpr char kNextRowGroup[] = "next_row_group";
+
+class ColumnarExampleDatasetOp::Dataset : public DatasetBase {
+ public:
+  Dataset(OpKernelContext* ctx, std::vector<string> filenames,
+          std::vector<string> sparse_keys, std::vector<string> dense_keys,
+          DataTypeVector sparse_types, DataTypeVector dense_types,
+          std::vector<PartialTensorShape> dense_shapes,
+          DataTypeVector output_types,
+          std::vector<PartialTensorShape> output_shapes)
+      : DatasetBase(DatasetContext(ctx)),
+        filenames_(std::move(filenames)),
+        sparse_keys_(std::move(sparse_keys)),
+        dense_keys_(std::move(dense_keys)),
+        sparse_types_(std::move(sparse_types)),
+        dense_types_(std::move(dense_types)),
+        dense_shapes_(std::move(dense_shapes)),
+        output_types_(std::move(output_types)),
+        output_shapes_(std::move(output_shapes)) {}
+
+  std::unique_ptr<IteratorBase> MakeIteratorInternal(
+      const string& prefix) const override {
+    return absl::make_unique<Iterator>(Iterator::Params{
+        this, name_utils::IteratorPrefix(kDatasetType, prefix)});
+  }
+
+  const DataTypeVector& output_dtypes() const override {
+    return output_types_;
+  }
+
+  const std::vector<PartialTensorShape>& output_shapes() const override {
+    return output_shapes_;
+  }
+
+  string DebugString() const override {
+    return name_utils::DatasetDebugString(kDatasetType);
+  }
+
+  Status CheckExternalState() const override { return Status::OK(); }
+
+ protected:
+  Status AsGraphDefInternal(SerializationContext* ctx,
+                            DatasetGraphDefBuilder* b,
+                            Node** output) const override {
+    Node* filenames = nullptr;
+    TF_RETURN_IF_ERROR(b->AddVector(filenames_, &filenames));
+    AttrValue sparse_keys;
+    b->BuildAttrValue(sparse_keys_, &sparse_keys);
+    AttrValue dense_keys;
+    b->BuildAttrValue(dense_keys_, &dense_keys);
+    AttrValue sparse_types;
+    b->BuildAttrValue(sparse_types_, &sparse_types);
+    AttrValue dense_types;
+    b->BuildAttrValue(dense_types_, &dense_types);
+    AttrValue dense_shapes;
+    b->BuildAttrValue(dense_shapes_, &dense_shapes);
+    TF_RETURN_IF_ERROR(b->AddDataset(this, {filenames},
+                                     {{kSparseKeys, sparse_keys},
+                                      {kDenseKeys, dense_keys},
+                                      {kSparseTypes, sparse_types},
+                                      {kDenseTypes, dense_types},
+                                      {kDenseShapes, dense_shapes}},
+                                     output));
+    return Status::OK();
+  }
+
+ private:
+  class Iterator : public DatasetIterator<Dataset> {
+   public:
+    explicit Iterator(const Params& params)
+        : DatasetIterator<Dataset>(params) {}
+
+    Status GetNextInternal(IteratorContext* ctx,
+                           std::vector<Tensor>* out_tensors,
+                           bool* end_of_sequence) override {
+      mutex_lock l(mu_);
+      do {
+        if (reader_) {
+          if (next_row_group_ < reader_->num_row_groups()) {
+            TF_RETURN_IF_ERROR(
+                ReadRowGroupLocked(ctx, next_row_group_, out_tensors));
+            ++next_row_group_;
+            *end_of_sequence = false;
+            return Status::OK();
+          }
+          ResetStreamsLocked();
+          ++current_file_index_;
+        }
+
+        if (current_file_index_ == dataset()->filenames_.size()) {
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+
+        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
+      } while (true);
+    }
+
+   protected:
+    std::shared_ptr<model::Node> CreateNode(
+        IteratorContext* ctx, model::Node::Args args) const override {
+      return model::MakeSourceNode(std::move(args));
+    }
+
+    Status SaveInternal(SerializationContext* ctx,
+                        IteratorStateWriter* writer) override {
+      mutex_lock l(mu_);
+      TF_RETURN_IF_ERROR(writer->WriteScalar(full_name(kCurrentFileIndex),
+                                             current_file_index_));
+      if (reader_) {
+        TF_RETURN_IF_ERROR(
+            writer->WriteScalar(full_name(kNextRowGroup), next_row_group_));
+      }
+      return Status::OK();
+    }
+
+    Status RestoreInternal(IteratorContext* ctx,
+                           IteratorStateReader* reader) override {
+      mutex_lock l(mu_);
+      ResetStreamsLocked();
+      int64 current_file_index;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kCurrentFileIndex),
+                                            &current_file_index));
+      current_file_index_ = size_t(current_file_index);
+      if (reader->Contains(full_name(kNextRowGroup))) {
+        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
+        TF_RETURN_IF_ERROR(
+            reader->ReadScalar(full_name(kNextRowGroup), &next_row_group_));
+      }
+      return Status::OK();
+    }
+
+   private:
+    // Reads the requested features of `row_group` of the current file. The
+    // outputs are ordered like those of `ParseExample`: the indices, values
+    // and dense shapes of the sparse features, followed by the dense features.
+    Status ReadRowGroupLocked(IteratorContext* ctx, int64 row_group,
+                              std::vector<Tensor>* out_tensors)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64 num_rows = reader_->row_group_size(row_group);
+      const size_t num_sparse = dataset()->sparse_keys_.size();
+      const size_t num_dense = dataset()->dense_keys_.size();
+      out_tensors->resize(3 * num_sparse + num_dense);
+
+      for (size_t i = 0; i < num_sparse; ++i) {
+        const string& key = dataset()->sparse_keys_[i];
+        Tensor values;
+        Tensor row_splits;
+        TF_RETURN_IF_ERROR(reader_->ReadSparse(key, row_group,
+                                               dataset()->sparse_types_[i],
+                                               ctx->allocator({}), &values,
+                                               &row_splits));
+        auto row_splits_flat = row_splits.flat<int64>();
+        int64 max_num_values = 0;
+        for (int64 row = 0; row < num_rows; ++row) {
+          max_num_values = std::max(
+              max_num_values, row_splits_flat(row + 1) - row_splits_flat(row));
+        }
+        Tensor indices(ctx->allocator({}), DT_INT64,
+                       TensorShape({values.NumElements(), 2}));
+        auto indices_matrix = indices.matrix<int64>();
+        for (int64 row = 0; row < num_rows; ++row) {
+          for (int64 j = row_splits_flat(row); j < row_splits_flat(row + 1);
+               ++j) {
+            indices_matrix(j, 0) = row;
+            indices_matrix(j, 1) = j - row_splits_flat(row);
+          }
+        }
+        Tensor dense_shape(ctx->allocator({}), DT_INT64, TensorShape({2}));
+        dense_shape.vec<int64>()(0) = num_rows;
+        dense_shape.vec<int64>()(1) = max_num_values;
+        (*out_tensors)[i] = std::move(indices);
+        (*out_tensors)[num_sparse + i] = std::move(values);
+        (*out_tensors)[2 * num_sparse + i] = std::move(dense_shape);
+      }
+
+      // Dense column chunks are read directly into the output tensors.
+      for (size_t i = 0; i < num_dense; ++i) {
+        const string& key = dataset()->dense_keys_[i];
+        Tensor* value = &(*out_tensors)[3 * num_sparse + i];
+        TF_RETURN_IF_ERROR(reader_->ReadDense(key, row_group,
+                                              dataset()->dense_types_[i],
+                                              ctx->allocator({}), value));
+        PartialTensorShape expected_shape({num_rows});
+        expected_shape =
+            expected_shape.Concatenate(dataset()->dense_shapes_[i]);
+        if (!expected_shape.IsCompatibleWith(value->shape())) {
+          return errors::InvalidArgument(
+              "Dense feature ", key, " has shape ",
+              value->shape().DebugString(), " in ",
+              dataset()->filenames_[current_file_index_], ", expected ",
+              expected_shape.DebugString());
+        }
+      }
+      return Status::OK();
+    }
+
+    Status SetupStreamsLocked(Env* env) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (current_file_index_ >= dataset()->filenames_.size()) {
+        return errors::InvalidArgument(
+            "current_file_index_:", current_file_index_,
+            " >= filenames_.size():", dataset()->filenames_.size());
+      }
+      TF_RETURN_IF_ERROR(columnar_util::Reader::Create(
+          env, dataset()->filenames_[current_file_index_], &reader_));
+      next_row_group_ = 0;
+      return Status::OK();
+    }
+
+    void ResetStreamsLocked() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      reader_.reset();
+    }
+
+    mutex mu_;
+    size_t current_file_index_ TF_GUARDED_BY(mu_) = 0;
+    int64 next_row_group_ TF_GUARDED_BY(mu_) = 0;
+    std::unique_ptr<columnar_util::Reader> reader_ TF_GUARDED_BY(mu_);
+  };
+
+  const std::vector<string> filenames_;
+  const std::vector<string> sparse_keys_;
+  const std::vector<string> dense_keys_;
+  const DataTypeVector sparse_types_;
+  const DataTypeVector dense_types_;
+  const std::vector<PartialTensorShape> dense_shapes_;
+  const DataTypeVector output_types_;
+  const std::vector<PartialTensorShape> output_shapes_;
+};
+
+ColumnarExampleDatasetOp::ColumnarExampleDatasetOp(OpKernelConstruction* ctx)
+    : DatasetOpKernel(ctx) {
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kSparseKeys, &sparse_keys_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kDenseKeys, &dense_keys_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kSparseTypes, &sparse_types_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kDenseTypes, &dense_types_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kDenseShapes, &dense_shapes_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputTypes, &output_types_));
+  OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputShapes, &output_shapes_));
+  OP_REQUIRES(ctx, sparse_keys_.size() == sparse_types_.size(),
+              errors::InvalidArgument("`", kSparseKeys, "` and `",
+                                      kSparseTypes,
+                                      "` must have the same length"));
+  OP_REQUIRES(ctx,
+              dense_keys_.size() == dense_types_.size() &&
+                  dense_keys_.size() == dense_shapes_.size(),
+              errors::InvalidArgument("`", kDenseKeys, "`, `", kDenseTypes,
+                                      "` and `", kDenseShapes,
+                                      "` must have the same length"));
+  // The outputs are the indices, values and dense shapes of the sparse
+  // features, followed by the dense features, all batched over the rows of a
+  // row group.
+  DataTypeVector expected_types;
+  std::vector<PartialTensorShape> expected_shapes;
+  for (size_t i = 0; i < sparse_keys_.size(); ++i) {
+    expected_types.push_back(DT_INT64);
+    expected_shapes.push_back(PartialTensorShape({-1, 2}));
+  }
+  for (size_t i = 0; i < sparse_keys_.size(); ++i) {
+    expected_types.push_back(sparse_types_[i]);
+    expected_shapes.push_back(PartialTensorShape({-1}));
+  }
+  for (size_t i = 0; i < sparse_keys_.size(); ++i) {
+    expected_types.push_back(DT_INT64);
+    expected_shapes.push_back(PartialTensorShape({2}));
+  }
+  for (size_t i = 0; i < dense_keys_.size(); ++i) {
+    expected_types.push_back(dense_types_[i]);
+    expected_shapes.push_back(
+        PartialTensorShape({-1}).Concatenate(dense_shapes_[i]));
+  }
+  OP_REQUIRES(ctx, output_types_ == expected_types,
+              errors::InvalidArgument(
+                  "`", kOutputTypes, "` must be ",
+                  DataTypeVectorString(expected_types), ", got ",
+                  DataTypeVectorString(output_types_)));
+  OP_REQUIRES(ctx, output_shapes_.size() == expected_shapes.size(),
+              errors::InvalidArgument("`", kOutputShapes, "` must have ",
+                                      expected_shapes.size(),
+                                      " elements, got ",
+                                      output_shapes_.size()));
+  for (size_t i = 0; i < expected_shapes.size(); ++i) {
+    OP_REQUIRES(ctx, output_shapes_[i].IsCompatibleWith(expected_shapes[i]),
+                errors::InvalidArgument(
+                    "`", kOutputShapes, "[", i, "]` must be compatible with ",
+                    expected_shapes[i].DebugString(), ", got ",
+                    output_shapes_[i].DebugString()));
+  }
+}
+
+void ColumnarExampleDatasetOp::MakeDataset(OpKernelContext* ctx,
+                                           DatasetBase** output) {
+  const Tensor* filenames_tensor;
+  OP_REQUIRES_OK(ctx, ctx->input(kFileNames, &filenames_tensor));
+  OP_REQUIRES(
+      ctx, filenames_tensor->dims() <= 1,
+      errors::InvalidArgument("`filenames` must be a scalar or a vector."));
+
+  std::vector<string> filenames;
+  filenames.reserve(filenames_tensor->NumElements());
+  for (int i = 0; i < filenames_tensor->NumElements(); ++i) {
+    filenames.push_back(filenames_tensor->flat<tstring>()(i));
+  }
+
+  *output = new Dataset(ctx, std::move(filenames), sparse_keys_, dense_keys_,
+                        sparse_types_, dense_types_, dense_shapes_,
+                        output_types_, output_shapes_);
+}
+
+namespace {
+
+REGISTER_KERNEL_BUILDER(Name("ColumnarExampleDataset").Device(DEVICE_CPU),
+                        ColumnarExampleDatasetOp);
+
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
@@ -0,0 +1,305 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/columnar_example_dataset_op.h"
+
+#include "tensorflow/core/example/example.pb.h"
+#include "tensorflow/core/kernels/data/dataset_test_base.h"
+#include "tensorflow/core/kernels/data/experimental/columnar_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+namespace {
+
+constexpr char kNodeName[] = "columnar_example_dataset";
+constexpr char kIteratorPrefix[] = "Iterator";
+constexpr char kFileName[] = "columnar_example_dataset_op_test";
+constexpr char kCorruptFileName[] = "columnar_example_dataset_op_test_corrupt";
+
+class ColumnarExampleDatasetParams : public DatasetParams {
+ public:
+  ColumnarExampleDatasetParams(std::vector<tstring> filenames,
+                               std::vector<string> sparse_keys,
+                               DataTypeVector sparse_types,
+                               std::vector<string> dense_keys,
+                               DataTypeVector dense_types,
+                               std::vector<PartialTensorShape> dense_shapes,
+                               string node_name)
+      : DatasetParams(OutputDtypes(sparse_types, dense_types),
+                      OutputShapes(sparse_types, dense_shapes),
+                      std::move(node_name)),
+        filenames_(CreateTensor<tstring>(
+            TensorShape({static_cast<int64>(filenames.size())}), filenames)),
+        sparse_keys_(std::move(sparse_keys)),
+        sparse_types_(std::move(sparse_types)),
+        dense_keys_(std::move(dense_keys)),
+        dense_types_(std::move(dense_types)),
+        dense_shapes_(std::move(dense_shapes)) {}
+
+  std::vector<Tensor> GetInputTensors() const override { return {filenames_}; }
+
+  Status GetInputNames(std::vector<string>* input_names) const override {
+    *input_names = {ColumnarExampleDatasetOp::kFileNames};
+    return Status::OK();
+  }
+
+  Status GetAttributes(AttributeVector* attributes) const override {
+    *attributes = {{ColumnarExampleDatasetOp::kSparseKeys, sparse_keys_},
+                   {ColumnarExampleDatasetOp::kDenseKeys, dense_keys_},
+                   {ColumnarExampleDatasetOp::kSparseTypes, sparse_types_},
+                   {ColumnarExampleDatasetOp::kDenseTypes, dense_types_},
+                   {ColumnarExampleDatasetOp::kDenseShapes, dense_shapes_},
+                   {ColumnarExampleDatasetOp::kOutputTypes, output_dtypes_},
+                   {ColumnarExampleDatasetOp::kOutputShapes, output_shapes_}};
+    return Status::OK();
+  }
+
+  string dataset_type() const override {
+    return ColumnarExampleDatasetOp::kDatasetType;
+  }
+
+ private:
+  // The outputs are the indices, values and dense shapes of the sparse
+  // features, followed by the dense features.
+  static DataTypeVector OutputDtypes(const DataTypeVector& sparse_types,
+                                     const DataTypeVector& dense_types) {
+    DataTypeVector output_dtypes(sparse_types.size(), DT_INT64);
+    output_dtypes.insert(output_dtypes.end(), sparse_types.begin(),
+                         sparse_types.end());
+    output_dtypes.insert(output_dtypes.end(), sparse_types.size(), DT_INT64);
+    output_dtypes.insert(output_dtypes.end(), dense_types.begin(),
+                         dense_types.end());
+    return output_dtypes;
+  }
+
+  static std::vector<PartialTensorShape> OutputShapes(
+      const DataTypeVector& sparse_types,
+      const std::vector<PartialTensorShape>& dense_shapes) {
+    std::vector<PartialTensorShape> output_shapes(sparse_types.size(),
+                                                  PartialTensorShape({-1, 2}));
+    output_shapes.insert(output_shapes.end(), sparse_types.size(),
+                         PartialTensorShape({-1}));
+    output_shapes.insert(output_shapes.end(), sparse_types.size(),
+                         PartialTensorShape({2}));
+    for (const PartialTensorShape& shape : dense_shapes) {
+      output_shapes.push_back(PartialTensorShape({-1}).Concatenate(shape));
+    }
+    return output_shapes;
+  }
+
+  Tensor filenames_;
+  std::vector<string> sparse_keys_;
+  DataTypeVector sparse_types_;
+  std::vector<string> dense_keys_;
+  DataTypeVector dense_types_;
+  std::vector<PartialTensorShape> dense_shapes_;
+};
+
+class ColumnarExampleDatasetOpTest : public DatasetOpsTestBase {};
+
+// Returns an example with label `i`, embedding `[i, -i]` and `i` tags.
+Example TestExample(int64 i) {
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  features["label"].mutable_int64_list()->add_value(i);
+  features["embedding"].mutable_float_list()->add_value(i);
+  features["embedding"].mutable_float_list()->add_value(-i);
+  for (int64 j = 0; j < i; ++j) {
+    features["tags"].mutable_bytes_list()->add_value(strings::StrCat("t", j));
+  }
+  return example;
+}
+
+// Writes examples 0, 1 and 2 to a columnar file with two row groups, and
+// returns the path of the file.
+tstring TestFile() {
+  tstring prefix = io::JoinPath(testing::TmpDir(), kFileName);
+  columnar_util::Schema schema;
+  schema.dense_keys = {"label", "embedding"};
+  schema.dense_types = {DT_INT64, DT_FLOAT};
+  schema.dense_shapes = {TensorShape({}), TensorShape({2})};
+  schema.sparse_keys = {"tags"};
+  schema.sparse_types = {DT_STRING};
+  std::unique_ptr<columnar_util::Writer> writer;
+  TF_CHECK_OK(columnar_util::Writer::Create(Env::Default(), prefix, schema,
+                                            /*row_group_size=*/2, &writer));
+  for (int64 i = 0; i < 3; ++i) {
+    TF_CHECK_OK(writer->Write(TestExample(i)));
+  }
+  TF_CHECK_OK(writer->Close());
+  return prefix;
+}
+
+// Writes a file with one row group of two rows, whose sparse feature "tags"
+// has row splits that do not end at the number of values.
+tstring CorruptTestFile() {
+  tstring prefix = io::JoinPath(testing::TmpDir(), kCorruptFileName);
+  BundleWriter writer(Env::Default(), prefix);
+  TF_CHECK_OK(writer.Add(columnar_util::kRowGroupsKey,
+                         CreateTensor<int64>(TensorShape({1}), {2})));
+  TF_CHECK_OK(writer.Add(columnar_util::SparseValuesChunkKey("tags", 0),
+                         CreateTensor<tstring>(TensorShape({1}), {"t0"})));
+  TF_CHECK_OK(writer.Add(columnar_util::SparseRowSplitsChunkKey("tags", 0),
+                         CreateTensor<int64>(TensorShape({3}), {0, 1, 5})));
+  TF_CHECK_OK(writer.Finish());
+  return prefix;
+}
+
+ColumnarExampleDatasetParams AllFeaturesParams() {
+  return {/*filenames=*/{TestFile()},
+          /*sparse_keys=*/{"tags"},
+          /*sparse_types=*/{DT_STRING},
+          /*dense_keys=*/{"label", "embedding"},
+          /*dense_types=*/{DT_INT64, DT_FLOAT},
+          /*dense_shapes=*/{PartialTensorShape({}), PartialTensorShape({2})},
+          /*node_name=*/kNodeName};
+}
+
+ColumnarExampleDatasetParams DenseFeaturesParams() {
+  return {/*filenames=*/{TestFile()},
+          /*sparse_keys=*/{},
+          /*sparse_types=*/{},
+          /*dense_keys=*/{"label", "embedding"},
+          /*dense_types=*/{DT_INT64, DT_FLOAT},
+          /*dense_shapes=*/{PartialTensorShape({}), PartialTensorShape({2})},
+          /*node_name=*/kNodeName};
+}
+
+ColumnarExampleDatasetParams SparseFeaturesParams() {
+  return {/*filenames=*/{TestFile()},
+          /*sparse_keys=*/{"tags"},
+          /*sparse_types=*/{DT_STRING},
+          /*dense_keys=*/{},
+          /*dense_types=*/{},
+          /*dense_shapes=*/{},
+          /*node_name=*/kNodeName};
+}
+
+// Reads only one of the features, from two copies of the file.
+ColumnarExampleDatasetParams ProjectionParams() {
+  return {/*filenames=*/{TestFile(), TestFile()},
+          /*sparse_keys=*/{},
+          /*sparse_types=*/{},
+          /*dense_keys=*/{"embedding"},
+          /*dense_types=*/{DT_FLOAT},
+          /*dense_shapes=*/{PartialTensorShape({2})},
+          /*node_name=*/kNodeName};
+}
+
+ColumnarExampleDatasetParams CorruptRowSplitsParams() {
+  return {/*filenames=*/{CorruptTestFile()},
+          /*sparse_keys=*/{"tags"},
+          /*sparse_types=*/{DT_STRING},
+          /*dense_keys=*/{},
+          /*dense_types=*/{},
+          /*dense_shapes=*/{},
+          /*node_name=*/kNodeName};
+}
+
+std::vector<Tensor> LabelOutputs() {
+  return {CreateTensor<int64>(TensorShape({2}), {0, 1}),
+          CreateTensor<int64>(TensorShape({1}), {2})};
+}
+
+std::vector<Tensor> EmbeddingOutputs() {
+  return {CreateTensor<float>(TensorShape({2, 2}), {0, 0, 1, -1}),
+          CreateTensor<float>(TensorShape({1, 2}), {2, -2})};
+}
+
+// The indices, values and dense shape of "tags" in each row group.
+std::vector<std::vector<Tensor>> TagsOutputs() {
+  return {{CreateTensor<int64>(TensorShape({1, 2}), {1, 0}),
+           CreateTensor<tstring>(TensorShape({1}), {"t0"}),
+           CreateTensor<int64>(TensorShape({2}), {2, 1})},
+          {CreateTensor<int64>(TensorShape({2, 2}), {0, 0, 0, 1}),
+           CreateTensor<tstring>(TensorShape({2}), {"t0", "t1"}),
+           CreateTensor<int64>(TensorShape({2}), {1, 2})}};
+}
+
+std::vector<GetNextTestCase<ColumnarExampleDatasetParams>>
+GetNextTestCases() {
+  const std::vector<Tensor> labels = LabelOutputs();
+  const std::vector<Tensor> embeddings = EmbeddingOutputs();
+  const std::vector<std::vector<Tensor>> tags = TagsOutputs();
+  return {{/*dataset_params=*/AllFeaturesParams(),
+           /*expected_outputs=*/{tags[0][0], tags[0][1], tags[0][2], labels[0],
+                                 embeddings[0], tags[1][0], tags[1][1],
+                                 tags[1][2], labels[1], embeddings[1]}},
+          {/*dataset_params=*/DenseFeaturesParams(),
+           /*expected_outputs=*/{labels[0], embeddings[0], labels[1],
+                                 embeddings[1]}},
+          {/*dataset_params=*/SparseFeaturesParams(),
+           /*expected_outputs=*/{tags[0][0], tags[0][1], tags[0][2],
+                                 tags[1][0], tags[1][1], tags[1][2]}},
+          {/*dataset_params=*/ProjectionParams(),
+           /*expected_outputs=*/{embeddings[0], embeddings[1], embeddings[0],
+                                 embeddings[1]}}};
+}
+
+ITERATOR_GET_NEXT_TEST_P(ColumnarExampleDatasetOpTest,
+                         ColumnarExampleDatasetParams, GetNextTestCases());
+
+TEST_F(ColumnarExampleDatasetOpTest, CorruptRowSplits) {
+  auto dataset_params = CorruptRowSplitsParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(
+      iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence)
+          .code(),
+      error::DATA_LOSS);
+}
+
+TEST_F(ColumnarExampleDatasetOpTest, DatasetNodeName) {
+  auto dataset_params = AllFeaturesParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetNodeName(dataset_params.node_name()));
+}
+
+TEST_F(ColumnarExampleDatasetOpTest, DatasetTypeString) {
+  auto dataset_params = AllFeaturesParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetTypeString(
+      name_utils::OpName(ColumnarExampleDatasetOp::kDatasetType)));
+}
+
+TEST_F(ColumnarExampleDatasetOpTest, IteratorOutputPrefix) {
+  auto dataset_params = AllFeaturesParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckIteratorPrefix(name_utils::IteratorPrefix(
+      ColumnarExampleDatasetOp::kDatasetType, kIteratorPrefix)));
+}
+
+std::vector<IteratorSaveAndRestoreTestCase<ColumnarExampleDatasetParams>>
+IteratorSaveAndRestoreTestCases() {
+  const std::vector<Tensor> embeddings = EmbeddingOutputs();
+  return {{/*dataset_params=*/ProjectionParams(),
+           /*breakpoints=*/{0, 1, 3, 5},
+           /*expected_outputs=*/{embeddings[0], embeddings[1], embeddings[0],
+                                 embeddings[1]}}};
+}
+
+ITERATOR_SAVE_AND_RESTORE_TEST_P(ColumnarExampleDatasetOpTest,
+                                 ColumnarExampleDatasetParams,
+                                 IteratorSaveAndRestoreTestCases());
+
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
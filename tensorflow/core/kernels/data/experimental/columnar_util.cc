@@ -0,0 +1,299 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/columnar_util.h"
+
+#include <algorithm>
+
+#include "absl/memory/memory.h"
+#include "tensorflow/core/example/feature.pb.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/strcat.h"
+
+namespace tensorflow {
+namespace data {
+namespace columnar_util {
+namespace {
+
+// Returns the number of values of `feature`, which must hold values of type
+// `dtype`.
+Status NumValues(const std::string& key, const Feature& feature,
+                 DataType dtype, int64* num_values) {
+  switch (dtype) {
+    case DT_INT64:
+      if (feature.kind_case() == Feature::kInt64List) {
+        *num_values = feature.int64_list().value_size();
+        return Status::OK();
+      }
+      break;
+    case DT_FLOAT:
+      if (feature.kind_case() == Feature::kFloatList) {
+        *num_values = feature.float_list().value_size();
+        return Status::OK();
+      }
+      break;
+    case DT_STRING:
+      if (feature.kind_case() == Feature::kBytesList) {
+        *num_values = feature.bytes_list().value_size();
+        return Status::OK();
+      }
+      break;
+    default:
+      return errors::InvalidArgument("Unsupported type ", DataTypeString(dtype),
+                                     " for feature ", key);
+  }
+  if (feature.kind_case() == Feature::KIND_NOT_SET) {
+    *num_values = 0;
+    return Status::OK();
+  }
+  return errors::InvalidArgument("Feature ", key, " does not hold values of ",
+                                 "type ", DataTypeString(dtype));
+}
+
+// Copies the values of `feature` to the flat `out` tensor, starting at
+// `offset`. The type of `feature` must have been validated by `NumValues`.
+void CopyValues(const Feature& feature, DataType dtype, int64 offset,
+                Tensor* out) {
+  switch (dtype) {
+    case DT_INT64:
+      std::copy(feature.int64_list().value().begin(),
+                feature.int64_list().value().end(),
+                out->flat<int64>().data() + offset);
+      break;
+    case DT_FLOAT:
+      std::copy(feature.float_list().value().begin(),
+                feature.float_list().value().end(),
+                out->flat<float>().data() + offset);
+      break;
+    case DT_STRING:
+      std::copy(feature.bytes_list().value().begin(),
+                feature.bytes_list().value().end(),
+                out->flat<tstring>().data() + offset);
+      break;
+    default:
+      break;
+  }
+}
+
+}  // namespace
+
+std::string DenseChunkKey(const std::string& key, int64 row_group) {
+  return strings::StrCat(key, "/", row_group);
+}
+
+std::string SparseValuesChunkKey(const std::string& key, int64 row_group) {
+  return strings::StrCat(key, "/", row_group, "/values");
+}
+
+std::string SparseRowSplitsChunkKey(const std::string& key, int64 row_group) {
+  return strings::StrCat(key, "/", row_group, "/row_splits");
+}
+
+Status Writer::Create(Env* env, const std::string& prefix,
+                      const Schema& schema, int64 row_group_size,
+                      std::unique_ptr<Writer>* out_writer) {
+  if (row_group_size <= 0) {
+    return errors::InvalidArgument("`row_group_size` must be positive, got ",
+                                   row_group_size);
+  }
+  if (schema.dense_keys.size() != schema.dense_types.size() ||
+      schema.dense_keys.size() != schema.dense_shapes.size() ||
+      schema.sparse_keys.size() != schema.sparse_types.size()) {
+    return errors::InvalidArgument(
+        "The schema must have one type (and shape) per feature key");
+  }
+  std::unique_ptr<Writer> writer(
+      new Writer(env, prefix, schema, row_group_size));
+  TF_RETURN_IF_ERROR(writer->bundle_writer_.status());
+  *out_writer = std::move(writer);
+  return Status::OK();
+}
+
+Writer::Writer(Env* env, const std::string& prefix, const Schema& schema,
+               int64 row_group_size)
+    : bundle_writer_(env, prefix),
+      schema_(schema),
+      row_group_size_(row_group_size) {}
+
+Status Writer::Write(const Example& example) {
+  rows_.push_back(example);
+  if (static_cast<int64>(rows_.size()) == row_group_size_) {
+    return FlushRowGroup();
+  }
+  return Status::OK();
+}
+
+Status Writer::Close() {
+  if (!rows_.empty()) {
+    TF_RETURN_IF_ERROR(FlushRowGroup());
+  }
+  Tensor row_group_sizes(DT_INT64,
+                         TensorShape({static_cast<int64>(
+                             row_group_sizes_.size())}));
+  std::copy(row_group_sizes_.begin(), row_group_sizes_.end(),
+            row_group_sizes.flat<int64>().data());
+  TF_RETURN_IF_ERROR(bundle_writer_.Add(kRowGroupsKey, row_group_sizes));
+  return bundle_writer_.Finish();
+}
+
+Status Writer::FlushRowGroup() {
+  const int64 row_group = row_group_sizes_.size();
+  const int64 num_rows = rows_.size();
+
+  for (size_t i = 0; i < schema_.dense_keys.size(); ++i) {
+    const std::string& key = schema_.dense_keys[i];
+    const DataType dtype = schema_.dense_types[i];
+    const int64 row_size = schema_.dense_shapes[i].num_elements();
+    TensorShape chunk_shape({num_rows});
+    chunk_shape.AppendShape(schema_.dense_shapes[i]);
+    Tensor chunk(dtype, chunk_shape);
+    for (int64 row = 0; row < num_rows; ++row) {
+      const auto& features = rows_[row].features().feature();
+      auto it = features.find(key);
+      if (it == features.end()) {
+        return errors::InvalidArgument("Dense feature ", key,
+                                       " is missing from an example");
+      }
+      int64 num_values;
+      TF_RETURN_IF_ERROR(NumValues(key, it->second, dtype, &num_values));
+      if (num_values != row_size) {
+        return errors::InvalidArgument(
+            "Dense feature ", key, " has ", num_values, " values, expected ",
+            row_size, " for shape ", schema_.dense_shapes[i].DebugString());
+      }
+      CopyValues(it->second, dtype, row * row_size, &chunk);
+    }
+    TF_RETURN_IF_ERROR(
+        bundle_writer_.Add(DenseChunkKey(key, row_group), chunk));
+  }
+
+  for (size_t i = 0; i < schema_.sparse_keys.size(); ++i) {
+    const std::string& key = schema_.sparse_keys[i];
+    const DataType dtype = schema_.sparse_types[i];
+    Tensor row_splits(DT_INT64, TensorShape({num_rows + 1}));
+    auto row_splits_flat = row_splits.flat<int64>();
+    row_splits_flat(0) = 0;
+    for (int64 row = 0; row < num_rows; ++row) {
+      const auto& features = rows_[row].features().feature();
+      auto it = features.find(key);
+      int64 num_values = 0;
+      if (it != features.end()) {
+        TF_RETURN_IF_ERROR(NumValues(key, it->second, dtype, &num_values));
+      }
+      row_splits_flat(row + 1) = row_splits_flat(row) + num_values;
+    }
+    Tensor values(dtype, TensorShape({row_splits_flat(num_rows)}));
+    for (int64 row = 0; row < num_rows; ++row) {
+      const auto& features = rows_[row].features().feature();
+      auto it = features.find(key);
+      if (it != features.end()) {
+        CopyValues(it->second, dtype, row_splits_flat(row), &values);
+      }
+    }
+    TF_RETURN_IF_ERROR(
+        bundle_writer_.Add(SparseValuesChunkKey(key, row_group), values));
+    TF_RETURN_IF_ERROR(bundle_writer_.Add(
+        SparseRowSplitsChunkKey(key, row_group), row_splits));
+  }
+
+  row_group_sizes_.push_back(num_rows);
+  rows_.clear();
+  return Status::OK();
+}
+
+Status Reader::Create(Env* env, const std::string& prefix,
+                      std::unique_ptr<Reader>* out_reader) {
+  auto bundle_reader = absl::make_unique<BundleReader>(env, prefix);
+  TF_RETURN_IF_ERROR(bundle_reader->status());
+  std::unique_ptr<Reader> reader(new Reader(std::move(bundle_reader)));
+  Tensor row_group_sizes;
+  TF_RETURN_IF_ERROR(reader->ReadChunk(kRowGroupsKey, DT_INT64,
+                                       cpu_allocator(), &row_group_sizes));
+  auto row_group_sizes_flat = row_group_sizes.flat<int64>();
+  for (int64 i = 0; i < row_group_sizes_flat.size(); ++i) {
+    if (row_group_sizes_flat(i) < 0) {
+      return errors::DataLoss("Row group ", i, " of ", prefix,
+                              " has negative size ", row_group_sizes_flat(i));
+    }
+  }
+  reader->row_group_sizes_.assign(
+      row_group_sizes_flat.data(),
+      row_group_sizes_flat.data() + row_group_sizes_flat.size());
+  *out_reader = std::move(reader);
+  return Status::OK();
+}
+
+Reader::Reader(std::unique_ptr<BundleReader> bundle_reader)
+    : bundle_reader_(std::move(bundle_reader)) {}
+
+Status Reader::ReadDense(const std::string& key, int64 row_group,
+                         DataType dtype, Allocator* allocator, Tensor* out) {
+  return ReadChunk(DenseChunkKey(key, row_group), dtype, allocator, out);
+}
+
+Status Reader::ReadSparse(const std::string& key, int64 row_group,
+                          DataType dtype, Allocator* allocator, Tensor* values,
+                          Tensor* row_splits) {
+  TF_RETURN_IF_ERROR(ReadChunk(SparseValuesChunkKey(key, row_group), dtype,
+                               allocator, values));
+  TF_RETURN_IF_ERROR(ReadChunk(SparseRowSplitsChunkKey(key, row_group),
+                               DT_INT64, allocator, row_splits));
+  if (row_splits->dims() != 1 ||
+      row_splits->NumElements() != row_group_size(row_group) + 1) {
+    return errors::DataLoss("Row splits of sparse feature ", key,
+                            " do not match the size of row group ", row_group);
+  }
+  // The row splits are used to index the values, so they must be validated
+  // before they are trusted.
+  auto row_splits_flat = row_splits->flat<int64>();
+  if (row_splits_flat(0) != 0) {
+    return errors::DataLoss("Row splits of sparse feature ", key,
+                            " in row group ", row_group,
+                            " do not start at 0, got ", row_splits_flat(0));
+  }
+  for (int64 i = 1; i < row_splits_flat.size(); ++i) {
+    if (row_splits_flat(i) < row_splits_flat(i - 1)) {
+      return errors::DataLoss("Row splits of sparse feature ", key,
+                              " in row group ", row_group,
+                              " are not non-decreasing at index ", i);
+    }
+  }
+  const int64 last_split = row_splits_flat(row_splits_flat.size() - 1);
+  if (values->dims() != 1 || last_split != values->NumElements()) {
+    return errors::DataLoss("Row splits of sparse feature ", key,
+                            " in row group ", row_group, " end at ",
+                            last_split, ", but there are ",
+                            values->NumElements(), " values");
+  }
+  return Status::OK();
+}
+
+Status Reader::ReadChunk(const std::string& chunk_key, DataType dtype,
+                         Allocator* allocator, Tensor* out) {
+  DataType stored_dtype;
+  TensorShape shape;
+  TF_RETURN_IF_ERROR(
+      bundle_reader_->LookupDtypeAndShape(chunk_key, &stored_dtype, &shape));
+  if (stored_dtype != dtype) {
+    return errors::InvalidArgument("Column chunk ", chunk_key, " has type ",
+                                   DataTypeString(stored_dtype), ", expected ",
+                                   DataTypeString(dtype));
+  }
+  *out = Tensor(allocator, dtype, shape);
+  return bundle_reader_->Lookup(chunk_key, out);
+}
+
+}  // namespace columnar_util
+}  // namespace data
+}  // namespace tensorflow
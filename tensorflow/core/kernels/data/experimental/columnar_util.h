@@ -0,0 +1,132 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_EXPERIMENTAL_COLUMNAR_UTIL_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_EXPERIMENTAL_COLUMNAR_UTIL_H_
+
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/example/example.pb.h"
+#include "tensorflow/core/framework/allocator.h"
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/framework/tensor_shape.h"
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/status.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
+
+namespace tensorflow {
+namespace data {
+namespace columnar_util {
+
+// A columnar file stores a sequence of `tf.Example` records as a tensor bundle
+// (see tensorflow/core/util/tensor_bundle/tensor_bundle.h). Rows are split into
+// row groups, and every feature of every row group is stored as a separate
+// column chunk, so that a reader that needs only some of the features reads
+// only the chunks of those features. The bundle contains the entries:
+//
+//   "_row_groups"                 int64 [num_row_groups], rows per group
+//   "<key>/<group>"               dense feature, [rows, <dense shape>]
+//   "<key>/<group>/values"        sparse feature, values of all rows
+//   "<key>/<group>/row_splits"    sparse feature, int64 [rows + 1]
+//
+// Supported feature types are DT_INT64, DT_FLOAT and DT_STRING.
+
+constexpr char kRowGroupsKey[] = "_row_groups";
+
+// Returns the bundle key of the dense column chunk of `key` in `row_group`.
+std::string DenseChunkKey(const std::string& key, int64 row_group);
+
+// Returns the bundle keys of the values and row splits column chunks of the
+// sparse feature `key` in `row_group`.
+std::string SparseValuesChunkKey(const std::string& key, int64 row_group);
+std::string SparseRowSplitsChunkKey(const std::string& key, int64 row_group);
+
+// The features stored in a columnar file.
+struct Schema {
+  std::vector<std::string> dense_keys;
+  DataTypeVector dense_types;
+  std::vector<TensorShape> dense_shapes;
+  std::vector<std::string> sparse_keys;
+  DataTypeVector sparse_types;
+};
+
+// Writes `tf.Example` records to a columnar file.
+class Writer {
+ public:
+  // Creates a writer for the columnar file at `prefix`, which buffers
+  // `row_group_size` examples before writing them out as a row group.
+  static Status Create(Env* env, const std::string& prefix,
+                       const Schema& schema, int64 row_group_size,
+                       std::unique_ptr<Writer>* out_writer);
+
+  // Adds an example. Every dense feature of the schema must be present with
+  // exactly as many values as its shape has elements.
+  Status Write(const Example& example);
+
+  // Writes the last, possibly partial, row group and finishes the file.
+  Status Close();
+
+ private:
+  Writer(Env* env, const std::string& prefix, const Schema& schema,
+         int64 row_group_size);
+
+  Status FlushRowGroup();
+
+  BundleWriter bundle_writer_;
+  const Schema schema_;
+  const int64 row_group_size_;
+  std::vector<Example> rows_;
+  std::vector<int64> row_group_sizes_;
+};
+
+// Reads column chunks from a columnar file.
+class Reader {
+ public:
+  static Status Create(Env* env, const std::string& prefix,
+                       std::unique_ptr<Reader>* out_reader);
+
+  int64 num_row_groups() const { return row_group_sizes_.size(); }
+
+  int64 row_group_size(int64 row_group) const {
+    return row_group_sizes_[row_group];
+  }
+
+  // Reads the dense column chunk of `key` in `row_group` into `out`, which is
+  // allocated with `allocator`. Only the bytes of the chunk are read.
+  Status ReadDense(const std::string& key, int64 row_group, DataType dtype,
+                   Allocator* allocator, Tensor* out);
+
+  // Reads the values and row splits column chunks of the sparse feature `key`
+  // in `row_group`. Returns `DataLoss` unless the row splits start at 0, are
+  // non-decreasing and end at the number of values.
+  Status ReadSparse(const std::string& key, int64 row_group, DataType dtype,
+                    Allocator* allocator, Tensor* values, Tensor* row_splits);
+
+ private:
+  explicit Reader(std::unique_ptr<BundleReader> bundle_reader);
+
+  Status ReadChunk(const std::string& chunk_key, DataType dtype,
+                   Allocator* allocator, Tensor* out);
+
+  const std::unique_ptr<BundleReader> bundle_reader_;
+  std::vector<int64> row_group_sizes_;
+};
+
+}  // namespace columnar_util
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_EXPERIMENTAL_COLUMNAR_UTIL_H_
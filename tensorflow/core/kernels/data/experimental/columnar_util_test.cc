@@ -0,0 +1,175 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/columnar_util.h"
+
+#include "tensorflow/core/example/example.pb.h"
+#include "tensorflow/core/framework/tensor_testutil.h"
+#include "tensorflow/core/lib/core/status_test_util.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/path.h"
+#include "tensorflow/core/platform/test.h"
+#include "tensorflow/core/util/tensor_bundle/tensor_bundle.h"
+
+namespace tensorflow {
+namespace data {
+namespace columnar_util {
+namespace {
+
+Schema TestSchema() {
+  Schema schema;
+  schema.dense_keys = {"label", "embedding"};
+  schema.dense_types = {DT_INT64, DT_FLOAT};
+  schema.dense_shapes = {TensorShape({}), TensorShape({2})};
+  schema.sparse_keys = {"tags"};
+  schema.sparse_types = {DT_STRING};
+  return schema;
+}
+
+// Returns an example with label `i`, embedding `[i, -i]` and `i` tags.
+Example TestExample(int64 i) {
+  Example example;
+  auto& features = *example.mutable_features()->mutable_feature();
+  features["label"].mutable_int64_list()->add_value(i);
+  features["embedding"].mutable_float_list()->add_value(i);
+  features["embedding"].mutable_float_list()->add_value(-i);
+  for (int64 j = 0; j < i; ++j) {
+    features["tags"].mutable_bytes_list()->add_value(strings::StrCat("t", j));
+  }
+  return example;
+}
+
+Status WriteTestFile(const string& prefix, int64 num_rows,
+                     int64 row_group_size) {
+  std::unique_ptr<Writer> writer;
+  TF_RETURN_IF_ERROR(Writer::Create(Env::Default(), prefix, TestSchema(),
+                                    row_group_size, &writer));
+  for (int64 i = 0; i < num_rows; ++i) {
+    TF_RETURN_IF_ERROR(writer->Write(TestExample(i)));
+  }
+  return writer->Close();
+}
+
+TEST(ColumnarUtilTest, RowGroups) {
+  string prefix = io::JoinPath(testing::TmpDir(), "columnar_row_groups");
+  TF_ASSERT_OK(WriteTestFile(prefix, /*num_rows=*/5, /*row_group_size=*/2));
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), prefix, &reader));
+  ASSERT_EQ(reader->num_row_groups(), 3);
+  EXPECT_EQ(reader->row_group_size(0), 2);
+  EXPECT_EQ(reader->row_group_size(1), 2);
+  EXPECT_EQ(reader->row_group_size(2), 1);
+}
+
+TEST(ColumnarUtilTest, ReadDense) {
+  string prefix = io::JoinPath(testing::TmpDir(), "columnar_dense");
+  TF_ASSERT_OK(WriteTestFile(prefix, /*num_rows=*/4, /*row_group_size=*/2));
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), prefix, &reader));
+  Tensor label;
+  TF_ASSERT_OK(reader->ReadDense("label", /*row_group=*/1, DT_INT64,
+                                 cpu_allocator(), &label));
+  test::ExpectTensorEqual<int64>(label, test::AsTensor<int64>({2, 3}));
+  Tensor embedding;
+  TF_ASSERT_OK(reader->ReadDense("embedding", /*row_group=*/1, DT_FLOAT,
+                                 cpu_allocator(), &embedding));
+  test::ExpectTensorEqual<float>(
+      embedding, test::AsTensor<float>({2, -2, 3, -3}, TensorShape({2, 2})));
+}
+
+TEST(ColumnarUtilTest, ReadSparse) {
+  string prefix = io::JoinPath(testing::TmpDir(), "columnar_sparse");
+  TF_ASSERT_OK(WriteTestFile(prefix, /*num_rows=*/4, /*row_group_size=*/2));
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), prefix, &reader));
+  Tensor values;
+  Tensor row_splits;
+  TF_ASSERT_OK(reader->ReadSparse("tags", /*row_group=*/1, DT_STRING,
+                                  cpu_allocator(), &values, &row_splits));
+  test::ExpectTensorEqual<tstring>(
+      values, test::AsTensor<tstring>({"t0", "t1", "t0", "t1", "t2"}));
+  test::ExpectTensorEqual<int64>(row_splits,
+                                 test::AsTensor<int64>({0, 2, 5}));
+}
+
+// Writes a file with one row group of 2 rows, whose sparse feature "tags" has
+// the given values and row splits.
+Status WriteSparseChunks(const string& prefix, const Tensor& values,
+                         const Tensor& row_splits) {
+  BundleWriter writer(Env::Default(), prefix);
+  TF_RETURN_IF_ERROR(writer.Add(kRowGroupsKey, test::AsTensor<int64>({2})));
+  TF_RETURN_IF_ERROR(writer.Add(SparseValuesChunkKey("tags", 0), values));
+  TF_RETURN_IF_ERROR(
+      writer.Add(SparseRowSplitsChunkKey("tags", 0), row_splits));
+  return writer.Finish();
+}
+
+TEST(ColumnarUtilTest, ReadSparseCorruptRowSplits) {
+  const Tensor values = test::AsTensor<tstring>({"t0", "t1", "t2"});
+  const std::vector<Tensor> corrupt_row_splits = {
+      // Does not start at 0.
+      test::AsTensor<int64>({1, 2, 3}),
+      // Decreasing.
+      test::AsTensor<int64>({0, 3, 2}),
+      // Ends before the last value.
+      test::AsTensor<int64>({0, 1, 2}),
+      // Ends after the last value.
+      test::AsTensor<int64>({0, 1, 4}),
+      // Too many rows.
+      test::AsTensor<int64>({0, 1, 2, 3}),
+  };
+  for (size_t i = 0; i < corrupt_row_splits.size(); ++i) {
+    string prefix = io::JoinPath(testing::TmpDir(),
+                                 strings::StrCat("columnar_corrupt_", i));
+    TF_ASSERT_OK(WriteSparseChunks(prefix, values, corrupt_row_splits[i]));
+
+    std::unique_ptr<Reader> reader;
+    TF_ASSERT_OK(Reader::Create(Env::Default(), prefix, &reader));
+    Tensor read_values;
+    Tensor read_row_splits;
+    EXPECT_TRUE(errors::IsDataLoss(
+        reader->ReadSparse("tags", /*row_group=*/0, DT_STRING,
+                           cpu_allocator(), &read_values, &read_row_splits)))
+        << "Row splits: " << corrupt_row_splits[i].DebugString();
+  }
+}
+
+TEST(ColumnarUtilTest, ReadWrongType) {
+  string prefix = io::JoinPath(testing::TmpDir(), "columnar_wrong_type");
+  TF_ASSERT_OK(WriteTestFile(prefix, /*num_rows=*/2, /*row_group_size=*/2));
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), prefix, &reader));
+  Tensor label;
+  EXPECT_TRUE(errors::IsInvalidArgument(reader->ReadDense(
+      "label", /*row_group=*/0, DT_FLOAT, cpu_allocator(), &label)));
+}
+
+TEST(ColumnarUtilTest, WriteMissingDenseFeature) {
+  string prefix = io::JoinPath(testing::TmpDir(), "columnar_missing");
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), prefix, TestSchema(),
+                              /*row_group_size=*/1, &writer));
+  Example example = TestExample(1);
+  example.mutable_features()->mutable_feature()->erase("label");
+  EXPECT_TRUE(errors::IsInvalidArgument(writer->Write(example)));
+}
+
+}  // namespace
+}  // namespace columnar_util
+}  // namespace data
+}  // namespace tensorflow
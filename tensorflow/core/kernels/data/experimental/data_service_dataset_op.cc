@@ -34,6 +34,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/serialization_utils.h"
 #include "tensorflow/core/lib/core/errors.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
+#include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/platform/errors.h"
 #include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/snappy.h"
@@ -53,6 +54,9 @@ namespace data {
     DataServiceDatasetOp::kMaxOutstandingRequests;
 /* static */ constexpr const char* const
     DataServiceDatasetOp::kIterationCounter;
+/* static */ constexpr const char* const DataServiceDatasetOp::kClientLocality;
+/* static */ constexpr const char* const DataServiceDatasetOp::kNumConsumers;
+/* static */ constexpr const char* const DataServiceDatasetOp::kConsumerIndex;
 /* static */ constexpr const char* const DataServiceDatasetOp::kOutputTypes;
 /* static */ constexpr const char* const DataServiceDatasetOp::kOutputShapes;
 
@@ -77,7 +81,9 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
           ProcessingMode processing_mode, const std::string& address,
           const std::string& protocol, const std::string& job_name,
           int64 max_outstanding_requests, int64 task_refresh_interval_ms,
-          IterationCounter* iteration_counter, bool owns_resource,
+          const std::string& client_locality, int64 num_consumers,
+          int64 consumer_index, IterationCounter* iteration_counter,
+          bool owns_resource,
           ResourceHandle iteration_counter_handle,
           const DataTypeVector& output_types,
           const std::vector<PartialTensorShape>& output_shapes)
@@ -89,6 +95,9 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
         job_name_(job_name),
         max_outstanding_requests_(max_outstanding_requests),
         task_refresh_interval_ms_(task_refresh_interval_ms),
+        client_locality_(client_locality),
+        num_consumers_(num_consumers),
+        consumer_index_(consumer_index),
         iteration_counter_(iteration_counter),
         owns_resource_(owns_resource),
         iteration_counter_handle_(iteration_counter_handle),
@@ -165,12 +174,24 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
     b->BuildAttrValue(task_refresh_interval_ms_,
                       &task_refresh_interval_hint_ms);
 
+    AttrValue client_locality;
+    b->BuildAttrValue(client_locality_, &client_locality);
+
+    AttrValue num_consumers;
+    b->BuildAttrValue(num_consumers_, &num_consumers);
+
+    AttrValue consumer_index;
+    b->BuildAttrValue(consumer_index_, &consumer_index);
+
     TF_RETURN_IF_ERROR(
         b->AddDataset(this,
                       {dataset_id, processing_mode, address, protocol, job_name,
                        max_outstanding_requests, iteration_counter_handle},
                       {std::make_pair(kTaskRefreshIntervalHintMs,
-                                      task_refresh_interval_hint_ms)},
+                                      task_refresh_interval_hint_ms),
+                       std::make_pair(kClientLocality, client_locality),
+                       std::make_pair(kNumConsumers, num_consumers),
+                       std::make_pair(kConsumerIndex, consumer_index)},
                       output));
     return Status::OK();
   }
@@ -189,6 +210,11 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
       VLOG(1) << "Destroying data service dataset iterator for job id "
               << job_id_;
       cancelled_ = true;
+      for (const auto& task : tasks_) {
+        if (task->stream) {
+          task->stream->Cancel();
+        }
+      }
       worker_thread_cv_.notify_all();
       manager_thread_cv_.notify_all();
       get_next_cv_.notify_all();
@@ -206,7 +232,8 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
       } else {
         TF_RETURN_IF_ERROR(master.GetOrCreateJob(
             dataset()->dataset_id_, dataset()->processing_mode_,
-            dataset()->job_name_, iterator_index_, &job_id_));
+            dataset()->job_name_, iterator_index_, dataset()->num_consumers_,
+            &job_id_));
       }
       VLOG(1) << "Created data service job with id " << job_id_;
       return Status::OK();
@@ -266,19 +293,46 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
 
    private:
     struct Task {
-      Task(int64 task_id, const std::string& address,
+      Task(int64 task_id, const std::string& address, bool local,
            std::unique_ptr<DataServiceWorkerClient> worker)
-          : task_id(task_id), address(address), worker(std::move(worker)) {}
+          : task_id(task_id),
+            address(address),
+            local(local),
+            worker(std::move(worker)),
+            stream_id(NewStreamId()) {}
+
+      // Returns a random non-zero id for the task's element stream.
+      static int64 NewStreamId() {
+        int64 id;
+        do {
+          id = static_cast<int64>(random::New64());
+        } while (id == 0);
+        return id;
+      }
 
       const int64 task_id;
       // Address of the tf.data service worker for task `task_id`.
       const std::string address;
+      // Whether the worker is in the client's locality.
+      const bool local;
       // Client for fetching task elements from the tf.data service worker.
       const std::unique_ptr<DataServiceWorkerClient> worker;
       // Indicates whether a worker thread is currently processing the task.
       bool in_use TF_GUARDED_BY(&Iterator::mu_) = false;
       // Indicates whether the worker has returned end_of_sequence for the task.
       bool end_of_sequence TF_GUARDED_BY(&Iterator::mu_) = false;
+      // Identifies the task's element stream to the worker, so that the
+      // stream can be resumed after errors.
+      const int64 stream_id;
+      // Stream of the task's elements. Opened on first use, and resumed at
+      // `next_element_index` after errors.
+      std::unique_ptr<DataServiceWorkerClient::ElementStream> stream
+          TF_GUARDED_BY(&Iterator::mu_);
+      // The index in the stream of the next element to receive.
+      int64 next_element_index TF_GUARDED_BY(&Iterator::mu_) = 0;
+      // Indicates whether the worker predates element streaming, in which
+      // case elements are fetched with one GetElement RPC each.
+      bool streaming_unsupported TF_GUARDED_BY(&Iterator::mu_) = false;
     };
 
     // Periodically refresh the task list.
@@ -357,8 +411,13 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
           get_next_cv_.notify_all();
           continue;
         }
-        tasks_.push_back(std::make_shared<Task>(
-            task_info.id(), task_info.worker_address(), std::move(worker)));
+        // Without a client locality, all workers are treated as local.
+        const bool local = dataset()->client_locality_.empty() ||
+                           task_info.worker_locality() ==
+                               dataset()->client_locality_;
+        tasks_.push_back(std::make_shared<Task>(task_info.id(),
+                                                task_info.worker_address(),
+                                                local, std::move(worker)));
       }
       if (dataset()->max_outstanding_requests_ == model::kAutotune) {
         // Adjust max_outstanding_requests to account for newly added tasks.
@@ -368,7 +427,12 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
 
     void UpdateWorkerThreads(IteratorContext* ctx) LOCKS_EXCLUDED(mu_) {
       mutex_lock l(mu_);
-      while (num_running_worker_threads_ < max_outstanding_requests_) {
+      // A thread fetches from one task at a time, so more threads than tasks
+      // would never run. Latency is hidden by the window of each task's
+      // element stream instead.
+      const int64 max_worker_threads = std::min<int64>(
+          max_outstanding_requests_, static_cast<int64>(tasks_.size()));
+      while (num_running_worker_threads_ < max_worker_threads) {
         num_running_worker_threads_++;
         outstanding_requests_++;
         auto done = [this]() {
@@ -397,7 +461,13 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
             worker_thread_cv_.notify_one();
           }
           outstanding_requests_--;
-          while (!cancelled_ && !(SpaceInBuffer() && TaskAvailable())) {
+          while (!cancelled_) {
+            if (SpaceInBuffer()) {
+              task_to_process = SelectTask();
+              if (task_to_process) {
+                break;
+              }
+            }
             if (VLOG_IS_ON(3)) {
               VLOG(3) << "Sleeping with results_.size=" << results_.size()
                       << ", outstanding_requests_=" << outstanding_requests_
@@ -412,19 +482,7 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
             return;
           }
           outstanding_requests_++;
-          // Search for a task to update.
-          int num_tasks = tasks_.size();
-          for (int i = 0; i < num_tasks; ++i) {
-            int index = (next_task_index_ + i) % num_tasks;
-            std::shared_ptr<Task>& task = tasks_[index];
-            if (!task->in_use && !task->end_of_sequence) {
-              task->in_use = true;
-              task_to_process = task;
-              next_task_index_ = (index + 1) % num_tasks;
-              break;
-            }
-          }
-          DCHECK(task_to_process != nullptr);
+          task_to_process->in_use = true;
           VLOG(3) << "Processing task " << task_to_process->task_id;
         }
         int64 deadline_micros =
@@ -452,8 +510,7 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
       CompressedElement compressed;
       bool end_of_sequence;
       for (int num_retries = 0;; ++num_retries) {
-        Status s = task->worker->GetElement(task->task_id, &compressed,
-                                            &end_of_sequence);
+        Status s = FetchElement(task, &compressed, &end_of_sequence);
         if (s.ok()) {
           break;
         }
@@ -512,6 +569,63 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
       return Status::OK();
     }
 
+    // Fetches the next element of `task` from the task's element stream, or
+    // with a GetElement RPC if the worker does not support streaming.
+    Status FetchElement(Task* task, CompressedElement* element,
+                        bool* end_of_sequence) TF_LOCKS_EXCLUDED(mu_) {
+      DataServiceWorkerClient::ElementStream* stream = nullptr;
+      bool streaming_unsupported;
+      int64 next_element_index;
+      int64 window_size;
+      {
+        mutex_lock l(mu_);
+        streaming_unsupported = task->streaming_unsupported;
+        stream = task->stream.get();
+        next_element_index = task->next_element_index;
+        // Split the element budget between the tasks.
+        window_size = std::max<int64>(
+            1, max_outstanding_requests_ /
+                   std::max<int64>(1, static_cast<int64>(tasks_.size())));
+      }
+      if (streaming_unsupported) {
+        return task->worker->GetElement(task->task_id,
+                                        dataset()->consumer_index_, element,
+                                        end_of_sequence);
+      }
+      if (stream == nullptr) {
+        std::unique_ptr<DataServiceWorkerClient::ElementStream> new_stream;
+        // When the stream is resumed, the worker sends again the elements
+        // that were lost with the previous stream, or fails with DataLoss if
+        // it can't.
+        TF_RETURN_IF_ERROR(task->worker->OpenElementStream(
+            task->task_id, dataset()->consumer_index_, window_size,
+            task->stream_id, next_element_index, &new_stream));
+        mutex_lock l(mu_);
+        if (cancelled_) {
+          return errors::Cancelled("Data service iterator was cancelled");
+        }
+        stream = new_stream.get();
+        task->stream = std::move(new_stream);
+      }
+      Status s = stream->GetNext(element, end_of_sequence);
+      if (s.ok()) {
+        return Status::OK();
+      }
+      {
+        mutex_lock l(mu_);
+        task->next_element_index = stream->next_element_index();
+        task->stream.reset();
+        if (!errors::IsUnimplemented(s)) {
+          return s;
+        }
+        VLOG(1) << "Worker " << task->address << " does not support element "
+                << "streaming, falling back to GetElement RPCs";
+        task->streaming_unsupported = true;
+      }
+      return task->worker->GetElement(task->task_id, dataset()->consumer_index_,
+                                      element, end_of_sequence);
+    }
+
     bool SpaceInBuffer() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       return results_.size() + outstanding_requests_ <
              max_outstanding_requests_;
@@ -521,6 +635,41 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
       return finished_tasks_ + outstanding_requests_ < tasks_.size();
     }
 
+    // Returns the next task to read from, or nullptr if no task should be read
+    // from now. Tasks on workers in the client's locality are read from first.
+    // A remote task is only read from when every local task is in use and the
+    // consumer has run out of elements, or when all local tasks are finished.
+    std::shared_ptr<Task> SelectTask() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!TaskAvailable()) {
+        return nullptr;
+      }
+      const int num_tasks = tasks_.size();
+      bool local_tasks_unfinished = false;
+      int remote_index = -1;
+      for (int i = 0; i < num_tasks; ++i) {
+        int index = (next_task_index_ + i) % num_tasks;
+        const std::shared_ptr<Task>& task = tasks_[index];
+        if (task->end_of_sequence) {
+          continue;
+        }
+        if (task->local) {
+          local_tasks_unfinished = true;
+          if (!task->in_use) {
+            next_task_index_ = (index + 1) % num_tasks;
+            return task;
+          }
+        } else if (remote_index == -1 && !task->in_use) {
+          remote_index = index;
+        }
+      }
+      if (remote_index == -1 ||
+          (local_tasks_unfinished && !results_.empty())) {
+        return nullptr;
+      }
+      next_task_index_ = (remote_index + 1) % num_tasks;
+      return tasks_[remote_index];
+    }
+
     const int64 iterator_index_;
 
     mutex mu_;
@@ -571,6 +720,9 @@ class DataServiceDatasetOp::Dataset : public DatasetBase {
   const tstring job_name_;
   const int64 max_outstanding_requests_;
   const int64 task_refresh_interval_ms_;
+  const std::string client_locality_;
+  const int64 num_consumers_;
+  const int64 consumer_index_;
   IterationCounter* const iteration_counter_;  // Owned
   const bool owns_resource_;
   const ResourceHandle iteration_counter_handle_;
@@ -586,6 +738,25 @@ DataServiceDatasetOp::DataServiceDatasetOp(OpKernelConstruction* ctx)
   if (task_refresh_interval_hint_ms_ == model::kAutotune) {
     task_refresh_interval_hint_ms_ = kDefaultTaskRefreshIntervalMs;
   }
+  if (ctx->HasAttr(kClientLocality)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kClientLocality, &client_locality_));
+  }
+  if (ctx->HasAttr(kNumConsumers)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kNumConsumers, &num_consumers_));
+  }
+  if (ctx->HasAttr(kConsumerIndex)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kConsumerIndex, &consumer_index_));
+  }
+  OP_REQUIRES(ctx, num_consumers_ >= 0,
+              errors::InvalidArgument(kNumConsumers,
+                                      " must be non-negative, got ",
+                                      num_consumers_));
+  OP_REQUIRES(
+      ctx,
+      num_consumers_ == 0 ||
+          (consumer_index_ >= 0 && consumer_index_ < num_consumers_),
+      errors::InvalidArgument(kConsumerIndex, " must be in [0, ",
+                              num_consumers_, "), got ", consumer_index_));
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputTypes, &output_types_));
   OP_REQUIRES_OK(ctx, ctx->GetAttr(kOutputShapes, &output_shapes_));
 }
@@ -614,6 +785,10 @@ void DataServiceDatasetOp::MakeDataset(OpKernelContext* ctx,
 
   tstring job_name;
   OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, kJobName, &job_name));
+  OP_REQUIRES(ctx, num_consumers_ == 0 || !job_name.empty(),
+              errors::InvalidArgument(
+                  "A ", kJobName, " is required to share a job between ",
+                  num_consumers_, " consumers"));
 
   int64 max_outstanding_requests;
   OP_REQUIRES_OK(ctx, ParseScalarArgument(ctx, kMaxOutstandingRequests,
@@ -657,6 +832,7 @@ void DataServiceDatasetOp::MakeDataset(OpKernelContext* ctx,
   *output =
       new Dataset(ctx, dataset_id, processing_mode, address, protocol, job_name,
                   max_outstanding_requests, task_refresh_interval_hint_ms_,
+                  client_locality_, num_consumers_, consumer_index_,
                   iteration_counter, owns_resource, iteration_counter_handle,
                   output_types_, output_shapes_);
 }
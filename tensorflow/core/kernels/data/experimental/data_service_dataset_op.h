@@ -56,6 +56,9 @@ class DataServiceDatasetOp : public DatasetOpKernel {
       "max_outstanding_requests";
   static constexpr const char* const kTaskRefreshIntervalHintMs =
       "task_refresh_interval_hint_ms";
+  static constexpr const char* const kClientLocality = "client_locality";
+  static constexpr const char* const kNumConsumers = "num_consumers";
+  static constexpr const char* const kConsumerIndex = "consumer_index";
   static constexpr const char* const kIterationCounter = "iteration_counter";
   static constexpr const char* const kOutputTypes = "output_types";
   static constexpr const char* const kOutputShapes = "output_shapes";
@@ -69,6 +72,9 @@ class DataServiceDatasetOp : public DatasetOpKernel {
   class Dataset;
 
   int64 task_refresh_interval_hint_ms_;
+  std::string client_locality_;
+  int64 num_consumers_ = 0;
+  int64 consumer_index_ = 0;
   DataTypeVector output_types_;
   std::vector<PartialTensorShape> output_shapes_;
 };
@@ -0,0 +1,260 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+    http://www.apache.org/licenses/LICENSE-2.0
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/experimental/map_filter_and_batch_dataset_op.h"
+
+#include "tensorflow/core/kernels/data/dataset_test_base.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+namespace {
+
+constexpr char kNodeName[] = "map_filter_and_batch_dataset";
+
+class MapFilterAndBatchDatasetParams : public DatasetParams {
+ public:
+  template <typename T>
+  MapFilterAndBatchDatasetParams(
+      T input_dataset_params, std::vector<Tensor> other_arguments,
+      int64 batch_size, int64 num_parallel_calls, bool drop_remainder,
+      FunctionDefHelper::AttrValueWrapper func,
+      std::vector<FunctionDef> func_lib, DataTypeVector type_arguments,
+      DataTypeVector output_dtypes,
+      std::vector<PartialTensorShape> output_shapes, string node_name)
+      : DatasetParams(std::move(output_dtypes), std::move(output_shapes),
+                      std::move(node_name)),
+        other_arguments_(std::move(other_arguments)),
+        batch_size_(batch_size),
+        num_parallel_calls_(num_parallel_calls),
+        drop_remainder_(drop_remainder),
+        func_(std::move(func)),
+        func_lib_(std::move(func_lib)),
+        type_arguments_(std::move(type_arguments)) {
+    input_dataset_params_.push_back(absl::make_unique<T>(input_dataset_params));
+    iterator_prefix_ =
+        name_utils::IteratorPrefix(input_dataset_params.dataset_type(),
+                                   input_dataset_params.iterator_prefix());
+  }
+
+  std::vector<Tensor> GetInputTensors() const override {
+    std::vector<Tensor> inputs = other_arguments_;
+    inputs.emplace_back(CreateTensor<int64>(TensorShape({}), {batch_size_}));
+    inputs.emplace_back(
+        CreateTensor<int64>(TensorShape({}), {num_parallel_calls_}));
+    inputs.emplace_back(CreateTensor<bool>(TensorShape({}), {drop_remainder_}));
+    return inputs;
+  }
+
+  Status GetInputNames(std::vector<string>* input_names) const override {
+    input_names->reserve(input_dataset_params_.size() +
+                         other_arguments_.size() + 3);
+    input_names->emplace_back(MapFilterAndBatchDatasetOp::kInputDataset);
+    for (int i = 0; i < other_arguments_.size(); ++i) {
+      input_names->emplace_back(
+          absl::StrCat(MapFilterAndBatchDatasetOp::kOtherArguments, "_", i));
+    }
+    input_names->emplace_back(MapFilterAndBatchDatasetOp::kBatchSize);
+    input_names->emplace_back(MapFilterAndBatchDatasetOp::kNumParallelCalls);
+    input_names->emplace_back(MapFilterAndBatchDatasetOp::kDropRemainder);
+    return Status::OK();
+  }
+
+  Status GetAttributes(AttributeVector* attr_vector) const override {
+    *attr_vector = {
+        {MapFilterAndBatchDatasetOp::kFunc, func_},
+        {MapFilterAndBatchDatasetOp::kTarguments, type_arguments_},
+        {MapFilterAndBatchDatasetOp::kOutputShapes, output_shapes_},
+        {MapFilterAndBatchDatasetOp::kOutputTypes, output_dtypes_},
+        {MapFilterAndBatchDatasetOp::kPreserveCardinality, false}};
+    return Status::OK();
+  }
+
+  std::vector<FunctionDef> func_lib() const override { return func_lib_; }
+
+  string dataset_type() const override {
+    return MapFilterAndBatchDatasetOp::kDatasetType;
+  }
+
+ private:
+  std::vector<Tensor> other_arguments_;
+  int64 batch_size_;
+  int64 num_parallel_calls_;
+  bool drop_remainder_;
+  FunctionDefHelper::AttrValueWrapper func_;
+  std::vector<FunctionDef> func_lib_;
+  DataTypeVector type_arguments_;
+};
+
+class MapFilterAndBatchDatasetOpTest : public DatasetOpsTestBase {};
+
+// Returns `2 * x` together with a predicate that keeps the even values of `x`.
+FunctionDef XTimesTwoIfEven() {
+  const Tensor kTwo = test::AsScalar<int64>(2);
+  const Tensor kZero = test::AsScalar<int64>(0);
+  return FunctionDefHelper::Define(
+      // Name
+      "XTimesTwoIfEven",
+      // Args
+      {"x: int64"},
+      // Return values
+      {"y: int64", "keep: bool"},
+      // Attr def
+      {},
+      // Nodes
+      {
+          {{"two"}, "Const", {}, {{"value", kTwo}, {"dtype", DT_INT64}}},
+          {{"zero"}, "Const", {}, {{"value", kZero}, {"dtype", DT_INT64}}},
+          {{"y"}, "Mul", {"x", "two"}, {{"T", DT_INT64}}},
+          {{"mod"}, "FloorMod", {"x", "two"}, {{"T", DT_INT64}}},
+          {{"keep"}, "Equal", {"mod", "zero"}, {{"T", DT_INT64}}},
+      });
+}
+
+MapFilterAndBatchDatasetParams XTimesTwoIfEvenDatasetParams(
+    int64 num_parallel_calls, bool drop_remainder) {
+  return MapFilterAndBatchDatasetParams(
+      RangeDatasetParams(0, 10, 1),
+      /*other_arguments=*/{},
+      /*batch_size=*/2,
+      /*num_parallel_calls=*/num_parallel_calls,
+      /*drop_remainder=*/drop_remainder,
+      /*func=*/FunctionDefHelper::FunctionRef("XTimesTwoIfEven"),
+      /*func_lib=*/{XTimesTwoIfEven()},
+      /*type_arguments*/ {},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({2})},
+      /*node_name=*/kNodeName);
+}
+
+// test case 1: num_parallel_calls = 1, drop_remainder = true
+MapFilterAndBatchDatasetParams MapFilterAndBatchDatasetParams1() {
+  return XTimesTwoIfEvenDatasetParams(/*num_parallel_calls=*/1,
+                                      /*drop_remainder=*/true);
+}
+
+// test case 2: num_parallel_calls = 3, drop_remainder = false
+MapFilterAndBatchDatasetParams MapFilterAndBatchDatasetParams2() {
+  return XTimesTwoIfEvenDatasetParams(/*num_parallel_calls=*/3,
+                                      /*drop_remainder=*/false);
+}
+
+// test case 3: num_parallel_calls = kAutotune, drop_remainder = false
+MapFilterAndBatchDatasetParams MapFilterAndBatchDatasetParams3() {
+  return XTimesTwoIfEvenDatasetParams(/*num_parallel_calls=*/model::kAutotune,
+                                      /*drop_remainder=*/false);
+}
+
+// The function does not return a predicate.
+MapFilterAndBatchDatasetParams
+MissingPredicateMapFilterAndBatchDatasetParams() {
+  return MapFilterAndBatchDatasetParams(
+      RangeDatasetParams(0, 10, 1),
+      /*other_arguments=*/{},
+      /*batch_size=*/2,
+      /*num_parallel_calls=*/2,
+      /*drop_remainder=*/false,
+      /*func=*/FunctionDefHelper::FunctionRef("XTimesTwo", {{"T", DT_INT64}}),
+      /*func_lib=*/{test::function::XTimesTwo()},
+      /*type_arguments*/ {},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({2})},
+      /*node_name=*/kNodeName);
+}
+
+MapFilterAndBatchDatasetParams
+InvalidBatchSizeMapFilterAndBatchDatasetParams() {
+  return MapFilterAndBatchDatasetParams(
+      RangeDatasetParams(0, 10, 1),
+      /*other_arguments=*/{},
+      /*batch_size=*/-2,
+      /*num_parallel_calls=*/2,
+      /*drop_remainder=*/false,
+      /*func=*/FunctionDefHelper::FunctionRef("XTimesTwoIfEven"),
+      /*func_lib=*/{XTimesTwoIfEven()},
+      /*type_arguments*/ {},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({2})},
+      /*node_name=*/kNodeName);
+}
+
+std::vector<GetNextTestCase<MapFilterAndBatchDatasetParams>>
+GetNextTestCases() {
+  return {{/*dataset_params=*/MapFilterAndBatchDatasetParams1(),
+           /*expected_outputs=*/
+           CreateTensors<int64>(TensorShape({2}), {{0, 4}, {8, 12}})},
+          {/*dataset_params=*/MapFilterAndBatchDatasetParams2(),
+           /*expected_outputs=*/
+           {CreateTensor<int64>(TensorShape({2}), {0, 4}),
+            CreateTensor<int64>(TensorShape({2}), {8, 12}),
+            CreateTensor<int64>(TensorShape({1}), {16})}},
+          {/*dataset_params=*/MapFilterAndBatchDatasetParams3(),
+           /*expected_outputs=*/
+           {CreateTensor<int64>(TensorShape({2}), {0, 4}),
+            CreateTensor<int64>(TensorShape({2}), {8, 12}),
+            CreateTensor<int64>(TensorShape({1}), {16})}}};
+}
+
+ITERATOR_GET_NEXT_TEST_P(MapFilterAndBatchDatasetOpTest,
+                         MapFilterAndBatchDatasetParams, GetNextTestCases())
+
+TEST_F(MapFilterAndBatchDatasetOpTest, DatasetTypeString) {
+  auto dataset_params = MapFilterAndBatchDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetTypeString(
+      name_utils::OpName(MapFilterAndBatchDatasetOp::kDatasetType)));
+}
+
+TEST_F(MapFilterAndBatchDatasetOpTest, Cardinality) {
+  auto dataset_params = MapFilterAndBatchDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  TF_ASSERT_OK(CheckDatasetCardinality(kUnknownCardinality));
+}
+
+std::vector<IteratorSaveAndRestoreTestCase<MapFilterAndBatchDatasetParams>>
+IteratorSaveAndRestoreTestCases() {
+  return {{/*dataset_params=*/MapFilterAndBatchDatasetParams1(),
+           /*breakpoints=*/{0, 1, 4},
+           /*expected_outputs=*/
+           CreateTensors<int64>(TensorShape({2}), {{0, 4}, {8, 12}})},
+          {/*dataset_params=*/MapFilterAndBatchDatasetParams2(),
+           /*breakpoints=*/{0, 1, 4},
+           /*expected_outputs=*/
+           {CreateTensor<int64>(TensorShape({2}), {0, 4}),
+            CreateTensor<int64>(TensorShape({2}), {8, 12}),
+            CreateTensor<int64>(TensorShape({1}), {16})}}};
+}
+
+ITERATOR_SAVE_AND_RESTORE_TEST_P(MapFilterAndBatchDatasetOpTest,
+                                 MapFilterAndBatchDatasetParams,
+                                 IteratorSaveAndRestoreTestCases())
+
+TEST_F(MapFilterAndBatchDatasetOpTest, MissingPredicate) {
+  auto dataset_params = MissingPredicateMapFilterAndBatchDatasetParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  EXPECT_EQ(
+      iterator_->GetNext(iterator_ctx_.get(), &out_tensors, &end_of_sequence)
+          .code(),
+      tensorflow::error::INVALID_ARGUMENT);
+}
+
+TEST_F(MapFilterAndBatchDatasetOpTest, InvalidBatchSize) {
+  auto dataset_params = InvalidBatchSizeMapFilterAndBatchDatasetParams();
+  EXPECT_EQ(Initialize(dataset_params).code(),
+            tensorflow::error::INVALID_ARGUMENT);
+}
+
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
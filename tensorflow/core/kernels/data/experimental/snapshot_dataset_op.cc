@@ -16,6 +16,7 @@ limitations under the License.
 
 #include <random>
 
+#include "absl/strings/match.h"
 #include "absl/time/clock.h"
 #include "tensorflow/core/common_runtime/dma_helper.h"
 #include "tensorflow/core/framework/dataset.h"
@@ -1270,9 +1271,13 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
           std::vector<std::string> filenames_str;
           TF_RETURN_IF_ERROR(ctx->env()->GetMatchingPaths(
               absl::StrCat(absl::string_view(run_dir_), "/*"), &filenames_str));
-          filenames_.resize(filenames_str.size());
-          std::copy(filenames_str.begin(), filenames_str.end(),
-                    filenames_.begin());
+          filenames_.reserve(filenames_str.size());
+          for (const auto& filename : filenames_str) {
+            // Skip the index files written next to the snapshot files.
+            if (!absl::EndsWith(filename, snapshot_util::kIndexFileSuffix)) {
+              filenames_.push_back(filename);
+            }
+          }
           if (filenames_.empty()) {
             return errors::NotFound("Could not find any files in dir: ",
                                     run_dir_);
@@ -1676,14 +1681,17 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
           mutex_lock l(mu_);
           cancelled_ = true;
           cond_var_.notify_all();
-          while (num_active_threads_ > 0) {
+          while (num_active_threads_ > 0 || num_pending_closes_ > 0) {
             cond_var_.wait(l);
           }
         }
 
         Status Initialize(IteratorContext* ctx) override {
-          thread_pool_ = ctx->CreateThreadPool(kSnapshotWriterWorkerPool,
-                                               dataset()->num_writer_threads_);
+          // `num_writer_threads_` bounds the number of writer threads; the
+          // extra thread guarantees that shards handed off by the writers can
+          // always be closed.
+          thread_pool_ = ctx->CreateThreadPool(
+              kSnapshotWriterWorkerPool, dataset()->num_writer_threads_ + 1);
           return dataset()->input_->MakeIterator(ctx, this, prefix(),
                                                  &input_impl_);
         }
@@ -1716,11 +1724,9 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
                 TF_RETURN_IF_ERROR(snapshot_util::WriteMetadataFile(
                     ctx->env(), hash_dir_, &metadata));
               }
-              for (int i = 0; i < dataset()->num_writer_threads_; ++i) {
-                ++num_active_threads_;
-                thread_pool_->Schedule(
-                    [this, env = ctx->env()]() { WriterThread(env); });
-              }
+              // Further writer threads are started by `FillBuffer` when the
+              // writers cannot keep up with the input.
+              StartWriterThread(ctx->env());
               first_call_ = false;
             }
           }
@@ -1986,8 +1992,17 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
             return Status::OK();
           }
 
+          // A full buffer means that the writer threads are the bottleneck,
+          // so we fan out to another file as long as we are allowed to.
+          if (buffer_.size() >= dataset()->writer_buffer_size_ &&
+              !snapshot_failed_ &&
+              static_cast<uint64>(num_active_threads_) <
+                  dataset()->num_writer_threads_) {
+            StartWriterThread(ctx->env());
+          }
+
           // Wait for a space in the buffer_.
-          while (!cancelled_ &&
+          while (!cancelled_ && !snapshot_failed_ &&
                  buffer_.size() >= dataset()->writer_buffer_size_) {
             cond_var_.wait(l);
           }
@@ -1997,6 +2012,12 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
                 "SnapshotDatasetOp::SnapshotWriterIterator::GetNext");
           }
 
+          // Once the snapshot failed nobody drains the buffer anymore, so we
+          // keep producing elements without writing them.
+          if (snapshot_failed_) {
+            return Status::OK();
+          }
+
           if (buffer_.size() >= dataset()->writer_buffer_size_) {
             return errors::Internal(
                 "Buffer size: ", buffer_.size(), " should be smaller than ",
@@ -2062,8 +2083,11 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
                 ShouldCloseWriter(env, *snapshot_data_filename, *bytes_written,
                                   (*writer).get(), &should_close));
             if (should_close) {
-              // If we exceed the shard size, we get a new file and reset.
-              TF_RETURN_IF_ERROR((*writer)->Close());
+              // If we exceed the shard size, we get a new file and reset. The
+              // finished shard is closed in the background so that writing
+              // continues while its data is flushed out.
+              CloseWriterAsync(env, *snapshot_data_filename, *bytes_written,
+                               std::move(*writer));
               *snapshot_data_filename = GetSnapshotFilename();
 
               TF_RETURN_IF_ERROR(snapshot_util::Writer::Create(
@@ -2078,6 +2102,19 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
           if (*end_of_processing) {
             TF_RETURN_IF_ERROR((*writer)->Close());
             mutex_lock l(mu_);
+            // Only the last writer thread to close its shard finalizes the
+            // snapshot, once all shards handed off earlier are closed too.
+            ++num_finished_threads_;
+            if (num_finished_threads_ < num_started_threads_) {
+              return Status::OK();
+            }
+            while (num_pending_closes_ > 0) {
+              cond_var_.wait(l);
+            }
+            if (snapshot_failed_) {
+              return errors::Internal(
+                  "SnapshotDataset::SnapshotWriterIterator snapshot failed");
+            }
             if (!written_final_metadata_file_) {
               experimental::SnapshotMetadataRecord metadata;
               bool file_exists;
@@ -2098,6 +2135,47 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
           return Status::OK();
         }
 
+        void StartWriterThread(Env* env) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+          ++num_active_threads_;
+          ++num_started_threads_;
+          thread_pool_->Schedule([this, env]() { WriterThread(env); });
+        }
+
+        // Closes `writer` on the thread pool, and refines the compression
+        // ratio estimate with the size of the closed file.
+        void CloseWriterAsync(Env* env, const string& filename,
+                              int64 bytes_written,
+                              std::unique_ptr<snapshot_util::Writer> writer)
+            TF_LOCKS_EXCLUDED(mu_) {
+          std::shared_ptr<snapshot_util::Writer> shared_writer =
+              std::move(writer);
+          mutex_lock l(mu_);
+          ++num_pending_closes_;
+          thread_pool_->Schedule([this, env, filename, bytes_written,
+                                  shared_writer]() {
+            Status s = shared_writer->Close();
+            uint64 file_size = 0;
+            if (s.ok()) {
+              s = env->GetFileSize(filename, &file_size);
+            }
+            mutex_lock l(mu_);
+            if (s.ok() && file_size > 0) {
+              closed_bytes_written_ += bytes_written;
+              closed_file_bytes_ += file_size;
+              compression_ratio_ = static_cast<double>(closed_bytes_written_) /
+                                   static_cast<double>(closed_file_bytes_);
+              VLOG(2) << "Writing compression achieved: "
+                      << compression_ratio_;
+            } else if (!s.ok()) {
+              LOG(ERROR) << "Closing " << filename
+                         << " failed: " << s.ToString();
+              snapshot_failed_ = true;
+            }
+            --num_pending_closes_;
+            cond_var_.notify_all();
+          });
+        }
+
         // Just pulls off elements from the buffer and writes them.
         void WriterThread(Env* env) {
           auto cleanup = gtl::MakeCleanup([this]() {
@@ -2144,9 +2222,9 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
                                  snapshot_util::Writer* writer,
                                  bool* should_close) {
           // If the compression ratio has been estimated, use it to decide
-          // whether the file should be closed. We avoid estimating the
-          // compression ratio repeatedly because it requires syncing the file,
-          // which can be expensive.
+          // whether the file should be closed. Only the first estimate requires
+          // syncing the file, which can be expensive; afterwards the estimate
+          // is refined with the sizes of the files closed in the background.
           {
             tf_shared_lock l(mu_);
             if (compression_ratio_ > 0.0) {
@@ -2183,6 +2261,7 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
         // 4. By the background writer threads when any error is encountered
         //    while writing.
         // 5. By the background threads when they finish.
+        // 6. By the background threads when a shard has been closed.
         condition_variable cond_var_;
 
         snapshot_util::ElementOrEOF next_elem_ TF_GUARDED_BY(mu_);
@@ -2192,6 +2271,10 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
         tstring run_id_ TF_GUARDED_BY(mu_);
         tstring run_dir_ TF_GUARDED_BY(mu_);
         double compression_ratio_ TF_GUARDED_BY(mu_) = 0.0;
+        // Uncompressed and on-disk bytes of the shards closed so far, used to
+        // refine `compression_ratio_`.
+        int64 closed_bytes_written_ TF_GUARDED_BY(mu_) = 0;
+        uint64 closed_file_bytes_ TF_GUARDED_BY(mu_) = 0;
         bool is_restored_ TF_GUARDED_BY(mu_) = false;
 
         uint64 elements_produced_ TF_GUARDED_BY(mu_) = 0;
@@ -2207,6 +2290,12 @@ class SnapshotDatasetOp : public UnaryDatasetOpKernel {
         uint64 next_file_index_ TF_GUARDED_BY(mu_) = 0;
         std::unique_ptr<thread::ThreadPool> thread_pool_;
         int64 num_active_threads_ TF_GUARDED_BY(mu_) = 0;
+        int64 num_started_threads_ TF_GUARDED_BY(mu_) = 0;
+        // Number of writer threads that have closed their last shard.
+        int64 num_finished_threads_ TF_GUARDED_BY(mu_) = 0;
+        // Number of shards handed off by `CloseWriterAsync` and not yet
+        // closed.
+        int64 num_pending_closes_ TF_GUARDED_BY(mu_) = 0;
         int64 num_elements_written_ = 0;
       };
 
@@ -0,0 +1,334 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include <atomic>
+
+#include "tensorflow/core/kernels/data/dataset_test_base.h"
+#include "tensorflow/core/kernels/data/experimental/snapshot_util.h"
+#include "tensorflow/core/lib/io/path.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/errors.h"
+#include "tensorflow/core/platform/null_file_system.h"
+#include "tensorflow/core/protobuf/data/experimental/snapshot.pb.h"
+
+namespace tensorflow {
+namespace data {
+namespace experimental {
+namespace {
+
+// Tests of the legacy `SnapshotDataset` writer.
+
+constexpr char kNodeName[] = "snapshot_dataset";
+constexpr char kDatasetType[] = "Snapshot";
+constexpr char kFaultyScheme[] = "faultyfs";
+constexpr char kFirstShardFilename[] = "00000000.snapshot";
+// The version of the snapshot files written by the legacy writer.
+constexpr int kSnapshotVersion = 1;
+
+// Number of `Close()` calls which `FaultyFileSystem` has failed.
+std::atomic<int64> num_failed_closes(0);
+
+// Forwards to `file`, except that closing it fails if `fail_close` is true.
+class FaultyWritableFile : public WritableFile {
+ public:
+  FaultyWritableFile(std::unique_ptr<WritableFile> file, bool fail_close)
+      : file_(std::move(file)), fail_close_(fail_close) {}
+
+  Status Append(StringPiece data) override { return file_->Append(data); }
+
+  Status Close() override {
+    TF_RETURN_IF_ERROR(file_->Close());
+    if (fail_close_) {
+      ++num_failed_closes;
+      return errors::Unavailable("Injected failure to close the file");
+    }
+    return Status::OK();
+  }
+
+  Status Flush() override { return file_->Flush(); }
+  Status Sync() override { return file_->Sync(); }
+  Status Tell(int64* position) override { return file_->Tell(position); }
+
+ private:
+  const std::unique_ptr<WritableFile> file_;
+  const bool fail_close_;
+};
+
+// Stores "faultyfs://<path>" at the local <path>, and fails to close the first
+// shard file of every snapshot run.
+class FaultyFileSystem : public NullFileSystem {
+ public:
+  Status NewRandomAccessFile(
+      const string& fname, std::unique_ptr<RandomAccessFile>* result) override {
+    return Env::Default()->NewRandomAccessFile(LocalPath(fname), result);
+  }
+
+  Status NewWritableFile(const string& fname,
+                         std::unique_ptr<WritableFile>* result) override {
+    std::unique_ptr<WritableFile> file;
+    TF_RETURN_IF_ERROR(
+        Env::Default()->NewWritableFile(LocalPath(fname), &file));
+    const bool fail_close = io::Basename(fname) == kFirstShardFilename;
+    *result = absl::make_unique<FaultyWritableFile>(std::move(file),
+                                                    fail_close);
+    return Status::OK();
+  }
+
+  Status NewAppendableFile(const string& fname,
+                           std::unique_ptr<WritableFile>* result) override {
+    return Env::Default()->NewAppendableFile(LocalPath(fname), result);
+  }
+
+  Status FileExists(const string& fname) override {
+    return Env::Default()->FileExists(LocalPath(fname));
+  }
+
+  Status GetChildren(const string& dir, std::vector<string>* result) override {
+    return Env::Default()->GetChildren(LocalPath(dir), result);
+  }
+
+  Status Stat(const string& fname, FileStatistics* stat) override {
+    return Env::Default()->Stat(LocalPath(fname), stat);
+  }
+
+  Status DeleteFile(const string& fname) override {
+    return Env::Default()->DeleteFile(LocalPath(fname));
+  }
+
+  Status CreateDir(const string& dirname) override {
+    return Env::Default()->CreateDir(LocalPath(dirname));
+  }
+
+  Status DeleteDir(const string& dirname) override {
+    return Env::Default()->DeleteDir(LocalPath(dirname));
+  }
+
+  Status IsDirectory(const string& fname) override {
+    return Env::Default()->IsDirectory(LocalPath(fname));
+  }
+
+  Status GetFileSize(const string& fname, uint64* file_size) override {
+    return Env::Default()->GetFileSize(LocalPath(fname), file_size);
+  }
+
+  Status RenameFile(const string& src, const string& target) override {
+    return Env::Default()->RenameFile(LocalPath(src), LocalPath(target));
+  }
+
+ private:
+  static string LocalPath(const string& fname) {
+    StringPiece scheme, host, path;
+    io::ParseURI(fname, &scheme, &host, &path);
+    return string(path);
+  }
+};
+
+REGISTER_FILE_SYSTEM(kFaultyScheme, FaultyFileSystem);
+
+class SnapshotDatasetParams : public DatasetParams {
+ public:
+  SnapshotDatasetParams(RangeDatasetParams input_dataset_params,
+                        const string& path, int64 shard_size_bytes,
+                        int64 num_writer_threads, int64 writer_buffer_size)
+      : DatasetParams({DT_INT64}, {PartialTensorShape({})}, kNodeName),
+        path_(CreateTensor<tstring>(TensorShape({}), {path})),
+        shard_size_bytes_(shard_size_bytes),
+        num_writer_threads_(num_writer_threads),
+        writer_buffer_size_(writer_buffer_size) {
+    input_dataset_params_.push_back(
+        absl::make_unique<RangeDatasetParams>(input_dataset_params));
+    iterator_prefix_ =
+        name_utils::IteratorPrefix(input_dataset_params.dataset_type(),
+                                   input_dataset_params.iterator_prefix());
+  }
+
+  std::vector<Tensor> GetInputTensors() const override { return {path_}; }
+
+  Status GetInputNames(std::vector<string>* input_names) const override {
+    *input_names = {"input_dataset", "path"};
+    return Status::OK();
+  }
+
+  Status GetAttributes(AttributeVector* attributes) const override {
+    *attributes = {{"output_types", output_dtypes_},
+                   {"output_shapes", output_shapes_},
+                   {"compression", ""},
+                   {"reader_path_prefix", ""},
+                   {"writer_path_prefix", ""},
+                   {"shard_size_bytes", shard_size_bytes_},
+                   {"pending_snapshot_expiry_seconds", 86400},
+                   {"num_reader_threads", 1},
+                   {"reader_buffer_size", 1},
+                   {"num_writer_threads", num_writer_threads_},
+                   {"writer_buffer_size", writer_buffer_size_},
+                   {"shuffle_on_read", false},
+                   {"seed", 0},
+                   {"seed2", 0},
+                   {"mode", snapshot_util::kModeWrite},
+                   {"snapshot_name", ""}};
+    return Status::OK();
+  }
+
+  string dataset_type() const override { return kDatasetType; }
+
+ private:
+  Tensor path_;
+  int64 shard_size_bytes_;
+  int64 num_writer_threads_;
+  int64 writer_buffer_size_;
+};
+
+class SnapshotDatasetOpTest : public DatasetOpsTestBase {
+ protected:
+  // Removes the snapshots written to the local `dir` by earlier runs.
+  static void ClearDirectory(const string& dir) {
+    int64 undeleted_files, undeleted_dirs;
+    Env::Default()
+        ->DeleteRecursively(dir, &undeleted_files, &undeleted_dirs)
+        .IgnoreError();
+  }
+
+  // Reads all elements of the shard files written to the local `dir`, and
+  // stores the number of shard files in `*num_shards`.
+  static Status ReadShards(const string& dir, std::vector<Tensor>* elements,
+                           int64* num_shards) {
+    std::vector<string> filenames;
+    TF_RETURN_IF_ERROR(Env::Default()->GetMatchingPaths(
+        io::JoinPath(dir, "*", "*", "*.snapshot"), &filenames));
+    for (const string& filename : filenames) {
+      std::unique_ptr<snapshot_util::Reader> reader;
+      TF_RETURN_IF_ERROR(snapshot_util::Reader::Create(
+          Env::Default(), filename, /*compression_type=*/"", kSnapshotVersion,
+          {DT_INT64}, &reader));
+      while (true) {
+        std::vector<Tensor> tensors;
+        Status s = reader->ReadTensors(&tensors);
+        if (errors::IsOutOfRange(s)) {
+          break;
+        }
+        TF_RETURN_IF_ERROR(s);
+        elements->insert(elements->end(), tensors.begin(), tensors.end());
+      }
+    }
+    *num_shards = filenames.size();
+    return Status::OK();
+  }
+
+  // Reads the metadata of the single snapshot written to the local `dir`.
+  static Status ReadMetadata(const string& dir,
+                             experimental::SnapshotMetadataRecord* metadata) {
+    std::vector<string> filenames;
+    TF_RETURN_IF_ERROR(Env::Default()->GetMatchingPaths(
+        io::JoinPath(dir, "*", snapshot_util::kMetadataFilename), &filenames));
+    if (filenames.size() != 1) {
+      return errors::Internal("Expected 1 metadata file, got ",
+                              filenames.size());
+    }
+    bool file_exists;
+    return snapshot_util::ReadMetadataFile(
+        Env::Default(), string(io::Dirname(filenames[0])), metadata,
+        &file_exists);
+  }
+
+  // Reads elements until the end of the input, and checks that they are the
+  // elements of `range(num_elements)` in order.
+  Status ReadAllElements(int64 num_elements) {
+    bool end_of_sequence = false;
+    int64 expected = 0;
+    while (!end_of_sequence) {
+      std::vector<Tensor> next;
+      TF_RETURN_IF_ERROR(
+          iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+      if (!end_of_sequence) {
+        TF_RETURN_IF_ERROR(
+            ExpectEqual(next[0], CreateTensor<int64>(TensorShape({}),
+                                                     {expected++})));
+      }
+    }
+    if (expected != num_elements) {
+      return errors::Internal("Expected ", num_elements, " elements, got ",
+                              expected);
+    }
+    return Status::OK();
+  }
+};
+
+std::vector<Tensor> RangeElements(int64 num_elements) {
+  std::vector<Tensor> elements;
+  for (int64 i = 0; i < num_elements; ++i) {
+    elements.push_back(CreateTensor<int64>(TensorShape({}), {i}));
+  }
+  return elements;
+}
+
+TEST_F(SnapshotDatasetOpTest, RotatedShardsHoldEveryElementOnce) {
+  const int64 kNumElements = 500;
+  const string dir = io::JoinPath(testing::TmpDir(), "snapshot_rotation");
+  ClearDirectory(dir);
+  // Small shards force many rotations, and a one-element buffer lets the
+  // iterator fan out to several writer threads.
+  auto params = SnapshotDatasetParams(RangeDatasetParams(0, kNumElements, 1),
+                                      dir, /*shard_size_bytes=*/256,
+                                      /*num_writer_threads=*/4,
+                                      /*writer_buffer_size=*/1);
+  TF_ASSERT_OK(Initialize(params));
+  TF_ASSERT_OK(ReadAllElements(kNumElements));
+
+  // The last writer thread finalizes the snapshot once every shard handed off
+  // for closing has been closed.
+  experimental::SnapshotMetadataRecord metadata;
+  const uint64 deadline_micros = Env::Default()->NowMicros() + 60 * 1000 * 1000;
+  while (true) {
+    TF_ASSERT_OK(ReadMetadata(dir, &metadata));
+    if (metadata.finalized()) {
+      break;
+    }
+    ASSERT_LT(Env::Default()->NowMicros(), deadline_micros)
+        << "The snapshot was never finalized";
+    Env::Default()->SleepForMicroseconds(10 * 1000);
+  }
+
+  std::vector<Tensor> written;
+  int64 num_shards;
+  TF_ASSERT_OK(ReadShards(dir, &written, &num_shards));
+  EXPECT_GT(num_shards, 4);
+  TF_EXPECT_OK(ExpectEqual(written, RangeElements(kNumElements),
+                           /*compare_order=*/false));
+}
+
+TEST_F(SnapshotDatasetOpTest, FailedShardCloseFailsTheSnapshot) {
+  const int64 kNumElements = 500;
+  const string dir = io::JoinPath(testing::TmpDir(), "snapshot_close_error");
+  ClearDirectory(dir);
+  const int64 num_failed_closes_before = num_failed_closes;
+  auto params = SnapshotDatasetParams(
+      RangeDatasetParams(0, kNumElements, 1),
+      strings::StrCat(kFaultyScheme, "://", dir), /*shard_size_bytes=*/256,
+      /*num_writer_threads=*/1, /*writer_buffer_size=*/1);
+  TF_ASSERT_OK(Initialize(params));
+  // The consumer still receives every element after the snapshot failed.
+  TF_ASSERT_OK(ReadAllElements(kNumElements));
+  // Waits for the writer threads and the pending closes.
+  iterator_.reset();
+  EXPECT_GT(num_failed_closes, num_failed_closes_before);
+
+  experimental::SnapshotMetadataRecord metadata;
+  TF_ASSERT_OK(ReadMetadata(dir, &metadata));
+  EXPECT_FALSE(metadata.finalized());
+}
+
+}  // namespace
+}  // namespace experimental
+}  // namespace data
+}  // namespace tensorflow
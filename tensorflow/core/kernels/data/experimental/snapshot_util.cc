@@ -15,6 +15,7 @@ limitations under the License.
 
 #include "tensorflow/core/kernels/data/experimental/snapshot_util.h"
 
+#include <algorithm>
 #include <queue>
 
 #include "absl/memory/memory.h"
@@ -79,6 +80,10 @@ std::string GetCheckpointFileName(const std::string& shard_directory,
                       static_cast<unsigned long long>(checkpoint_id)));
 }
 
+std::string IndexFileName(const std::string& filename) {
+  return absl::StrCat(filename, kIndexFileSuffix);
+}
+
 Status Writer::Create(Env* env, const std::string& filename,
                       const std::string& compression_type, int version,
                       const DataTypeVector& dtypes,
@@ -157,6 +162,7 @@ CustomWriter::CustomWriter(const std::string& filename,
       dtypes_(dtypes) {}
 
 Status CustomWriter::Initialize(tensorflow::Env* env) {
+  env_ = env;
   TF_RETURN_IF_ERROR(env->NewAppendableFile(filename_, &dest_));
 #if defined(IS_SLIM_BUILD)
   if (compression_type_ != io::compression::kNone) {
@@ -164,6 +170,13 @@ Status CustomWriter::Initialize(tensorflow::Env* env) {
                << "off compression.";
   }
 #else   // IS_SLIM_BUILD
+  // Offsets into a gzip stream cannot be seeked to, so such files are not
+  // indexed.
+  write_index_ = compression_type_ != io::compression::kGzip;
+  if (write_index_) {
+    TF_RETURN_IF_ERROR(
+        env->NewWritableFile(IndexFileName(filename_), &index_dest_));
+  }
   if (compression_type_ == io::compression::kGzip) {
     zlib_underlying_dest_.swap(dest_);
     io::ZlibCompressionOptions zlib_options;
@@ -191,6 +204,9 @@ Status CustomWriter::Initialize(tensorflow::Env* env) {
 }
 
 Status CustomWriter::WriteTensors(const std::vector<Tensor>& tensors) {
+  if (write_index_) {
+    TF_RETURN_IF_ERROR(AddIndexEntry());
+  }
   if (compression_type_ != io::compression::kSnappy) {
     experimental::SnapshotRecord record;
     for (const auto& tensor : tensors) {
@@ -274,6 +290,14 @@ Status CustomWriter::Close() {
   if (dest_ != nullptr) {
     TF_RETURN_IF_ERROR(dest_->Close());
     dest_ = nullptr;
+    if (index_dest_ != nullptr) {
+      // The index ends with the size of the file, which tells readers that
+      // it is complete.
+      core::PutFixed64(&index_buffer_, offset_);
+      TF_RETURN_IF_ERROR(FlushIndex());
+      TF_RETURN_IF_ERROR(index_dest_->Close());
+      index_dest_ = nullptr;
+    }
   }
   if (zlib_underlying_dest_ != nullptr) {
     TF_RETURN_IF_ERROR(zlib_underlying_dest_->Close());
@@ -293,6 +317,7 @@ Status CustomWriter::WriteRecord(const StringPiece& data) {
   char header[kHeaderSize];
   core::EncodeFixed64(header, data.size());
   TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
+  offset_ += kHeaderSize + data.size();
   return dest_->Append(data);
 }
 
@@ -301,10 +326,25 @@ Status CustomWriter::WriteRecord(const absl::Cord& data) {
   char header[kHeaderSize];
   core::EncodeFixed64(header, data.size());
   TF_RETURN_IF_ERROR(dest_->Append(StringPiece(header, sizeof(header))));
+  offset_ += kHeaderSize + data.size();
   return dest_->Append(data);
 }
 #endif  // PLATFORM_GOOGLE
 
+Status CustomWriter::AddIndexEntry() {
+  core::PutFixed64(&index_buffer_, offset_);
+  if (index_buffer_.size() >= kIndexBlockSizeBytes) {
+    return FlushIndex();
+  }
+  return Status::OK();
+}
+
+Status CustomWriter::FlushIndex() {
+  TF_RETURN_IF_ERROR(index_dest_->Append(index_buffer_));
+  index_buffer_.clear();
+  return Status::OK();
+}
+
 Status Reader::Create(Env* env, const std::string& filename,
                       const string& compression_type, int version,
                       const DataTypeVector& dtypes,
@@ -631,6 +671,7 @@ CustomReader::CustomReader(const std::string& filename,
       dtypes_(dtypes) {}
 
 Status CustomReader::Initialize(Env* env) {
+  env_ = env;
   TF_RETURN_IF_ERROR(env->NewRandomAccessFile(filename_, &file_));
   input_stream_ = std::make_unique<io::RandomAccessInputStream>(file_.get());
 
@@ -733,6 +774,7 @@ Status CustomReader::ReadTensors(std::vector<Tensor>* read_tensors) {
       complex_index++;
     }
   }
+  num_elements_read_++;
   return Status::OK();
 }
 
@@ -754,6 +796,83 @@ Status CustomReader::ReadTensorsV0(std::vector<Tensor>* read_tensors) {
       return errors::DataLoss("Unable to parse tensor from proto.");
     }
   }
+  num_elements_read_++;
+  return Status::OK();
+}
+
+Status CustomReader::SkipRecords(int64 num_records) {
+  if (!index_read_) {
+    TF_RETURN_IF_ERROR(ReadIndex());
+    index_read_ = true;
+  }
+  if (element_offsets_.empty()) {
+    return Reader::SkipRecords(num_records);
+  }
+  // The last offset is the end of the file.
+  const int64 num_elements = element_offsets_.size() - 1;
+  const int64 target = num_elements_read_ + num_records;
+  TF_RETURN_IF_ERROR(
+      Seek(element_offsets_[std::min<int64>(target, num_elements)]));
+  num_elements_read_ = std::min<int64>(target, num_elements);
+  if (target > num_elements) {
+    return errors::OutOfRange("Cannot skip ", num_records, " elements of ",
+                              filename_, " which has only ", num_elements,
+                              " elements.");
+  }
+  return Status::OK();
+}
+
+Status CustomReader::ReadIndex() {
+  if (version_ != 1 || compression_type_ == io::compression::kGzip) {
+    return Status::OK();
+  }
+  std::string index;
+  Status s = ReadFileToString(env_, IndexFileName(filename_), &index);
+  if (errors::IsNotFound(s)) {
+    return Status::OK();
+  }
+  TF_RETURN_IF_ERROR(s);
+  uint64 file_size;
+  TF_RETURN_IF_ERROR(env_->GetFileSize(filename_, &file_size));
+  // An index that does not end with the size of the file belongs to a
+  // different (e.g. partially written) version of it.
+  if (index.empty() || index.size() % sizeof(uint64) != 0 ||
+      core::DecodeFixed64(index.data() + index.size() - sizeof(uint64)) !=
+          file_size) {
+    LOG(WARNING) << "Ignoring invalid snapshot index for " << filename_;
+    return Status::OK();
+  }
+  std::vector<uint64> element_offsets;
+  element_offsets.reserve(index.size() / sizeof(uint64));
+  for (size_t i = 0; i < index.size(); i += sizeof(uint64)) {
+    const uint64 offset = core::DecodeFixed64(index.data() + i);
+    // Seeking to an offset out of order or past the end of the file would
+    // silently read the wrong elements.
+    if (offset > file_size ||
+        (!element_offsets.empty() && offset < element_offsets.back())) {
+      return errors::DataLoss("Snapshot index ", IndexFileName(filename_),
+                              " has invalid offset ", offset, " for element ",
+                              i / sizeof(uint64), " of a file of ", file_size,
+                              " bytes.");
+    }
+    element_offsets.push_back(offset);
+  }
+  element_offsets_ = std::move(element_offsets);
+  return Status::OK();
+}
+
+Status CustomReader::Seek(uint64 offset) {
+  if (compression_type_ == io::compression::kSnappy) {
+    auto input_stream =
+        absl::make_unique<io::BufferedInputStream>(file_.get(), 64 << 20);
+    TF_RETURN_IF_ERROR(input_stream->Seek(offset));
+    input_stream_ = std::move(input_stream);
+  } else {
+    auto input_stream =
+        absl::make_unique<io::RandomAccessInputStream>(file_.get());
+    TF_RETURN_IF_ERROR(input_stream->Seek(offset));
+    input_stream_ = std::move(input_stream);
+  }
   return Status::OK();
 }
 
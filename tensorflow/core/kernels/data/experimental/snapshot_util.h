@@ -50,6 +50,7 @@ constexpr char kModeWrite[] = "write";
 constexpr char kModeRead[] = "read";
 constexpr char kModePassthrough[] = "passthrough";
 constexpr char kShardDirectorySuffix[] = ".shard";
+constexpr char kIndexFileSuffix[] = ".index";
 
 enum Mode { READER = 0, WRITER = 1, PASSTHROUGH = 2 };
 
@@ -69,6 +70,14 @@ std::string ShardDirectory(const std::string& run_directory, int64 shard_id);
 std::string GetCheckpointFileName(const std::string& shard_directory,
                                   const uint64 checkpoint_id);
 
+// Returns the name of the sidecar index file of the snapshot file `filename`.
+//
+// The index is written by `CustomWriter` for files that can be read at random
+// offsets, i.e. uncompressed and snappy compressed ones. It holds the file
+// offset of every element followed by the size of the file, each encoded as a
+// fixed64, and lets `CustomReader::SkipRecords` seek to an element directly.
+std::string IndexFileName(const std::string& filename);
+
 // This is a interface class that exposes snapshot writing functionality.
 class Writer {
  public:
@@ -123,6 +132,9 @@ class TFRecordWriter : public Writer {
 class CustomWriter : public Writer {
  public:
   static constexpr const size_t kHeaderSize = sizeof(uint64);
+  // The offsets of the elements are appended to the index file in blocks of
+  // this many bytes, so that the memory they take does not grow with the file.
+  static constexpr const size_t kIndexBlockSizeBytes = 64 << 10;  // 64 KiB
 
   static constexpr const char* const kClassName = "SnapshotWriter";
   static constexpr const char* const kWriteStringPiece = "WriteStringPiece";
@@ -150,6 +162,14 @@ class CustomWriter : public Writer {
   Status WriteRecord(const absl::Cord& data);
 #endif  // PLATFORM_GOOGLE
 
+  // Records that an element starts at `offset_`, appending the buffered
+  // offsets to the index file once a block of them is full.
+  Status AddIndexEntry();
+
+  // Appends the buffered offsets to the index file.
+  Status FlushIndex();
+
+  Env* env_ = nullptr;
   std::unique_ptr<WritableFile> dest_;
   const std::string filename_;
   const std::string compression_type_;
@@ -161,6 +181,13 @@ class CustomWriter : public Writer {
   std::vector<bool> simple_tensor_mask_;  // true for simple, false for complex.
   int num_simple_ = 0;
   int num_complex_ = 0;
+  // Whether an index file is written alongside the file.
+  bool write_index_ = false;
+  std::unique_ptr<WritableFile> index_dest_;
+  // Number of bytes written to `dest_` so far.
+  uint64 offset_ = 0;
+  // The encoded offsets of the elements that are not yet in the index file.
+  std::string index_buffer_;
 };
 
 // Interface class for reading snapshot files previous written with Writer.
@@ -249,6 +276,10 @@ class CustomReader : public Reader {
 
   Status ReadTensors(std::vector<Tensor>* read_tensors) override;
 
+  // Seeks to the requested element if the file has an index file, and falls
+  // back to reading and discarding elements otherwise.
+  Status SkipRecords(int64 num_records) override;
+
   ~CustomReader() override {}
 
  protected:
@@ -269,6 +300,14 @@ class CustomReader : public Reader {
   Status ReadRecord(absl::Cord* record);
 #endif
 
+  // Reads the index file into `element_offsets_`, leaving it empty if the file
+  // has no usable index.
+  Status ReadIndex();
+
+  // Repositions `input_stream_` at `offset` in the file.
+  Status Seek(uint64 offset);
+
+  Env* env_ = nullptr;
   std::string filename_;
   std::unique_ptr<RandomAccessFile> file_;
   std::unique_ptr<io::InputStreamInterface> input_stream_;
@@ -278,6 +317,12 @@ class CustomReader : public Reader {
   int num_simple_ = 0;
   int num_complex_ = 0;
   std::vector<bool> simple_tensor_mask_;  // true for simple, false for complex.
+  // Number of elements read or skipped so far.
+  int64 num_elements_read_ = 0;
+  bool index_read_ = false;
+  // The offset of every element followed by the size of the file, or empty if
+  // the file has no usable index.
+  std::vector<uint64> element_offsets_;
 };
 
 // Writes snapshot metadata to the given directory.
@@ -18,6 +18,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.pb.h"
 #include "tensorflow/core/lib/core/status_test_util.h"
 #include "tensorflow/core/lib/io/compression.h"
+#include "tensorflow/core/platform/coding.h"
 #include "tensorflow/core/platform/env.h"
 #include "tensorflow/core/platform/logging.h"
 #include "tensorflow/core/platform/test.h"
@@ -91,6 +92,123 @@ TEST(SnapshotUtilTest, CombinationRoundTripTest) {
   SnapshotRoundTrip(io::compression::kSnappy, 2);
 }
 
+void SnapshotSkipRecords(std::string compression_type, bool expect_index,
+                         bool delete_index) {
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), filename, compression_type,
+                              /*version=*/1, {DT_INT64}, &writer));
+  for (int64 i = 0; i < 100; ++i) {
+    TF_ASSERT_OK(writer->WriteTensors({Tensor(i)}));
+  }
+  TF_ASSERT_OK(writer->Close());
+  EXPECT_EQ(Env::Default()->FileExists(IndexFileName(filename)).ok(),
+            expect_index);
+  if (delete_index) {
+    TF_ASSERT_OK(Env::Default()->DeleteFile(IndexFileName(filename)));
+  }
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), filename, compression_type,
+                              /*version=*/1, {DT_INT64}, &reader));
+  std::vector<Tensor> read_tensors;
+  TF_ASSERT_OK(reader->SkipRecords(10));
+  TF_ASSERT_OK(reader->ReadTensors(&read_tensors));
+  EXPECT_EQ(read_tensors[0].scalar<int64>()(), 10);
+  read_tensors.clear();
+  TF_ASSERT_OK(reader->SkipRecords(50));
+  TF_ASSERT_OK(reader->ReadTensors(&read_tensors));
+  EXPECT_EQ(read_tensors[0].scalar<int64>()(), 61);
+  EXPECT_TRUE(errors::IsOutOfRange(reader->SkipRecords(100)));
+
+  TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+  if (expect_index && !delete_index) {
+    TF_ASSERT_OK(Env::Default()->DeleteFile(IndexFileName(filename)));
+  }
+}
+
+TEST(SnapshotUtilTest, SkipRecordsTest) {
+  SnapshotSkipRecords(io::compression::kNone, /*expect_index=*/true,
+                      /*delete_index=*/false);
+  SnapshotSkipRecords(io::compression::kSnappy, /*expect_index=*/true,
+                      /*delete_index=*/false);
+  SnapshotSkipRecords(io::compression::kGzip, /*expect_index=*/false,
+                      /*delete_index=*/false);
+  SnapshotSkipRecords(io::compression::kNone, /*expect_index=*/true,
+                      /*delete_index=*/true);
+}
+
+TEST(SnapshotUtilTest, IndexSpansSeveralBlocks) {
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+
+  // More elements than the offsets that fit in one block of the index.
+  const int64 num_elements =
+      2 * CustomWriter::kIndexBlockSizeBytes / sizeof(uint64) + 10;
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), filename,
+                              io::compression::kSnappy, /*version=*/1,
+                              {DT_INT64}, &writer));
+  for (int64 i = 0; i < num_elements; ++i) {
+    TF_ASSERT_OK(writer->WriteTensors({Tensor(i)}));
+  }
+  TF_ASSERT_OK(writer->Close());
+  uint64 index_size;
+  TF_ASSERT_OK(
+      Env::Default()->GetFileSize(IndexFileName(filename), &index_size));
+  EXPECT_EQ(index_size, (num_elements + 1) * sizeof(uint64));
+
+  std::unique_ptr<Reader> reader;
+  TF_ASSERT_OK(Reader::Create(Env::Default(), filename,
+                              io::compression::kSnappy, /*version=*/1,
+                              {DT_INT64}, &reader));
+  std::vector<Tensor> read_tensors;
+  TF_ASSERT_OK(reader->SkipRecords(num_elements - 1));
+  TF_ASSERT_OK(reader->ReadTensors(&read_tensors));
+  EXPECT_EQ(read_tensors[0].scalar<int64>()(), num_elements - 1);
+
+  TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+  TF_ASSERT_OK(Env::Default()->DeleteFile(IndexFileName(filename)));
+}
+
+TEST(SnapshotUtilTest, IndexWithInvalidOffsets) {
+  std::string filename;
+  EXPECT_TRUE(Env::Default()->LocalTempFilename(&filename));
+
+  std::unique_ptr<Writer> writer;
+  TF_ASSERT_OK(Writer::Create(Env::Default(), filename, io::compression::kNone,
+                              /*version=*/1, {DT_INT64}, &writer));
+  for (int64 i = 0; i < 10; ++i) {
+    TF_ASSERT_OK(writer->WriteTensors({Tensor(i)}));
+  }
+  TF_ASSERT_OK(writer->Close());
+  uint64 file_size;
+  TF_ASSERT_OK(Env::Default()->GetFileSize(filename, &file_size));
+
+  // Both indices end with the size of the file, but have an offset that is
+  // out of order or past the end of the file.
+  for (uint64 invalid_offset : {file_size / 4, file_size + 1}) {
+    std::string index;
+    core::PutFixed64(&index, 0);
+    core::PutFixed64(&index, file_size / 2);
+    core::PutFixed64(&index, invalid_offset);
+    core::PutFixed64(&index, file_size);
+    TF_ASSERT_OK(
+        WriteStringToFile(Env::Default(), IndexFileName(filename), index));
+
+    std::unique_ptr<Reader> reader;
+    TF_ASSERT_OK(Reader::Create(Env::Default(), filename,
+                                io::compression::kNone, /*version=*/1,
+                                {DT_INT64}, &reader));
+    EXPECT_TRUE(errors::IsDataLoss(reader->SkipRecords(1)));
+  }
+
+  TF_ASSERT_OK(Env::Default()->DeleteFile(filename));
+  TF_ASSERT_OK(Env::Default()->DeleteFile(IndexFileName(filename)));
+}
+
 void SnapshotReaderBenchmarkLoop(int iters, std::string compression_type,
                                  int version) {
   tensorflow::testing::StopTiming();
@@ -12,14 +12,20 @@ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
+#include <atomic>
 #include <memory>
+#include <vector>
 
+#include "tensorflow/core/common_runtime/pool_allocator.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/framework/resource_mgr.h"
 #include "tensorflow/core/kernels/data/dataset_utils.h"
 #include "tensorflow/core/lib/core/refcount.h"
 #include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/mutex.h"
+#include "tensorflow/core/platform/numa.h"
 #include "tensorflow/core/platform/thread_annotations.h"
 #include "tensorflow/core/util/work_sharder.h"
 
@@ -28,20 +34,74 @@ namespace data {
 namespace experimental {
 namespace {
 
+// The NUMA node of the current thread, if it is a thread of a NUMA-aware
+// ThreadPoolResource. Set by the closures that the resource schedules, so
+// that the node is known without querying the thread's affinity.
+thread_local int current_thread_numa_node = port::kNUMANoAffinity;
+
+// Returns an allocator of host memory on `numa_node`. The allocators are
+// created on first use, and live as long as the process, since tensors
+// allocated from them may outlive any input pipeline.
+Allocator* NumaNodeAllocator(int numa_node) {
+  static mutex* mu = new mutex;
+  static std::vector<Allocator*>* allocators = new std::vector<Allocator*>;
+  mutex_lock l(*mu);
+  while (static_cast<int>(allocators->size()) <= numa_node) {
+    const int node = static_cast<int>(allocators->size());
+    allocators->push_back(new PoolAllocator(
+        /*pool_size_limit=*/100, /*auto_resize=*/true,
+        new BasicCPUAllocator(node, {}, {}), new NoopRounder,
+        strings::StrCat("tf_data_numa_", node)));
+  }
+  return (*allocators)[numa_node];
+}
+
+// If `numa_aware` is set and the machine has multiple NUMA nodes, the threads
+// are split into one pool per NUMA node, with each pool's threads pinned to
+// its node.
 class ThreadPoolResource : public ResourceBase {
  public:
   ThreadPoolResource(Env* env, const ThreadOptions& thread_options,
                      const string& name, int num_threads, bool low_latency_hint,
-                     int max_intra_op_parallelism)
-      : thread_pool_(env, thread_options, name, num_threads, low_latency_hint),
-        max_intra_op_parallelism_(max_intra_op_parallelism) {}
+                     int max_intra_op_parallelism, bool numa_aware)
+      : num_threads_(num_threads),
+        max_intra_op_parallelism_(max_intra_op_parallelism) {
+    int num_numa_nodes = 1;
+    if (numa_aware && port::NUMAEnabled()) {
+      num_numa_nodes = std::min(port::NUMANumNodes(), num_threads);
+    }
+    if (num_numa_nodes <= 1) {
+      thread_pools_.push_back(absl::make_unique<thread::ThreadPool>(
+          env, thread_options, name, num_threads, low_latency_hint));
+      return;
+    }
+    for (int node = 0; node < num_numa_nodes; ++node) {
+      ThreadOptions numa_thread_options = thread_options;
+      numa_thread_options.numa_node = node;
+      int node_threads = num_threads / num_numa_nodes +
+                         (node < num_threads % num_numa_nodes ? 1 : 0);
+      thread_pools_.push_back(absl::make_unique<thread::ThreadPool>(
+          env, numa_thread_options, strings::StrCat(name, "_numa_", node),
+          node_threads, low_latency_hint));
+    }
+  }
 
   // Schedules fn() for execution in the pool of threads.
   void Schedule(std::function<void()> fn) {
+    const int node = NumaNodeForCurrentThread();
+    thread::ThreadPool* thread_pool = thread_pools_[node].get();
+    if (IsNumaAware()) {
+      fn = std::bind(
+          [node](std::function<void()> bound_fn) {
+            current_thread_numa_node = node;
+            bound_fn();
+          },
+          std::move(fn));
+    }
     if (max_intra_op_parallelism_ < 0) {
-      thread_pool_.Schedule(std::move(fn));
+      thread_pool->Schedule(std::move(fn));
     } else {
-      thread_pool_.Schedule(std::bind(
+      thread_pool->Schedule(std::bind(
           [this](std::function<void()> bound_fn) {
             // TODO(mrry): Consider moving this thread-local configuration to
             // the threads themselves.
@@ -52,12 +112,48 @@ class ThreadPoolResource : public ResourceBase {
     }
   }
 
-  int32 NumThreads() { return thread_pool_.NumThreads(); }
+  int32 NumThreads() { return num_threads_; }
+
+  // Returns whether the threads are pinned to NUMA nodes.
+  bool IsNumaAware() const { return thread_pools_.size() > 1; }
+
+  // Returns an allocator of host memory local to the NUMA node of the current
+  // thread, or nullptr if the current thread is not pinned to a node by a
+  // NUMA-aware resource.
+  static Allocator* AllocatorForCurrentThread() {
+    if (current_thread_numa_node == port::kNUMANoAffinity) {
+      return nullptr;
+    }
+    return NumaNodeAllocator(current_thread_numa_node);
+  }
 
   string DebugString() const override { return "ThreadPoolResource"; }
 
  private:
-  thread::ThreadPool thread_pool_;
+  // Returns the index of the pool that should run a function scheduled from
+  // the current thread, which is also the NUMA node of the pool's threads if
+  // the resource is NUMA-aware. Functions scheduled from a thread pinned to a
+  // NUMA node stay on that node, so that work spawned by an input pipeline
+  // shard (and the memory it touches) does not cross sockets. Functions
+  // scheduled from other threads are distributed round-robin across the NUMA
+  // nodes.
+  int NumaNodeForCurrentThread() {
+    const int num_pools = static_cast<int>(thread_pools_.size());
+    if (num_pools == 1) {
+      return 0;
+    }
+    const int node = current_thread_numa_node;
+    if (node >= 0 && node < num_pools) {
+      return node;
+    }
+    return static_cast<int>(next_thread_pool_++ % num_pools);
+  }
+
+  // One pool per NUMA node if the resource is NUMA-aware, a single pool
+  // otherwise.
+  std::vector<std::unique_ptr<thread::ThreadPool>> thread_pools_;
+  std::atomic<uint64> next_thread_pool_{0};
+  const int num_threads_;
   const int max_intra_op_parallelism_;
 };
 
@@ -75,6 +171,7 @@ class ThreadPoolHandleOp : public OpKernel {
     OP_REQUIRES(
         ctx, num_threads_ > 0,
         errors::InvalidArgument("`num_threads` must be greater than zero."));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("numa_aware", &numa_aware_));
   }
 
   // The resource is deleted from the resource manager only when it is private
@@ -104,7 +201,8 @@ class ThreadPoolHandleOp : public OpKernel {
                                         ctx->env(), {}, display_name_,
                                         num_threads_,
                                         /*low_latency_hint=*/false,
-                                        max_intra_op_parallelism_);
+                                        max_intra_op_parallelism_,
+                                        numa_aware_);
                                     return Status::OK();
                                   }));
       initialized_ = true;
@@ -121,6 +219,7 @@ class ThreadPoolHandleOp : public OpKernel {
   string display_name_;
   int num_threads_;
   int max_intra_op_parallelism_;
+  bool numa_aware_ = false;
 };
 
 class ThreadPoolDatasetOp : public UnaryDatasetOpKernel {
@@ -239,6 +338,23 @@ class ThreadPoolDatasetOp : public UnaryDatasetOpKernel {
           pool->Schedule(std::move(c));
         };
         params.runner_threadpool_size = pool->NumThreads();
+        if (pool->IsNumaAware()) {
+          // Allocate host memory from the NUMA node of the allocating thread,
+          // so that elements are produced in memory local to the socket that
+          // produces them.
+          auto allocator_getter = params.allocator_getter;
+          params.allocator_getter =
+              [allocator_getter](AllocatorAttributes attrs) {
+                if (attrs.value == 0) {
+                  Allocator* allocator =
+                      ThreadPoolResource::AllocatorForCurrentThread();
+                  if (allocator != nullptr) {
+                    return allocator;
+                  }
+                }
+                return allocator_getter(attrs);
+              };
+        }
         return params;
       }
 
@@ -14,12 +14,17 @@ limitations under the License.
 ==============================================================================*/
 
 #include "absl/memory/memory.h"
+#include "tensorflow/core/data/dataset.pb.h"
 #include "tensorflow/core/framework/dataset.h"
 #include "tensorflow/core/framework/metrics.h"
 #include "tensorflow/core/framework/model.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/kernels/data/dataset_utils.h"
+#include "tensorflow/core/kernels/data/serialization_utils.h"
+#include "tensorflow/core/lib/io/path.h"
 #include "tensorflow/core/lib/random/random.h"
+#include "tensorflow/core/lib/strings/strcat.h"
 #include "tensorflow/core/platform/cpu_info.h"
 #include "tensorflow/core/util/ptr_util.h"
 
@@ -32,6 +37,77 @@ constexpr int64 kOptimizationPeriodThresholdMs = 60 * EnvTime::kSecondsToMillis;
 // Default share of available RAM that can be used by model's internal buffers.
 constexpr double kRamBudgetShare = 0.5;
 
+// Suffix of the files storing the autotuning state of an input pipeline.
+constexpr char kAutotuneStateSuffix[] = ".autotune";
+
+Status ReadAutotuneState(Env* env, const string& filename,
+                         model::ModelState* state) {
+  AutotuneState proto;
+  TF_RETURN_IF_ERROR(ReadBinaryProto(env, filename, &proto));
+  for (const auto& node : proto.nodes()) {
+    model::NodeState& node_state = (*state)[node.first];
+    node_state.self_processing_time = node.second.self_processing_time();
+    for (const auto& parameter : node.second.parameters()) {
+      node_state.parameters[parameter.first] = parameter.second;
+    }
+  }
+  return Status::OK();
+}
+
+Status WriteAutotuneState(Env* env, const string& filename,
+                          const model::ModelState& state) {
+  AutotuneState proto;
+  for (const auto& pair : state) {
+    AutotuneState::Node& node = (*proto.mutable_nodes())[pair.first];
+    node.set_self_processing_time(pair.second.self_processing_time);
+    for (const auto& parameter : pair.second.parameters) {
+      (*node.mutable_parameters())[parameter.first] = parameter.second;
+    }
+  }
+  TF_RETURN_IF_ERROR(env->RecursivelyCreateDir(string(io::Dirname(filename))));
+  // Write to a temporary file first so that a concurrently starting pipeline
+  // never reads a partially written state.
+  string tmp_filename = strings::StrCat(filename, "-tmp-", random::New64());
+  TF_RETURN_IF_ERROR(WriteBinaryProto(env, tmp_filename, proto));
+  return env->RenameFile(tmp_filename, filename);
+}
+
+// Returns whether the tunable parameter values of `a` and `b` differ. The
+// processing times are not compared, as they change with every measurement.
+bool TunedValuesDiffer(const model::ModelState& a, const model::ModelState& b) {
+  if (a.size() != b.size()) {
+    return true;
+  }
+  for (const auto& pair : a) {
+    auto it = b.find(pair.first);
+    if (it == b.end() || it->second.parameters != pair.second.parameters) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Returns the file storing the autotuning state of `input` in `dir`, keyed on
+// the fingerprint of the input pipeline so that the state is only reused for
+// the same pipeline.
+Status AutotuneStateFile(OpKernelContext* ctx, const DatasetBase* input,
+                         const string& dir, string* filename) {
+  GraphDef graph_def;
+  SerializationContext::Params params;
+  std::vector<std::pair<string, Tensor>> input_list;
+  params.input_list = &input_list;
+  params.external_state_policy =
+      SerializationContext::ExternalStatePolicy::kIgnore;
+  TF_RETURN_IF_ERROR(
+      AsGraphDef(ctx, input, SerializationContext(params), &graph_def));
+  uint64 hash;
+  TF_RETURN_IF_ERROR(HashGraph(graph_def, &hash));
+  *filename = io::JoinPath(
+      dir, strings::StrCat(strings::Hex(hash, strings::kZeroPad16),
+                           kAutotuneStateSuffix));
+  return Status::OK();
+}
+
 class ModelDatasetOp : public UnaryDatasetOpKernel {
  public:
   explicit ModelDatasetOp(OpKernelConstruction* ctx)
@@ -51,11 +127,51 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
                 errors::InvalidArgument("CPU budget must be positive but is ",
                                         cpu_budget_, "."));
     ram_budget_ = kRamBudgetShare * port::AvailableRam();
+    if (ctx->HasAttr("latency_weight")) {
+      float latency_weight, cpu_weight, ram_weight;
+      int64 target_step_time_us;
+      OP_REQUIRES_OK(ctx, ctx->GetAttr("latency_weight", &latency_weight));
+      OP_REQUIRES_OK(ctx, ctx->GetAttr("cpu_weight", &cpu_weight));
+      OP_REQUIRES_OK(ctx, ctx->GetAttr("ram_weight", &ram_weight));
+      OP_REQUIRES_OK(
+          ctx, ctx->GetAttr("target_step_time_us", &target_step_time_us));
+      OP_REQUIRES(ctx,
+                  latency_weight >= 0 && cpu_weight >= 0 && ram_weight >= 0,
+                  errors::InvalidArgument(
+                      "Autotuning objective weights must be non-negative."));
+      OP_REQUIRES(ctx, target_step_time_us >= 0,
+                  errors::InvalidArgument(
+                      "Target step time must be non-negative but is ",
+                      target_step_time_us, "."));
+      objective_.latency_weight = latency_weight;
+      objective_.cpu_weight = cpu_weight;
+      objective_.ram_weight = ram_weight;
+      objective_.target_output_time =
+          static_cast<double>(target_step_time_us) * EnvTime::kMicrosToNanos;
+    }
+    if (ctx->HasAttr("autotune_state_dir")) {
+      OP_REQUIRES_OK(ctx,
+                     ctx->GetAttr("autotune_state_dir", &autotune_state_dir_));
+    }
   }
 
   void MakeDataset(OpKernelContext* ctx, DatasetBase* input,
                    DatasetBase** output) override {
-    *output = new Dataset(ctx, input, algorithm_, cpu_budget_, ram_budget_);
+    string autotune_state_file;
+    // Serializing and hashing the input pipeline is only worth its cost when
+    // the autotuning state is persisted.
+    if (!autotune_state_dir_.empty()) {
+      Status s = AutotuneStateFile(ctx, input, autotune_state_dir_,
+                                   &autotune_state_file);
+      if (!s.ok()) {
+        autotune_state_file.clear();
+        LOG(WARNING) << "Failed to compute the fingerprint of the input "
+                        "pipeline. Its autotuning state will not be persisted: "
+                     << s;
+      }
+    }
+    *output = new Dataset(ctx, input, algorithm_, cpu_budget_, ram_budget_,
+                          objective_, autotune_state_file);
   }
 
  private:
@@ -63,12 +179,15 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
    public:
     Dataset(OpKernelContext* ctx, const DatasetBase* input,
             model::AutotuneAlgorithm algorithm, int64 cpu_budget,
-            int64 ram_budget)
+            int64 ram_budget, const model::OptimizationObjective& objective,
+            const string& autotune_state_file)
         : DatasetBase(DatasetContext(ctx)),
           input_(input),
           algorithm_(algorithm),
           cpu_budget_(cpu_budget),
-          ram_budget_(ram_budget) {
+          ram_budget_(ram_budget),
+          objective_(objective),
+          autotune_state_file_(autotune_state_file) {
       input_->Ref();
     }
 
@@ -114,14 +233,36 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
       }
 
       ~Iterator() override {
-        // Signal the optimize thread to terminate it. We will then join that
-        // thread when we delete `this->optimize_thread_`.
-        mutex_lock l(mu_);
-        cancelled_ = true;
-        cond_var_.notify_all();
+        // Signal the optimize thread to terminate it, and join it.
+        std::unique_ptr<Thread> model_thread;
+        {
+          mutex_lock l(mu_);
+          cancelled_ = true;
+          cond_var_.notify_all();
+          model_thread = std::move(model_thread_);
+        }
+        // The model thread writes the final autotuning state, so it is joined
+        // while the input iterators, and hence the model nodes, still exist.
+        model_thread.reset();
       }
 
       Status Initialize(IteratorContext* ctx) override {
+        if (!dataset()->autotune_state_file_.empty()) {
+          // Warm-start the model with the state of a previous run of the same
+          // input pipeline, if any. This must happen before the input
+          // iterators, and hence the model nodes, are created.
+          model::ModelState state;
+          Status s = ReadAutotuneState(
+              ctx->env(), dataset()->autotune_state_file_, &state);
+          if (s.ok()) {
+            VLOG(2) << "Warm-starting autotuning from "
+                    << dataset()->autotune_state_file_;
+            model_->SetWarmStartState(std::move(state));
+          } else if (!errors::IsNotFound(s)) {
+            LOG(WARNING) << "Failed to read the autotuning state from "
+                         << dataset()->autotune_state_file_ << ": " << s;
+          }
+        }
         IteratorContext::Params params(ctx);
         params.model = model_;
         return dataset()->input_->MakeIterator(
@@ -179,6 +320,7 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
         int64 optimization_period_ms = 10;
         int64 current_time_ms = EnvTime::NowMicros() / EnvTime::kMillisToMicros;
         while (true) {
+          bool cancelled;
           {
             mutex_lock l(mu_);
             while (!cancelled_ &&
@@ -190,10 +332,17 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
               cond_var_.wait_for(l, std::chrono::milliseconds(wait_ms));
               current_time_ms = EnvTime::NowMicros() / EnvTime::kMillisToMicros;
             }
-            if (cancelled_) return;
+            cancelled = cancelled_;
+          }
+          if (cancelled) {
+            // Persists the latest processing times as well, which are not
+            // written when only they changed.
+            MaybeWriteAutotuneState(ctx->env(), /*force=*/true);
+            return;
           }
           model_->Optimize(dataset()->algorithm_, dataset()->cpu_budget_,
-                           dataset()->ram_budget_);
+                           dataset()->ram_budget_, dataset()->objective_);
+          MaybeWriteAutotuneState(ctx->env(), /*force=*/false);
           // Exponentially increase the period of running the optimization
           // until a threshold is reached.
           if (optimization_period_ms != kOptimizationPeriodThresholdMs) {
@@ -206,9 +355,35 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
         }
       }
 
+      // Writes the autotuning state of the model if it is persisted, and
+      // either `force` is true or the tuned values changed since the last
+      // write. Called by the model thread only.
+      void MaybeWriteAutotuneState(Env* env, bool force) {
+        if (dataset()->autotune_state_file_.empty()) {
+          return;
+        }
+        model::ModelState state = model_->GetState();
+        // An empty state would replace the state of an earlier run with
+        // nothing, e.g. if the iterator is destroyed before it is used.
+        if (state.empty() ||
+            (!force && !TunedValuesDiffer(state, written_state_))) {
+          return;
+        }
+        Status s =
+            WriteAutotuneState(env, dataset()->autotune_state_file_, state);
+        if (!s.ok()) {
+          LOG(WARNING) << "Failed to write the autotuning state to "
+                       << dataset()->autotune_state_file_ << ": " << s;
+          return;
+        }
+        written_state_ = std::move(state);
+      }
+
       mutex mu_;
       condition_variable cond_var_;
       std::shared_ptr<model::Model> model_;
+      // The autotuning state last written by the model thread.
+      model::ModelState written_state_;
       std::unique_ptr<Thread> model_thread_ TF_GUARDED_BY(mu_);
       bool cancelled_ TF_GUARDED_BY(mu_) = false;
       std::unique_ptr<IteratorBase> input_impl_;
@@ -218,11 +393,17 @@ class ModelDatasetOp : public UnaryDatasetOpKernel {
     const model::AutotuneAlgorithm algorithm_;
     const int64 cpu_budget_;
     const int64 ram_budget_;
+    const model::OptimizationObjective objective_;
+    // File storing the autotuning state of the input pipeline, or empty if the
+    // state is not persisted.
+    const string autotune_state_file_;
   };
 
   model::AutotuneAlgorithm algorithm_;
   int64 cpu_budget_;
   int64 ram_budget_;
+  model::OptimizationObjective objective_;
+  string autotune_state_dir_;
 };
 
 REGISTER_KERNEL_BUILDER(Name("ModelDataset").Device(DEVICE_CPU),
@@ -41,6 +41,7 @@ limitations under the License.
 #include "tensorflow/core/lib/strings/stringprintf.h"
 #include "tensorflow/core/platform/blocking_counter.h"
 #include "tensorflow/core/platform/cpu_info.h"
+#include "tensorflow/core/platform/env_time.h"
 #include "tensorflow/core/platform/stringprintf.h"
 
 namespace tensorflow {
@@ -650,8 +651,7 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           std::swap(*result, element->results.front());
           element->results.pop_front();
           if (!element->active) {
-            elements_to_process_.push_back(cycle_index_);
-            current_workers_cond_var_.notify_one();
+            ScheduleCurrentElement(cycle_index_);
           }
           AdvancePosition();
           return true;
@@ -680,9 +680,8 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
           current_elements_[cycle_index_] = MakeElement();
           if (current_elements_[cycle_index_]) {
             current_elements_[cycle_index_]->cycle_index = cycle_index_;
-            elements_to_process_.push_back(cycle_index_);
             element->cycle_index = cycle_index_;
-            current_workers_cond_var_.notify_one();
+            ScheduleCurrentElement(cycle_index_);
           }
           while (last_valid_current_element_ >= 0 &&
                  !current_elements_[last_valid_current_element_]) {
@@ -782,7 +781,9 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
     // processing it. When a worker is processing an element, it will
     // claim the element by setting `element->active`, then continue to produce
     // results for the element until enough results have been computed for the
-    // current cycle and the results buffer is full.
+    // current cycle and the results buffer is full. When no current element
+    // needs processing, an idle current worker steals buffered prefetch work
+    // from a future element that no other worker is processing.
     void CurrentWorkerThread() TF_LOCKS_EXCLUDED(mu_) {
       RecordStart(ctx_.get());
       auto done = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
@@ -793,7 +794,6 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
         DecrementCurrentWorkers();
       };
       while (true) {
-        int element_index;
         std::shared_ptr<Element> element;
         // Find an element to process.
         {
@@ -811,11 +811,13 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
               elements_to_process_.pop_front();
               auto& e = current_elements_[index];
               if (NeedsProcessing(e) && !e->active) {
-                element_index = index;
                 element = e;
                 break;
               }
             }
+            if (!element && !wait_for_checkpoint_) {
+              element = StealFutureElement();
+            }
             if (element) {
               break;
             }
@@ -850,7 +852,10 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
     // Future workers process elements after the current interleave cycle. A
     // future worker's job is to keep `future_elements_` filled with elements.
     // Elements in `future_elements` have had their first `kPerIteratorPrefetch`
-    // results computed.
+    // results computed. When `future_elements_` is full and every current
+    // worker is busy, an idle future worker steals the processing of a current
+    // element so that a slow element does not leave the rest of the cycle
+    // without workers.
     void FutureWorkerThread() TF_LOCKS_EXCLUDED(mu_) {
       RecordStart(ctx_.get());
       auto done = [this]() TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
@@ -867,32 +872,88 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
             if (element->cycle_index != -1) {
               element->cond_var.notify_one();
               // A current worker may need to process the element further.
-              elements_to_process_.push_back(element->cycle_index);
-              current_workers_cond_var_.notify_one();
+              ScheduleCurrentElement(element->cycle_index);
             }
           }
-          while (!cancelled_ && (future_elements_.size() >=
-                                     dataset()->prefetch_input_elements_ ||
-                                 wait_for_checkpoint_)) {
+          element.reset();
+          while (!cancelled_) {
+            if (!wait_for_checkpoint_) {
+              if (future_elements_.size() <
+                  dataset()->prefetch_input_elements_) {
+                break;
+              }
+              element = StealCurrentElement();
+              if (element) {
+                break;
+              }
+            }
             WaitWorkerThread(&future_workers_cond_var_, &l);
           }
           if (cancelled_) {
             done();
             return;
           }
-          element = MakeElement();
-          if (!element) {
-            done();
-            return;
+          if (element) {
+            VLOG(3) << "Future worker stole element " << element->id;
+            element->active = true;
+          } else {
+            element = MakeElement();
+            if (!element) {
+              done();
+              return;
+            }
+            VLOG(3) << "Future worker created element " << element->id;
+            element->active = true;
+            future_elements_.push_back(element);
           }
-          VLOG(3) << "Future worker created element " << element->id;
-          element->active = true;
-          future_elements_.push_back(element);
         }
         ProcessElement(element);
       }
     }
 
+    // Returns a current element that needs processing and is not being
+    // processed by any worker, or null if there is no such element or some
+    // current worker is idle and can process it instead.
+    std::shared_ptr<Element> StealCurrentElement()
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (num_current_active_workers_ < num_current_workers_) {
+        return nullptr;
+      }
+      while (!elements_to_process_.empty()) {
+        int index = elements_to_process_.front();
+        elements_to_process_.pop_front();
+        auto& e = current_elements_[index];
+        if (NeedsProcessing(e) && !e->active) {
+          return e;
+        }
+      }
+      return nullptr;
+    }
+
+    // Returns a future element that needs processing and is not being
+    // processed by any worker, or null if there is no such element. This
+    // happens, for instance, for future elements restored from a checkpoint.
+    std::shared_ptr<Element> StealFutureElement()
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      for (const auto& e : future_elements_) {
+        if (NeedsProcessing(e) && !e->active) {
+          return e;
+        }
+      }
+      return nullptr;
+    }
+
+    // Queues the current element at the given cycle index for processing. If
+    // every current worker is busy, an idle future worker is woken up as well
+    // so that it can steal the work.
+    void ScheduleCurrentElement(int64 index) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      elements_to_process_.push_back(index);
+      current_workers_cond_var_.notify_one();
+      if (num_current_active_workers_ >= num_current_workers_) {
+        future_workers_cond_var_.notify_one();
+      }
+    }
+
     // Generates results for the given element until the element's results
     // buffer is full or the element is done producing results.
     void ProcessElement(std::shared_ptr<Element> element)
@@ -919,8 +980,16 @@ class ParallelInterleaveDatasetOp::Dataset : public DatasetBase {
       while (true) {
         auto result = std::make_shared<Result>();
         bool end_of_input = false;
+        auto stats_aggregator = ctx_->stats_aggregator();
+        const uint64 start_ns = stats_aggregator ? EnvTime::NowNanos() : 0;
         result->status = iterator->GetNext(ctx_.get(), &result->return_values,
                                            &end_of_input);
+        if (stats_aggregator) {
+          stats_aggregator->AddToHistogram(
+              stats_utils::ElementLatencyHistogramName(dataset()->node_name()),
+              {static_cast<double>(EnvTime::NowNanos() - start_ns)},
+              num_elements());
+        }
         if (end_of_input) {
           mutex_lock l(*mu_);
           element->iterator.reset();
@@ -11,7 +11,12 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/parallel_interleave_dataset_op.h"
 
+#include <map>
+#include <numeric>
+
+#include "tensorflow/core/framework/stats_aggregator.h"
 #include "tensorflow/core/kernels/data/dataset_test_base.h"
+#include "tensorflow/core/kernels/data/stats_utils.h"
 
 namespace tensorflow {
 namespace data {
@@ -774,6 +779,148 @@ TEST_F(ParallelInterleaveDatasetOpTest, InvalidArguments) {
   }
 }
 
+// Fewer parallel calls than cycle elements, so queued current elements can be
+// stolen by future workers and future elements by idle current workers.
+ParallelInterleaveDatasetParams WorkStealingParams() {
+  std::vector<int64> values(24);
+  std::iota(values.begin(), values.end(), 0);
+  auto tensor_slice_dataset_params = TensorSliceDatasetParams(
+      /*components=*/{CreateTensor<int64>(TensorShape{8, 3, 1}, values)},
+      /*node_name=*/"tensor_slice");
+  return ParallelInterleaveDatasetParams(
+      tensor_slice_dataset_params,
+      /*other_arguments=*/{},
+      /*cycle_length=*/4,
+      /*block_length=*/1,
+      /*buffer_output_elements=*/1,
+      /*prefetch_input_elements=*/4,
+      /*num_parallel_calls=*/2,
+      /*func=*/
+      MakeTensorSliceDatasetFunc(
+          DataTypeVector({DT_INT64}),
+          std::vector<PartialTensorShape>({PartialTensorShape({1})})),
+      /*func_lib=*/{test::function::MakeTensorSliceDataset()},
+      /*type_arguments=*/{},
+      /*output_dtypes=*/{DT_INT64},
+      /*output_shapes=*/{PartialTensorShape({1})},
+      /*deterministic=*/DeterminismPolicy::kNondeterministic,
+      /*node_name=*/kNodeName);
+}
+
+std::vector<Tensor> WorkStealingOutputs() {
+  std::vector<std::vector<int64>> values;
+  for (int64 i = 0; i < 24; ++i) {
+    values.push_back({i});
+  }
+  return CreateTensors<int64>(TensorShape{1}, values);
+}
+
+TEST_F(ParallelInterleaveDatasetOpTest, WorkStealingProducesEveryElementOnce) {
+  auto dataset_params = WorkStealingParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  while (!end_of_sequence) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+  }
+  TF_EXPECT_OK(ExpectEqual(out_tensors, WorkStealingOutputs(),
+                           /*compare_order=*/false));
+}
+
+TEST_F(ParallelInterleaveDatasetOpTest, WorkStealingAfterRestore) {
+  auto dataset_params = WorkStealingParams();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  bool end_of_sequence = false;
+  std::vector<Tensor> out_tensors;
+  for (int i = 0; i < 5; ++i) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+  }
+
+  // Restored future elements have no worker until an idle current worker
+  // picks them up.
+  std::unique_ptr<SerializationContext> serialization_ctx;
+  TF_ASSERT_OK(CreateSerializationContext(&serialization_ctx));
+  VariantTensorDataWriter writer;
+  TF_ASSERT_OK(iterator_->Save(serialization_ctx.get(), &writer));
+  std::vector<const VariantTensorData*> data;
+  writer.GetData(&data);
+  VariantTensorDataReader reader(data);
+  TF_ASSERT_OK(RestoreIterator(iterator_ctx_.get(), &reader,
+                               dataset_params.iterator_prefix(), *dataset_,
+                               &iterator_));
+  while (!end_of_sequence) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(
+        iterator_->GetNext(iterator_ctx_.get(), &next, &end_of_sequence));
+    out_tensors.insert(out_tensors.end(), next.begin(), next.end());
+  }
+  TF_EXPECT_OK(ExpectEqual(out_tensors, WorkStealingOutputs(),
+                           /*compare_order=*/false));
+}
+
+// Counts the values added to each histogram.
+class CountingStatsAggregator : public StatsAggregator {
+ public:
+  void AddToHistogram(const string& name, gtl::ArraySlice<double> values,
+                      int64 global_step) override {
+    mutex_lock l(mu_);
+    histogram_counts_[name] += values.size();
+  }
+
+  void AddScalar(const string& name, float value,
+                 int64 global_step) override {}
+
+  void EncodeToProto(Summary* out_summary) override {}
+
+  Status SetSummaryWriter(SummaryWriterInterface* summary_writer) override {
+    return Status::OK();
+  }
+
+  void IncrementCounter(const string& name, const string& label,
+                        int64 val) override {}
+
+  int64 histogram_count(const string& name) {
+    mutex_lock l(mu_);
+    return histogram_counts_[name];
+  }
+
+ private:
+  mutex mu_;
+  std::map<string, int64> histogram_counts_ TF_GUARDED_BY(mu_);
+};
+
+TEST_F(ParallelInterleaveDatasetOpTest, RecordsElementLatency) {
+  auto dataset_params = ParallelInterleaveDatasetParams1();
+  TF_ASSERT_OK(Initialize(dataset_params));
+  auto stats_aggregator = std::make_shared<CountingStatsAggregator>();
+  IteratorContext::Params params(iterator_ctx_.get());
+  params.stats_aggregator = stats_aggregator;
+  IteratorContext ctx(std::move(params));
+  std::unique_ptr<IteratorBase> iterator;
+  TF_ASSERT_OK(dataset_->MakeIterator(&ctx, /*parent=*/nullptr,
+                                      dataset_params.iterator_prefix(),
+                                      &iterator));
+  bool end_of_sequence = false;
+  int num_elements = 0;
+  while (!end_of_sequence) {
+    std::vector<Tensor> next;
+    TF_ASSERT_OK(iterator->GetNext(&ctx, &next, &end_of_sequence));
+    if (!end_of_sequence) num_elements++;
+  }
+  EXPECT_EQ(num_elements, 9);
+  // Every element, and the end of input of each of the three cycle elements,
+  // takes one GetNext call on a cycle element.
+  EXPECT_EQ(stats_aggregator->histogram_count(
+                stats_utils::ElementLatencyHistogramName(kNodeName)),
+            12);
+}
+
 }  // namespace
 }  // namespace data
 }  // namespace tensorflow
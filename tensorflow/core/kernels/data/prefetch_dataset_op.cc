@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/prefetch_dataset_op.h"
 
+#include <atomic>
 #include <deque>
 
 #include "tensorflow/core/common_runtime/metrics.h"
@@ -23,6 +24,7 @@ limitations under the License.
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/dataset_utils.h"
 #include "tensorflow/core/kernels/data/name_utils.h"
+#include "tensorflow/core/kernels/data/spsc_ring_buffer.h"
 #include "tensorflow/core/kernels/data/stats_utils.h"
 #include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/strings/str_util.h"
@@ -45,6 +47,7 @@ namespace data {
 /* static */ constexpr const char* const PrefetchDatasetOp::kOutputShapes;
 /* static */ constexpr const char* const PrefetchDatasetOp::kSlackPeriod;
 /* static */ constexpr const char* const PrefetchDatasetOp::kLegacyAutotune;
+/* static */ constexpr const char* const PrefetchDatasetOp::kLockFreeBuffer;
 
 // Determines the fraction of slack time by which to delay prefetching of data.
 constexpr double kSleepFactor = 0.2;
@@ -53,16 +56,37 @@ constexpr char kStatus[] = "status";
 constexpr char kSizeSuffix[] = ".size";
 constexpr char kCodeSuffix[] = ".code";
 constexpr char kErrorMessageSuffix[] = ".error_message";
+// Bounds on the number of times a thread polls the lock-free buffer before it
+// parks on the condition variable.
+constexpr int64 kMinSpins = 16;
+constexpr int64 kMaxSpins = 4096;
+
+namespace {
+
+// Adapts a spin budget: it grows while spinning pays off and shrinks when the
+// thread ends up parking anyway.
+void GrowSpins(std::atomic<int64>* spins) {
+  spins->store(std::min(spins->load(std::memory_order_relaxed) * 2, kMaxSpins),
+               std::memory_order_relaxed);
+}
+
+void ShrinkSpins(std::atomic<int64>* spins) {
+  spins->store(std::max(spins->load(std::memory_order_relaxed) / 2, kMinSpins),
+               std::memory_order_relaxed);
+}
+
+}  // namespace
 
 class PrefetchDatasetOp::Dataset : public DatasetBase {
  public:
   Dataset(OpKernelContext* ctx, const DatasetBase* input, int64 buffer_size,
-          int64 slack_period, bool legacy_autotune)
+          int64 slack_period, bool legacy_autotune, bool lock_free_buffer)
       : DatasetBase(DatasetContext(ctx)),
         input_(input),
         buffer_size_(buffer_size),
         slack_period_(slack_period),
-        legacy_autotune_(legacy_autotune) {
+        legacy_autotune_(legacy_autotune),
+        lock_free_buffer_(lock_free_buffer) {
     input_->Ref();
   }
 
@@ -104,10 +128,13 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
     b->BuildAttrValue(slack_period_, &slack_period_attr);
     AttrValue legacy_autotune_attr;
     b->BuildAttrValue(legacy_autotune_, &legacy_autotune_attr);
+    AttrValue lock_free_buffer_attr;
+    b->BuildAttrValue(lock_free_buffer_, &lock_free_buffer_attr);
     TF_RETURN_IF_ERROR(
         b->AddDataset(this, {input_graph_node, buffer_size},
                       {std::make_pair(kSlackPeriod, slack_period_attr),
-                       std::make_pair(kLegacyAutotune, legacy_autotune_attr)},
+                       std::make_pair(kLegacyAutotune, legacy_autotune_attr),
+                       std::make_pair(kLockFreeBuffer, lock_free_buffer_attr)},
                       output));
     return Status::OK();
   }
@@ -125,6 +152,13 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
               legacy_autotune_ ? 0 : params.dataset->buffer_size_, mu_,
               cond_var_)) {
       slack_us_ = 0;
+      // The ring buffer has a fixed capacity, so it can only be used when the
+      // buffer size is not tuned.
+      if (params.dataset->lock_free_buffer_ &&
+          params.dataset->buffer_size_ > 0) {
+        ring_buffer_ = absl::make_unique<SpscRingBuffer<BufferElement>>(
+            params.dataset->buffer_size_);
+      }
     }
 
     ~Iterator() override {
@@ -146,6 +180,9 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
     Status GetNextInternal(IteratorContext* ctx,
                            std::vector<Tensor>* out_tensors,
                            bool* end_of_sequence) override {
+      if (ring_buffer_) {
+        return GetNextFromRingBuffer(ctx, out_tensors, end_of_sequence);
+      }
       const auto& stats_aggregator = ctx->stats_aggregator();
       {
         mutex_lock l(*mu_);
@@ -214,15 +251,19 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
 
     Status SaveInternal(SerializationContext* ctx,
                         IteratorStateWriter* writer) override {
-      // Acquire both locks to ensure that the prefetch thread and
+      // Acquire all locks to ensure that the prefetch thread and
       // all GetNext threads are blocked.
       mutex_lock input_l(input_mu_);
+      mutex_lock consumer_l(consumer_mu_);
       mutex_lock l(*mu_);
       TF_RETURN_IF_ERROR(SaveInput(ctx, writer, input_impl_));
+      const size_t buffer_size =
+          ring_buffer_ ? ring_buffer_->size() : buffer_.size();
       TF_RETURN_IF_ERROR(
-          writer->WriteScalar(prefix(), kBufferSize, buffer_.size()));
-      for (size_t i = 0; i < buffer_.size(); i++) {
-        auto& buffer_element = buffer_[i];
+          writer->WriteScalar(prefix(), kBufferSize, buffer_size));
+      for (size_t i = 0; i < buffer_size; i++) {
+        auto& buffer_element =
+            ring_buffer_ ? ring_buffer_->Get(i) : buffer_[i];
         TF_RETURN_IF_ERROR(WriteStatus(writer, i, buffer_element.status));
         if (buffer_element.status.ok()) {
           TF_RETURN_IF_ERROR(writer->WriteScalar(
@@ -241,8 +282,12 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
     Status RestoreInternal(IteratorContext* ctx,
                            IteratorStateReader* reader) override {
       mutex_lock input_l(input_mu_);
+      mutex_lock consumer_l(consumer_mu_);
       mutex_lock l(*mu_);
       buffer_.clear();
+      if (ring_buffer_) {
+        ring_buffer_->Clear();
+      }
       TF_RETURN_IF_ERROR(RestoreInput(ctx, reader, input_impl_));
       size_t buffer_size;
       {
@@ -251,8 +296,7 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
         buffer_size = static_cast<size_t>(temp);
       }
       for (size_t i = 0; i < buffer_size; i++) {
-        buffer_.emplace_back();
-        auto& buffer_element = buffer_.back();
+        BufferElement buffer_element;
         TF_RETURN_IF_ERROR(ReadStatus(reader, i, &buffer_element.status));
         if (buffer_element.status.ok()) {
           size_t value_size;
@@ -272,6 +316,14 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
                                    &buffer_element.value.back()));
           }
         }
+        if (!ring_buffer_) {
+          buffer_.push_back(std::move(buffer_element));
+        } else if (!ring_buffer_->TryPush(std::move(buffer_element))) {
+          return errors::FailedPrecondition(
+              "Checkpointed prefetch buffer holds ", buffer_size,
+              " elements, but the buffer size is ",
+              ring_buffer_->capacity());
+        }
       }
       return Status::OK();
     }
@@ -388,10 +440,138 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
             std::make_shared<IteratorContext>(*ctx);
         prefetch_thread_ = ctx->StartThread(
             "tf_data_prefetch", [this, new_ctx]() { PrefetchThread(new_ctx); });
+        prefetch_thread_started_ = true;
       }
       return Status::OK();
     }
 
+    // Implements `GetNext` on top of `ring_buffer_`. Consumers poll the ring
+    // buffer for a while before parking on `cond_var_`, so that neither side
+    // acquires `mu_` while the buffer is neither empty nor full.
+    Status GetNextFromRingBuffer(IteratorContext* ctx,
+                                 std::vector<Tensor>* out_tensors,
+                                 bool* end_of_sequence) {
+      if (!prefetch_thread_started_) {
+        mutex_lock l(*mu_);
+        TF_RETURN_IF_ERROR(EnsurePrefetchThreadStarted(ctx));
+      }
+      BufferElement buffer_element;
+      while (!PopFromRingBuffer(&buffer_element)) {
+        mutex_lock l(*mu_);
+        ++num_waiting_consumers_;
+        // Pairs with the fence in `PushToRingBuffer`: either the producer sees
+        // the waiting consumer, or the consumer sees the new element.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!cancelled_ && ring_buffer_->empty() &&
+               !prefetch_thread_finished_) {
+          RecordStop(ctx);
+          cond_var_->wait(l);
+          RecordStart(ctx);
+        }
+        --num_waiting_consumers_;
+        if (cancelled_) {
+          return errors::Cancelled("Iterator was cancelled");
+        }
+        if (ring_buffer_->empty() && prefetch_thread_finished_) {
+          *end_of_sequence = true;
+          return Status::OK();
+        }
+      }
+      // Wake the prefetch thread in case it has been waiting for space.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (producer_waiting_) {
+        mutex_lock l(*mu_);
+        cond_var_->notify_all();
+      }
+
+      const auto& stats_aggregator = ctx->stats_aggregator();
+      if (stats_aggregator) {
+        stats_aggregator->AddScalar(
+            stats_utils::BufferSizeScalarName(dataset()->node_name()),
+            static_cast<float>(ring_buffer_->size()), num_elements());
+        stats_aggregator->AddScalar(
+            stats_utils::BufferCapacityScalarName(dataset()->node_name()),
+            static_cast<float>(ring_buffer_->capacity()), num_elements());
+      }
+      *end_of_sequence = false;
+      if (!buffer_element.status.ok()) {
+        return buffer_element.status;
+      }
+      if (dataset()->slack_period_ > 0 &&
+          (num_elements() + 1) % dataset()->slack_period_ == 0) {
+        int64 slack_us = EnvTime::NowMicros() - buffer_element.created_us;
+        slack_us_ = kSleepFactor * slack_us_ + slack_us;
+        VLOG(2) << "Setting slack_us_: " << slack_us_;
+      }
+      *out_tensors = std::move(buffer_element.value);
+      RecordBufferDequeue(ctx, *out_tensors);
+      return Status::OK();
+    }
+
+    // Pops the next element off `ring_buffer_`, polling it for at most
+    // `consumer_spins_` times. Returns false if the buffer stayed empty.
+    bool PopFromRingBuffer(BufferElement* buffer_element)
+        TF_LOCKS_EXCLUDED(consumer_mu_) {
+      // Serializes concurrent `GetNext` calls, because the ring buffer only
+      // supports a single consumer at a time.
+      mutex_lock l(consumer_mu_);
+      const int64 spins = consumer_spins_.load(std::memory_order_relaxed);
+      for (int64 i = 0; i <= spins; ++i) {
+        if (ring_buffer_->TryPop(buffer_element)) {
+          if (i > 0) GrowSpins(&consumer_spins_);
+          return true;
+        }
+      }
+      ShrinkSpins(&consumer_spins_);
+      return false;
+    }
+
+    // Waits until `ring_buffer_` has space for another element, polling it
+    // for at most `producer_spins_` times before parking on `cond_var_`.
+    // Returns false if the iterator has been cancelled.
+    bool WaitForRingBufferSpace(IteratorContext* ctx) TF_LOCKS_EXCLUDED(*mu_) {
+      const int64 spins = producer_spins_.load(std::memory_order_relaxed);
+      for (int64 i = 0; i <= spins && !cancelled_; ++i) {
+        if (!ring_buffer_->full()) {
+          if (i > 0) GrowSpins(&producer_spins_);
+          return true;
+        }
+      }
+      ShrinkSpins(&producer_spins_);
+      mutex_lock l(*mu_);
+      producer_waiting_ = true;
+      // Pairs with the fence in `GetNextFromRingBuffer`.
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      while (!cancelled_ && ring_buffer_->full()) {
+        RecordStop(ctx);
+        cond_var_->wait(l);
+        RecordStart(ctx);
+      }
+      producer_waiting_ = false;
+      return !cancelled_;
+    }
+
+    // Pushes an element onto `ring_buffer_` and wakes up parked consumers.
+    // Returns false if the iterator has been cancelled while waiting for space.
+    bool PushToRingBuffer(IteratorContext* ctx, BufferElement* buffer_element)
+        TF_LOCKS_EXCLUDED(input_mu_, *mu_) {
+      while (true) {
+        {
+          // Holding `input_mu_` keeps the push from racing with
+          // `SaveInternal` and `RestoreInternal`.
+          mutex_lock input_l(input_mu_);
+          if (ring_buffer_->TryPush(std::move(*buffer_element))) break;
+        }
+        if (!WaitForRingBufferSpace(ctx)) return false;
+      }
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (num_waiting_consumers_ > 0) {
+        mutex_lock l(*mu_);
+        cond_var_->notify_all();
+      }
+      return true;
+    }
+
     // Prefetches elements of the input, storing results in an internal buffer.
     //
     // It owns the iterator context passed to it.
@@ -402,7 +582,14 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
       int num_produced = 0;
       while (true) {
         // 1. Wait for a slot in the buffer.
-        {
+        if (ring_buffer_) {
+          if (!WaitForRingBufferSpace(ctx.get())) {
+            mutex_lock l(*mu_);
+            prefetch_thread_finished_ = true;
+            cond_var_->notify_all();
+            return;
+          }
+        } else {
           mutex_lock l(*mu_);
           while (!cancelled_ && buffer_.size() >= buffer_limit()) {
             RecordStop(ctx.get());
@@ -451,7 +638,17 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
         }
 
         // 3. Signal that the element has been produced.
-        {
+        if (ring_buffer_) {
+          RecordBufferEnqueue(ctx.get(), buffer_element.value);
+          buffer_element.created_us = EnvTime::NowMicros();
+          buffer_element.id = num_produced;
+          if (!PushToRingBuffer(ctx.get(), &buffer_element)) {
+            mutex_lock l(*mu_);
+            prefetch_thread_finished_ = true;
+            cond_var_->notify_all();
+            return;
+          }
+        } else {
           mutex_lock l(*mu_);
           RecordBufferEnqueue(ctx.get(), buffer_element.value);
           buffer_element.created_us = EnvTime::NowMicros();
@@ -515,10 +712,24 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
     PrefetchAutotuner auto_tuner_ TF_GUARDED_BY(*mu_);
     std::deque<BufferElement> buffer_ TF_GUARDED_BY(*mu_);
     std::unique_ptr<Thread> prefetch_thread_ TF_GUARDED_BY(*mu_);
-    bool cancelled_ TF_GUARDED_BY(*mu_) = false;
+    // Only written while holding `mu_`, but atomic so that the lock-free
+    // buffer can poll it without acquiring `mu_`.
+    std::atomic<bool> cancelled_{false};
     bool prefetch_thread_finished_ TF_GUARDED_BY(*mu_) = false;
     const bool legacy_autotune_;
 
+    // If set, replaces `buffer_`. Elements are pushed by the prefetch thread
+    // and popped by `GetNext` callers, which serialize on `consumer_mu_`.
+    std::unique_ptr<SpscRingBuffer<BufferElement>> ring_buffer_;
+    mutex consumer_mu_ TF_ACQUIRED_AFTER(input_mu_) TF_ACQUIRED_BEFORE(*mu_);
+    std::atomic<bool> prefetch_thread_started_{false};
+    // Number of consumers parked on `cond_var_` waiting for an element.
+    std::atomic<int64> num_waiting_consumers_{0};
+    // Whether the prefetch thread is parked on `cond_var_` waiting for space.
+    std::atomic<bool> producer_waiting_{false};
+    std::atomic<int64> consumer_spins_{kMinSpins};
+    std::atomic<int64> producer_spins_{kMinSpins};
+
     std::atomic<int64> slack_us_;
 
     // If legacy_autotune_ is false, identifies the maximum size of the buffer.
@@ -537,6 +748,9 @@ class PrefetchDatasetOp::Dataset : public DatasetBase {
   // Determines whether legacy autotuning should be used.
   const bool legacy_autotune_ = true;
 
+  // Determines whether a fixed-size buffer should be a lock-free ring buffer.
+  const bool lock_free_buffer_ = false;
+
   TraceMeMetadata traceme_metadata_;
 };
 
@@ -548,6 +762,9 @@ PrefetchDatasetOp::PrefetchDatasetOp(OpKernelConstruction* ctx)
   if (ctx->HasAttr(kLegacyAutotune)) {
     OP_REQUIRES_OK(ctx, ctx->GetAttr(kLegacyAutotune, &legacy_autotune_));
   }
+  if (ctx->HasAttr(kLockFreeBuffer)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kLockFreeBuffer, &lock_free_buffer_));
+  }
 }
 
 void PrefetchDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
@@ -564,8 +781,8 @@ void PrefetchDatasetOp::MakeDataset(OpKernelContext* ctx, DatasetBase* input,
     metrics::RecordTFDataAutotune(kDatasetType);
   }
 
-  *output =
-      new Dataset(ctx, input, buffer_size, slack_period_, legacy_autotune_);
+  *output = new Dataset(ctx, input, buffer_size, slack_period_,
+                        legacy_autotune_, lock_free_buffer_);
 }
 
 namespace {
@@ -14,6 +14,7 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/shuffle_dataset_op.h"
 
+#include <algorithm>
 #include <deque>
 #include <tuple>
 #include <vector>
@@ -26,6 +27,7 @@ limitations under the License.
 #include "tensorflow/core/kernels/data/name_utils.h"
 #include "tensorflow/core/kernels/data/random_seed_ops.h"
 #include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/gtl/cleanup.h"
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/random_distributions.h"
@@ -55,6 +57,13 @@ namespace data {
 
 const int64 kLogIntervalMicros = 10 * 1000000;  // 10 seconds.
 const int64 kMaxEpochsInBuffer = 3;
+// Buffers of at least this many elements are filled by a background thread
+// that reads the input ahead of the buffer.
+const int64 kMinBufferSizeForBackgroundFill = 1 << 16;
+// The maximum number of elements the background thread reads ahead.
+const int64 kMaxReadAheadElements = 1024;
+// The number of elements in each separately allocated shard of the buffer.
+const int64 kBufferShardSize = 1 << 14;
 
 constexpr char kNumRandomSamples[] = "num_random_samples";
 constexpr char kDataProduced[] = "data_produced";
@@ -66,6 +75,11 @@ constexpr char kSlicesStart[] = "slices_start";
 constexpr char kSlicesEnd[] = "slices_end";
 constexpr char kBuffer[] = "buffer";
 constexpr char kSize[] = "size";
+constexpr char kReadAhead[] = "read_ahead";
+constexpr char kReadAheadSize[] = "read_ahead_size";
+constexpr char kKind[] = "kind";
+constexpr char kCode[] = "code";
+constexpr char kErrorMessage[] = "error_message";
 constexpr char kSeedGenerator[] = "SeedGenerator";
 constexpr char kTFData[] = "tf_data";
 constexpr char kEpochNumRandomSamples[] = "epoch_num_random_samples";
@@ -140,18 +154,30 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
    public:
     explicit Iterator(const Params& params, SeedGenerator* seed_generator)
         : DatasetIterator<ShuffleDatasetBase>(params),
+          background_fill_(params.dataset->buffer_size_ >=
+                           kMinBufferSizeForBackgroundFill),
           seed_generator_(seed_generator),
+          buffer_((params.dataset->buffer_size_ + kBufferShardSize - 1) /
+                  kBufferShardSize),
           parent_generator_(seed_generator->seed(), seed_generator->seed2()),
           generator_(&parent_generator_) {
-      buffer_ = absl::make_unique<std::vector<Tensor>[]>(
-          params.dataset->buffer_size_);
       slices_.push_back(absl::make_unique<Slice>(0, 0));
     }
 
+    ~Iterator() override {
+      CancelThreads();
+      if (deregister_fn_) deregister_fn_();
+    }
+
     Status Initialize(IteratorContext* ctx) override {
       mutex_lock l(mu_);
       seed_generator_->GenerateSeeds(&seed_, &seed2_);
       ResetRngs();
+      if (background_fill_) {
+        TF_RETURN_IF_ERROR(RegisterCancellationCallback(
+            ctx->cancellation_manager(), [this]() { CancelThreads(); },
+            &deregister_fn_));
+      }
       return Status::OK();
     }
 
@@ -161,52 +187,37 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       mutex_lock l(mu_);
       int64 start_micros = EnvTime::NowMicros();
       int64 num_log_entries = 0;
-      if (!input_impl_ && epoch_ == 0) {
-        TF_RETURN_IF_ERROR(this->dataset()->input_->MakeIterator(
-            ctx, this, this->prefix(), &input_impl_));
-      }
-      while (input_impl_ && num_elements_ < this->dataset()->buffer_size_) {
+      while (!end_of_input_ && num_elements_ < this->dataset()->buffer_size_) {
         if (EnvTime::NowMicros() >
             ((num_log_entries + 1) * kLogIntervalMicros) + start_micros) {
           num_log_entries++;
           LOG(INFO) << "Filling up shuffle buffer (this may take a while): "
                     << num_elements_ << " of " << this->dataset()->buffer_size_;
         }
-        std::vector<Tensor> input_element;
-        bool end_of_input_sequence = false;
-        while (this->dataset()->count_ == -1 ||
-               epoch_ < this->dataset()->count_) {
-          TF_RETURN_IF_ERROR(input_impl_->GetNext(ctx, &input_element,
-                                                  &end_of_input_sequence));
-          if (!end_of_input_sequence) {
-            data_produced_ = true;
-            break;
-          }
-          if (!data_produced_ && this->dataset()->count_ == -1) {
-            // If we encounter the end of sequence without producing data, we
-            // terminate the iteration immediately. (Otherwise, this iterator
-            // would loop infinitely and never produce a value.)
-            *end_of_sequence = true;
-            return Status::OK();
-          }
-          epoch_++;
-          int64 n = slices_.back()->end;
-          slices_.push_back(absl::make_unique<Slice>(n, n));
-          TF_RETURN_IF_ERROR(this->dataset()->input_->MakeIterator(
-              ctx, this, this->prefix(), &input_impl_));
+        InputElement input_element;
+        TF_RETURN_IF_ERROR(ReadInputElement(ctx, &input_element));
+        if (input_element.kind == InputElement::kEmptyInput) {
+          end_of_input_ = true;
+          *end_of_sequence = true;
+          return Status::OK();
         }
-        if (!end_of_input_sequence) {
+        if (input_element.kind == InputElement::kValue) {
           if (num_elements_ == 0) {
             VLOG(1) << "Starting to fill up shuffle buffer of size: "
                     << this->dataset()->buffer_size_;
           }
-          this->RecordBufferEnqueue(ctx, input_element);
-          buffer_[slices_.back()->end % this->dataset()->buffer_size_] =
-              std::move(input_element);
+          this->RecordBufferEnqueue(ctx, input_element.value);
+          BufferSlot(slices_.back()->end) = std::move(input_element.value);
           num_elements_++;
           slices_.back()->end++;
         } else {
-          input_impl_.reset();
+          epoch_++;
+          int64 n = slices_.back()->end;
+          slices_.push_back(absl::make_unique<Slice>(n, n));
+          if (input_element.kind == InputElement::kEndOfEpoch) {
+            continue;
+          }
+          end_of_input_ = true;
         }
         if (slices_.size() > kMaxEpochsInBuffer) {
           // When the elements stored in `buffer_` span more than
@@ -237,17 +248,15 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
         // slice, and then remove the element from the slice.
         int64 offset =
             Random() % (slices_.front()->end - slices_.front()->start);
-        int64 index =
-            (slices_.front()->start + offset) % this->dataset()->buffer_size_;
-        *out_tensors = std::move(buffer_[index]);
+        std::vector<Tensor>& slot =
+            BufferSlot(slices_.front()->start + offset);
+        *out_tensors = std::move(slot);
         this->RecordBufferDequeue(ctx, *out_tensors);
-        std::swap(
-            buffer_[index],
-            buffer_[slices_.front()->start % this->dataset()->buffer_size_]);
+        std::swap(slot, BufferSlot(slices_.front()->start));
         slices_.front()->start++;
         num_elements_--;
       } else {
-        DCHECK(input_impl_ == nullptr);
+        DCHECK(end_of_input_);
         *end_of_sequence = true;
       }
       return Status::OK();
@@ -271,6 +280,8 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     Status SaveInternal(SerializationContext* ctx,
                         IteratorStateWriter* writer) override {
       mutex_lock l(mu_);
+      mutex_lock input_l(input_mu_);
+      mutex_lock fill_l(fill_mu_);
       // Save state needed to restore the random number generators.
       TF_RETURN_IF_ERROR(
           writer->WriteScalar(full_name(kEpochNumRandomSamples),
@@ -305,15 +316,16 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
             slices_[i]->end));
         for (size_t j = slices_[i]->start; j < slices_[i]->end; ++j) {
           size_t index = j % this->dataset()->buffer_size_;
+          const std::vector<Tensor>& slot = BufferSlot(j);
           TF_RETURN_IF_ERROR(writer->WriteScalar(
               this->full_name(
                   absl::StrJoin(std::make_tuple(kBuffer, index, kSize), "_")),
-              buffer_[index].size()));
-          for (size_t k = 0; k < buffer_[index].size(); ++k) {
+              slot.size()));
+          for (size_t k = 0; k < slot.size(); ++k) {
             TF_RETURN_IF_ERROR(writer->WriteTensor(
                 this->full_name(
                     absl::StrJoin(std::make_tuple(kBuffer, index, k), "_")),
-                buffer_[index][k]));
+                slot[k]));
           }
         }
       }
@@ -322,12 +334,24 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
             writer->WriteScalar(this->full_name(kDataProduced), ""));
       }
 
+      // Save the elements that the background fill thread has read from the
+      // input but that have not been added to `buffer_` yet.
+      if (!read_ahead_.empty()) {
+        TF_RETURN_IF_ERROR(writer->WriteScalar(
+            this->full_name(kReadAheadSize), read_ahead_.size()));
+      }
+      for (size_t i = 0; i < read_ahead_.size(); ++i) {
+        TF_RETURN_IF_ERROR(SaveReadAheadElement(writer, i, read_ahead_[i]));
+      }
+
       return Status::OK();
     }
 
     Status RestoreInternal(IteratorContext* ctx,
                            IteratorStateReader* reader) override {
       mutex_lock l(mu_);
+      mutex_lock input_l(input_mu_);
+      mutex_lock fill_l(fill_mu_);
       // Restore the random number generators.
       int64 num_random_samples;
       TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kEpochNumRandomSamples),
@@ -360,8 +384,11 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
             reader->ReadScalar(this->full_name(kSlicesSize), &temp));
         slices_size = static_cast<size_t>(temp);
       }
-      buffer_ = absl::make_unique<std::vector<Tensor>[]>(
-          this->dataset()->buffer_size_);
+      // Release the current buffer before restoring the saved one, so that
+      // restoring does not hold two buffers at once.
+      for (auto& shard : buffer_) {
+        shard.reset();
+      }
       slices_.clear();
       for (size_t i = 0; i < slices_size; ++i) {
         int64 start;
@@ -381,17 +408,41 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
               this->full_name(
                   absl::StrJoin(std::make_tuple(kBuffer, index, kSize), "_")),
               &list_size));
-          buffer_[index] = std::vector<Tensor>(list_size);
+          std::vector<Tensor>& slot = BufferSlot(j);
+          slot = std::vector<Tensor>(list_size);
           for (int k = 0; k < list_size; ++k) {
             TF_RETURN_IF_ERROR(reader->ReadTensor(
                 this->full_name(
                     absl::StrJoin(std::make_tuple(kBuffer, index, k), "_")),
-                &buffer_[index][k]));
+                &slot[k]));
           }
         }
       }
       data_produced_ = reader->Contains(this->full_name(kDataProduced));
 
+      read_ahead_.clear();
+      if (reader->Contains(this->full_name(kReadAheadSize))) {
+        int64 read_ahead_size;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(
+            this->full_name(kReadAheadSize), &read_ahead_size));
+        for (int64 i = 0; i < read_ahead_size; ++i) {
+          InputElement element;
+          TF_RETURN_IF_ERROR(RestoreReadAheadElement(reader, i, &element));
+          read_ahead_.push_back(std::move(element));
+        }
+      }
+      // The input epoch is ahead of `epoch_` by the number of epoch ends that
+      // are still waiting in `read_ahead_`.
+      input_epoch_ = epoch_;
+      for (const auto& element : read_ahead_) {
+        if (element.IsEndOfEpoch()) {
+          input_epoch_++;
+        }
+      }
+      fill_finished_ = IsLastEpoch(input_epoch_);
+      end_of_input_ = fill_finished_ && read_ahead_.empty();
+      fill_cond_var_.notify_all();
+
       return Status::OK();
     }
 
@@ -412,6 +463,25 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       int64 end;
     };
 
+    // The result of reading from the input: an element, or the end of an
+    // epoch, of the last epoch, or of an input that produced no data at all.
+    struct InputElement {
+      enum Kind { kValue, kEndOfEpoch, kEndOfInput, kEmptyInput };
+
+      bool IsEndOfEpoch() const {
+        return status.ok() && (kind == kEndOfEpoch || kind == kEndOfInput);
+      }
+
+      // Returns true if nothing more will be read from the input after this.
+      bool IsLast() const {
+        return status.ok() && (kind == kEndOfInput || kind == kEmptyInput);
+      }
+
+      Status status;
+      Kind kind = kValue;
+      std::vector<Tensor> value;
+    };
+
     random::SingleSampleAdapter<random::PhiloxRandom>::ResultType Random()
         TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       num_random_samples_++;
@@ -419,10 +489,206 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
       return out;
     }
 
+    // Returns the slot of `buffer_` for the given position of a slice,
+    // allocating the shard that contains it on first use.
+    std::vector<Tensor>& BufferSlot(int64 position)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const int64 index = position % this->dataset()->buffer_size_;
+      const int64 shard_index = index / kBufferShardSize;
+      auto& shard = buffer_[shard_index];
+      if (!shard) {
+        shard = absl::make_unique<std::vector<Tensor>[]>(
+            std::min(kBufferShardSize, this->dataset()->buffer_size_ -
+                                           shard_index * kBufferShardSize));
+      }
+      return shard[index % kBufferShardSize];
+    }
+
+    // Reads the next element of the input, either directly or from the
+    // elements read ahead by the background fill thread.
+    Status ReadInputElement(IteratorContext* ctx, InputElement* element)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!background_fill_) {
+        mutex_lock l(input_mu_);
+        return ReadFromInput(ctx, element);
+      }
+      EnsureFillThreadStarted(ctx);
+      mutex_lock l(fill_mu_);
+      while (!cancelled_ && read_ahead_.empty()) {
+        RecordStop(ctx);
+        fill_cond_var_.wait(l);
+        RecordStart(ctx);
+      }
+      if (cancelled_) {
+        return errors::Cancelled("Iterator was cancelled");
+      }
+      *element = std::move(read_ahead_.front());
+      read_ahead_.pop_front();
+      fill_cond_var_.notify_all();
+      return element->status;
+    }
+
+    Status ReadFromInput(IteratorContext* ctx, InputElement* element)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(input_mu_) {
+      if (!input_impl_) {
+        // The input iterator of an epoch is created when it is first read
+        // from, so that a failure to create it can be retried.
+        TF_RETURN_IF_ERROR(this->dataset()->input_->MakeIterator(
+            ctx, this, this->prefix(), &input_impl_));
+      }
+      bool end_of_input_sequence = false;
+      TF_RETURN_IF_ERROR(
+          input_impl_->GetNext(ctx, &element->value, &end_of_input_sequence));
+      if (!end_of_input_sequence) {
+        data_produced_ = true;
+        element->kind = InputElement::kValue;
+        return Status::OK();
+      }
+      if (!data_produced_ && this->dataset()->count_ == -1) {
+        // If we encounter the end of sequence without producing data, we
+        // terminate the iteration immediately. (Otherwise, this iterator
+        // would loop infinitely and never produce a value.)
+        element->kind = InputElement::kEmptyInput;
+        return Status::OK();
+      }
+      input_impl_.reset();
+      input_epoch_++;
+      element->kind = IsLastEpoch(input_epoch_) ? InputElement::kEndOfInput
+                                                : InputElement::kEndOfEpoch;
+      return Status::OK();
+    }
+
+    // Returns true if `num_epochs` epochs of the input is all there is to
+    // read.
+    bool IsLastEpoch(int64 num_epochs) const {
+      return this->dataset()->count_ != -1 &&
+             num_epochs >= this->dataset()->count_;
+    }
+
+    void EnsureFillThreadStarted(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      if (!fill_thread_) {
+        std::shared_ptr<IteratorContext> new_ctx =
+            std::make_shared<IteratorContext>(*ctx);
+        fill_thread_ = ctx->StartThread(
+            "tf_data_shuffle_fill", [this, new_ctx]() { FillThread(new_ctx); });
+      }
+    }
+
+    // Reads elements of the input ahead of the shuffle buffer and stores them
+    // in `read_ahead_` in input order, so that the order in which `buffer_`
+    // is filled, and therefore the output order, does not depend on timing.
+    //
+    // It owns the iterator context passed to it.
+    void FillThread(const std::shared_ptr<IteratorContext>& ctx) {
+      RecordStart(ctx.get());
+      auto cleanup = gtl::MakeCleanup([this, ctx] { RecordStop(ctx.get()); });
+      while (true) {
+        {
+          mutex_lock l(fill_mu_);
+          while (!cancelled_ && (fill_finished_ || read_ahead_.size() >=
+                                                       kMaxReadAheadElements)) {
+            RecordStop(ctx.get());
+            fill_cond_var_.wait(l);
+            RecordStart(ctx.get());
+          }
+          if (cancelled_) {
+            return;
+          }
+        }
+        // Hold `input_mu_` until the element is in `read_ahead_` so that
+        // SaveInternal observes the input iterator and `read_ahead_` in a
+        // consistent state.
+        mutex_lock input_l(input_mu_);
+        {
+          // The iterator may have been restored while this thread was
+          // waiting for `input_mu_`.
+          mutex_lock l(fill_mu_);
+          if (fill_finished_) {
+            continue;
+          }
+        }
+        InputElement element;
+        element.status = ReadFromInput(ctx.get(), &element);
+        mutex_lock l(fill_mu_);
+        fill_finished_ = element.IsLast();
+        read_ahead_.push_back(std::move(element));
+        fill_cond_var_.notify_all();
+      }
+    }
+
+    void CancelThreads() TF_LOCKS_EXCLUDED(fill_mu_) {
+      mutex_lock l(fill_mu_);
+      cancelled_ = true;
+      fill_cond_var_.notify_all();
+    }
+
+    Status SaveReadAheadElement(IteratorStateWriter* writer, size_t index,
+                                const InputElement& element)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(fill_mu_) {
+      const string prefix = absl::StrCat(kReadAhead, "_", index, "_");
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(this->full_name(absl::StrCat(prefix, kCode)),
+                              static_cast<int64>(element.status.code())));
+      if (!element.status.ok()) {
+        return writer->WriteScalar(
+            this->full_name(absl::StrCat(prefix, kErrorMessage)),
+            element.status.error_message());
+      }
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(this->full_name(absl::StrCat(prefix, kKind)),
+                              static_cast<int64>(element.kind)));
+      TF_RETURN_IF_ERROR(
+          writer->WriteScalar(this->full_name(absl::StrCat(prefix, kSize)),
+                              element.value.size()));
+      for (size_t k = 0; k < element.value.size(); ++k) {
+        TF_RETURN_IF_ERROR(writer->WriteTensor(
+            this->full_name(absl::StrCat(prefix, k)), element.value[k]));
+      }
+      return Status::OK();
+    }
+
+    Status RestoreReadAheadElement(IteratorStateReader* reader, size_t index,
+                                   InputElement* element)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(fill_mu_) {
+      const string prefix = absl::StrCat(kReadAhead, "_", index, "_");
+      int64 code;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(
+          this->full_name(absl::StrCat(prefix, kCode)), &code));
+      if (code != error::Code::OK) {
+        tstring error_message;
+        TF_RETURN_IF_ERROR(reader->ReadScalar(
+            this->full_name(absl::StrCat(prefix, kErrorMessage)),
+            &error_message));
+        element->status = Status(static_cast<error::Code>(code), error_message);
+        return Status::OK();
+      }
+      int64 kind;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(
+          this->full_name(absl::StrCat(prefix, kKind)), &kind));
+      element->kind = static_cast<InputElement::Kind>(kind);
+      int64 size;
+      TF_RETURN_IF_ERROR(reader->ReadScalar(
+          this->full_name(absl::StrCat(prefix, kSize)), &size));
+      element->value.resize(size);
+      for (int64 k = 0; k < size; ++k) {
+        TF_RETURN_IF_ERROR(reader->ReadTensor(
+            this->full_name(absl::StrCat(prefix, k)), &element->value[k]));
+      }
+      return Status::OK();
+    }
+
+    // Whether the input is read by a background thread. This is only done
+    // for large buffers, where reading the input dominates.
+    const bool background_fill_;
+
     mutex mu_;
     SeedGenerator* const seed_generator_ TF_GUARDED_BY(mu_);  // Not owned.
-    std::unique_ptr<std::vector<Tensor>[]> buffer_ TF_GUARDED_BY(mu_);
-    std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(mu_) = nullptr;
+    // The buffer is split into shards of `kBufferShardSize` elements that are
+    // allocated on first use, so that its memory grows with the number of
+    // buffered elements rather than with `buffer_size`.
+    std::vector<std::unique_ptr<std::vector<Tensor>[]>> buffer_
+        TF_GUARDED_BY(mu_);
     int64 epoch_ TF_GUARDED_BY(mu_) = 0;
     int64 num_elements_ TF_GUARDED_BY(mu_) = 0;
     int64 seed_ TF_GUARDED_BY(mu_) = 0;
@@ -436,7 +702,30 @@ class ShuffleDatasetOpBase::ShuffleDatasetBase : public DatasetBase {
     random::SingleSampleAdapter<random::PhiloxRandom> generator_
         TF_GUARDED_BY(mu_);
     int64 num_random_samples_ TF_GUARDED_BY(mu_) = 0;
-    bool data_produced_ TF_GUARDED_BY(mu_) = false;
+    // Whether the last element of the input has been added to `buffer_`.
+    bool end_of_input_ TF_GUARDED_BY(mu_) = false;
+
+    // Guards the input iterator. Acquired after `mu_`.
+    mutex input_mu_ TF_ACQUIRED_AFTER(mu_);
+    std::unique_ptr<IteratorBase> input_impl_ TF_GUARDED_BY(input_mu_) =
+        nullptr;
+    // The number of epochs of the input that have been read so far. This is
+    // ahead of `epoch_` while the background fill thread reads ahead.
+    int64 input_epoch_ TF_GUARDED_BY(input_mu_) = 0;
+    bool data_produced_ TF_GUARDED_BY(input_mu_) = false;
+
+    // Guards the elements read ahead by the background fill thread. Acquired
+    // after `input_mu_`.
+    mutex fill_mu_ TF_ACQUIRED_AFTER(input_mu_);
+    condition_variable fill_cond_var_;
+    std::deque<InputElement> read_ahead_ TF_GUARDED_BY(fill_mu_);
+    bool fill_finished_ TF_GUARDED_BY(fill_mu_) = false;
+    bool cancelled_ TF_GUARDED_BY(fill_mu_) = false;
+    std::function<void()> deregister_fn_;
+
+    // Declared last so that the thread is joined before the state it
+    // accesses is destroyed.
+    std::unique_ptr<Thread> fill_thread_ TF_GUARDED_BY(mu_);
   };
 
   const DatasetBase* const input_;
@@ -204,6 +204,34 @@ ShuffleDatasetParams ShuffleDatasetParams8() {
                               /*node_name=*/kShuffleAndRepeatNodeName);
 }
 
+// Test case 9: similar with the test case 7 but with a buffer that is large
+// enough to be filled by a background thread.
+ShuffleDatasetParams ShuffleDatasetParams9() {
+  return ShuffleDatasetParams(RangeDatasetParams(0, 10, 1),
+                              /*buffer_size=*/1 << 16,
+                              /*seed=*/1,
+                              /*seed2=*/2,
+                              /*count=*/2,
+                              /*reshuffle_each_iteration=*/false,
+                              /*output_dtypes=*/{DT_INT64},
+                              /*output_shapes=*/{PartialTensorShape({})},
+                              /*node_name=*/kShuffleAndRepeatNodeName);
+}
+
+// Test case 10: similar with the test case 8 but with a buffer that is large
+// enough to be filled by a background thread.
+ShuffleDatasetParams ShuffleDatasetParams10() {
+  return ShuffleDatasetParams(RangeDatasetParams(0, 3, 1),
+                              /*buffer_size=*/1 << 16,
+                              /*seed=*/1,
+                              /*seed2=*/2,
+                              /*count=*/-1,
+                              /*reshuffle_each_iteration=*/false,
+                              /*output_dtypes=*/{DT_INT64},
+                              /*output_shapes=*/{PartialTensorShape({})},
+                              /*node_name=*/kShuffleAndRepeatNodeName);
+}
+
 ShuffleDatasetParams ShuffleDatasetParamsWithInvalidBufferSize() {
   return ShuffleDatasetParams(RangeDatasetParams(0, 0, 1),
                               /*buffer_size=*/-1,
@@ -302,6 +330,26 @@ std::vector<GetNextTestCase<ShuffleDatasetParams>> GetNextTestCases() {
                                               {2}, {4}, {5}, {9}, {0}, {8}, {6},
                                               {1}, {3}, {7}, {2}, {4}, {5}})},
       {/*dataset_params=*/ShuffleDatasetParams8(),
+       /*expected_shuffle_outputs=*/
+       CreateTensors<int64>(
+           TensorShape({}),
+           {{2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0},
+            {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}}),
+       /*expected_reshuffle_outputs=*/
+       CreateTensors<int64>(
+           TensorShape({}),
+           {{2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0},
+            {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}})},
+      {/*dataset_params=*/ShuffleDatasetParams9(),
+       /*expected_shuffle_outputs=*/
+       CreateTensors<int64>(TensorShape({}),
+                            {{9}, {0}, {8}, {6}, {1}, {3}, {7}, {2}, {4}, {5},
+                             {9}, {0}, {8}, {6}, {1}, {3}, {7}, {2}, {4}, {5}}),
+       /*expected_reshuffle_outputs=*/
+       CreateTensors<int64>(TensorShape({}), {{9}, {0}, {8}, {6}, {1}, {3}, {7},
+                                              {2}, {4}, {5}, {9}, {0}, {8}, {6},
+                                              {1}, {3}, {7}, {2}, {4}, {5}})},
+      {/*dataset_params=*/ShuffleDatasetParams10(),
        /*expected_shuffle_outputs=*/
        CreateTensors<int64>(
            TensorShape({}),
@@ -498,6 +546,19 @@ IteratorSaveAndRestoreTestCases() {
                                               {2}, {4}, {5}, {9}, {0}, {8}, {6},
                                               {1}, {3}, {7}, {2}, {4}, {5}})},
       {/*dataset_params=*/ShuffleDatasetParams8(),
+       /*breakpoints=*/{0, 5, 20},
+       /*expected_shuffle_outputs=*/
+       CreateTensors<int64>(
+           TensorShape({}),
+           {{2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0},
+            {1}, {2}, {0}, {1}, {2}, {0}, {1}, {2}, {0}, {1}})},
+      {/*dataset_params=*/ShuffleDatasetParams9(),
+       /*breakpoints=*/{0, 5, 22},
+       /*expected_shuffle_outputs=*/
+       CreateTensors<int64>(TensorShape({}), {{9}, {0}, {8}, {6}, {1}, {3}, {7},
+                                              {2}, {4}, {5}, {9}, {0}, {8}, {6},
+                                              {1}, {3}, {7}, {2}, {4}, {5}})},
+      {/*dataset_params=*/ShuffleDatasetParams10(),
        /*breakpoints=*/{0, 5, 20},
        /*expected_shuffle_outputs=*/
        CreateTensors<int64>(
@@ -0,0 +1,114 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#ifndef TENSORFLOW_CORE_KERNELS_DATA_SPSC_RING_BUFFER_H_
+#define TENSORFLOW_CORE_KERNELS_DATA_SPSC_RING_BUFFER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+#include "tensorflow/core/platform/types.h"
+
+namespace tensorflow {
+namespace data {
+
+// SpscRingBuffer is a bounded FIFO queue for exactly one producer and one
+// consumer thread, which synchronize through a pair of atomic counters instead
+// of a mutex.
+//
+// `TryPush` may only be called by the producer, and `TryPop` only by the
+// consumer, although the producer and consumer threads may change over time as
+// long as the handoff is synchronized externally. `size`, `empty` and `full`
+// may be called from any thread, but the result is only a snapshot.
+//
+// `Get` and `Clear` require that neither the producer nor the consumer are
+// active, e.g. because the caller holds the locks that both of them acquire
+// between operations.
+template <typename T>
+class SpscRingBuffer {
+ public:
+  explicit SpscRingBuffer(size_t capacity) : slots_(capacity) {}
+
+  size_t capacity() const { return slots_.size(); }
+
+  size_t size() const {
+    // `head_` never overtakes `tail_`, so reading it first guarantees a
+    // non-negative difference.
+    const uint64 head = head_.load(std::memory_order_acquire);
+    const uint64 tail = tail_.load(std::memory_order_acquire);
+    return std::min<uint64>(tail - head, slots_.size());
+  }
+
+  bool empty() const { return size() == 0; }
+
+  bool full() const { return size() == slots_.size(); }
+
+  // Moves `value` into the buffer and returns true, or returns false without
+  // modifying `value` if the buffer is full.
+  bool TryPush(T&& value) {
+    const uint64 tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_.load(std::memory_order_acquire) >= slots_.size()) {
+      return false;
+    }
+    slots_[tail % slots_.size()] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the oldest element of the buffer into `value` and returns true, or
+  // returns false if the buffer is empty.
+  bool TryPop(T* value) {
+    const uint64 head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire)) {
+      return false;
+    }
+    T& slot = slots_[head % slots_.size()];
+    *value = std::move(slot);
+    // Release whatever the moved-from slot still holds before the producer
+    // can reuse it.
+    slot = T();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Returns the `i`-th oldest element of the buffer.
+  T& Get(size_t i) { return slots_[(head_.load() + i) % slots_.size()]; }
+
+  void Clear() {
+    for (auto& slot : slots_) {
+      slot = T();
+    }
+    head_.store(0);
+    tail_.store(0);
+  }
+
+ private:
+  static constexpr size_t kCacheLineSize = 64;
+
+  std::vector<T> slots_;
+  // The producer and the consumer each write one of the counters; keep them
+  // on separate cache lines so that they do not invalidate each other.
+  char padding0_[kCacheLineSize];
+  // Number of elements popped so far. Written by the consumer.
+  std::atomic<uint64> head_{0};
+  char padding1_[kCacheLineSize - sizeof(std::atomic<uint64>)];
+  // Number of elements pushed so far. Written by the producer.
+  std::atomic<uint64> tail_{0};
+};
+
+}  // namespace data
+}  // namespace tensorflow
+
+#endif  // TENSORFLOW_CORE_KERNELS_DATA_SPSC_RING_BUFFER_H_
@@ -0,0 +1,87 @@
+/* Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+==============================================================================*/
+#include "tensorflow/core/kernels/data/spsc_ring_buffer.h"
+
+#include <memory>
+#include <thread>  // NOLINT
+
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/test.h"
+
+namespace tensorflow {
+namespace data {
+namespace {
+
+TEST(SpscRingBufferTest, PushPop) {
+  SpscRingBuffer<int64> buffer(2);
+  EXPECT_TRUE(buffer.empty());
+  int64 value = 1;
+  EXPECT_TRUE(buffer.TryPush(std::move(value)));
+  value = 2;
+  EXPECT_TRUE(buffer.TryPush(std::move(value)));
+  EXPECT_TRUE(buffer.full());
+  value = 3;
+  EXPECT_FALSE(buffer.TryPush(std::move(value)));
+  EXPECT_EQ(buffer.Get(0), 1);
+  EXPECT_EQ(buffer.Get(1), 2);
+
+  EXPECT_TRUE(buffer.TryPop(&value));
+  EXPECT_EQ(value, 1);
+  value = 3;
+  EXPECT_TRUE(buffer.TryPush(std::move(value)));
+  EXPECT_TRUE(buffer.TryPop(&value));
+  EXPECT_EQ(value, 2);
+  EXPECT_TRUE(buffer.TryPop(&value));
+  EXPECT_EQ(value, 3);
+  EXPECT_FALSE(buffer.TryPop(&value));
+  EXPECT_TRUE(buffer.empty());
+}
+
+TEST(SpscRingBufferTest, Clear) {
+  SpscRingBuffer<std::vector<int64>> buffer(3);
+  std::vector<int64> value = {1, 2};
+  EXPECT_TRUE(buffer.TryPush(std::move(value)));
+  buffer.Clear();
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_FALSE(buffer.TryPop(&value));
+}
+
+TEST(SpscRingBufferTest, ConcurrentProducerConsumer) {
+  constexpr int64 kNumElements = 10000;
+  SpscRingBuffer<int64> buffer(16);
+  {
+    std::unique_ptr<Thread> producer(Env::Default()->StartThread(
+        {}, "producer", [&buffer]() {
+          for (int64 i = 0; i < kNumElements; ++i) {
+            int64 value = i;
+            while (!buffer.TryPush(std::move(value))) {
+              std::this_thread::yield();
+            }
+          }
+        }));
+    for (int64 i = 0; i < kNumElements; ++i) {
+      int64 value;
+      while (!buffer.TryPop(&value)) {
+        std::this_thread::yield();
+      }
+      ASSERT_EQ(value, i);
+    }
+  }
+  EXPECT_TRUE(buffer.empty());
+}
+
+}  // namespace
+}  // namespace data
+}  // namespace tensorflow
@@ -32,6 +32,7 @@ ABSL_CONST_INIT const char kDroppedElements[] = "dropped_elements";
 ABSL_CONST_INIT const char kFeaturesCount[] = "features_count";
 ABSL_CONST_INIT const char kFeatureValuesCount[] = "feature_values_count";
 ABSL_CONST_INIT const char kExamplesCount[] = "examples_count";
+ABSL_CONST_INIT const char kElementLatency[] = "element_latency";
 
 string ExecutionTimeHistogramName(const string& prefix) {
   return strings::StrCat(prefix, kDelimiter, kExecutionTime);
@@ -61,6 +62,10 @@ string DroppedElementsScalarName(const string& prefix) {
   return strings::StrCat(prefix, kDelimiter, kDroppedElements);
 }
 
+string ElementLatencyHistogramName(const string& prefix) {
+  return strings::StrCat(prefix, kDelimiter, kElementLatency);
+}
+
 string FeatureHistogramName(const string& prefix) {
   return strings::StrCat(prefix, kDelimiter, kFeaturesCount);
 }
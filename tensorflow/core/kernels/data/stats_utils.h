@@ -31,6 +31,7 @@ extern const char kDroppedElements[];
 extern const char kFeaturesCount[];
 extern const char kFeatureValuesCount[];
 extern const char kExamplesCount[];
+extern const char kElementLatency[];
 
 // Name for tf.data function execution time (in ns) histogram metrics.
 string ExecutionTimeHistogramName(const string& prefix);
@@ -55,6 +56,9 @@ string FilterdElementsScalarName(const string& prefix);
 // Name for dropped elements scalar mereics.
 string DroppedElementsScalarName(const string& prefix);
 
+// Name for per-element production latency (in ns) histogram metrics.
+string ElementLatencyHistogramName(const string& prefix);
+
 // Name for features count histogram metrics.
 string FeatureHistogramName(const string& prefix);
 
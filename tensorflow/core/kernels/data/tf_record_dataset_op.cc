@@ -14,16 +14,22 @@ limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/kernels/data/tf_record_dataset_op.h"
 
+#include <deque>
+#include <map>
+#include <vector>
+
 #include "tensorflow/core/common_runtime/metrics.h"
 #include "tensorflow/core/framework/partial_tensor_shape.h"
 #include "tensorflow/core/framework/tensor.h"
 #include "tensorflow/core/kernels/data/name_utils.h"
+#include "tensorflow/core/lib/core/threadpool.h"
 #include "tensorflow/core/lib/io/buffered_inputstream.h"
 #include "tensorflow/core/lib/io/inputbuffer.h"
 #include "tensorflow/core/lib/io/random_inputstream.h"
 #include "tensorflow/core/lib/io/record_reader.h"
 #include "tensorflow/core/lib/io/zlib_compression_options.h"
 #include "tensorflow/core/lib/io/zlib_inputstream.h"
+#include "tensorflow/core/platform/path.h"
 
 namespace tensorflow {
 namespace data {
@@ -35,6 +41,7 @@ namespace data {
 /* static */ constexpr const char* const TFRecordDatasetOp::kFileNames;
 /* static */ constexpr const char* const TFRecordDatasetOp::kCompressionType;
 /* static */ constexpr const char* const TFRecordDatasetOp::kBufferSize;
+/* static */ constexpr const char* const TFRecordDatasetOp::kReadAheadDepth;
 
 constexpr char kCurrentFileIndex[] = "current_file_index";
 constexpr char kOffset[] = "offset";
@@ -42,6 +49,14 @@ constexpr char kGcsFsPrefix[] = "gs://";
 constexpr char kS3FsPrefix[] = "s3://";
 constexpr int64 kCloudTpuBlockSize = 127LL << 20;  // 127MB.
 constexpr int64 kS3BlockSize = kCloudTpuBlockSize;
+// Block size used for read-ahead when the dataset is unbuffered.
+constexpr int64 kDefaultReadAheadBlockSize = 256 << 10;  // 256KB.
+// Number of files, beyond the one being read, for which read-ahead is started.
+constexpr int kNumReadAheadFiles = 1;
+// Number of threads of the pool that an iterator owns for its block reads.
+// The reads block on I/O, so they do not run on the inter-op pool that the
+// runner of the iterator context uses.
+constexpr int kNumReadAheadThreads = 1;
 
 bool is_cloud_tpu_gcs_fs() {
 #if defined(PLATFORM_CLOUD_TPU) && defined(TPU_GCS_FS)
@@ -50,15 +65,201 @@ bool is_cloud_tpu_gcs_fs() {
   return false;
 }
 
+// Returns true if `filename` is on the local file system. Read-ahead is only
+// used for local files; remote file systems do their own buffering.
+bool IsLocalFile(const string& filename) {
+  StringPiece scheme, host, path;
+  io::ParseURI(filename, &scheme, &host, &path);
+  return scheme.empty() || scheme == "file";
+}
+
+// A `RandomAccessFile` that keeps up to `depth` block reads of the underlying
+// file in flight on `thread_pool` and serves sequential reads from the blocks
+// as they complete. Files that share a thread pool have their reads
+// outstanding at the same time, so read-ahead also overlaps across files. A
+// non-sequential read discards the blocks read so far and restarts read-ahead
+// at the new offset. Discarded blocks that are still being read count against
+// `depth` until their reads finish.
+class ReadAheadFile : public RandomAccessFile {
+ public:
+  ReadAheadFile(std::unique_ptr<RandomAccessFile> file, int64 block_size,
+                int64 depth, thread::ThreadPool* thread_pool)
+      : file_(std::move(file)),
+        block_size_(block_size),
+        depth_(depth),
+        thread_pool_(thread_pool) {
+    std::vector<std::shared_ptr<Block>> new_blocks;
+    {
+      mutex_lock l(mu_);
+      new_blocks = AddBlocksLocked();
+    }
+    ScheduleReads(new_blocks);
+  }
+
+  ~ReadAheadFile() override {
+    mutex_lock l(mu_);
+    DropBlocksLocked();
+    while (num_outstanding_reads_ > 0) {
+      cond_var_.wait(l);
+    }
+  }
+
+  Status Name(StringPiece* result) const override {
+    return file_->Name(result);
+  }
+
+  Status Read(uint64 offset, size_t n, StringPiece* result,
+              char* scratch) const override {
+    {
+      mutex_lock l(mu_);
+      if (offset != read_offset_) {
+        DropBlocksLocked();
+        read_offset_ = offset;
+        next_block_offset_ = offset;
+      }
+    }
+    Status status;
+    size_t bytes_read = 0;
+    while (bytes_read < n && status.ok()) {
+      // Block reads are scheduled without holding `mu_`, so that they never
+      // run while this thread holds it.
+      std::vector<std::shared_ptr<Block>> new_blocks;
+      {
+        mutex_lock l(mu_);
+        new_blocks = AddBlocksLocked();
+        if (new_blocks.empty()) {
+          status = ConsumeFrontBlockLocked(&l, n, &bytes_read, scratch);
+        }
+      }
+      ScheduleReads(new_blocks);
+    }
+    *result = StringPiece(scratch, bytes_read);
+    return status;
+  }
+
+ private:
+  struct Block {
+    uint64 offset;
+    // The fields below are written by the reading thread before `done` is
+    // set, and read by the consumer only after `done` is observed under `mu_`.
+    string data;
+    Status status;
+    bool done = false;
+    // Whether the block was discarded by a non-sequential read or on
+    // destruction while it was being read.
+    bool dropped = false;
+  };
+
+  // Adds blocks until `depth_` blocks are buffered or in flight, counting the
+  // discarded blocks that are still being read, and returns the added blocks.
+  // The caller must schedule their reads with `ScheduleReads()` after
+  // releasing `mu_`.
+  std::vector<std::shared_ptr<Block>> AddBlocksLocked() const
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    std::vector<std::shared_ptr<Block>> new_blocks;
+    while (blocks_.size() + num_dropped_reads_ < depth_) {
+      auto block = std::make_shared<Block>();
+      block->offset = next_block_offset_;
+      next_block_offset_ += block_size_;
+      blocks_.push_back(block);
+      ++num_outstanding_reads_;
+      new_blocks.push_back(std::move(block));
+    }
+    return new_blocks;
+  }
+
+  // Discards the buffered blocks. The reads still in flight keep counting
+  // against `depth_` until they finish.
+  void DropBlocksLocked() const TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    for (const auto& block : blocks_) {
+      if (!block->done) {
+        block->dropped = true;
+        ++num_dropped_reads_;
+      }
+    }
+    blocks_.clear();
+  }
+
+  // Copies the data at `read_offset_` from the front block into `scratch`,
+  // waiting for the block to be read if necessary, or pops the front block if
+  // it is exhausted.
+  Status ConsumeFrontBlockLocked(mutex_lock* l, size_t n, size_t* bytes_read,
+                                 char* scratch) const
+      TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    std::shared_ptr<Block> block = blocks_.front();
+    while (!block->done) {
+      cond_var_.wait(*l);
+    }
+    size_t block_offset = read_offset_ - block->offset;
+    if (block_offset == block->data.size()) {
+      if (!block->status.ok()) {
+        // The failed block stays at the front, so that subsequent reads
+        // return the same error.
+        return block->status;
+      }
+      blocks_.pop_front();
+      return Status::OK();
+    }
+    size_t bytes_to_copy =
+        std::min(n - *bytes_read, block->data.size() - block_offset);
+    memcpy(scratch + *bytes_read, block->data.data() + block_offset,
+           bytes_to_copy);
+    *bytes_read += bytes_to_copy;
+    read_offset_ += bytes_to_copy;
+    return Status::OK();
+  }
+
+  void ScheduleReads(const std::vector<std::shared_ptr<Block>>& blocks) const
+      TF_LOCKS_EXCLUDED(mu_) {
+    for (const auto& block : blocks) {
+      thread_pool_->Schedule([this, block]() {
+        block->data.resize(block_size_);
+        StringPiece data;
+        Status s =
+            file_->Read(block->offset, block_size_, &data, &block->data[0]);
+        if (data.data() != block->data.data()) {
+          memmove(&block->data[0], data.data(), data.size());
+        }
+        block->data.resize(data.size());
+        mutex_lock l(mu_);
+        block->status = s;
+        block->done = true;
+        if (block->dropped) {
+          --num_dropped_reads_;
+        }
+        --num_outstanding_reads_;
+        cond_var_.notify_all();
+      });
+    }
+  }
+
+  const std::unique_ptr<RandomAccessFile> file_;
+  const int64 block_size_;
+  const int64 depth_;
+  thread::ThreadPool* const thread_pool_;  // not owned.
+
+  mutable mutex mu_;
+  mutable condition_variable cond_var_;
+  // Blocks in file order, starting with the block containing `read_offset_`.
+  mutable std::deque<std::shared_ptr<Block>> blocks_ TF_GUARDED_BY(mu_);
+  mutable uint64 read_offset_ TF_GUARDED_BY(mu_) = 0;
+  mutable uint64 next_block_offset_ TF_GUARDED_BY(mu_) = 0;
+  mutable int64 num_outstanding_reads_ TF_GUARDED_BY(mu_) = 0;
+  // Number of discarded blocks whose reads are still in flight.
+  mutable int64 num_dropped_reads_ TF_GUARDED_BY(mu_) = 0;
+};
+
 class TFRecordDatasetOp::Dataset : public DatasetBase {
  public:
   explicit Dataset(OpKernelContext* ctx, std::vector<string> filenames,
-                   const string& compression_type, int64 buffer_size)
+                   const string& compression_type, int64 buffer_size,
+                   int64 read_ahead_depth)
       : DatasetBase(DatasetContext(ctx)),
         filenames_(std::move(filenames)),
         compression_type_(compression_type),
         options_(io::RecordReaderOptions::CreateRecordReaderOptions(
-            compression_type)) {
+            compression_type)),
+        read_ahead_depth_(read_ahead_depth) {
     if (buffer_size > 0) {
       options_.buffer_size = buffer_size;
     }
@@ -97,8 +298,11 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     TF_RETURN_IF_ERROR(b->AddScalar(compression_type_, &compression_type));
     Node* buffer_size = nullptr;
     TF_RETURN_IF_ERROR(b->AddScalar(options_.buffer_size, &buffer_size));
-    TF_RETURN_IF_ERROR(b->AddDataset(
-        this, {filenames, compression_type, buffer_size}, output));
+    AttrValue read_ahead_depth;
+    b->BuildAttrValue(read_ahead_depth_, &read_ahead_depth);
+    TF_RETURN_IF_ERROR(
+        b->AddDataset(this, {filenames, compression_type, buffer_size},
+                      {{kReadAheadDepth, read_ahead_depth}}, output));
     return Status::OK();
   }
 
@@ -150,7 +354,7 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
           return Status::OK();
         }
 
-        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
+        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx));
       } while (true);
     }
 
@@ -184,7 +388,7 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       if (reader->Contains(full_name(kOffset))) {
         int64 offset;
         TF_RETURN_IF_ERROR(reader->ReadScalar(full_name(kOffset), &offset));
-        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx->env()));
+        TF_RETURN_IF_ERROR(SetupStreamsLocked(ctx));
         TF_RETURN_IF_ERROR(reader_->SeekOffset(offset));
       }
       return Status::OK();
@@ -192,7 +396,8 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
 
    private:
     // Sets up reader streams to read from the file at `current_file_index_`.
-    Status SetupStreamsLocked(Env* env) TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Status SetupStreamsLocked(IteratorContext* ctx)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
       if (current_file_index_ >= dataset()->filenames_.size()) {
         return errors::InvalidArgument(
             "current_file_index_:", current_file_index_,
@@ -200,10 +405,58 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
       }
 
       // Actually move on to next file.
-      const string& next_filename = dataset()->filenames_[current_file_index_];
-      TF_RETURN_IF_ERROR(env->NewRandomAccessFile(next_filename, &file_));
+      auto it = read_ahead_files_.find(current_file_index_);
+      if (it != read_ahead_files_.end()) {
+        file_ = std::move(it->second);
+      } else {
+        TF_RETURN_IF_ERROR(NewFileLocked(ctx, current_file_index_, &file_));
+      }
+      read_ahead_files_.erase(
+          read_ahead_files_.begin(),
+          read_ahead_files_.upper_bound(current_file_index_));
       reader_ = absl::make_unique<io::SequentialRecordReader>(
           file_.get(), dataset()->options_);
+
+      // Start reading ahead the files that follow, so that their first blocks
+      // are in flight while the current file is being decoded. Errors are
+      // ignored here and surface when the file becomes the current file.
+      if (dataset()->read_ahead_depth_ > 0) {
+        for (size_t i = current_file_index_ + 1;
+             i <= current_file_index_ + kNumReadAheadFiles &&
+             i < dataset()->filenames_.size();
+             ++i) {
+          if (read_ahead_files_.count(i) == 0) {
+            std::unique_ptr<RandomAccessFile> file;
+            if (NewFileLocked(ctx, i, &file).ok()) {
+              read_ahead_files_[i] = std::move(file);
+            }
+          }
+        }
+      }
+      return Status::OK();
+    }
+
+    // Opens the file at `index`, wrapping it in a `ReadAheadFile` whose block
+    // reads run on `read_ahead_pool_` if read-ahead is enabled and the file
+    // is local.
+    Status NewFileLocked(IteratorContext* ctx, size_t index,
+                         std::unique_ptr<RandomAccessFile>* file)
+        TF_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      const string& filename = dataset()->filenames_[index];
+      TF_RETURN_IF_ERROR(ctx->env()->NewRandomAccessFile(filename, file));
+      if (dataset()->read_ahead_depth_ > 0 && IsLocalFile(filename)) {
+        int64 block_size = dataset()->options_.buffer_size > 0
+                               ? dataset()->options_.buffer_size
+                               : kDefaultReadAheadBlockSize;
+        if (!read_ahead_pool_) {
+          read_ahead_pool_ = absl::make_unique<thread::ThreadPool>(
+              ctx->env(), ThreadOptions(), "tf_record_read_ahead",
+              kNumReadAheadThreads, /*low_latency_hint=*/false);
+        }
+        *file = absl::make_unique<ReadAheadFile>(
+            std::move(*file), block_size, dataset()->read_ahead_depth_,
+            read_ahead_pool_.get());
+      }
       return Status::OK();
     }
 
@@ -216,6 +469,15 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
     mutex mu_;
     size_t current_file_index_ TF_GUARDED_BY(mu_) = 0;
 
+    // Runs the block reads of the files below, which wait for their reads on
+    // destruction, so it must be declared before them.
+    std::unique_ptr<thread::ThreadPool> read_ahead_pool_ TF_GUARDED_BY(mu_);
+
+    // Files following the current one whose read-ahead has already started,
+    // keyed by file index.
+    std::map<size_t, std::unique_ptr<RandomAccessFile>> read_ahead_files_
+        TF_GUARDED_BY(mu_);
+
     // `reader_` will borrow the object that `file_` points to, so
     // we must destroy `reader_` before `file_`.
     std::unique_ptr<RandomAccessFile> file_ TF_GUARDED_BY(mu_);
@@ -225,10 +487,18 @@ class TFRecordDatasetOp::Dataset : public DatasetBase {
   const std::vector<string> filenames_;
   const tstring compression_type_;
   io::RecordReaderOptions options_;
+  const int64 read_ahead_depth_;
 };
 
 TFRecordDatasetOp::TFRecordDatasetOp(OpKernelConstruction* ctx)
-    : DatasetOpKernel(ctx) {}
+    : DatasetOpKernel(ctx) {
+  if (ctx->HasAttr(kReadAheadDepth)) {
+    OP_REQUIRES_OK(ctx, ctx->GetAttr(kReadAheadDepth, &read_ahead_depth_));
+    OP_REQUIRES(ctx, read_ahead_depth_ >= 0,
+                errors::InvalidArgument("`", kReadAheadDepth,
+                                        "` must be >= 0 (0 == disabled)"));
+  }
+}
 
 void TFRecordDatasetOp::MakeDataset(OpKernelContext* ctx,
                                     DatasetBase** output) {
@@ -275,8 +545,8 @@ void TFRecordDatasetOp::MakeDataset(OpKernelContext* ctx,
     buffer_size = kS3BlockSize;
   }
 
-  *output =
-      new Dataset(ctx, std::move(filenames), compression_type, buffer_size);
+  *output = new Dataset(ctx, std::move(filenames), compression_type,
+                        buffer_size, read_ahead_depth_);
 }
 
 namespace {
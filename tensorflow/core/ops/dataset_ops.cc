@@ -184,6 +184,7 @@ REGISTER_OP("PrefetchDataset")
     .Attr("output_shapes: list(shape) >= 1")
     .Attr("slack_period: int = 0")
     .Attr("legacy_autotune: bool = true")
+    .Attr("lock_free_buffer: bool = false")
     .SetShapeFn([](shape_inference::InferenceContext* c) {
       shape_inference::ShapeHandle unused;
       // buffer_size should be a scalar.
@@ -570,6 +571,10 @@ REGISTER_OP("CacheDataset")
     .Input("input_dataset: variant")
     .Input("filename: string")
     .Output("handle: variant")
+    .Attr("memory_budget: int = -1")
+    .Attr("max_shard_bytes: int = 0")
+    .Attr("num_reader_threads: int = 0")
+    .Attr("read_ahead_window: int = 16")
     .Attr("output_types: list(type) >= 1")
     .Attr("output_shapes: list(shape) >= 1")
     .SetShapeFn([](shape_inference::InferenceContext* c) {
@@ -584,6 +589,10 @@ REGISTER_OP("CacheDatasetV2")
     .Input("filename: string")
     .Input("cache: resource")
     .Output("handle: variant")
+    .Attr("memory_budget: int = -1")
+    .Attr("max_shard_bytes: int = 0")
+    .Attr("num_reader_threads: int = 0")
+    .Attr("read_ahead_window: int = 16")
     .Attr("output_types: list(type) >= 1")
     .Attr("output_shapes: list(shape) >= 1")
     .SetShapeFn([](shape_inference::InferenceContext* c) {
@@ -663,6 +672,7 @@ REGISTER_OP("TFRecordDataset")
     .Input("compression_type: string")
     .Input("buffer_size: int64")
     .Output("handle: variant")
+    .Attr("read_ahead_depth: int = 0")
     .SetDoNotOptimize()  // TODO(b/123753214): Source dataset ops must
                          // disable constant folding.
     .SetShapeFn([](shape_inference::InferenceContext* c) {
@@ -871,6 +881,11 @@ REGISTER_OP("ModelDataset")
     .Output("handle: variant")
     .Attr("algorithm: int = 0")
     .Attr("cpu_budget: int = 0")
+    .Attr("latency_weight: float = 1.0")
+    .Attr("cpu_weight: float = 0.0")
+    .Attr("ram_weight: float = 0.0")
+    .Attr("target_step_time_us: int = 0")
+    .Attr("autotune_state_dir: string = ''")
     .Attr("output_types: list(type) >= 1")
     .Attr("output_shapes: list(shape) >= 1")
     .SetShapeFn(shape_inference::ScalarShape);
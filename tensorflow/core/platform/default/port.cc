@@ -315,6 +315,24 @@ bool Snappy_Compress(const char* input, size_t length, string* output) {
 #endif
 }
 
+size_t Snappy_MaxCompressedLength(size_t length) {
+#ifdef TF_USE_SNAPPY
+  return snappy::MaxCompressedLength(length);
+#else
+  return 0;
+#endif
+}
+
+bool Snappy_RawCompress(const char* input, size_t length, char* output,
+                        size_t* output_length) {
+#ifdef TF_USE_SNAPPY
+  snappy::RawCompress(input, length, output, output_length);
+  return true;
+#else
+  return false;
+#endif
+}
+
 bool Snappy_GetUncompressedLength(const char* input, size_t length,
                                   size_t* result) {
 #ifdef TF_USE_SNAPPY
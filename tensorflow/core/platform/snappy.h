@@ -35,6 +35,15 @@ namespace port {
 // Snappy compression/decompression support
 bool Snappy_Compress(const char* input, size_t length, string* output);
 
+// Returns the maximum number of bytes Snappy_RawCompress() writes for an input
+// of `length` bytes.
+size_t Snappy_MaxCompressedLength(size_t length);
+// Compresses `length` bytes at `input` into the buffer at `output`, which must
+// hold at least Snappy_MaxCompressedLength(length) bytes, and sets
+// `*output_length` to the number of bytes written.
+bool Snappy_RawCompress(const char* input, size_t length, char* output,
+                        size_t* output_length);
+
 bool Snappy_GetUncompressedLength(const char* input, size_t length,
                                   size_t* result);
 bool Snappy_Uncompress(const char* input, size_t length, char* output);
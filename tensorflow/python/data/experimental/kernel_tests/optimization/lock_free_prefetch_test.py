@@ -0,0 +1,75 @@
+# Copyright 2020 The TensorFlow Authors. All Rights Reserved.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+# ==============================================================================
+"""Tests for the `LockFreePrefetch` rewrite."""
+from __future__ import absolute_import
+from __future__ import division
+from __future__ import print_function
+
+from absl.testing import parameterized
+
+from tensorflow.python.data.experimental.ops import testing
+from tensorflow.python.data.kernel_tests import test_base
+from tensorflow.python.data.ops import dataset_ops
+from tensorflow.python.framework import combinations
+from tensorflow.python.platform import test
+
+
+class LockFreePrefetchTest(test_base.DatasetTestBase, parameterized.TestCase):
+
+  def _enable_lock_free_prefetch(self, dataset):
+    options = dataset_ops.Options()
+    options.experimental_optimization.lock_free_prefetch = True
+    return dataset.with_options(options)
+
+  @combinations.generate(test_base.default_test_combinations())
+  def testOptionEnablesRewrite(self):
+    options = dataset_ops.Options()
+    self.assertNotIn("lock_free_prefetch", options._graph_rewrites())
+    options.experimental_optimization.lock_free_prefetch = True
+    self.assertIn("lock_free_prefetch", options._graph_rewrites())
+
+  @combinations.generate(
+      combinations.times(test_base.default_test_combinations(),
+                         combinations.combine(buffer_size=[1, 2, 16])))
+  def testFixedBufferSize(self, buffer_size):
+    dataset = dataset_ops.Dataset.range(1000)
+    dataset = dataset.apply(testing.assert_next(["Prefetch"]))
+    dataset = dataset.prefetch(buffer_size)
+    dataset = self._enable_lock_free_prefetch(dataset)
+    self.assertDatasetProduces(dataset, range(1000))
+
+  @combinations.generate(test_base.default_test_combinations())
+  def testAutotunedBufferSize(self):
+    dataset = dataset_ops.Dataset.range(100)
+    dataset = dataset.prefetch(dataset_ops.AUTOTUNE)
+    dataset = self._enable_lock_free_prefetch(dataset)
+    self.assertDatasetProduces(dataset, range(100))
+
+  @combinations.generate(test_base.default_test_combinations())
+  def testChainedPrefetches(self):
+    dataset = dataset_ops.Dataset.range(100)
+    dataset = dataset.prefetch(4).map(lambda x: x * 2).prefetch(1)
+    dataset = self._enable_lock_free_prefetch(dataset)
+    self.assertDatasetProduces(dataset, range(0, 200, 2))
+
+  @combinations.generate(test_base.default_test_combinations())
+  def testEarlyTermination(self):
+    dataset = dataset_ops.Dataset.range(100).prefetch(8).take(10)
+    dataset = self._enable_lock_free_prefetch(dataset)
+    self.assertDatasetProduces(dataset, range(10))
+
+
+if __name__ == "__main__":
+  test.main()
@@ -40,6 +40,31 @@ class MapAndBatchFusionTest(test_base.DatasetTestBase, parameterized.TestCase):
     self.assertDatasetProduces(
         dataset, expected_output=[[x * x for x in range(10)]])
 
+  @combinations.generate(test_base.default_test_combinations())
+  def testMapFilterAndBatchFusion(self):
+    dataset = dataset_ops.Dataset.range(10).apply(
+        testing.assert_next(["MapFilterAndBatch"])).map(
+            lambda x: x * x).filter(lambda x: x % 2 == 0).batch(3)
+    options = dataset_ops.Options()
+    options.experimental_optimization.apply_default_optimizations = False
+    options.experimental_optimization.map_and_batch_fusion = True
+    options.experimental_optimization.map_filter_and_batch_fusion = True
+    dataset = dataset.with_options(options)
+    self.assertDatasetProduces(
+        dataset, expected_output=[[0, 4, 16], [36, 64]])
+
+  @combinations.generate(test_base.default_test_combinations())
+  def testMapFilterAndBatchFusionDisabledByDefault(self):
+    dataset = dataset_ops.Dataset.range(10).apply(
+        testing.assert_next(["Map", "Filter", "Batch"])).map(
+            lambda x: x * x).filter(lambda x: x % 2 == 0).batch(3)
+    options = dataset_ops.Options()
+    options.experimental_optimization.apply_default_optimizations = False
+    options.experimental_optimization.map_and_batch_fusion = True
+    dataset = dataset.with_options(options)
+    self.assertDatasetProduces(
+        dataset, expected_output=[[0, 4, 16], [36, 64]])
+
 
 if __name__ == "__main__":
   test.main()
@@ -18,6 +18,7 @@ from __future__ import division
 from __future__ import print_function
 
 import functools
+import os
 import warnings
 
 from absl.testing import parameterized
@@ -38,6 +39,7 @@ from tensorflow.python.framework import ops
 from tensorflow.python.ops import array_ops
 from tensorflow.python.ops import random_ops
 from tensorflow.python.ops import variable_scope
+from tensorflow.python.platform import gfile
 from tensorflow.python.platform import test
 
 
@@ -302,6 +304,44 @@ class OptimizeDatasetTest(test_base.DatasetTestBase, parameterized.TestCase):
                      optimization_options._AutotuneAlgorithm.GRADIENT_DESCENT)
     self.assertEqual(cpu_budget, 0)
 
+  @combinations.generate(test_base.default_test_combinations())
+  def testAutotuningObjective(self):
+    options = dataset_ops.Options()
+    options.experimental_optimization.autotune_cpu_weight = 1000.0
+    options.experimental_optimization.autotune_target_step_time_us = 100
+    autotune, algorithm, cpu_budget = options._autotune_settings()
+    self.assertTrue(autotune)
+    self.assertEqual(algorithm,
+                     optimization_options._AutotuneAlgorithm.MULTI_OBJECTIVE)
+    self.assertEqual(cpu_budget, 0)
+    self.assertEqual(options._autotune_objective(), {
+        "cpu_weight": 1000.0,
+        "target_step_time_us": 100
+    })
+
+    dataset = dataset_ops.Dataset.range(10).map(
+        lambda x: x * 2, num_parallel_calls=dataset_ops.AUTOTUNE)
+    dataset = dataset.with_options(options)
+    self.assertDatasetProduces(dataset, expected_output=list(range(0, 20, 2)))
+
+  @combinations.generate(test_base.eager_only_combinations())
+  def testAutotuneStateDir(self):
+    state_dir = os.path.join(self.get_temp_dir(), "autotune_state")
+    options = dataset_ops.Options()
+    options.experimental_optimization.autotune_state_dir = state_dir
+    dataset = dataset_ops.Dataset.range(10).map(
+        lambda x: x * 2, num_parallel_calls=dataset_ops.AUTOTUNE)
+    dataset = dataset.with_options(options)
+
+    # The autotuning state is written at the latest when the iterator is
+    # destroyed, and a new iterator over the same dataset starts from it.
+    iterator = iter(dataset)
+    self.assertEqual([next(iterator).numpy() for _ in range(10)],
+                     list(range(0, 20, 2)))
+    del iterator
+    self.assertLen(gfile.Glob(os.path.join(state_dir, "*.autotune")), 1)
+    self.assertDatasetProduces(dataset, expected_output=list(range(0, 20, 2)))
+
 
 if __name__ == "__main__":
   test.main()
@@ -88,6 +88,22 @@ class OverrideThreadpoolTest(test_base.DatasetTestBase,
 
     self._testNumThreadsHelper(num_threads, override_threadpool_fn)
 
+  @combinations.generate(
+      combinations.times(
+          test_base.default_test_combinations(),
+          combinations.combine(num_threads=[1, 2, 4, 8, 16])))
+  def testNumThreadsNumaAware(self, num_threads):
+
+    def override_threadpool_fn(dataset):
+      return threadpool.override_threadpool(
+          dataset,
+          threadpool.PrivateThreadPool(
+              num_threads,
+              display_name="numa_thread_pool_%d" % num_threads,
+              numa_aware=True))
+
+    self._testNumThreadsHelper(num_threads, override_threadpool_fn)
+
   @combinations.generate(
       combinations.times(
           test_base.default_test_combinations(),
@@ -365,7 +365,9 @@ class LegacySnapshotDatasetTest(
 
       for j in range(num_runs_per_fp):
         run_dir = os.path.join(fingerprint_dir, fingerprint_dir_list[j])
-        run_dirlist = sorted(os.listdir(run_dir))
+        # Ignore the index files written next to the snapshot files.
+        run_dirlist = sorted(
+            f for f in os.listdir(run_dir) if not f.endswith(".index"))
         self.assertLen(run_dirlist, num_snapshot_files)
 
         file_counter = 0
@@ -56,7 +56,10 @@ class _DataServiceDatasetV2(dataset_ops.DatasetSource):
                protocol,
                job_name=None,
                max_outstanding_requests=None,
-               task_refresh_interval_hint_ms=None):
+               task_refresh_interval_hint_ms=None,
+               num_consumers=None,
+               consumer_index=None,
+               client_locality=None):
     """Constructs a _DataServiceDatasetV2.
 
     Args:
@@ -78,6 +81,13 @@ class _DataServiceDatasetV2(dataset_ops.DatasetSource):
         `element_size` * `max_outstanding_requests` of memory.
       task_refresh_interval_hint_ms: (Optional.) A hint for how often to query
         the master for task changes.
+      num_consumers: (Optional.) The number of consumers of a shared job. If
+        set, every consumer reads all elements of the job, instead of the
+        consumers splitting the elements between them.
+      consumer_index: (Optional.) The index of this consumer of the shared
+        job, in `[0, num_consumers)`.
+      client_locality: (Optional.) The locality of the client. If set, tasks on
+        workers with the same `worker_locality` are read from first.
     """
 
     if job_name is None:
@@ -86,6 +96,12 @@ class _DataServiceDatasetV2(dataset_ops.DatasetSource):
       max_outstanding_requests = dataset_ops.AUTOTUNE
     if task_refresh_interval_hint_ms is None:
       task_refresh_interval_hint_ms = dataset_ops.AUTOTUNE
+    if num_consumers is None:
+      num_consumers = 0
+    if consumer_index is None:
+      consumer_index = 0
+    if client_locality is None:
+      client_locality = ""
 
     self._input_dataset = input_dataset
     self._dataset_id = ops.convert_to_tensor(
@@ -112,6 +128,9 @@ class _DataServiceDatasetV2(dataset_ops.DatasetSource):
         job_name=self._job_name,
         max_outstanding_requests=self._max_outstanding_requests,
         task_refresh_interval_hint_ms=task_refresh_interval_hint_ms,
+        num_consumers=num_consumers,
+        consumer_index=consumer_index,
+        client_locality=client_locality,
         iteration_counter=gen_experimental_dataset_ops.dummy_iteration_counter(
         ),
         **self._flat_structure)
@@ -128,7 +147,8 @@ class _DataServiceDatasetV1(dataset_ops.DatasetV1Adapter):
   @functools.wraps(_DataServiceDatasetV2.__init__)
   def __init__(self, input_dataset, dataset_id, processing_mode, address,
                protocol, job_name, max_outstanding_requests,
-               task_refresh_interval_hint_ms):
+               task_refresh_interval_hint_ms, num_consumers, consumer_index,
+               client_locality):
 
     self._wrapped = _DataServiceDatasetV2(
         input_dataset=input_dataset,
@@ -138,7 +158,10 @@ class _DataServiceDatasetV1(dataset_ops.DatasetV1Adapter):
         protocol=protocol,
         job_name=job_name,
         max_outstanding_requests=max_outstanding_requests,
-        task_refresh_interval_hint_ms=task_refresh_interval_hint_ms)
+        task_refresh_interval_hint_ms=task_refresh_interval_hint_ms,
+        num_consumers=num_consumers,
+        consumer_index=consumer_index,
+        client_locality=client_locality)
     super(_DataServiceDatasetV1, self).__init__(self._wrapped)
 
 
@@ -152,7 +175,10 @@ def _distribute(processing_mode,
                 service,
                 job_name=None,
                 max_outstanding_requests=None,
-                task_refresh_interval_hint_ms=None):
+                task_refresh_interval_hint_ms=None,
+                num_consumers=None,
+                consumer_index=None,
+                client_locality=None):
   """A transformation that moves dataset processing to the tf.data service.
 
   This transformation is similar to `distribute`, but supports additional
@@ -174,6 +200,18 @@ def _distribute(processing_mode,
       `max_outstanding_requests` of memory.
     task_refresh_interval_hint_ms: (Optional.) A hint for how often to query the
       master for task changes.
+    num_consumers: (Optional.) The number of consumers of the job named
+      `job_name`. If set, every consumer reads all elements of the job, instead
+      of the consumers splitting the elements between them. Workers produce
+      each element once and keep it buffered until every consumer has read it.
+      A consumer which stops reading for several minutes while the others wait
+      on it is evicted, and its reads fail afterwards.
+    consumer_index: (Optional.) The index of this consumer of the shared job,
+      in `[0, num_consumers)`. Required if `num_consumers` is set.
+    client_locality: (Optional.) The locality of the client, such as a rack or
+      zone. If set, the client reads from workers started with the same
+      `worker_locality` first, and from other workers only when the local ones
+      cannot keep up or have finished.
 
   Returns:
     Dataset: A `Dataset` of the elements produced by the data service.
@@ -185,6 +223,21 @@ def _distribute(processing_mode,
                        "{0}. job_name={1}".format(type(job_name), job_name))
     if not job_name:
       raise ValueError("job_name must not be empty")
+  if num_consumers is not None:
+    if job_name is None:
+      raise ValueError("job_name must be set when num_consumers is set")
+    if num_consumers <= 0:
+      raise ValueError("num_consumers must be positive, but num_consumers "
+                       "was {0}".format(num_consumers))
+    if consumer_index is None:
+      raise ValueError("consumer_index must be set when num_consumers is set")
+    if consumer_index < 0 or consumer_index >= num_consumers:
+      raise ValueError("consumer_index must be in [0, num_consumers), but "
+                       "consumer_index was {0} and num_consumers was {1}"
+                       .format(consumer_index, num_consumers))
+  elif consumer_index is not None:
+    raise ValueError("consumer_index must only be set along with "
+                     "num_consumers")
   if not isinstance(service, six.string_types):
     raise ValueError(
         "service must be a string, but service was of type {0}. service={1}"
@@ -237,7 +290,10 @@ def _distribute(processing_mode,
         protocol=protocol,
         job_name=job_name,
         max_outstanding_requests=max_outstanding_requests,
-        task_refresh_interval_hint_ms=task_refresh_interval_hint_ms)
+        task_refresh_interval_hint_ms=task_refresh_interval_hint_ms,
+        num_consumers=num_consumers,
+        consumer_index=consumer_index,
+        client_locality=client_locality)
     # TODO(b/157105111): Make this an autotuned parallel map when we have a way
     # to limit memory usage.
     # The value 16 is chosen based on experience with pipelines that require
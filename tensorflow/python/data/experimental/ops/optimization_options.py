@@ -30,6 +30,7 @@ class _AutotuneAlgorithm(enum.Enum):
   """Controls what algorithm is used in the autotune implementation."""
   HILL_CLIMB = 0
   GRADIENT_DESCENT = 1
+  MULTI_OBJECTIVE = 2
 
 
 @tf_export("data.experimental.MapVectorizationOptions")
@@ -113,6 +114,54 @@ class OptimizationOptions(options.OptionsBase):
       "are allowed but may result in CPU contention. If None, defaults to the "
       "number of schedulable CPU cores.")
 
+  autotune_cpu_weight = options.create_option(
+      name="autotune_cpu_weight",
+      ty=float,
+      docstring=
+      "When autotuning is enabled (through `autotune`), determines the cost "
+      "of each unit of parallelism, relative to the cost of a nanosecond of "
+      "output latency (see `autotune_latency_weight`). Setting any of the "
+      "`autotune_*_weight` options or `autotune_target_step_time_us` tunes "
+      "for the weighted sum of latency, CPU and RAM instead of latency alone. "
+      "If None, defaults to 0.")
+
+  autotune_latency_weight = options.create_option(
+      name="autotune_latency_weight",
+      ty=float,
+      docstring=
+      "When autotuning is enabled (through `autotune`), determines the cost "
+      "of a nanosecond of output latency above `autotune_target_step_time_us`."
+      " If None, defaults to 1.")
+
+  autotune_ram_weight = options.create_option(
+      name="autotune_ram_weight",
+      ty=float,
+      docstring=
+      "When autotuning is enabled (through `autotune`), determines the cost "
+      "of each byte of buffered elements, relative to the cost of a "
+      "nanosecond of output latency (see `autotune_latency_weight`). If None, "
+      "defaults to 0.")
+
+  autotune_state_dir = options.create_option(
+      name="autotune_state_dir",
+      ty=str,
+      docstring=
+      "When autotuning is enabled (through `autotune`), determines the "
+      "directory in which the autotuned parameters are saved, keyed by the "
+      "fingerprint of the input pipeline, and from which they are restored "
+      "when an iterator over the same input pipeline is created. Lets "
+      "restarted jobs skip the initial autotuning. If None, the autotuned "
+      "parameters are not persisted.")
+
+  autotune_target_step_time_us = options.create_option(
+      name="autotune_target_step_time_us",
+      ty=int,
+      docstring=
+      "When autotuning is enabled (through `autotune`), determines the output "
+      "latency, in microseconds, below which autotuning stops spending CPU or "
+      "RAM on further improvements. Typically the step time of the model "
+      "consuming the dataset. If None, defaults to no target.")
+
   filter_fusion = options.create_option(
       name="filter_fusion",
       ty=bool,
@@ -133,6 +182,16 @@ class OptimizationOptions(options.OptionsBase):
       "Whether to hoist `tf.random_uniform()` ops out of map transformations. "
       "If None, defaults to False.")
 
+  lock_free_prefetch = options.create_option(
+      name="lock_free_prefetch",
+      ty=bool,
+      docstring=
+      "Whether `prefetch` transformations with a fixed buffer size should pass "
+      "elements from the background thread to the consumer through a "
+      "lock-free ring buffer instead of a mutex-guarded queue. This reduces "
+      "contention for very small elements. Prefetch transformations whose "
+      "buffer size is autotuned are not affected. If None, defaults to False.")
+
   map_and_batch_fusion = options.create_option(
       name="map_and_batch_fusion",
       ty=bool,
@@ -147,6 +206,13 @@ class OptimizationOptions(options.OptionsBase):
       "Whether to fuse map and filter transformations. If None, defaults to "
       "False.")
 
+  map_filter_and_batch_fusion = options.create_option(
+      name="map_filter_and_batch_fusion",
+      ty=bool,
+      docstring=
+      "Whether map and batch fusion (see `map_and_batch_fusion`) also fuses "
+      "map, filter and batch transformations. If None, defaults to False.")
+
   map_fusion = options.create_option(
       name="map_fusion",
       ty=bool,
@@ -199,9 +265,14 @@ class OptimizationOptions(options.OptionsBase):
 
     # If autotune_buffers is enabled, we use the GRADIENT_DESCENT algorithm by
     # default, which is more performant for tuning heterogeneous parameters.
-    algorithm = (
-        _AutotuneAlgorithm.GRADIENT_DESCENT
-        if self._autotune_buffers() else _AutotuneAlgorithm.HILL_CLIMB)
+    # If the user sets part of the autotuning objective, we use the
+    # MULTI_OBJECTIVE algorithm, which is the only one to take it into account.
+    if self._autotune_objective():
+      algorithm = _AutotuneAlgorithm.MULTI_OBJECTIVE
+    elif self._autotune_buffers():
+      algorithm = _AutotuneAlgorithm.GRADIENT_DESCENT
+    else:
+      algorithm = _AutotuneAlgorithm.HILL_CLIMB
     cpu_budget = 0  # Indicates that all CPU cores should be used by default.
 
     # Set these options if they are explicitly set by the user.
@@ -212,6 +283,19 @@ class OptimizationOptions(options.OptionsBase):
 
     return autotune, algorithm, cpu_budget
 
+  def _autotune_objective(self):
+    """Returns the explicitly set `ModelDataset` objective attrs by name."""
+    objective = {}
+    if self.autotune_latency_weight is not None:
+      objective["latency_weight"] = self.autotune_latency_weight
+    if self.autotune_cpu_weight is not None:
+      objective["cpu_weight"] = self.autotune_cpu_weight
+    if self.autotune_ram_weight is not None:
+      objective["ram_weight"] = self.autotune_ram_weight
+    if self.autotune_target_step_time_us is not None:
+      objective["target_step_time_us"] = self.autotune_target_step_time_us
+    return objective
+
   def _graph_rewrites(self):
     """Produces the list of enabled graph optimizations."""
     result = set()
@@ -219,6 +303,7 @@ class OptimizationOptions(options.OptionsBase):
         "filter_fusion",
         "filter_with_random_uniform_fusion",
         "hoist_random_uniform",
+        "lock_free_prefetch",
         "map_and_batch_fusion",
         "map_and_filter_fusion",
         "map_parallelization",
@@ -257,6 +342,9 @@ class OptimizationOptions(options.OptionsBase):
     return sorted(list(result))
 
   def _graph_rewrite_configs(self):
+    result = []
     if self.map_vectorization is not None:
-      return self.map_vectorization._graph_rewrite_configs()  # pylint: disable=protected-access
-    return []
+      result.extend(self.map_vectorization._graph_rewrite_configs())  # pylint: disable=protected-access
+    if self.map_filter_and_batch_fusion:
+      result.append("map_and_batch_fusion:fuse_filter:true")
+    return result
@@ -147,12 +147,14 @@ def legacy_snapshot(path,
     reader_buffer_size: Maximum number of elements we can prefetch reading from
       the snapshot. Defaults to 1. Increasing this might improve performance but
       will increase memory consumption.
-    num_writer_threads: Number of threads to parallelize writing from snapshot.
-      We'll open up `num_writer_threads` files and write to them in parallel.
-      Especially useful if compression is turned on since the compression
-      operation tends to be intensive. Defaults to 1. If > 1, then this might
-      introduce non-determinism i.e. the order in which the elements are read
-      from the upstream iterator are different from the order they're written.
+    num_writer_threads: Maximum number of threads to parallelize writing from
+      snapshot. We start with one writer and, whenever the writers cannot keep
+      up with the input, open up another file to write to in parallel until
+      there are `num_writer_threads` of them. Especially useful if compression
+      is turned on since the compression operation tends to be intensive.
+      Defaults to 1. If > 1, then this might introduce non-determinism i.e.
+      the order in which the elements are read from the upstream iterator are
+      different from the order they're written.
     writer_buffer_size: Maximum number of pipeline elements to fill up the
       buffer before writing them out using `num_writer_threads`.
     shuffle_on_read: If this is True, then the order in which examples are
@@ -42,22 +42,34 @@ class PrivateThreadPool(object):
   """A stateful resource that represents a private thread pool."""
 
   def __init__(self, num_threads, display_name=None,
-               max_intra_op_parallelism=1):
-    """Creates a `PrivateThreadPool` with the given number of threads."""
+               max_intra_op_parallelism=1, numa_aware=False):
+    """Creates a `PrivateThreadPool` with the given number of threads.
+
+    Args:
+      num_threads: The number of threads in the pool.
+      display_name: (Optional.) A name for the threads of the pool.
+      max_intra_op_parallelism: (Optional.) The maximum intra-op parallelism of
+        functions run in the pool.
+      numa_aware: (Optional.) If true and the host has several NUMA nodes, the
+        threads are split across the nodes and pinned to them, and the
+        elements they produce are allocated in node-local memory.
+    """
     if context.executing_eagerly():
       shared_name = _generate_shared_name("privatethreadpool")
       self._resource = ged_ops.thread_pool_handle(
           num_threads=num_threads,
           max_intra_op_parallelism=max_intra_op_parallelism,
           display_name=display_name,
-          shared_name=shared_name)
+          shared_name=shared_name,
+          numa_aware=numa_aware)
       self._resource_deleter = resource_variable_ops.EagerResourceDeleter(
           handle=self._resource, handle_device=context.context().device_name)
     else:
       self._resource = ged_ops.thread_pool_handle(
           num_threads=num_threads,
           max_intra_op_parallelism=max_intra_op_parallelism,
-          display_name=display_name)
+          display_name=display_name,
+          numa_aware=numa_aware)
 
 
 class _ThreadPoolDataset(dataset_ops.UnaryUnchangedStructureDataset):
@@ -174,7 +174,9 @@ class WorkerServer(object):
                master_address,
                worker_address=None,
                protocol=None,
-               start=True):
+               start=True,
+               worker_locality=None,
+               consumer_timeout_ms=None):
     """Creates a new worker server.
 
     Args:
@@ -189,6 +191,13 @@ class WorkerServer(object):
         Acceptable values include `"grpc", "grpc+local"`. Defaults to `"grpc"`.
       start: (Optional.) Boolean, indicating whether to start the server after
         creating it. Defaults to `True`.
+      worker_locality: (Optional.) A label for where the worker runs, such as a
+        rack or zone. Clients which set the same `client_locality` read from
+        this worker before reading from workers elsewhere.
+      consumer_timeout_ms: (Optional.) How long, in milliseconds, a consumer of
+        a shared job may keep the job's other consumers waiting on this worker
+        without requesting elements before it is evicted. An evicted consumer
+        can no longer read from the job. Defaults to 5 minutes.
 
     Raises:
       tf.errors.OpError: Or one of its subclasses if an error occurs while
@@ -196,12 +205,17 @@ class WorkerServer(object):
     """
     if worker_address is None:
       worker_address = "localhost:%port%"
+    if worker_locality is None:
+      worker_locality = ""
+    if consumer_timeout_ms is None:
+      consumer_timeout_ms = 0
     if protocol is None:
       protocol = "grpc"
 
     self._protocol = protocol
     self._server = _pywrap_server_lib.TF_DATA_NewWorkerServer(
-        port, protocol, master_address, worker_address)
+        port, protocol, master_address, worker_address, worker_locality,
+        consumer_timeout_ms)
     if start:
       self._server.start()
 
@@ -62,11 +62,13 @@ PYBIND11_MODULE(_pywrap_server_lib, m) {
   m.def(
       "TF_DATA_NewWorkerServer",
       [](int port, std::string protocol, std::string master_address,
-         std::string worker_address)
+         std::string worker_address, std::string worker_locality,
+         tensorflow::int64 consumer_timeout_ms)
           -> std::unique_ptr<tensorflow::data::WorkerGrpcDataServer> {
         std::unique_ptr<tensorflow::data::WorkerGrpcDataServer> server;
         tensorflow::Status status = tensorflow::data::NewWorkerServer(
-            port, protocol, master_address, worker_address, &server);
+            port, protocol, master_address, worker_address, worker_locality,
+            consumer_timeout_ms, &server);
         tensorflow::MaybeRaiseFromStatus(status);
         return server;
       },
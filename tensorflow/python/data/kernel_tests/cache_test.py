@@ -380,6 +380,13 @@ class MemoryCacheTest(test_base.DatasetTestBase, parameterized.TestCase):
     for i in range(10):
       self.assertEqual(next(it), results[i])
 
+  @combinations.generate(test_base.default_test_combinations())
+  def testCacheMemoryBudget(self):
+    # Each element takes 8 bytes, so only the first two fit in memory and the
+    # rest are spilled to disk.
+    dataset = dataset_ops.Dataset.range(10).cache(memory_budget=16).repeat(2)
+    self.assertDatasetProduces(dataset, expected_output=2 * list(range(10)))
+
 
 if __name__ == "__main__":
   test.main()
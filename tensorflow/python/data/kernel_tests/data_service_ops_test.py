@@ -255,6 +255,32 @@ class DataServiceOpsTest(test_base.DatasetTestBase, parameterized.TestCase):
     self.assertCountEqual(num_workers * list(range(num_elements)),
                           self.getDatasetOutput(ds))
 
+  @combinations.generate(test_base.eager_only_combinations())
+  def testClientLocalityPrefersLocalWorkers(self):
+    num_elements = 10
+    self._master = server_lib.MasterServer(port=0, protocol=PROTOCOL)
+    # The remote worker registers first, so that it would be read from first
+    # if the client had no locality.
+    self._servers = [
+        server_lib.WorkerServer(
+            port=0,
+            master_address=self._master._address,
+            protocol=PROTOCOL,
+            worker_locality=locality) for locality in ["remote", "local"]
+    ]
+    ds = dataset_ops.Dataset.range(num_elements)
+    ds = ds.apply(
+        data_service_ops._distribute(
+            "parallel_epochs",
+            "{0}://{1}".format(PROTOCOL, self._master._address),
+            max_outstanding_requests=1,
+            task_refresh_interval_hint_ms=20,
+            client_locality="local"))
+    # With a single outstanding request, the local task is never in use while
+    # the consumer waits for an element. So all of the local elements come
+    # first, and the remote task is still read once the local one finishes.
+    self.assertEqual(2 * list(range(num_elements)), self.getDatasetOutput(ds))
+
   @combinations.generate(test_base.eager_only_combinations())
   def testInsideFunction(self):
     num_workers = 3
@@ -295,6 +321,43 @@ class DataServiceOpsTest(test_base.DatasetTestBase, parameterized.TestCase):
       results.append(elem.numpy())
     self.assertCountEqual(list(range(num_elements)), results)
 
+  @combinations.generate(test_base.eager_only_combinations())
+  def testSharedJobConsumersReadAllElements(self):
+    num_elements = 100
+    num_consumers = 3
+    master_address = self.create_cluster(1)
+    ds = dataset_ops.Dataset.range(num_elements)
+    iterators = []
+    for consumer_index in range(num_consumers):
+      iterators.append(
+          iter(
+              ds.apply(
+                  data_service_ops._distribute(
+                      "parallel_epochs",
+                      "{0}://{1}".format(PROTOCOL, master_address),
+                      job_name="job_name",
+                      task_refresh_interval_hint_ms=20,
+                      num_consumers=num_consumers,
+                      consumer_index=consumer_index))))
+    results = [[] for _ in range(num_consumers)]
+    for _ in range(num_elements):
+      for consumer_index, iterator in enumerate(iterators):
+        results[consumer_index].append(next(iterator).numpy())
+    for consumer_index, iterator in enumerate(iterators):
+      with self.assertRaises(StopIteration):
+        next(iterator)
+      self.assertEqual(list(range(num_elements)), results[consumer_index])
+
+  @combinations.generate(test_base.eager_only_combinations())
+  def testSharedJobConsumerIndexOutOfRange(self):
+    with self.assertRaisesRegex(ValueError, "consumer_index must be in"):
+      data_service_ops._distribute(
+          "parallel_epochs",
+          "grpc://localhost:5000",
+          job_name="job_name",
+          num_consumers=2,
+          consumer_index=2)
+
   @combinations.generate(test_base.eager_only_combinations())
   def testDifferentJobNames(self):
     num_elements = 10
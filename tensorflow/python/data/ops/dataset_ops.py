@@ -388,9 +388,16 @@ class DatasetV2(collections.Iterable, tracking_base.Trackable,
 
     # (3) Apply autotune options
     autotune, algorithm, cpu_budget = options._autotune_settings()  # pylint: disable=protected-access
+    objective = options._autotune_objective()  # pylint: disable=protected-access
+    autotune_state_dir = options._autotune_state_dir()  # pylint: disable=protected-access
 
     if autotune:
-      dataset = _ModelDataset(dataset, algorithm, cpu_budget)
+      dataset = _ModelDataset(
+          dataset,
+          algorithm,
+          cpu_budget,
+          autotune_state_dir=autotune_state_dir,
+          **objective)
 
     # (4) Apply stats aggregator options
     if options.experimental_stats and options.experimental_stats.aggregator:  # pylint: disable=line-too-long
@@ -1239,7 +1246,7 @@ class DatasetV2(collections.Iterable, tracking_base.Trackable,
     """
     return ShuffleDataset(self, buffer_size, seed, reshuffle_each_iteration)
 
-  def cache(self, filename=""):
+  def cache(self, filename="", memory_budget=None):
     """Caches the elements in this dataset.
 
     The first time the dataset is iterated over, its elements will be cached
@@ -1279,15 +1286,29 @@ class DatasetV2(collections.Iterable, tracking_base.Trackable,
     through the dataset. If you wish to randomize the iteration order, make sure
     to call `shuffle` *after* calling `cache`.
 
+    When caching in memory, `memory_budget` bounds the number of bytes of
+    elements held in memory. The elements that do not fit within the budget are
+    spilled to a local scratch file, which is deleted once the cache is no
+    longer used. Iterator checkpoints hold the spilled elements themselves, so
+    they can be restored without the scratch file.
+
+    >>> dataset = tf.data.Dataset.range(5)
+    >>> dataset = dataset.cache(memory_budget=16)
+    >>> list(dataset.as_numpy_iterator())
+    [0, 1, 2, 3, 4]
+
     Args:
       filename: A `tf.string` scalar `tf.Tensor`, representing the name of a
         directory on the filesystem to use for caching elements in this Dataset.
         If a filename is not provided, the dataset will be cached in memory.
+      memory_budget: (Optional.) A Python integer, representing the maximum
+        number of bytes of elements held in memory when caching in memory. If
+        not specified, all elements are held in memory.
 
     Returns:
       Dataset: A `Dataset`.
     """
-    return CacheDataset(self, filename)
+    return CacheDataset(self, filename, memory_budget)
 
   def take(self, count):
     """Creates a `Dataset` with at most `count` elements from this dataset.
@@ -2472,8 +2493,9 @@ class DatasetV1(DatasetV2):
         buffer_size, seed, reshuffle_each_iteration))
 
   @functools.wraps(DatasetV2.cache)
-  def cache(self, filename=""):
-    return DatasetV1Adapter(super(DatasetV1, self).cache(filename))
+  def cache(self, filename="", memory_budget=None):
+    return DatasetV1Adapter(super(DatasetV1, self).cache(
+        filename, memory_budget))
 
   @functools.wraps(DatasetV2.take)
   def take(self, count):
@@ -2924,6 +2946,16 @@ class Options(options_lib.OptionsBase):
     # Return default autotune options
     return optimization_options.OptimizationOptions()._autotune_settings()  # pylint: disable=protected-access
 
+  def _autotune_objective(self):
+    if self.experimental_optimization is not None:
+      return self.experimental_optimization._autotune_objective()  # pylint: disable=protected-access
+    return {}
+
+  def _autotune_state_dir(self):
+    if self.experimental_optimization is not None:
+      return self.experimental_optimization.autotune_state_dir
+    return None
+
   def merge(self, options):
     """Merges itself with the given `tf.data.Options`.
 
@@ -3610,21 +3642,25 @@ class RangeDataset(DatasetSource):
 class CacheDataset(UnaryUnchangedStructureDataset):
   """A `Dataset` that caches elements of its input."""
 
-  def __init__(self, input_dataset, filename):
+  def __init__(self, input_dataset, filename, memory_budget=None):
     """See `Dataset.cache()` for details."""
     self._input_dataset = input_dataset
     self._filename = ops.convert_to_tensor(
         filename, dtype=dtypes.string, name="filename")
+    if memory_budget is None:
+      memory_budget = -1
     if tf2.enabled() and (context.executing_eagerly() or ops.inside_function()):
       variant_tensor = gen_dataset_ops.cache_dataset_v2(
           input_dataset._variant_tensor,  # pylint: disable=protected-access
           filename=self._filename,
           cache=gen_dataset_ops.dummy_memory_cache(),
+          memory_budget=memory_budget,
           **self._flat_structure)
     else:
       variant_tensor = gen_dataset_ops.cache_dataset(
           input_dataset._variant_tensor,  # pylint: disable=protected-access
           filename=self._filename,
+          memory_budget=memory_budget,
           **self._flat_structure)
     super(CacheDataset, self).__init__(input_dataset, variant_tensor)
 
@@ -4372,12 +4408,25 @@ class _OptionsDataset(UnaryUnchangedStructureDataset):
 class _ModelDataset(UnaryUnchangedStructureDataset):
   """A `Dataset` that acts as an identity, and models performance."""
 
-  def __init__(self, input_dataset, algorithm, cpu_budget):
+  def __init__(self,
+               input_dataset,
+               algorithm,
+               cpu_budget,
+               latency_weight=None,
+               cpu_weight=None,
+               ram_weight=None,
+               target_step_time_us=None,
+               autotune_state_dir=None):
     self._input_dataset = input_dataset
     variant_tensor = gen_dataset_ops.model_dataset(
         input_dataset._variant_tensor,  # pylint: disable=protected-access
         algorithm=algorithm.value,
         cpu_budget=cpu_budget,
+        latency_weight=latency_weight,
+        cpu_weight=cpu_weight,
+        ram_weight=ram_weight,
+        target_step_time_us=target_step_time_us,
+        autotune_state_dir=autotune_state_dir,
         **self._flat_structure)
     super(_ModelDataset, self).__init__(input_dataset, variant_tensor)
 